@@ -0,0 +1,418 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "AbyssinianPRNG.hpp"
+#include "CPUFeatures.hpp"
+#include <string.h>
+using namespace cat;
+
+// SSE2 is always there on x86-64, and the AVX2 kernel is picked at run time
+// from the CPU features
+#if defined(CAT_X86_DISPATCH)
+# define CAT_ABYSSINIAN_X86_DISPATCH
+# include <immintrin.h>
+#elif defined(CAT_HAS_NEON)
+# define CAT_ABYSSINIAN_NEON
+# include <arm_neon.h>
+#endif
+
+
+//// Modular arithmetic
+
+/*
+	A MWC lane stores the carry in the high word and the value in the
+	low word.  Reading the whole 64-bit state s = c * 2^^32 + x, one
+	step computes a * x + c, which is congruent to a * s mod m where
+	m = a * 2^^32 - 1 since a * 2^^32 = 1 (mod m).  So after k steps
+	the state is a^^k * s mod m, with results always in [0, m].
+*/
+
+// Returns (x * y) mod m, for x, y < m
+static u64 MulMod(u64 x, u64 y, u64 m)
+{
+#if defined(CAT_HAS_U128)
+	return (u64)(((u128)x * y) % m);
+#else
+	u64 r = 0;
+
+	// Double-and-add to stay within 64 bits
+	while (y)
+	{
+		if (y & 1)
+		{
+			r += x;
+			if (r < x || r >= m) r -= m;
+		}
+
+		u64 x2 = x + x;
+		if (x2 < x || x2 >= m) x2 -= m;
+		x = x2;
+
+		y >>= 1;
+	}
+
+	return r;
+#endif
+}
+
+// Returns the state of a MWC lane after the given number of steps
+static u64 JumpLane(u64 s, u32 a, u64 steps)
+{
+	const u64 m = ((u64)a << 32) - 1;
+
+	u64 r = s % m;
+
+	// 0 and m are fixed points of the recurrence
+	if (r == 0) return s;
+
+	// Multiply by a^^steps using square-and-multiply
+	u64 p = a;
+	while (steps)
+	{
+		if (steps & 1) r = MulMod(r, p, m);
+		p = MulMod(p, p, m);
+		steps >>= 1;
+	}
+
+	return r;
+}
+
+
+//// Abyssinian
+
+void Abyssinian::Jump(u64 steps)
+{
+	if (steps == 0) return;
+
+	_x = JumpLane(_x, MULT_X, steps);
+	_y = JumpLane(_y, MULT_Y, steps);
+}
+
+
+//// Lane kernels
+
+/*
+	Each kernel runs all eight lanes for the given number of steps and
+	writes the eight outputs of each step to out in lane order.
+
+	The 64-bit lane states stay in 64-bit vector lanes, where one
+	32x32->64 multiply per lane is all a step needs.  The low halves
+	are then packed into 32-bit lanes to form the outputs.
+*/
+typedef void (*StepFunc)(u64 *x, u64 *y, u8 *out, int steps);
+
+// Only built where no vector kernel is always available to stand in for it
+#if !defined(CAT_ABYSSINIAN_NEON) && \
+	!(defined(CAT_ABYSSINIAN_X86_DISPATCH) && defined(CAT_HAS_SSE2))
+
+static void StepsGeneric(u64 *x, u64 *y, u8 *out, int steps)
+{
+	for (int ii = 0; ii < steps; ++ii, out += 32)
+	{
+		u32 words[AbyssinianLanes::LANES];
+
+		for (int jj = 0; jj < AbyssinianLanes::LANES; ++jj)
+		{
+			x[jj] = (u64)Abyssinian::MULT_X * (u32)x[jj] + (u32)(x[jj] >> 32);
+			y[jj] = (u64)Abyssinian::MULT_Y * (u32)y[jj] + (u32)(y[jj] >> 32);
+			words[jj] = CAT_ROL32((u32)x[jj], 7) + (u32)y[jj];
+		}
+
+		memcpy(out, words, sizeof(words));
+	}
+}
+
+#endif
+
+#if defined(CAT_ABYSSINIAN_X86_DISPATCH)
+
+#if defined(CAT_HAS_SSE2)
+
+// Low halves of two vectors of 64-bit lanes, in order
+static CAT_INLINE __m128i PackLow(__m128i a, __m128i b)
+{
+	a = _mm_shuffle_epi32(a, _MM_SHUFFLE(2, 0, 2, 0));
+	b = _mm_shuffle_epi32(b, _MM_SHUFFLE(2, 0, 2, 0));
+	return _mm_unpacklo_epi64(a, b);
+}
+
+static CAT_INLINE __m128i Output(__m128i x, __m128i y)
+{
+	return _mm_add_epi32(_mm_or_si128(_mm_slli_epi32(x, 7), _mm_srli_epi32(x, 25)), y);
+}
+
+static void StepsSSE2(u64 *x, u64 *y, u8 *out, int steps)
+{
+	const __m128i ax = _mm_set1_epi32(Abyssinian::MULT_X);
+	const __m128i ay = _mm_set1_epi32(Abyssinian::MULT_Y);
+
+	__m128i x0 = _mm_loadu_si128((const __m128i *)x);
+	__m128i x1 = _mm_loadu_si128((const __m128i *)x + 1);
+	__m128i x2 = _mm_loadu_si128((const __m128i *)x + 2);
+	__m128i x3 = _mm_loadu_si128((const __m128i *)x + 3);
+	__m128i y0 = _mm_loadu_si128((const __m128i *)y);
+	__m128i y1 = _mm_loadu_si128((const __m128i *)y + 1);
+	__m128i y2 = _mm_loadu_si128((const __m128i *)y + 2);
+	__m128i y3 = _mm_loadu_si128((const __m128i *)y + 3);
+
+#define CAT_ABYSSINIAN_MWC(v, a) _mm_add_epi64(_mm_mul_epu32(v, a), _mm_srli_epi64(v, 32))
+
+	for (int ii = 0; ii < steps; ++ii, out += 32)
+	{
+		x0 = CAT_ABYSSINIAN_MWC(x0, ax);
+		x1 = CAT_ABYSSINIAN_MWC(x1, ax);
+		x2 = CAT_ABYSSINIAN_MWC(x2, ax);
+		x3 = CAT_ABYSSINIAN_MWC(x3, ax);
+		y0 = CAT_ABYSSINIAN_MWC(y0, ay);
+		y1 = CAT_ABYSSINIAN_MWC(y1, ay);
+		y2 = CAT_ABYSSINIAN_MWC(y2, ay);
+		y3 = CAT_ABYSSINIAN_MWC(y3, ay);
+
+		_mm_storeu_si128((__m128i *)out, Output(PackLow(x0, x1), PackLow(y0, y1)));
+		_mm_storeu_si128((__m128i *)out + 1, Output(PackLow(x2, x3), PackLow(y2, y3)));
+	}
+
+#undef CAT_ABYSSINIAN_MWC
+
+	_mm_storeu_si128((__m128i *)x, x0);
+	_mm_storeu_si128((__m128i *)x + 1, x1);
+	_mm_storeu_si128((__m128i *)x + 2, x2);
+	_mm_storeu_si128((__m128i *)x + 3, x3);
+	_mm_storeu_si128((__m128i *)y, y0);
+	_mm_storeu_si128((__m128i *)y + 1, y1);
+	_mm_storeu_si128((__m128i *)y + 2, y2);
+	_mm_storeu_si128((__m128i *)y + 3, y3);
+}
+
+#endif // CAT_HAS_SSE2
+
+// Low halves of lanes 0..3 in a and 4..7 in b, in order
+CAT_TARGET_AVX2 static CAT_INLINE __m256i PackLowAVX2(__m256i a, __m256i b)
+{
+	a = _mm256_shuffle_epi32(a, _MM_SHUFFLE(2, 0, 2, 0));
+	b = _mm256_shuffle_epi32(b, _MM_SHUFFLE(2, 0, 2, 0));
+	return _mm256_permute4x64_epi64(_mm256_blend_epi32(a, b, 0xcc), _MM_SHUFFLE(3, 1, 2, 0));
+}
+
+CAT_TARGET_AVX2 static void StepsAVX2(u64 *x, u64 *y, u8 *out, int steps)
+{
+	const __m256i ax = _mm256_set1_epi32(Abyssinian::MULT_X);
+	const __m256i ay = _mm256_set1_epi32(Abyssinian::MULT_Y);
+
+	__m256i x0 = _mm256_loadu_si256((const __m256i *)x);
+	__m256i x1 = _mm256_loadu_si256((const __m256i *)x + 1);
+	__m256i y0 = _mm256_loadu_si256((const __m256i *)y);
+	__m256i y1 = _mm256_loadu_si256((const __m256i *)y + 1);
+
+#define CAT_ABYSSINIAN_MWC(v, a) _mm256_add_epi64(_mm256_mul_epu32(v, a), _mm256_srli_epi64(v, 32))
+
+	for (int ii = 0; ii < steps; ++ii, out += 32)
+	{
+		x0 = CAT_ABYSSINIAN_MWC(x0, ax);
+		x1 = CAT_ABYSSINIAN_MWC(x1, ax);
+		y0 = CAT_ABYSSINIAN_MWC(y0, ay);
+		y1 = CAT_ABYSSINIAN_MWC(y1, ay);
+
+		__m256i xl = PackLowAVX2(x0, x1);
+		__m256i yl = PackLowAVX2(y0, y1);
+		__m256i r = _mm256_or_si256(_mm256_slli_epi32(xl, 7), _mm256_srli_epi32(xl, 25));
+
+		_mm256_storeu_si256((__m256i *)out, _mm256_add_epi32(r, yl));
+	}
+
+#undef CAT_ABYSSINIAN_MWC
+
+	_mm256_storeu_si256((__m256i *)x, x0);
+	_mm256_storeu_si256((__m256i *)x + 1, x1);
+	_mm256_storeu_si256((__m256i *)y, y0);
+	_mm256_storeu_si256((__m256i *)y + 1, y1);
+}
+
+static StepFunc DetectKernel()
+{
+	if (HasCPUFeatures(CPU_AVX2)) return StepsAVX2;
+#if defined(CAT_HAS_SSE2)
+	return StepsSSE2;
+#else
+	return StepsGeneric;
+#endif
+}
+
+static StepFunc m_steps = 0;
+
+static CAT_INLINE StepFunc GetKernel()
+{
+	return BindKernel(m_steps, DetectKernel);
+}
+
+#elif defined(CAT_ABYSSINIAN_NEON)
+
+// Outputs of four lanes, given their x and y states in pairs
+static CAT_INLINE uint8x16_t OutputNEON(uint64x2_t x0, uint64x2_t x1, uint64x2_t y0, uint64x2_t y1)
+{
+	uint32x4_t xl = vcombine_u32(vmovn_u64(x0), vmovn_u64(x1));
+	uint32x4_t yl = vcombine_u32(vmovn_u64(y0), vmovn_u64(y1));
+
+	// Rotate left by 7 with a shift-and-insert
+	return vreinterpretq_u8_u32(vaddq_u32(vsliq_n_u32(vshrq_n_u32(xl, 25), xl, 7), yl));
+}
+
+static void StepsNEON(u64 *x, u64 *y, u8 *out, int steps)
+{
+	const uint32x2_t ax = vdup_n_u32(Abyssinian::MULT_X);
+	const uint32x2_t ay = vdup_n_u32(Abyssinian::MULT_Y);
+
+	uint64x2_t x0 = vld1q_u64(x), x1 = vld1q_u64(x + 2), x2 = vld1q_u64(x + 4), x3 = vld1q_u64(x + 6);
+	uint64x2_t y0 = vld1q_u64(y), y1 = vld1q_u64(y + 2), y2 = vld1q_u64(y + 4), y3 = vld1q_u64(y + 6);
+
+#define CAT_ABYSSINIAN_MWC(v, a) vmlal_u32(vshrq_n_u64(v, 32), vmovn_u64(v), a)
+
+	for (int ii = 0; ii < steps; ++ii, out += 32)
+	{
+		x0 = CAT_ABYSSINIAN_MWC(x0, ax);
+		x1 = CAT_ABYSSINIAN_MWC(x1, ax);
+		x2 = CAT_ABYSSINIAN_MWC(x2, ax);
+		x3 = CAT_ABYSSINIAN_MWC(x3, ax);
+		y0 = CAT_ABYSSINIAN_MWC(y0, ay);
+		y1 = CAT_ABYSSINIAN_MWC(y1, ay);
+		y2 = CAT_ABYSSINIAN_MWC(y2, ay);
+		y3 = CAT_ABYSSINIAN_MWC(y3, ay);
+
+		vst1q_u8(out, OutputNEON(x0, x1, y0, y1));
+		vst1q_u8(out + 16, OutputNEON(x2, x3, y2, y3));
+	}
+
+#undef CAT_ABYSSINIAN_MWC
+
+	vst1q_u64(x, x0); vst1q_u64(x + 2, x1); vst1q_u64(x + 4, x2); vst1q_u64(x + 6, x3);
+	vst1q_u64(y, y0); vst1q_u64(y + 2, y1); vst1q_u64(y + 4, y2); vst1q_u64(y + 6, y3);
+}
+
+static CAT_INLINE StepFunc GetKernel()
+{
+	return StepsNEON;
+}
+
+#else
+
+static CAT_INLINE StepFunc GetKernel()
+{
+	return StepsGeneric;
+}
+
+#endif
+
+
+//// AbyssinianLanes
+
+void AbyssinianLanes::Initialize(u32 seed)
+{
+	Abyssinian lane;
+	lane.Initialize(seed);
+
+	for (int ii = 0; ii < LANES; ++ii)
+	{
+		_x[ii] = lane._x;
+		_y[ii] = lane._y;
+
+		lane.JumpStreams(1);
+	}
+}
+
+void AbyssinianLanes::Fill(void *buffer, int bytes)
+{
+	static const int STEP_BYTES = LANES * 4;
+
+	if (bytes <= 0) return;
+
+	u8 *out = (u8 *)buffer;
+	StepFunc steps = GetKernel();
+
+	int whole = bytes / STEP_BYTES;
+	if (whole > 0)
+	{
+		steps(_x, _y, out, whole);
+		out += whole * STEP_BYTES;
+		bytes -= whole * STEP_BYTES;
+	}
+
+	// If there is a partial step left,
+	if (bytes > 0)
+	{
+		u8 last[STEP_BYTES];
+		steps(_x, _y, last, 1);
+		memcpy(out, last, bytes);
+	}
+}
+
+void AbyssinianLanes::GenerateUnbiased(u32 *numbers, int count, u32 low, u32 high)
+{
+	// Words drawn per batch
+	static const int BATCH_STEPS = 32;
+	static const int BATCH_WORDS = BATCH_STEPS * LANES;
+
+	if (count <= 0) return;
+
+	u32 range = high - low + 1;
+
+	// If the range is all 32-bit numbers, every word is usable
+	if (range == 0)
+	{
+		Fill(numbers, count * 4);
+		return;
+	}
+
+	// Products whose low half falls under 2^^32 mod range are rejected,
+	// which leaves exactly floor(2^^32 / range) words for each result.
+	// The one division is shared by the whole batch
+	const u32 threshold = (0 - range) % range;
+
+	StepFunc steps = GetKernel();
+	u32 words[BATCH_WORDS], results[BATCH_WORDS];
+
+	while (count > 0)
+	{
+		steps(_x, _y, (u8 *)words, BATCH_STEPS);
+
+		// Keep the accepted results without branching on each word
+		int accepted = 0;
+		for (int ii = 0; ii < BATCH_WORDS; ++ii)
+		{
+			u64 m = (u64)words[ii] * range;
+
+			results[accepted] = low + (u32)(m >> 32);
+			accepted += (u32)m >= threshold;
+		}
+
+		if (accepted > count) accepted = count;
+
+		memcpy(numbers, results, accepted * 4);
+		numbers += accepted;
+		count -= accepted;
+	}
+}
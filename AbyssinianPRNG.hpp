@@ -44,12 +44,27 @@ namespace cat {
 	Furthermore, the input seeds are hashed to avoid linear
 	relationships between the input seeds and the low bits of
 	the first few outputs.
+
+	Each lane is a multiply-with-carry generator, so its state
+	is just multiplied by the lane multiplier modulo the prime
+	(a * 2^^32 - 1) on every step.  This allows jumping ahead
+	by any number of steps in logarithmic time, which is used
+	to split one seed into non-overlapping streams for threads.
 */
 class CAT_EXPORT Abyssinian
 {
+	friend class AbyssinianLanes;
+
 	u64 _x, _y;
 
 public:
+	// Each stream is 2^^STREAM_BITS outputs long
+	static const int STREAM_BITS = 32;
+
+	// Multipliers for the two MWC lanes
+	static const u32 MULT_X = 0xfffd21a7;
+	static const u32 MULT_Y = 0xfffd1361;
+
 	CAT_INLINE void Initialize(u32 x, u32 y)
 	{
 		// Based on the mixing functions of MurmurHash3
@@ -77,8 +92,8 @@ public:
 
 		// Inlined Next(): Discard first output
 
-		_x = (u64)0xfffd21a7 * (u32)_x + (u32)(_x >> 32);
-		_y = (u64)0xfffd1361 * (u32)_y + (u32)(_y >> 32);
+		_x = (u64)MULT_X * (u32)_x + (u32)(_x >> 32);
+		_y = (u64)MULT_Y * (u32)_y + (u32)(_y >> 32);
 	}
 
 	CAT_INLINE void Initialize(u32 seed)
@@ -88,10 +103,53 @@ public:
 
 	CAT_INLINE u32 Next()
 	{
-		_x = (u64)0xfffd21a7 * (u32)_x + (u32)(_x >> 32);
-		_y = (u64)0xfffd1361 * (u32)_y + (u32)(_y >> 32);
+		_x = (u64)MULT_X * (u32)_x + (u32)(_x >> 32);
+		_y = (u64)MULT_Y * (u32)_y + (u32)(_y >> 32);
 		return CAT_ROL32((u32)_x, 7) + (u32)_y;
 	}
+
+	// Advance the state as if Next() was called the given number of times
+	void Jump(u64 steps);
+
+	// Skip past the given number of streams.
+	// To give each thread its own stream, seed one generator and jump a
+	// copy of it ahead by the thread index.  The lane periods are about
+	// 2^^63 and coprime, so up to 2^^32 streams never overlap.
+	CAT_INLINE void JumpStreams(u32 count)
+	{
+		Jump((u64)count << STREAM_BITS);
+	}
+};
+
+
+
+/*
+	Eight Abyssinian generators run side by side in SIMD registers,
+	for filling buffers and drawing many bounded integers at once.
+
+	Lane i starts at stream i of the seed, so lane 0 produces the same
+	words as Abyssinian::Initialize(seed) and the lanes never overlap.
+	Each step produces one word from every lane, in lane order.
+	The output does not depend on which instruction set is used.
+*/
+class CAT_EXPORT AbyssinianLanes
+{
+public:
+	static const int LANES = 8;
+
+private:
+	u64 _x[LANES], _y[LANES];
+
+public:
+	void Initialize(u32 seed);
+
+	// Fill the buffer with random bytes.
+	// Any unused words of the final step are discarded
+	void Fill(void *buffer, int bytes);
+
+	// Fill the array with unbiased random numbers in [low..high] inclusive,
+	// using Lemire's multiply-shift with rejection
+	void GenerateUnbiased(u32 *numbers, int count, u32 low, u32 high);
 };
 
 
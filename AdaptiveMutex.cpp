@@ -0,0 +1,114 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "AdaptiveMutex.hpp"
+using namespace cat;
+
+#if defined(CAT_OS_WINDOWS)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+# if defined(_WIN32_WINNT) && (_WIN32_WINNT >= 0x0602) // Windows 8+
+#  define CAT_FUTEX_WAIT_ON_ADDRESS
+#  pragma comment(lib, "synchronization.lib")
+# endif
+#elif defined(__linux__) // CAT_OS_LINUX also covers other Unixes
+# define CAT_FUTEX_LINUX
+# include <linux/futex.h>
+# include <sys/syscall.h>
+# include <unistd.h>
+# include <climits>
+#else
+# include <sched.h>
+#endif
+
+
+//// Futex
+
+void Futex::Wait(volatile u32 *x, u32 value)
+{
+#if defined(CAT_FUTEX_WAIT_ON_ADDRESS)
+
+	WaitOnAddress(x, &value, sizeof(value), INFINITE);
+
+#elif defined(CAT_OS_WINDOWS)
+
+	// No way to sleep on an address before Windows 8, so give up the time slice
+	if (*x == value) SwitchToThread();
+
+#elif defined(CAT_FUTEX_LINUX)
+
+	// The kernel compares *x to value atomically with going to sleep
+	syscall(SYS_futex, (void*)x, FUTEX_WAIT_PRIVATE, value, 0, 0, 0);
+
+#else
+
+	if (*x == value) sched_yield();
+
+#endif
+}
+
+void Futex::Wake(volatile u32 *x, bool all)
+{
+#if defined(CAT_FUTEX_WAIT_ON_ADDRESS)
+
+	if (all) WakeByAddressAll((PVOID)x);
+	else WakeByAddressSingle((PVOID)x);
+
+#elif defined(CAT_FUTEX_LINUX)
+
+	syscall(SYS_futex, (void*)x, FUTEX_WAKE_PRIVATE, all ? INT_MAX : 1, 0, 0, 0);
+
+#else
+
+	// Waiters are polling
+	(void) x;
+	(void) all;
+
+#endif
+}
+
+
+//// AdaptiveMutex
+
+void AdaptiveMutex::EnterSlow()
+{
+	// Spin on a plain read so the cache line stays shared until it is free
+	for (u32 ii = 0; ii < SPIN_COUNT; ++ii)
+	{
+		Futex::SpinPause();
+
+		if (_state == 0 && Atomic::CAS(&_state, 0, 1))
+			return;
+	}
+
+	// Mark the lock as having waiters and park until it is handed back.
+	// Taking it as 2 is conservative: the next Leave() may make a wake
+	// call that nobody needs, but no waiter is ever missed
+	while (Atomic::Set(&_state, 2) != 0)
+		Futex::Wait(&_state, 2);
+}
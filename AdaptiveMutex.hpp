@@ -0,0 +1,157 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_ADAPTIVE_MUTEX_HPP
+#define CAT_ADAPTIVE_MUTEX_HPP
+
+#include "Atomic.hpp"
+
+#if defined(CAT_COMPILER_MSVC) && defined(CAT_ISA_X86)
+# include <intrin.h>
+#endif
+
+namespace cat {
+
+
+namespace Futex {
+
+
+// Hint to the processor that this is a spin-wait loop
+CAT_INLINE void SpinPause()
+{
+#if defined(CAT_ISA_X86)
+# if defined(CAT_COMPILER_MSVC)
+	_mm_pause();
+# else
+	CAT_ASM_BEGIN_VOLATILE "pause" CAT_ASM_END
+# endif
+#elif defined(__aarch64__) && defined(CAT_COMPILER_GCC)
+	CAT_ASM_BEGIN_VOLATILE "yield" CAT_ASM_END
+#else
+	CAT_FENCE_COMPILER
+#endif
+}
+
+// Block the calling thread while *x == value.
+// May return early, so callers re-check their condition in a loop
+CAT_EXPORT void Wait(volatile u32 *x, u32 value);
+
+// Wake one or all threads blocked in Wait() on x
+CAT_EXPORT void Wake(volatile u32 *x, bool all);
+
+
+} // namespace Futex
+
+
+/*
+	Mutex for short critical sections
+
+	Uncontended Enter() and Leave() are a single atomic instruction each.
+	Under contention the caller spins for a moment with pause instructions
+	in case the owner is about to leave, and only then parks in the kernel
+	(futex on Linux, WaitOnAddress on Windows 8+).  Leave() only makes a
+	system call when some thread is parked.
+
+	Like Mutex, it is NOT reentrant.
+*/
+class CAT_EXPORT AdaptiveMutex
+{
+	// Pause instructions to spend spinning before parking
+	static const u32 SPIN_COUNT = 128;
+
+	// 0 = free, 1 = held, 2 = held and threads may be parked
+	volatile u32 _state;
+
+	void EnterSlow();
+
+	CAT_NO_COPY(AdaptiveMutex);
+
+public:
+	CAT_INLINE AdaptiveMutex() { _state = 0; }
+
+	CAT_INLINE bool Valid() { return true; }
+
+	CAT_INLINE bool Enter()
+	{
+		if (!Atomic::CAS(&_state, 0, 1))
+			EnterSlow();
+
+		return true;
+	}
+
+	CAT_INLINE bool Leave()
+	{
+		if (Atomic::Set(&_state, 0) == 2)
+			Futex::Wake(&_state, false);
+
+		return true;
+	}
+
+	// Returns true if the lock was acquired without blocking
+	CAT_INLINE bool TryEnter()
+	{
+		return Atomic::CAS(&_state, 0, 1);
+	}
+};
+
+
+// RAII AdaptiveMutex wrapper
+class AutoAdaptiveMutex
+{
+	AdaptiveMutex *_mutex;
+
+public:
+	CAT_INLINE AutoAdaptiveMutex(AdaptiveMutex &mutex)
+	{
+		_mutex = &mutex;
+		mutex.Enter();
+	}
+
+	CAT_INLINE ~AutoAdaptiveMutex()
+	{
+		Release();
+	}
+
+	CAT_INLINE bool Release()
+	{
+		bool success = false;
+
+		if (_mutex)
+		{
+			success = _mutex->Leave();
+			_mutex = 0;
+		}
+
+		return success;
+	}
+};
+
+
+} // namespace cat
+
+#endif // CAT_ADAPTIVE_MUTEX_HPP
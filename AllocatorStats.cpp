@@ -0,0 +1,88 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "AllocatorStats.hpp"
+#include "Atomic.hpp"
+using namespace cat;
+
+
+//// AllocatorStats
+
+static volatile u32 m_next_slot = 0;
+
+// Slot index + 1 for this thread, or 0 if not assigned yet
+static CAT_TLS u32 m_thread_slot = 0;
+
+u32 AllocatorStats::GetSlotIndex()
+{
+	u32 slot = m_thread_slot;
+
+	// If not assigned yet,
+	if (CAT_UNLIKELY(slot == 0))
+	{
+		slot = (Atomic::Add(&m_next_slot, 1) % SLOT_COUNT) + 1;
+		m_thread_slot = slot;
+	}
+
+	return slot - 1;
+}
+
+AllocatorStats::AllocatorStats()
+{
+	Clear();
+}
+
+void AllocatorStats::Clear()
+{
+	CAT_OBJCLR(_slots);
+}
+
+void AllocatorStats::Snapshot(AllocatorSnapshot &snapshot)
+{
+	u64 totals[COUNTER_COUNT] = { 0 };
+
+	// For each thread slot,
+	for (u32 ii = 0; ii < SLOT_COUNT; ++ii)
+	{
+		const volatile u64 *counters = _slots[ii].counters;
+
+		for (u32 jj = 0; jj < COUNTER_COUNT; ++jj)
+			totals[jj] += counters[jj];
+	}
+
+	snapshot.acquires = totals[ACQUIRES];
+	snapshot.releases = totals[RELEASES];
+	snapshot.batch_acquires = totals[BATCH_ACQUIRES];
+	snapshot.batch_acquired = totals[BATCH_ACQUIRED];
+	snapshot.batch_releases = totals[BATCH_RELEASES];
+	snapshot.batch_released = totals[BATCH_RELEASED];
+	snapshot.heap_allocs = totals[HEAP_ALLOCS];
+	snapshot.heap_bytes = totals[HEAP_BYTES];
+	snapshot.lock_contentions = totals[LOCK_CONTENTIONS];
+	snapshot.lock_cycles = totals[LOCK_CYCLES];
+}
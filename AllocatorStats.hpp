@@ -0,0 +1,165 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_ALLOCATOR_STATS_HPP
+#define CAT_ALLOCATOR_STATS_HPP
+
+#include "Platform.hpp"
+
+#ifdef CAT_ALLOCATOR_STATS
+#include "Mutex.hpp"
+#include "Clock.hpp"
+#endif
+
+namespace cat {
+
+
+// Merged allocator counters at one point in time
+struct AllocatorSnapshot
+{
+	u64 acquires;				// Single buffers acquired
+	u64 releases;				// Single buffers released
+	u64 batch_acquires;			// Calls to AcquireBatch()
+	u64 batch_acquired;			// Buffers acquired in batches
+	u64 batch_releases;			// Calls to ReleaseBatch()
+	u64 batch_released;			// Buffers released in batches
+	u64 heap_allocs;			// Fell through to the heap (for pools: high-water mark of buffers held)
+	u64 heap_bytes;				// Bytes taken from the heap by those allocations
+	u64 lock_contentions;		// Times a lock was already held when we tried to take it
+	u64 lock_cycles;			// Cycles spent holding locks
+
+	// Buffers acquired but not yet released
+	CAT_INLINE s64 GetOutstanding()
+	{
+		return (s64)(acquires + batch_acquired) - (s64)(releases + batch_released);
+	}
+
+	// Average number of buffers per batch acquire
+	CAT_INLINE double GetAverageBatchAcquire()
+	{
+		return batch_acquires ? batch_acquired / (double)batch_acquires : 0.;
+	}
+};
+
+
+/*
+	Low-overhead allocator counters.
+
+	Each thread bumps counters in its own cache line, so there is no sharing
+	on the hot path.  Snapshot() sums up all the per-thread slots on read.
+	Threads are assigned slots round-robin the first time they touch any
+	AllocatorStats object, so if more than SLOT_COUNT threads are active some
+	will share a slot and counts may be slightly low.
+
+	Only compiled into the allocators when CAT_ALLOCATOR_STATS is defined.
+	Use the CAT_ALLOC_STAT, CAT_ALLOC_LOCK and CAT_ALLOC_UNLOCK macros (below)
+	so that the counters vanish otherwise.
+*/
+
+class CAT_EXPORT AllocatorStats
+{
+public:
+	enum Counter
+	{
+		ACQUIRES,
+		RELEASES,
+		BATCH_ACQUIRES,
+		BATCH_ACQUIRED,
+		BATCH_RELEASES,
+		BATCH_RELEASED,
+		HEAP_ALLOCS,
+		HEAP_BYTES,
+		LOCK_CONTENTIONS,
+		LOCK_CYCLES,
+
+		COUNTER_COUNT
+	};
+
+	static const u32 SLOT_COUNT = 64;
+
+private:
+	struct CAT_ALIGNED(CAT_DEFAULT_CACHE_LINE_SIZE) Slot
+	{
+		u64 counters[COUNTER_COUNT];
+	};
+
+	Slot _slots[SLOT_COUNT];
+
+	// Returns the slot index for the calling thread
+	static u32 GetSlotIndex();
+
+public:
+	AllocatorStats();
+
+	void Clear();
+
+	CAT_INLINE void Add(Counter counter, u64 n = 1)
+	{
+		_slots[GetSlotIndex()].counters[counter] += n;
+	}
+
+	// Merge all the per-thread counters
+	void Snapshot(AllocatorSnapshot &snapshot);
+
+#ifdef CAT_ALLOCATOR_STATS
+	// Take a lock, counting contention, and return the time it was taken
+	CAT_INLINE u32 Enter(Mutex &lock)
+	{
+		if (!lock.TryEnter())
+		{
+			Add(LOCK_CONTENTIONS);
+			lock.Enter();
+		}
+
+		return Clock::cycles(false);
+	}
+
+	// Release a lock taken with Enter(), counting the time it was held
+	CAT_INLINE void Leave(Mutex &lock, u32 start)
+	{
+		Add(LOCK_CYCLES, (u32)(Clock::cycles(false) - start));
+		lock.Leave();
+	}
+#endif // CAT_ALLOCATOR_STATS
+};
+
+
+#ifdef CAT_ALLOCATOR_STATS
+# define CAT_ALLOC_STAT(stats, counter, n) (stats).Add(AllocatorStats::counter, n)
+# define CAT_ALLOC_LOCK(stats, lock, start) (start) = (stats).Enter(lock)
+# define CAT_ALLOC_UNLOCK(stats, lock, start) (stats).Leave(lock, start)
+#else
+# define CAT_ALLOC_STAT(stats, counter, n)
+# define CAT_ALLOC_LOCK(stats, lock, start) (lock).Enter()
+# define CAT_ALLOC_UNLOCK(stats, lock, start) (lock).Leave()
+#endif
+
+
+} // namespace cat
+
+#endif // CAT_ALLOCATOR_STATS_HPP
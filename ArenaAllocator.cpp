@@ -0,0 +1,287 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "ArenaAllocator.hpp"
+#include "SystemInfo.hpp"
+using namespace cat;
+
+#if defined(CAT_OS_WINDOWS)
+# include "WindowsInclude.hpp"
+#else
+# include <sys/mman.h>
+#endif
+
+
+//// ArenaAllocator
+
+ArenaAllocator::ArenaAllocator()
+{
+	_chunk_bytes = 0;
+	_use_pages = false;
+	_chunks = 0;
+	_used = 0;
+	_spare = 0;
+	_last = 0;
+}
+
+ArenaAllocator::~ArenaAllocator()
+{
+	Reset();
+	Trim();
+}
+
+void ArenaAllocator::Initialize(u32 chunk_bytes, bool use_pages)
+{
+	// Free chunks allocated with the old settings
+	Reset();
+	Trim();
+
+	if (chunk_bytes <= HEADER_BYTES)
+		chunk_bytes = DEFAULT_CHUNK_BYTES;
+
+	_chunk_bytes = chunk_bytes;
+	_use_pages = use_pages;
+}
+
+ArenaAllocator::Chunk *ArenaAllocator::AllocateChunk(u32 bytes)
+{
+	u32 total = HEADER_BYTES + bytes;
+
+	// Guard against overflow
+	if (total < bytes) return 0;
+
+	u8 *base;
+
+	// If allocating anonymous pages,
+	if (_use_pages)
+	{
+		// Round up to the page size so that the slack is usable
+		u32 page_bytes = SystemInfo::ref()->GetPageSize();
+		u32 rounded = CAT_CEIL(total, page_bytes);
+		if (rounded < total) return 0;
+		total = rounded;
+
+#if defined(CAT_OS_WINDOWS)
+		base = reinterpret_cast<u8*>( VirtualAlloc(0, total, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE) );
+#else
+		void *pages = mmap(0, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		base = (pages == MAP_FAILED) ? 0 : reinterpret_cast<u8*>( pages );
+#endif
+	}
+	else
+	{
+		base = new (std::nothrow) u8[total];
+	}
+
+	if (!base) return 0;
+
+	Chunk *chunk = reinterpret_cast<Chunk*>( base );
+	chunk->next = 0;
+	chunk->bytes = total - HEADER_BYTES;
+	chunk->used = 0;
+
+	return chunk;
+}
+
+void ArenaAllocator::FreeChunk(Chunk *chunk)
+{
+	u8 *base = reinterpret_cast<u8*>( chunk );
+
+	if (_use_pages)
+	{
+#if defined(CAT_OS_WINDOWS)
+		VirtualFree(base, 0, MEM_RELEASE);
+#else
+		munmap(base, HEADER_BYTES + chunk->bytes);
+#endif
+	}
+	else
+	{
+		delete []base;
+	}
+}
+
+bool ArenaAllocator::NextChunk(u32 bytes)
+{
+	// Remember how much of the old front chunk was used
+	if (_chunks)
+		_chunks->used = _used;
+
+	// Look for a spare chunk that is large enough
+	Chunk *chunk = 0;
+	for (Chunk *prev = 0, *spare = _spare; spare; prev = spare, spare = spare->next)
+	{
+		// If found,
+		if (spare->bytes >= bytes)
+		{
+			// Unlink it
+			if (prev) prev->next = spare->next;
+			else _spare = spare->next;
+
+			chunk = spare;
+			break;
+		}
+	}
+
+	// If no spare chunk would do,
+	if (!chunk)
+	{
+		u32 chunk_bytes = _chunk_bytes - HEADER_BYTES;
+		if (chunk_bytes < bytes)
+			chunk_bytes = bytes;
+
+		chunk = AllocateChunk(chunk_bytes);
+		if (!chunk) return false;
+	}
+
+	// Push it on the front
+	chunk->next = _chunks;
+	_chunks = chunk;
+	_used = 0;
+
+	return true;
+}
+
+void ArenaAllocator::Rewind(Chunk *chunk, u32 used)
+{
+	// Retire chunks in front of the marked one
+	while (_chunks && _chunks != chunk)
+	{
+		Chunk *next = _chunks->next;
+
+		_chunks->next = _spare;
+		_spare = _chunks;
+
+		_chunks = next;
+	}
+
+	_used = _chunks ? used : 0;
+	_last = 0;
+}
+
+void ArenaAllocator::Reset()
+{
+	Rewind(0, 0);
+}
+
+void ArenaAllocator::Trim()
+{
+	// For each spare chunk,
+	for (Chunk *next, *chunk = _spare; chunk; chunk = next)
+	{
+		next = chunk->next;
+
+		FreeChunk(chunk);
+	}
+
+	_spare = 0;
+}
+
+void *ArenaAllocator::Acquire(u32 bytes)
+{
+	// Round up to keep buffers aligned
+	u32 aligned = bytes ? CAT_CEIL(bytes, ALIGN_BYTES) : ALIGN_BYTES;
+	if (aligned < bytes) return 0;
+
+	// If it does not fit in the front chunk,
+	if (!_chunks || aligned > _chunks->bytes - _used)
+	{
+		if (!NextChunk(aligned))
+			return 0;
+	}
+
+	u8 *buffer = reinterpret_cast<u8*>( _chunks ) + HEADER_BYTES + _used;
+	_used += aligned;
+	_last = buffer;
+
+	return buffer;
+}
+
+void *ArenaAllocator::Resize(void *ptr, u32 bytes)
+{
+	// If no buffer was given, acquire a new one
+	if (!ptr) return Acquire(bytes);
+
+	u8 *old = reinterpret_cast<u8*>( ptr );
+
+	// If resizing the most recent allocation,
+	if (old == _last)
+	{
+		u32 offset = (u32)(old - (reinterpret_cast<u8*>( _chunks ) + HEADER_BYTES));
+		u32 aligned = bytes ? CAT_CEIL(bytes, ALIGN_BYTES) : ALIGN_BYTES;
+
+		// If it still fits, grow or shrink it in place
+		if (aligned >= bytes && aligned <= _chunks->bytes - offset)
+		{
+			_used = offset + aligned;
+			return ptr;
+		}
+	}
+
+	// Find the chunk holding the buffer to bound the copy
+	u32 old_bytes = 0;
+	for (Chunk *chunk = _chunks; chunk; chunk = chunk->next)
+	{
+		u8 *data = reinterpret_cast<u8*>( chunk ) + HEADER_BYTES;
+		u8 *end = data + (chunk == _chunks ? _used : chunk->used);
+
+		// If found,
+		if (old >= data && old < end)
+		{
+			old_bytes = (u32)(end - old);
+			break;
+		}
+	}
+
+	void *buffer = Acquire(bytes);
+	if (!buffer) return 0;
+
+	memcpy(buffer, ptr, old_bytes < bytes ? old_bytes : bytes);
+
+	return buffer;
+}
+
+u32 ArenaAllocator::AcquireBatch(BatchSet &set, u32 count, u32 bytes)
+{
+	set.Clear();
+
+	if (bytes < sizeof(BatchHead))
+		bytes = sizeof(BatchHead);
+
+	u32 acquired;
+
+	for (acquired = 0; acquired < count; ++acquired)
+	{
+		BatchHead *buffer = reinterpret_cast<BatchHead*>( Acquire(bytes) );
+		if (!buffer) break;
+
+		set.PushBack(buffer);
+	}
+
+	return acquired;
+}
@@ -0,0 +1,161 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_ARENA_ALLOCATOR_HPP
+#define CAT_ARENA_ALLOCATOR_HPP
+
+#include "IAllocator.hpp"
+
+namespace cat {
+
+
+/*
+	The arena allocator bump-allocates out of large chunks for short-lived
+	scratch memory, such as per-request parse buffers and one-off HashItems.
+
+	Release() does nothing.  Instead, all of the memory is freed at once with
+	Reset(), or back to a saved point with an ArenaScope (below).  Chunks are
+	kept around after a reset for re-use, until Trim() is called.
+
+	Chunks are allocated off the CRT heap by default, or optionally straight
+	from the OS as anonymous pages (mmap/VirtualAlloc) to keep large arenas
+	out of the heap entirely.
+
+	Buffers are aligned to 16 bytes.
+
+	The arena is not thread-safe: use one per thread or per request.
+*/
+
+class CAT_EXPORT ArenaAllocator : public IAllocator
+{
+	CAT_NO_COPY(ArenaAllocator);
+
+	friend class ArenaScope;
+
+	struct Chunk
+	{
+		Chunk *next;
+		u32 bytes;		// Usable bytes after the header
+		u32 used;		// Bytes used when this chunk was retired
+	};
+
+	static const u32 ALIGN_BYTES = 16;
+	static const u32 HEADER_BYTES = CAT_CEIL(sizeof(Chunk), ALIGN_BYTES);
+
+	u32 _chunk_bytes;
+	bool _use_pages;
+
+	Chunk *_chunks;		// Chunks in use, the front one is being bumped
+	u32 _used;			// Bytes used in the front chunk
+	Chunk *_spare;		// Chunks released by Reset() for re-use
+
+	u8 *_last;			// Most recent allocation, for Resize() in place
+
+	Chunk *AllocateChunk(u32 bytes);
+	void FreeChunk(Chunk *chunk);
+
+	// Make room for a buffer of the given size in a new front chunk
+	bool NextChunk(u32 bytes);
+
+	// Retire chunks back to the spare list until the given one is at the front
+	void Rewind(Chunk *chunk, u32 used);
+
+public:
+	static const u32 DEFAULT_CHUNK_BYTES = 65536;
+
+	ArenaAllocator();
+	virtual ~ArenaAllocator();
+
+	// Set chunk size and whether to allocate chunks as anonymous pages
+	void Initialize(u32 chunk_bytes = DEFAULT_CHUNK_BYTES, bool use_pages = false);
+
+	CAT_INLINE bool Valid() {
+		// Invalid until Initialize()
+		return _chunk_bytes != 0;
+	}
+
+	void *Acquire(u32 bytes);
+	void *Resize(void *ptr, u32 bytes);
+
+	// Does nothing: memory is freed by Reset() or ArenaScope
+	CAT_INLINE void Release(void *ptr) {}
+
+	// Acquire a number of buffers of the given size
+	// Returns the number of buffers it was able to acquire
+	u32 AcquireBatch(BatchSet &set, u32 count, u32 bytes = 0);
+
+	// Does nothing: memory is freed by Reset() or ArenaScope
+	CAT_INLINE void ReleaseBatch(const BatchSet &set) {}
+
+	// Free all allocations at once, keeping the chunks for re-use
+	void Reset();
+
+	// Return spare chunks to the heap
+	void Trim();
+};
+
+
+/*
+	Scope marker for an ArenaAllocator.
+
+	On destruction, everything acquired from the arena since the marker was
+	constructed is freed at once.  Scopes may be nested.
+
+		{
+			ArenaScope scope(arena);
+
+			... acquire scratch memory from arena ...
+		} // freed here
+*/
+
+class CAT_EXPORT ArenaScope
+{
+	CAT_NO_COPY(ArenaScope);
+
+	ArenaAllocator *_arena;
+	ArenaAllocator::Chunk *_chunk;
+	u32 _used;
+
+public:
+	CAT_INLINE ArenaScope(ArenaAllocator &arena)
+	{
+		_arena = &arena;
+		_chunk = arena._chunks;
+		_used = arena._used;
+	}
+
+	CAT_INLINE ~ArenaScope()
+	{
+		_arena->Rewind(_chunk, _used);
+	}
+};
+
+
+} // namespace cat
+
+#endif // CAT_ARENA_ALLOCATOR_HPP
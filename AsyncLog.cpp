@@ -0,0 +1,509 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "AsyncLog.hpp"
+#include "Clock.hpp"
+#include "Strings.hpp"
+using namespace cat;
+
+#include <string.h>
+#include <stdio.h>
+
+#if defined(CAT_OS_WINDOWS)
+# include <io.h>
+# define CAT_LOG_WRITE_FD _write
+#else
+# include <unistd.h>
+# include <errno.h>
+# define CAT_LOG_WRITE_FD write
+#endif
+
+#if defined(CAT_COMPILER_MSVC)
+# define CAT_LOG_SNPRINTF _snprintf
+#else
+# define CAT_LOG_SNPRINTF snprintf
+#endif
+
+// Numbers each sink, so a new sink at the address of a deleted one is not
+// mistaken for it
+static volatile u32 m_instances = 0;
+
+// The ring this thread last logged through, and the sink that owns it
+static CAT_TLS u32 m_ring_owner = 0;
+static CAT_TLS void *m_ring = 0;
+
+
+//// Formatting
+
+// Skips the flags, width, precision and length modifiers after a '%',
+// returning the character that should be the conversion.  Widths and
+// precisions taken from arguments ('*') and modifiers outside C99, like
+// %I64d, stop the scan early so the caller prints them as written
+static const char *ParseSpec(const char *spec)
+{
+	const char *f = spec + 1;
+
+	while (*f && strchr("-+ #0", *f))
+		++f;
+	while (*f >= '0' && *f <= '9')
+		++f;
+	if (*f == '.')
+	{
+		++f;
+		while (*f >= '0' && *f <= '9')
+			++f;
+	}
+	while (*f && strchr("hlLqjzt", *f))
+		++f;
+
+	return f;
+}
+
+// Writes one printf-style conversion of arg, returning the characters written
+static int FormatArg(char *out, int space, const char *spec, int spec_len, char conv, u64 arg)
+{
+	// Fast path for plain %d and %u
+	if (spec_len == 2 && space >= MAX_DECIMAL64_CHARS)
+	{
+		if (conv == 'd' || conv == 'i')
+			return FormatDecimal((s64)arg, out);
+		if (conv == 'u')
+			return FormatDecimal(arg, out);
+	}
+
+	// Rebuild the conversion with its flags and width, and the length
+	// modifier for the 64-bit argument
+	char fmt[32];
+	int len = 0;
+
+	for (int ii = 0; ii < spec_len - 1 && len < 28; ++ii)
+	{
+		char ch = spec[ii];
+
+		// Drop the caller's length modifiers, since every argument is 64-bit
+		if (ch == 'h' || ch == 'l' || ch == 'L' || ch == 'q' ||
+			ch == 'j' || ch == 'z' || ch == 't')
+			continue;
+
+		fmt[len++] = ch;
+	}
+
+	int written;
+
+	switch (conv)
+	{
+	case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+		if (conv != 'c')
+		{
+			fmt[len++] = 'l';
+			fmt[len++] = 'l';
+		}
+		fmt[len++] = conv;
+		fmt[len] = '\0';
+		if (conv == 'd' || conv == 'i')
+			written = CAT_LOG_SNPRINTF(out, space, fmt, (long long)arg);
+		else if (conv == 'c')
+			written = CAT_LOG_SNPRINTF(out, space, fmt, (int)arg);
+		else
+			written = CAT_LOG_SNPRINTF(out, space, fmt, (unsigned long long)arg);
+		break;
+
+	case 's': case 'p':
+		fmt[len++] = conv;
+		fmt[len] = '\0';
+		if (conv == 's' && !arg)
+			written = CAT_LOG_SNPRINTF(out, space, "(null)");
+		else
+			written = CAT_LOG_SNPRINTF(out, space, fmt, (const void *)(size_t)arg);
+		break;
+
+	default: // Floating-point
+		{
+			union { u64 u; double d; } bits;
+			bits.u = arg;
+			fmt[len++] = conv;
+			fmt[len] = '\0';
+			written = CAT_LOG_SNPRINTF(out, space, fmt, bits.d);
+		}
+		break;
+	}
+
+	// If the output was cut or failed,
+	if (written < 0 || written >= space)
+		written = space - 1;
+
+	return written;
+}
+
+// Formats a record as one line, returning the characters written, at most max
+static u32 FormatRecord(const LogRecord &rec, u32 thread_id, char *out, u32 max)
+{
+	char *line = out;
+	char *end = out + max - 1; // Room for the newline
+
+	// "<ticks> <thread> "
+	line += FormatDecimal(rec.ticks, line);
+	*line++ = ' ';
+	line += FormatDecimal(thread_id, line);
+	*line++ = ' ';
+
+	u32 next_arg = 0;
+
+	for (const char *f = rec.format; *f && line < end; ++f)
+	{
+		if (*f != '%')
+		{
+			*line++ = *f;
+			continue;
+		}
+
+		if (f[1] == '%')
+		{
+			*line++ = '%';
+			++f;
+			continue;
+		}
+
+		// If the conversion is not one we can print, copy it literally
+		const char *spec = f;
+		f = ParseSpec(spec);
+		if (!*f || !strchr("diuxXocspfFeEgGaA", *f))
+		{
+			const char *stop = *f ? f + 1 : f;
+			while (spec < stop && line < end)
+				*line++ = *spec++;
+			if (!*f)
+				break;
+			continue;
+		}
+
+		u64 arg = next_arg < rec.count ? rec.args[next_arg] : 0;
+		++next_arg;
+
+		line += FormatArg(line, (int)(end - line + 1), spec, (int)(f - spec + 1), *f, arg);
+	}
+
+	if (line > end) line = end;
+	*line++ = '\n';
+
+	return (u32)(line - out);
+}
+
+
+//// AsyncLog
+
+AsyncLog::AsyncLog()
+{
+	_rings = 0;
+	_instance = Atomic::Add(&m_instances, 1) + 1;
+	_ring_log2 = 0;
+	_stop = false;
+	_started = false;
+	_flush_msec = 10;
+	_fd = -1;
+#ifdef CAT_COMPILE_MMAP
+	_used = 0;
+#endif
+	_batch = 0;
+	_batch_used = 0;
+}
+
+AsyncLog::~AsyncLog()
+{
+	Shutdown();
+
+	ThreadRing *ring = _rings;
+	while (ring)
+	{
+		ThreadRing *next = ring->next;
+		delete ring;
+		ring = next;
+	}
+
+	delete []_batch;
+}
+
+bool AsyncLog::Start(u32 ring_log2, u32 flush_msec)
+{
+	if (!_wake.Valid()) return false;
+
+	if (!_batch)
+	{
+		_batch = new (std::nothrow) char[BATCH_BYTES];
+		if (!_batch) return false;
+	}
+
+	_ring_log2 = ring_log2;
+	_flush_msec = flush_msec;
+	_batch_used = 0;
+	_stop = false;
+
+	if (!StartThread())
+		return false;
+
+	_started = true;
+
+	return true;
+}
+
+bool AsyncLog::Initialize(int fd, u32 ring_log2, u32 flush_msec)
+{
+	Shutdown();
+
+	if (fd < 0) return false;
+
+	_fd = fd;
+
+	return Start(ring_log2, flush_msec);
+}
+
+#ifdef CAT_COMPILE_MMAP
+
+bool AsyncLog::Initialize(const char *path, u32 ring_log2, u32 flush_msec)
+{
+	Shutdown();
+
+	_fd = -1;
+	_used = 0;
+
+	if (!_file.OpenWrite(path, BATCH_BYTES * 16) ||
+		!_view.Open(&_file) ||
+		!_view.MapView(0, 0, MappedView::HINT_SEQUENTIAL))
+	{
+		_view.Close();
+		_file.Close();
+		return false;
+	}
+
+	return Start(ring_log2, flush_msec);
+}
+
+#endif // CAT_COMPILE_MMAP
+
+void AsyncLog::Shutdown()
+{
+	if (!_started) return;
+
+	_stop = true;
+	_wake.Set();
+
+	WaitForThread();
+
+	_started = false;
+
+#ifdef CAT_COMPILE_MMAP
+	// Cut the file back to what was written, even if that is nothing
+	if (_view.IsValid())
+	{
+		_view.Close();
+		_file.SetLength(_used);
+		_file.Close();
+	}
+#endif
+}
+
+AsyncLog::ThreadRing *AsyncLog::CreateRing(u32 thread_id)
+{
+	// If this thread already has a ring here, as when another sink was used
+	// in between or a thread ID is reused after its thread exited,
+	for (ThreadRing *ring = _rings; ring; ring = ring->next)
+	{
+		if (ring->thread_id == thread_id)
+			return ring;
+	}
+
+	ThreadRing *ring = new (std::nothrow) ThreadRing;
+	if (!ring) return 0;
+
+	if (!ring->queue.Initialize(_ring_log2))
+	{
+		delete ring;
+		return 0;
+	}
+
+	ring->thread_id = thread_id;
+	ring->dropped = 0;
+	ring->reported = 0;
+
+	// Publish it to the writer thread
+	ThreadRing *head;
+	do
+	{
+		head = _rings;
+		ring->next = head;
+	} while (!Atomic::CASPointer((void * volatile *)&_rings, head, ring));
+
+	return ring;
+}
+
+AsyncLog::ThreadRing *AsyncLog::GetRing()
+{
+	// If this thread last logged here,
+	if (m_ring_owner == _instance)
+		return (ThreadRing *)m_ring;
+
+	ThreadRing *ring = CreateRing(GetThreadID());
+	if (ring)
+	{
+		m_ring_owner = _instance;
+		m_ring = ring;
+	}
+
+	return ring;
+}
+
+bool AsyncLog::Push(const char *format, u32 count, u64 a0, u64 a1, u64 a2, u64 a3)
+{
+	if (!_started) return false;
+
+	ThreadRing *ring = GetRing();
+	if (!ring) return false;
+
+	LogRecord rec;
+	rec.format = format;
+	rec.ticks = Clock::ticks();
+	rec.count = count;
+	rec.args[0] = a0;
+	rec.args[1] = a1;
+	rec.args[2] = a2;
+	rec.args[3] = a3;
+
+	if (!ring->queue.Push(rec))
+	{
+		++ring->dropped;
+		return false;
+	}
+
+	return true;
+}
+
+void AsyncLog::Output()
+{
+	if (_batch_used == 0) return;
+
+	const char *data = _batch;
+	u32 bytes = _batch_used;
+	_batch_used = 0;
+
+#ifdef CAT_COMPILE_MMAP
+	if (_view.IsValid())
+	{
+		// Grow the file geometrically to fit
+		if (_used + bytes > _view.GetLength() && !_view.Grow(_used + bytes, MappedView::HINT_SEQUENTIAL))
+			return;
+
+		memcpy(_view.GetFront() + _used, data, bytes);
+		_used += bytes;
+		return;
+	}
+#endif
+
+	while (bytes > 0)
+	{
+		int written = (int)CAT_LOG_WRITE_FD(_fd, data, bytes);
+
+		if (written <= 0)
+		{
+#if !defined(CAT_OS_WINDOWS)
+			if (written < 0 && errno == EINTR) continue;
+#endif
+			return;
+		}
+
+		data += written;
+		bytes -= written;
+	}
+}
+
+void AsyncLog::Append(const char *text, u32 bytes)
+{
+	if (_batch_used + bytes > BATCH_BYTES)
+		Output();
+
+	memcpy(_batch + _batch_used, text, bytes);
+	_batch_used += bytes;
+}
+
+u32 AsyncLog::Drain()
+{
+	u32 total = 0;
+
+	for (ThreadRing *ring = _rings; ring; ring = ring->next)
+	{
+		LogRecord rec;
+		u32 count = 0;
+
+		while (count < DRAIN_LIMIT && ring->queue.Pop(rec))
+		{
+			// Format in place when there is room for a whole line
+			if (_batch_used + MAX_LINE_CHARS > BATCH_BYTES)
+				Output();
+
+			_batch_used += FormatRecord(rec, ring->thread_id, _batch + _batch_used, MAX_LINE_CHARS);
+			++count;
+		}
+
+		// Report records dropped since the last drain
+		u32 dropped = ring->dropped;
+		if (dropped != ring->reported)
+		{
+			char line[96];
+			int len = CAT_LOG_SNPRINTF(line, sizeof(line), "%llu %u Dropped %u log records\n",
+				(unsigned long long)Clock::ticks(), ring->thread_id, dropped - ring->reported);
+			if (len > 0 && len < (int)sizeof(line))
+				Append(line, (u32)len);
+
+			ring->reported = dropped;
+		}
+
+		total += count;
+	}
+
+	Output();
+
+	return total;
+}
+
+bool AsyncLog::Entrypoint(void *param)
+{
+	for (;;)
+	{
+		bool stopping = _stop;
+
+		// Keep draining while there is work; only stop once a pass
+		// started after the stop request finds nothing
+		if (Drain() > 0)
+			continue;
+
+		if (stopping) break;
+
+		_wake.Wait(_flush_msec);
+	}
+
+	return true;
+}
@@ -0,0 +1,196 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_ASYNC_LOG_HPP
+#define CAT_ASYNC_LOG_HPP
+
+#include "LockFree.hpp"
+#include "Thread.hpp"
+#include "WaitableFlag.hpp"
+
+#ifdef CAT_COMPILE_MMAP
+#include "MappedFile.hpp"
+#endif
+
+namespace cat {
+
+
+/*
+	Asynchronous log sink
+
+	Logging on a hot path costs a timestamp and one push of a fixed-size
+	binary record onto a ring owned by the calling thread: no lock, no
+	formatting and no system call.  A background thread drains every ring,
+	formats the records printf-style and appends them in large batches to
+	a file descriptor or a memory-mapped file.
+
+	The format string is stored as a pointer and read later by the writer
+	thread, so it must be a string literal or otherwise outlive the sink.
+	The same goes for %s arguments.  Integers are passed as u64 and
+	printed with the conversion in the format; pass pointers through Ptr()
+	and floating-point values through Float().  Conversions with a '*'
+	width or precision, or with modifiers outside C99 such as %I64d, are
+	printed as written and take no argument.
+
+		log.Write("Resent packet %u after %d ms", seq, rtt);
+
+	Records that find their thread's ring full are counted and dropped
+	rather than blocking the caller, and the writer reports how many were
+	lost.  Lines carry the raw Clock::ticks() timestamp and the thread ID,
+	and are in order within each thread but not across threads.
+*/
+
+// Arguments a record can carry
+static const int LOG_RECORD_ARGS = 4;
+
+// One log call, formatted later by the writer thread
+struct LogRecord
+{
+	const char *format;
+	u64 ticks;
+	u32 count;
+	u64 args[LOG_RECORD_ARGS];
+};
+
+
+class CAT_EXPORT AsyncLog : public Thread
+{
+	// Longest formatted line; longer lines are cut
+	static const u32 MAX_LINE_CHARS = 1024;
+
+	// Output is collected up to this size before it is written
+	static const u32 BATCH_BYTES = 64 * 1024;
+
+	// Records taken from one ring before moving on to the next
+	static const u32 DRAIN_LIMIT = 1024;
+
+	struct ThreadRing
+	{
+		SPSCQueue<LogRecord> queue;
+		ThreadRing *next;
+		u32 thread_id;
+		u32 dropped;		// Written by the producer only
+		u32 reported;		// Written by the writer thread only
+	};
+
+	// Rings are pushed here once per thread and freed on destruction
+	ThreadRing * volatile _rings;
+	u32 _instance;
+	u32 _ring_log2;
+
+	WaitableFlag _wake;
+	volatile bool _stop;
+	bool _started;
+	u32 _flush_msec;
+
+	// Output
+	int _fd;
+#ifdef CAT_COMPILE_MMAP
+	MappedFile _file;
+	MappedView _view;
+	u64 _used;
+#endif
+	char *_batch;
+	u32 _batch_used;
+
+	CAT_NO_COPY(AsyncLog);
+
+	ThreadRing *GetRing();
+	ThreadRing *CreateRing(u32 thread_id);
+
+	u32 Drain();
+	void Append(const char *text, u32 bytes);
+	void Output();
+
+	bool Start(u32 ring_log2, u32 flush_msec);
+	bool Entrypoint(void *param);
+
+	bool Push(const char *format, u32 count, u64 a0 = 0, u64 a1 = 0, u64 a2 = 0, u64 a3 = 0);
+
+public:
+	AsyncLog();
+	~AsyncLog();
+
+	// Each thread that logs gets a ring of 2^ring_log2 records, and the
+	// writer wakes every flush_msec milliseconds to drain them.
+	// Returns false on error
+
+	// Appends to an open file descriptor, which the caller keeps ownership of
+	bool Initialize(int fd, u32 ring_log2 = 12, u32 flush_msec = 10);
+
+#ifdef CAT_COMPILE_MMAP
+	// Creates the file and writes through a growing memory-mapped view
+	bool Initialize(const char *path, u32 ring_log2 = 12, u32 flush_msec = 10);
+#endif
+
+	// Writes out everything still queued and stops the thread.
+	// Initialize() and Shutdown() must not race with Write()
+	void Shutdown();
+
+	// Wake the writer thread now instead of at the next interval
+	CAT_INLINE void Flush() { _wake.Set(); }
+
+	// Any thread.  Returns false if the record was dropped
+	CAT_INLINE bool Write(const char *format)
+	{
+		return Push(format, 0);
+	}
+	CAT_INLINE bool Write(const char *format, u64 a0)
+	{
+		return Push(format, 1, a0);
+	}
+	CAT_INLINE bool Write(const char *format, u64 a0, u64 a1)
+	{
+		return Push(format, 2, a0, a1);
+	}
+	CAT_INLINE bool Write(const char *format, u64 a0, u64 a1, u64 a2)
+	{
+		return Push(format, 3, a0, a1, a2);
+	}
+	CAT_INLINE bool Write(const char *format, u64 a0, u64 a1, u64 a2, u64 a3)
+	{
+		return Push(format, 4, a0, a1, a2, a3);
+	}
+
+	// Argument wrappers for %p / %s and %f / %g / %e
+	static CAT_INLINE u64 Ptr(const void *p)
+	{
+		return (u64)(size_t)p;
+	}
+	static CAT_INLINE u64 Float(double x)
+	{
+		union { double d; u64 u; } bits;
+		bits.d = x;
+		return bits.u;
+	}
+};
+
+
+} // namespace cat
+
+#endif // CAT_ASYNC_LOG_HPP
@@ -61,6 +61,20 @@ CAT_INLINE u32 Add(volatile u32 *x, s32 y);
 CAT_INLINE u32 Set(volatile u32 *x, u32 new_value);
 // Will define CAT_NO_ATOMIC_SET if the platform/compiler does not support atomic set
 
+// Compare-and-Swap (CAS)
+// Returns true if x was equal to the expected value and is now the new value
+CAT_INLINE bool CAS(volatile u32 *x, u32 expected_old_value, u32 new_value);
+// Will define CAT_NO_ATOMIC_CAS if the platform/compiler does not support atomic CAS
+
+// Compare-and-Swap a pointer (CASPointer)
+// Returns true if x was equal to the expected value and is now the new value
+CAT_INLINE bool CASPointer(void * volatile *x, void *expected_old_value, void *new_value);
+// Will define CAT_NO_ATOMIC_CAS_POINTER if the platform/compiler does not support atomic pointer CAS
+
+// Set a pointer to a new value, returning the previous pointer
+CAT_INLINE void *SetPointer(void * volatile *x, void *new_value);
+// Will define CAT_NO_ATOMIC_SET_POINTER if the platform/compiler does not support atomic pointer set
+
 // Bit Test and Set (BTS)
 // Returns true if the bit was 1 and is still 1, otherwise false
 CAT_INLINE bool BTS(volatile u32 *x, int bit);
@@ -200,14 +214,14 @@ bool Atomic::CAS2(volatile void *x, const void *expected_old_value, const void *
 
 	u128 *target = (u128*)x;
 	u64 *replace = (u64*)new_value;
-	u128 *expected = (u128*)expected_old_value;
+	u128 expected = *(u128*)expected_old_value; // CMPXCHG16B overwrites rdx:rax on failure
 	bool retval;
 
     CAT_ASM_BEGIN_VOLATILE
 		"lock; CMPXCHG16B %0\n\t"
-		"sete %%al"
-		: "=m" (*target), "=a" (retval)
-		: "m" (*target), "b" (replace[0]), "c" (replace[1]), "A" (*expected)
+		"sete %1"
+		: "+m" (*target), "=q" (retval), "+A" (expected)
+		: "b" (replace[0]), "c" (replace[1])
 		: "memory", "cc"
     CAT_ASM_END
 
@@ -216,7 +230,7 @@ bool Atomic::CAS2(volatile void *x, const void *expected_old_value, const void *
 
 #elif defined(CAT_COMPILER_GCC)
 	
-	return __sync_val_compare_and_swap((u64 *)x, *(u64 *)expected_old_value, *(const u64 *)new_value);
+	return __sync_bool_compare_and_swap((volatile u128 *)x, *(const u128 *)expected_old_value, *(const u128 *)new_value);
 
 #else
 
@@ -273,14 +287,14 @@ bool Atomic::CAS2(volatile void *x, const void *expected_old_value, const void *
 
 	u64 *target = (u64*)x;
 	u32 *replace = (u32*)new_value;
-	u64 *expected = (u64*)expected_old_value;
+	u64 expected = *(u64*)expected_old_value; // CMPXCHG8B overwrites edx:eax on failure
 	bool retval;
 
     CAT_ASM_BEGIN_VOLATILE
 		"lock; CMPXCHG8B %0\n\t"
-		"sete %%al"
-		: "=m" (*target), "=a" (retval)
-		: "m" (*target), "b" (replace[0]), "c" (replace[1]), "A" (*expected)
+		"sete %1"
+		: "+m" (*target), "=q" (retval), "+A" (expected)
+		: "b" (replace[0]), "c" (replace[1])
 		: "memory", "cc"
     CAT_ASM_END
 
@@ -289,7 +303,7 @@ bool Atomic::CAS2(volatile void *x, const void *expected_old_value, const void *
 
 #elif defined(CAT_COMPILER_GCC)
 
-	return __sync_val_compare_and_swap((u32 *)x, *(u32 *)expected_old_value, *(const u32 *)new_value);
+	return __sync_bool_compare_and_swap((volatile u64 *)x, *(const u64 *)expected_old_value, *(const u64 *)new_value);
 
 #else
 
@@ -422,6 +436,130 @@ u32 Atomic::Set(volatile u32 *x, u32 new_value)
 }
 
 
+//// Compare-and-Swap
+
+bool Atomic::CAS(volatile u32 *x, u32 expected_old_value, u32 new_value)
+{
+	CAT_FENCE_COMPILER
+
+#if defined(CAT_COMPILER_MSVC)
+
+	bool success = (u32)_InterlockedCompareExchange((volatile LONG*)x, new_value, expected_old_value) == expected_old_value;
+
+	CAT_FENCE_COMPILER
+	return success;
+
+#elif defined(CAT_ASM_ATT) && defined(CAT_ISA_X86)
+
+	bool retval;
+
+    CAT_ASM_BEGIN_VOLATILE
+		"lock; CMPXCHGl %3, %0\n\t"
+		"sete %%al"
+		: "=m" (*x), "=a" (retval)
+		: "m" (*x), "r" (new_value), "a" (expected_old_value)
+		: "memory", "cc"
+    CAT_ASM_END
+
+	CAT_FENCE_COMPILER
+    return retval;
+
+#elif defined(CAT_COMPILER_GCC)
+
+	return __sync_bool_compare_and_swap(x, expected_old_value, new_value);
+
+#else
+
+#define CAT_NO_ATOMIC_CAS /* Platform/compiler does not support atomic CAS */
+
+	bool success = *x == expected_old_value;
+	if (success) *x = new_value;
+
+	CAT_FENCE_COMPILER
+	return success;
+
+#endif
+}
+
+//// Pointer Compare-and-Swap
+
+bool Atomic::CASPointer(void * volatile *x, void *expected_old_value, void *new_value)
+{
+	CAT_FENCE_COMPILER
+
+#if defined(CAT_COMPILER_MSVC)
+
+	bool success = _InterlockedCompareExchangePointer(x, new_value, expected_old_value) == expected_old_value;
+
+	CAT_FENCE_COMPILER
+	return success;
+
+#elif defined(CAT_COMPILER_GCC)
+
+	return __sync_bool_compare_and_swap(x, expected_old_value, new_value);
+
+#else
+
+#define CAT_NO_ATOMIC_CAS_POINTER /* Platform/compiler does not support atomic pointer CAS */
+
+	bool success = *x == expected_old_value;
+	if (success) *x = new_value;
+
+	CAT_FENCE_COMPILER
+	return success;
+
+#endif
+}
+
+//// Pointer Set
+
+void *Atomic::SetPointer(void * volatile *x, void *new_value)
+{
+	CAT_FENCE_COMPILER
+
+#if defined(CAT_COMPILER_MSVC)
+
+	void *result = _InterlockedExchangePointer(x, new_value);
+
+	CAT_FENCE_COMPILER
+	return result;
+
+#elif defined(CAT_ASM_ATT) && defined(CAT_ISA_X86)
+
+	void *retval = new_value;
+
+    CAT_ASM_BEGIN_VOLATILE
+		"XCHG %0, %1" // Implicitly locked
+		: "+m" (*x), "+r" (retval)
+		:
+		: "memory"
+    CAT_ASM_END
+
+	CAT_FENCE_COMPILER
+    return retval;
+
+#elif defined(CAT_COMPILER_GCC)
+
+	// __sync_lock_test_and_set is only an acquire barrier, so loop on CAS instead
+	void *old_value;
+	do old_value = *x;
+	while (!__sync_bool_compare_and_swap(x, old_value, new_value));
+
+	return old_value;
+
+#else
+
+#define CAT_NO_ATOMIC_SET_POINTER /* Platform/compiler does not support atomic pointer set */
+
+	void *old_value = *x;
+	*x = new_value;
+
+	CAT_FENCE_COMPILER
+	return old_value;
+
+#endif
+}
+
 //// Bit Test and Set (BTS)
 
 bool Atomic::BTS(volatile u32 *x, int bit)
@@ -452,7 +590,7 @@ bool Atomic::BTS(volatile u32 *x, int bit)
 
 #elif defined(CAT_ASM_ATT) && defined(CAT_ISA_X86)
 
-	bool retval;
+	u32 retval; // sbb leaves 0 or ~0
 
     CAT_ASM_BEGIN_VOLATILE
 		"lock; BTSl %2, %0\n\t"
@@ -463,7 +601,7 @@ bool Atomic::BTS(volatile u32 *x, int bit)
     CAT_ASM_END
 
 	CAT_FENCE_COMPILER
-    return retval;
+    return retval != 0;
 
 #elif defined(CAT_COMPILER_GCC)
 
@@ -515,7 +653,7 @@ bool Atomic::BTR(volatile u32 *x, int bit)
 
 #elif defined(CAT_ASM_ATT) && defined(CAT_ISA_X86)
 
-	bool retval;
+	u32 retval; // sbb leaves 0 or ~0
 
     CAT_ASM_BEGIN_VOLATILE
 		"lock; BTRl %2, %0\n\t"
@@ -526,7 +664,7 @@ bool Atomic::BTR(volatile u32 *x, int bit)
     CAT_ASM_END
 
 	CAT_FENCE_COMPILER
-    return retval;
+    return retval != 0;
 
 #elif defined(CAT_COMPILER_GCC)
 
@@ -27,9 +27,60 @@
 */
 
 #include "Base64.hpp"
+#include "CPUFeatures.hpp"
 using namespace std;
 using namespace cat;
 
+#include <string.h> // memchr
+
+// Build the AVX2 kernels where the compiler can target them per function,
+// and pick them at run time from the CPU features
+#if defined(CAT_X86_DISPATCH)
+# define CAT_BASE64_X86_DISPATCH
+# include <immintrin.h>
+#elif defined(CAT_HAS_NEON) && defined(__aarch64__)
+# define CAT_BASE64_NEON
+# include <arm_neon.h>
+#endif
+
+
+// Stack buffer used by the std::ostream forms: 768 bytes <-> 1024 characters
+static const int STREAM_CHUNK_BYTES = 768;
+static const int STREAM_CHUNK_CHARS = 1024;
+
+
+//// Dispatch
+
+typedef int (*EncodeFunc)(const u8 *data, int bytes, char *encoded);
+typedef int (*DecodeFunc)(const u8 *from, int chars, u8 *to, int to_bytes);
+
+// Vector kernels, or 0 to leave the whole input to the generic code
+struct Base64Kernels
+{
+	EncodeFunc encode;
+	DecodeFunc decode;
+};
+
+static const Base64Kernels *DetectKernels();
+
+static const Base64Kernels *m_kernels = 0;
+
+// Encodes whole blocks from the front of the input, returning bytes consumed
+static CAT_INLINE int EncodeBlocks(const u8 *data, int bytes, char *encoded)
+{
+	EncodeFunc encode = BindKernel(m_kernels, DetectKernels)->encode;
+
+	return encode ? encode(data, bytes, encoded) : 0;
+}
+
+// Decodes whole blocks from the front of the input, returning characters consumed
+static CAT_INLINE int DecodeBlocks(const u8 *from, int chars, u8 *to, int to_bytes)
+{
+	DecodeFunc decode = BindKernel(m_kernels, DetectKernels)->decode;
+
+	return decode ? decode(from, chars, to, to_bytes) : 0;
+}
+
 
 //// Conversion into Base64
 
@@ -45,6 +96,96 @@ static const char TO_BASE64[64] = {
 };
 
 
+// Vector encoders
+
+#if defined(CAT_BASE64_X86_DISPATCH)
+
+/*
+	24 input bytes become 32 characters per step, after Wojciech Mula and
+	Daniel Lemire, "Faster Base64 Encoding and Decoding Using AVX2
+	Instructions" (2018): shuffle each 3 bytes into a 32-bit lane, pull
+	out the four 6-bit fields with multiplies, then add a per-range
+	offset looked up from the field value to turn it into ASCII.
+*/
+CAT_TARGET_AVX2 static int EncodeAVX2(const u8 *data, int bytes, char *encoded)
+{
+	const __m256i shuffle = _mm256_setr_epi8(
+		1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+		1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+	const __m256i offsets = _mm256_setr_epi8(
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+	int ii = 0;
+
+	// Each step reads 28 bytes, of which it encodes 24
+	for (; ii + 28 <= bytes; ii += 24, encoded += 32)
+	{
+		__m256i in = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(data + ii))),
+			_mm_loadu_si128((const __m128i *)(data + ii + 12)), 1);
+
+		in = _mm256_shuffle_epi8(in, shuffle);
+
+		// Fields 0 and 2 by multiply-high, fields 1 and 3 by multiply-low
+		__m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)),
+										_mm256_set1_epi32(0x04000040));
+		__m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)),
+										_mm256_set1_epi32(0x01000010));
+		__m256i fields = _mm256_or_si256(t0, t1);
+
+		// 0..25 select 'A', 26..51 select 'a', then one entry for each digit,
+		// '+' and '/' after saturating subtract
+		__m256i range = _mm256_subs_epu8(fields, _mm256_set1_epi8(51));
+		__m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), fields);
+		range = _mm256_or_si256(range, _mm256_and_si256(upper, _mm256_set1_epi8(13)));
+
+		__m256i chars = _mm256_add_epi8(fields, _mm256_shuffle_epi8(offsets, range));
+		_mm256_storeu_si256((__m256i *)encoded, chars);
+	}
+
+	return ii;
+}
+
+#endif // CAT_BASE64_X86_DISPATCH
+
+#if defined(CAT_BASE64_NEON)
+
+// 48 input bytes become 64 characters per step, with the alphabet in a
+// four-register table lookup
+static int EncodeNEON(const u8 *data, int bytes, char *encoded)
+{
+	const uint8x16x4_t alphabet = vld1q_u8_x4(reinterpret_cast<const u8 *>( TO_BASE64 ));
+	const uint8x16_t mask = vdupq_n_u8(0x3f);
+
+	int ii = 0;
+
+	for (; ii + 48 <= bytes; ii += 48, encoded += 64)
+	{
+		uint8x16x3_t in = vld3q_u8(data + ii);
+		uint8x16x4_t out;
+
+		out.val[0] = vshrq_n_u8(in.val[0], 2);
+		out.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4), vshrq_n_u8(in.val[1], 4)), mask);
+		out.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2), vshrq_n_u8(in.val[2], 6)), mask);
+		out.val[3] = vandq_u8(in.val[2], mask);
+
+		out.val[0] = vqtbl4q_u8(alphabet, out.val[0]);
+		out.val[1] = vqtbl4q_u8(alphabet, out.val[1]);
+		out.val[2] = vqtbl4q_u8(alphabet, out.val[2]);
+		out.val[3] = vqtbl4q_u8(alphabet, out.val[3]);
+
+		vst4q_u8(reinterpret_cast<u8 *>( encoded ), out);
+	}
+
+	return ii;
+}
+
+#endif // CAT_BASE64_NEON
+
+
 int cat::GetBase64LengthFromBinaryLength(int bytes)
 {
 	if (bytes <= 0) return 0;
@@ -61,8 +202,11 @@ int cat::WriteBase64(const void *buffer, int bytes, char *encoded_buffer, int en
 
 	const u8 *data = reinterpret_cast<const u8*>( buffer );
 
-	int ii, jj, end;
-	for (ii = 0, jj = 0, end = bytes - 2; ii < end; ii += 3, jj += 4)
+	// Vector kernel takes whole blocks from the front
+	int ii = EncodeBlocks(data, bytes, encoded_buffer);
+
+	int jj, end;
+	for (jj = (ii / 3) * 4, end = bytes - 2; ii < end; ii += 3, jj += 4)
 	{
 		encoded_buffer[jj] = TO_BASE64[data[ii] >> 2];
 		encoded_buffer[jj+1] = TO_BASE64[((data[ii] << 4) | (data[ii+1] >> 4)) & 0x3f];
@@ -110,33 +254,17 @@ int cat::WriteBase64(const void *buffer, int bytes, ostream &output)
 
 	const u8 *data = reinterpret_cast<const u8*>( buffer );
 
-	int ii, end;
-	for (ii = 0, end = bytes - 2; ii < end; ii += 3)
-	{
-		output << TO_BASE64[data[ii] >> 2];
-		output << TO_BASE64[((data[ii] << 4) | (data[ii+1] >> 4)) & 0x3f];
-		output << TO_BASE64[((data[ii+1] << 2) | (data[ii+2] >> 6)) & 0x3f];
-		output << TO_BASE64[data[ii+2] & 0x3f];
-	}
+	// Encode through a small buffer, whole triples at a time so padding only
+	// appears at the end
+	char chunk[STREAM_CHUNK_CHARS];
 
-	switch (ii - end)
+	for (int ii = 0; ii < bytes; ii += STREAM_CHUNK_BYTES)
 	{
-	default:
-	case 2: // Nothing to write
-		break;
-
-	case 1: // Need to write final 1 byte
-		output << TO_BASE64[data[bytes-1] >> 2];
-		output << TO_BASE64[(data[bytes-1] << 4) & 0x3f];
-		output << "==";
-		break;
+		int len = bytes - ii;
+		if (len > STREAM_CHUNK_BYTES) len = STREAM_CHUNK_BYTES;
 
-	case 0: // Need to write final 2 bytes
-		output << TO_BASE64[data[bytes-2] >> 2];
-		output << TO_BASE64[((data[bytes-2] << 4) | (data[bytes-1] >> 4)) & 0x3f];
-		output << TO_BASE64[(data[bytes-1] << 2) & 0x3f];
-		output << '=';
-		break;
+		int chars = WriteBase64(data + ii, len, chunk, sizeof(chunk));
+		output.write(chunk, chars);
 	}
 
 	return ((bytes + 2) / 3) * 4;
@@ -176,7 +304,7 @@ int cat::GetBinaryLengthFromBase64Length(const char *encoded_buffer, int bytes)
 	while (bytes >= 1) {
 		unsigned char ch = encoded_buffer[bytes - 1];
 
-		if (ch == '0' || FROM_BASE64(ch) != 0) {
+		if (ch == 'A' || FROM_BASE64[ch] != 0) {
 			break;
 		}
 
@@ -186,13 +314,151 @@ int cat::GetBinaryLengthFromBase64Length(const char *encoded_buffer, int bytes)
 	return (bytes * 3) / 4;
 }
 
+// Decode 4 characters into 3 bytes at a time, as the generic code does
+static void DecodeQuads(const u8 *from, u8 *to, int quads)
+{
+	for (int ii = 0; ii < quads; ++ii, from += 4, to += 3)
+	{
+		u8 a = FROM_BASE64[from[0]];
+		u8 b = FROM_BASE64[from[1]];
+		u8 c = FROM_BASE64[from[2]];
+		u8 d = FROM_BASE64[from[3]];
+
+		to[0] = (a << 2) | (b >> 4);
+		to[1] = (b << 4) | (c >> 2);
+		to[2] = (c << 6) | d;
+	}
+}
+
+// Vector decoders
+
+#if defined(CAT_BASE64_X86_DISPATCH)
+
+/*
+	32 characters become 24 bytes per step, after Mula and Lemire: the two
+	nibbles of each character index small tables that flag anything outside
+	the alphabet and give the offset back to its 6-bit value, then multiply-
+	adds pack the fields together.  Blocks with a character outside the
+	alphabet go through the table so they decode exactly as before.
+*/
+CAT_TARGET_AVX2 static int DecodeAVX2(const u8 *from, int chars, u8 *to, int to_bytes)
+{
+	const __m256i lut_lo = _mm256_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m256i lut_hi = _mm256_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i lut_roll = _mm256_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+		0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i nibble = _mm256_set1_epi8(0x0f);
+	const __m256i pack = _mm256_setr_epi8(
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+	int ii = 0, jj = 0;
+
+	// Each step writes exactly the 24 output bytes
+	for (; ii + 32 <= chars && jj + 24 <= to_bytes; ii += 32, jj += 24)
+	{
+		__m256i in = _mm256_loadu_si256((const __m256i *)(from + ii));
+
+		__m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(in, 4), nibble);
+		__m256i lo_nibbles = _mm256_and_si256(in, nibble);
+
+		// If any character is outside the alphabet,
+		if (!_mm256_testz_si256(_mm256_shuffle_epi8(lut_lo, lo_nibbles),
+								_mm256_shuffle_epi8(lut_hi, hi_nibbles)))
+		{
+			DecodeQuads(from + ii, to + jj, 8);
+			continue;
+		}
+
+		// '/' shares its high nibble with '+' so it gets the entry before
+		__m256i slash = _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/'));
+		__m256i roll = _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(slash, hi_nibbles));
+		__m256i fields = _mm256_add_epi8(in, roll);
+
+		// Join pairs of 6-bit fields into 12 bits, then pairs of those into 24
+		__m256i out = _mm256_maddubs_epi16(fields, _mm256_set1_epi32(0x01400140));
+		out = _mm256_madd_epi16(out, _mm256_set1_epi32(0x00011000));
+
+		out = _mm256_shuffle_epi8(out, pack);
+		out = _mm256_permutevar8x32_epi32(out, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+
+		_mm_storeu_si128((__m128i *)(to + jj), _mm256_castsi256_si128(out));
+		_mm_storel_epi64((__m128i *)(to + jj + 16), _mm256_extracti128_si256(out, 1));
+	}
+
+	return ii;
+}
+
+#endif // CAT_BASE64_X86_DISPATCH
+
+#if defined(CAT_BASE64_NEON)
+
+// 64 characters become 48 bytes per step.  Two four-register lookups cover
+// the first 128 entries of the table, and anything else decodes to zero
+// just as in the table
+static int DecodeNEON(const u8 *from, int chars, u8 *to, int to_bytes)
+{
+	const uint8x16x4_t table_lo = vld1q_u8_x4(FROM_BASE64);
+	const uint8x16x4_t table_hi = vld1q_u8_x4(FROM_BASE64 + 64);
+	const uint8x16_t sixty_four = vdupq_n_u8(64);
+
+	int ii = 0, jj = 0;
+
+	for (; ii + 64 <= chars && jj + 48 <= to_bytes; ii += 64, jj += 48)
+	{
+		uint8x16x4_t in = vld4q_u8(from + ii);
+
+		for (int kk = 0; kk < 4; ++kk)
+			in.val[kk] = vqtbx4q_u8(vqtbl4q_u8(table_lo, in.val[kk]), table_hi,
+									vsubq_u8(in.val[kk], sixty_four));
+
+		uint8x16x3_t out;
+		out.val[0] = vorrq_u8(vshlq_n_u8(in.val[0], 2), vshrq_n_u8(in.val[1], 4));
+		out.val[1] = vorrq_u8(vshlq_n_u8(in.val[1], 4), vshrq_n_u8(in.val[2], 2));
+		out.val[2] = vorrq_u8(vshlq_n_u8(in.val[2], 6), in.val[3]);
+
+		vst3q_u8(to + jj, out);
+	}
+
+	return ii;
+}
+
+#endif // CAT_BASE64_NEON
+
+static const Base64Kernels *DetectKernels()
+{
+	static const Base64Kernels GENERIC = { 0, 0 };
+
+#if defined(CAT_BASE64_X86_DISPATCH)
+	static const Base64Kernels AVX2 = { EncodeAVX2, DecodeAVX2 };
+
+	if (HasCPUFeatures(CPU_AVX2))
+		return &AVX2;
+#elif defined(CAT_BASE64_NEON)
+	static const Base64Kernels NEON = { EncodeNEON, DecodeNEON };
+
+	if (HasCPUFeatures(CPU_NEON))
+		return &NEON;
+#endif
+
+	return &GENERIC;
+}
+
+
+static int DecodeSpan(const u8 *from, int encoded_bytes, u8 *to, int decoded_bytes);
+
 int cat::ReadBase64(const char *encoded_buffer, int encoded_bytes, void *decoded_buffer, int decoded_bytes)
 {
 	// Skip characters from end until one is a valid BASE64 character
 	while (encoded_bytes >= 1) {
 		unsigned char ch = encoded_buffer[encoded_bytes - 1];
 
-		if (ch == '0' || FROM_BASE64(ch) != 0) {
+		if (ch == 'A' || FROM_BASE64[ch] != 0) {
 			break;
 		}
 
@@ -205,13 +471,20 @@ int cat::ReadBase64(const char *encoded_buffer, int encoded_bytes, void *decoded
 		return 0;
 	}
 
-	const u8 *from = reinterpret_cast<const u8*>( encoded_buffer );
-	u8 *to = reinterpret_cast<u8*>( decoded_buffer );
+	return DecodeSpan(reinterpret_cast<const u8*>( encoded_buffer ), encoded_bytes,
+					  reinterpret_cast<u8*>( decoded_buffer ), decoded_bytes);
+}
+
+// Decode characters with no trimming, into room for (chars * 3) / 4 bytes
+static int DecodeSpan(const u8 *from, int encoded_bytes, u8 *to, int decoded_bytes)
+{
+	// Vector kernel takes whole blocks from the front
+	int ii = DecodeBlocks(from, encoded_bytes, to, decoded_bytes);
 
 	u8 a, b, c, d;
 
-	int ii, jj, end;
-	for (ii = 0, jj = 0, end = encoded_bytes - 3; ii < end; ii += 4, jj += 3)
+	int jj, end;
+	for (jj = (ii / 4) * 3, end = encoded_bytes - 3; ii < end; ii += 4, jj += 3)
 	{
 		a = FROM_BASE64[from[ii]];
 		b = FROM_BASE64[from[ii+1]];
@@ -255,40 +528,210 @@ int cat::ReadBase64(const char *encoded_buffer, int encoded_bytes, std::ostream
 
 	const u8 *from = reinterpret_cast<const u8*>( encoded_buffer );
 
-	u8 a, b, c, d;
+	// Decode through a small buffer, whole quads at a time
+	u8 chunk[STREAM_CHUNK_BYTES];
 
-	int ii, end;
-	for (ii = 0, end = encoded_bytes - 3; ii < end; ii += 4)
+	for (int ii = 0; ii < encoded_bytes; ii += STREAM_CHUNK_CHARS)
 	{
-		a = FROM_BASE64[from[ii]];
-		b = FROM_BASE64[from[ii+1]];
-		c = FROM_BASE64[from[ii+2]];
-		d = FROM_BASE64[from[ii+3]];
+		int chars = encoded_bytes - ii;
+		if (chars > STREAM_CHUNK_CHARS) chars = STREAM_CHUNK_CHARS;
 
-		output << (u8)((a << 2) | (b >> 4));
-		output << (u8)((b << 4) | (c >> 2));
-		output << (u8)((c << 6) | d);
+		int len = DecodeSpan(from + ii, chars, chunk, sizeof(chunk));
+		output.write(reinterpret_cast<const char*>( chunk ), len);
 	}
 
-	switch (encoded_bytes & 3)
+	return (encoded_bytes * 3) / 4;
+}
+
+
+//// Base64Encoder
+
+// Encode one whole triple
+static CAT_INLINE void EncodeTriple(const u8 *data, char *encoded)
+{
+	encoded[0] = TO_BASE64[data[0] >> 2];
+	encoded[1] = TO_BASE64[((data[0] << 4) | (data[1] >> 4)) & 0x3f];
+	encoded[2] = TO_BASE64[((data[1] << 2) | (data[2] >> 6)) & 0x3f];
+	encoded[3] = TO_BASE64[data[2] & 0x3f];
+}
+
+int Base64Encoder::Encode(const void *buffer, int bytes, char *encoded_buffer, int encoded_bytes, int &consumed)
+{
+	const u8 *data = reinterpret_cast<const u8*>( buffer );
+	int read = 0, written = 0;
+
+	// Complete the triple left over from the last slice first
+	while (_count > 0)
 	{
-	case 3: // 3 characters left
-		a = FROM_BASE64[from[ii]];
-		b = FROM_BASE64[from[ii+1]];
-		c = FROM_BASE64[from[ii+2]];
+		if (_count == 3)
+		{
+			// If there is no room for it yet,
+			if (encoded_bytes < 4)
+			{
+				consumed = read;
+				return 0;
+			}
+
+			EncodeTriple(_pending, encoded_buffer);
+			written = 4;
+			_count = 0;
+			break;
+		}
+
+		// If this slice does not complete it either,
+		if (read >= bytes)
+		{
+			consumed = read;
+			return 0;
+		}
 
-		output << (u8)((a << 2) | (b >> 4));
-		output << (u8)((b << 4) | (c >> 2));
+		_pending[_count++] = data[read++];
+	}
+
+	// Whole blocks through the vector kernel, limited to the room left
+	int room = ((encoded_bytes - written) / 4) * 3;
+	int span = bytes - read;
+	if (span > room) span = room;
+
+	int blocks = EncodeBlocks(data + read, span, encoded_buffer + written);
+	read += blocks;
+	written += (blocks / 3) * 4;
+
+	// Then whole triples
+	while (bytes - read >= 3 && encoded_bytes - written >= 4)
+	{
+		EncodeTriple(data + read, encoded_buffer + written);
+		read += 3;
+		written += 4;
+	}
+
+	// Hold the last 1..2 bytes for the next slice
+	if (bytes - read < 3)
+	{
+		while (read < bytes)
+			_pending[_count++] = data[read++];
+	}
+
+	consumed = read;
+	return written;
+}
+
+int Base64Encoder::Finish(char *encoded_buffer, int encoded_bytes)
+{
+	if (_count <= 0 || encoded_bytes < 4)
+		return 0;
+
+	const u8 *data = _pending;
+
+	switch (_count)
+	{
+	case 3:
+		EncodeTriple(data, encoded_buffer);
 		break;
 
-	case 2: // 2 characters left
-		a = FROM_BASE64[from[ii]];
-		b = FROM_BASE64[from[ii+1]];
+	case 2:
+		encoded_buffer[0] = TO_BASE64[data[0] >> 2];
+		encoded_buffer[1] = TO_BASE64[((data[0] << 4) | (data[1] >> 4)) & 0x3f];
+		encoded_buffer[2] = TO_BASE64[(data[1] << 2) & 0x3f];
+		encoded_buffer[3] = '=';
+		break;
 
-		output << (u8)((a << 2) | (b >> 4));
+	case 1:
+		encoded_buffer[0] = TO_BASE64[data[0] >> 2];
+		encoded_buffer[1] = TO_BASE64[(data[0] << 4) & 0x3f];
+		encoded_buffer[2] = '=';
+		encoded_buffer[3] = '=';
 		break;
 	}
 
-	return (encoded_bytes * 3) / 4;
+	_count = 0;
+	return 4;
 }
 
+
+//// Base64Decoder
+
+int Base64Decoder::Decode(const char *encoded_buffer, int encoded_bytes, void *decoded_buffer, int decoded_bytes, int &consumed)
+{
+	const u8 *from = reinterpret_cast<const u8*>( encoded_buffer );
+	u8 *to = reinterpret_cast<u8*>( decoded_buffer );
+	int read = 0, written = 0;
+
+	while (read < encoded_bytes || _count == 4)
+	{
+		// If a quad is complete,
+		if (_count == 4)
+		{
+			// If there is no room for it yet,
+			if (decoded_bytes - written < 3)
+				break;
+
+			DecodeQuads(_quad, to + written, 1);
+			written += 3;
+			_count = 0;
+			continue;
+		}
+
+		// On a quad boundary, take whole quads up to any padding at once
+		if (_count == 0)
+		{
+			int span = encoded_bytes - read;
+
+			const void *pad = memchr(from + read, '=', span);
+			if (pad) span = (int)(reinterpret_cast<const u8*>( pad ) - (from + read));
+
+			int room = ((decoded_bytes - written) / 3) * 4;
+			if (span > room) span = room;
+			span &= ~3;
+
+			if (span > 0)
+			{
+				int blocks = DecodeBlocks(from + read, span, to + written, decoded_bytes - written);
+
+				DecodeQuads(from + read + blocks, to + written + (blocks / 4) * 3, (span - blocks) / 4);
+
+				read += span;
+				written += (span / 4) * 3;
+				continue;
+			}
+		}
+
+		// Otherwise build up the partial quad, skipping padding
+		u8 ch = from[read++];
+		if (ch != '=')
+			_quad[_count++] = ch;
+	}
+
+	consumed = read;
+	return written;
+}
+
+int Base64Decoder::Finish(void *decoded_buffer, int decoded_bytes)
+{
+	u8 *to = reinterpret_cast<u8*>( decoded_buffer );
+
+	// 2 characters make 1 byte and 3 make 2; a lone character carries none
+	int len = _count == 4 ? 3 : (_count > 1 ? _count - 1 : 0);
+
+	if (decoded_bytes < len)
+		return 0;
+
+	switch (len)
+	{
+	case 3:
+		DecodeQuads(_quad, to, 1);
+		break;
+
+	case 2:
+		to[0] = (FROM_BASE64[_quad[0]] << 2) | (FROM_BASE64[_quad[1]] >> 4);
+		to[1] = (FROM_BASE64[_quad[1]] << 4) | (FROM_BASE64[_quad[2]] >> 2);
+		break;
+
+	case 1:
+		to[0] = (FROM_BASE64[_quad[0]] << 2) | (FROM_BASE64[_quad[1]] >> 4);
+		break;
+	}
+
+	_count = 0;
+	return len;
+}
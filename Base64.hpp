@@ -51,6 +51,54 @@ CAT_EXPORT int ReadBase64(const char *encoded_buffer, int encoded_bytes, void *d
 CAT_EXPORT int ReadBase64(const char *encoded_buffer, int encoded_bytes, std::ostream &output);
 
 
+// Resumable encoder for data that arrives in slices of any size.
+// Output is identical to WriteBase64() over the joined slices
+class CAT_EXPORT Base64Encoder
+{
+	u8 _pending[3];	// Bytes of a triple not yet written
+	int _count;
+
+public:
+	CAT_INLINE Base64Encoder() { Reset(); }
+
+	CAT_INLINE void Reset() { _count = 0; }
+
+	// Encodes as much of the slice as fits, carrying a partial triple over.
+	// Sets consumed to the input bytes taken, which is all of them unless the
+	// output filled up.  Returns the number of characters written
+	int Encode(const void *buffer, int bytes, char *encoded_buffer, int encoded_bytes, int &consumed);
+
+	// Writes the last quad with padding if any bytes are left over.
+	// Returns 4, or 0 if nothing was left or encoded_bytes < 4
+	int Finish(char *encoded_buffer, int encoded_bytes);
+};
+
+// Resumable decoder for Base64 that arrives in slices of any size.
+// Other characters outside the alphabet decode as zero bits, as in
+// ReadBase64(), but '=' is skipped wherever it appears since a slice cannot
+// tell padding from the end of the input.  ReadBase64() strips only the
+// trailing '=' and decodes any earlier one as zero bits
+class CAT_EXPORT Base64Decoder
+{
+	u8 _quad[4];	// Characters of a quad not yet decoded
+	int _count;
+
+public:
+	CAT_INLINE Base64Decoder() { Reset(); }
+
+	CAT_INLINE void Reset() { _count = 0; }
+
+	// Decodes as much of the slice as fits, carrying a partial quad over.
+	// Sets consumed to the characters taken, which is all of them unless the
+	// output filled up.  Returns the number of bytes written
+	int Decode(const char *encoded_buffer, int encoded_bytes, void *decoded_buffer, int decoded_bytes, int &consumed);
+
+	// Writes the bytes of a final partial quad.  Returns the number written,
+	// or 0 if there is not room for them
+	int Finish(void *decoded_buffer, int decoded_bytes);
+};
+
+
 } // namespace cat
 
 #endif // CAT_BASE64_HPP
@@ -0,0 +1,164 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Benchmark.hpp"
+#include "Thread.hpp"
+#include <algorithm>
+#include <new>
+using namespace cat;
+
+
+//// Benchmark
+
+Benchmark::Benchmark()
+{
+	_clock = 0;
+	_overhead = 0;
+	_samples = 0;
+	_sample_count = 0;
+}
+
+Benchmark::~Benchmark()
+{
+	delete []_samples;
+}
+
+bool Benchmark::Initialize(Clock *clock, int core)
+{
+	if (!clock) return false;
+
+	_clock = clock;
+
+	// If a core was requested but pinning failed, results would be noisy
+	if (core >= 0 && !SetExecCore(core))
+		return false;
+
+	// Find the cost of reading the tick counter twice
+	u64 overhead = ~(u64)0;
+
+	for (int ii = 0; ii < 1000; ++ii)
+	{
+		CAT_FENCE_COMPILER
+		u64 a = Clock::ticks();
+		CAT_FENCE_COMPILER
+		u64 b = Clock::ticks();
+		CAT_FENCE_COMPILER
+
+		if (overhead > b - a)
+			overhead = b - a;
+	}
+
+	_overhead = overhead;
+
+	return true;
+}
+
+bool Benchmark::Run(const char *name, const BenchmarkDelegate &function, u64 bytes, int iterations, BenchmarkResult &result)
+{
+	if (!_clock || !function.IsValid() || iterations <= 0)
+		return false;
+
+	// Grow the sample buffer, keeping it between runs
+	if (_sample_count < iterations)
+	{
+		delete []_samples;
+
+		_samples = new (std::nothrow) u64[iterations];
+		if (!_samples)
+		{
+			_sample_count = 0;
+			return false;
+		}
+
+		_sample_count = iterations;
+	}
+
+	ThreadPrio caller_prio = GetExecPriority();
+	SetExecPriority(P_HIGHEST);
+
+	// Warm up for a while, and for at least a tenth of the timed calls
+	u64 warmup_end = _clock->nsec() + WARMUP_MSEC * 1000000ULL;
+	for (int ii = 0; ii < iterations / 10 || _clock->nsec() < warmup_end; ++ii)
+		function();
+
+	u64 start_nsec = _clock->nsec();
+	u64 start_ticks = Clock::ticks();
+
+	for (int ii = 0; ii < iterations; ++ii)
+	{
+		CAT_FENCE_COMPILER
+		u64 a = Clock::ticks();
+		CAT_FENCE_COMPILER
+		function();
+		CAT_FENCE_COMPILER
+		u64 b = Clock::ticks();
+		CAT_FENCE_COMPILER
+
+		u64 dt = b - a;
+		_samples[ii] = dt > _overhead ? dt - _overhead : 0;
+	}
+
+	u64 end_ticks = Clock::ticks();
+	u64 end_nsec = _clock->nsec();
+
+	SetExecPriority(caller_prio);
+
+	std::sort(_samples, _samples + iterations);
+
+	result.name = name;
+	result.iterations = iterations;
+	result.bytes = bytes;
+	result.min_cycles = _samples[0];
+	result.median_cycles = _samples[iterations / 2];
+	result.p99_cycles = _samples[(iterations - 1) - (iterations - 1) / 100];
+
+	// Convert with the tick rate seen over the timed loop
+	double nsec_per_tick = 0;
+	if (end_ticks > start_ticks)
+		nsec_per_tick = (double)(end_nsec - start_nsec) / (double)(end_ticks - start_ticks);
+
+	result.median_nsec = result.median_cycles * nsec_per_tick;
+	result.bytes_per_sec = 0;
+	if (bytes > 0 && result.median_nsec > 0)
+		result.bytes_per_sec = bytes * 1000000000.0 / result.median_nsec;
+
+	return true;
+}
+
+void Benchmark::Write(std::ostream &output, const BenchmarkResult &result)
+{
+	output << "{\"name\":\"" << (result.name ? result.name : "")
+		<< "\",\"iterations\":" << result.iterations
+		<< ",\"bytes\":" << result.bytes
+		<< ",\"min_cycles\":" << result.min_cycles
+		<< ",\"median_cycles\":" << result.median_cycles
+		<< ",\"p99_cycles\":" << result.p99_cycles
+		<< ",\"median_nsec\":" << result.median_nsec
+		<< ",\"bytes_per_sec\":" << result.bytes_per_sec
+		<< "}\n";
+}
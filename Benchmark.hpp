@@ -0,0 +1,115 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_BENCHMARK_HPP
+#define CAT_BENCHMARK_HPP
+
+#include "Clock.hpp"
+#include "Delegates.hpp"
+#include <ostream>
+
+namespace cat {
+
+
+/*
+	Micro-benchmark harness
+
+	Each call of the function under test is timed on its own with
+	Clock::ticks(), which counts TSC cycles on x86.  The cost of an
+	empty measurement is subtracted, and the function is run for a
+	while before timing starts so caches and branch predictors are warm.
+
+	Usage:
+
+		Benchmark bench;
+		bench.Initialize(clock, 2); // Pin to core 2
+
+		BenchmarkResult result;
+		if (bench.Run("memxor/1500", BenchmarkDelegate::FromMember<Test, &Test::XOR>(&test), 1500, 10000, result))
+			Benchmark::Write(std::cout, result);
+
+	Write() prints one JSON object per line so that runs can be compared
+	by a script and regressions caught before release.
+
+	RunBenchmarkSuite() runs the built-in cases for memxor(), GF256MemMulAdd(),
+	siphash24(), Base64, HashTableBase::Lookup(), ReuseAllocator and the
+	Ragdoll parser, for a tool to call from its main().
+*/
+
+typedef Delegate0<void> BenchmarkDelegate;
+
+struct BenchmarkResult
+{
+	const char *name;
+	int iterations;
+	u64 bytes;				// Bytes processed by each call, or 0
+
+	u64 min_cycles;			// Per call, after subtracting timing overhead
+	u64 median_cycles;
+	u64 p99_cycles;
+
+	double median_nsec;
+	double bytes_per_sec;	// At the median, or 0 if bytes is 0
+};
+
+class CAT_EXPORT Benchmark
+{
+	// Minimum warm-up time before each run
+	static const u32 WARMUP_MSEC = 20;
+
+	Clock *_clock;
+	u64 _overhead;			// Cycles for an empty measurement
+
+	u64 *_samples;
+	int _sample_count;
+
+public:
+	Benchmark();
+	~Benchmark();
+
+	// Pin the calling thread to the given core, unless it is negative
+	bool Initialize(Clock *clock, int core = -1);
+
+	// Call the function the given number of times after warming it up.
+	// Runs at high priority on the calling thread, then restores its priority.
+	// Returns false on out of memory or a bad argument
+	bool Run(const char *name, const BenchmarkDelegate &function, u64 bytes, int iterations, BenchmarkResult &result);
+
+	// Write the result as one line of JSON
+	static void Write(std::ostream &output, const BenchmarkResult &result);
+};
+
+
+// Write a result line for each built-in case, pinned to the given core
+// unless it is negative.  Returns false if any case could not be run
+bool RunBenchmarkSuite(Clock *clock, std::ostream &output, int core = -1);
+
+
+} // namespace cat
+
+#endif // CAT_BENCHMARK_HPP
@@ -0,0 +1,210 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "Benchmark.hpp"
+#include "MemXOR.hpp"
+#include "Galois256.hpp"
+#include "SipHash.hpp"
+#include "Base64.hpp"
+#include "HashTable.hpp"
+#include "ReuseAllocator.hpp"
+#include "RagdollFile.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+using namespace cat;
+
+
+//// Suite cases
+
+// Typical datagram payload
+static const int PACKET_BYTES = 1500;
+
+// Keys in the hash table and lines in the Ragdoll file
+static const int KEY_COUNT = 1000;
+
+// Buffers taken from the allocator at once
+static const u32 ALLOCATOR_BATCH = 16;
+
+static const char *const RAGDOLL_PATH = "BenchmarkSuite.cfg";
+
+class SuiteCases
+{
+	u8 _a[PACKET_BYTES], _b[PACKET_BYTES];
+	char _encoded[PACKET_BYTES * 2];
+	int _encoded_bytes;
+	char _key[16];
+	volatile u64 _sink;
+
+	HashTable<HashItem> _table;
+	StaticKey _lookup_key;
+
+	ReuseAllocator _allocator;
+
+public:
+	SuiteCases() : _lookup_key("Suite.Key500")
+	{
+		for (int ii = 0; ii < PACKET_BYTES; ++ii)
+		{
+			_a[ii] = (u8)ii;
+			_b[ii] = (u8)(ii * 7 + 1);
+		}
+
+		for (int ii = 0; ii < 16; ++ii)
+			_key[ii] = (char)ii;
+
+		_encoded_bytes = WriteBase64(_a, PACKET_BYTES, _encoded, sizeof(_encoded));
+		_sink = 0;
+
+		_allocator.Initialize(PACKET_BYTES);
+	}
+
+	// Returns false on out of memory or if the Ragdoll file cannot be written
+	bool Initialize()
+	{
+		char name[32];
+
+		for (int ii = 0; ii < KEY_COUNT; ++ii)
+		{
+			sprintf(name, "Suite.Key%d", ii);
+			if (!_table.Create(StaticKey(name))) return false;
+		}
+
+		std::ofstream file(RAGDOLL_PATH, std::ios::binary);
+		if (!file) return false;
+
+		file << "; Generated by RunBenchmarkSuite()\nSuite\n";
+		for (int ii = 0; ii < KEY_COUNT; ++ii)
+			file << "\tKey" << ii << " " << ii * 31 << "\n";
+
+		file.close();
+		return !file.fail();
+	}
+
+	~SuiteCases()
+	{
+		std::remove(RAGDOLL_PATH);
+	}
+
+	void MemXOR()
+	{
+		memxor(_a, _b, PACKET_BYTES);
+	}
+
+	void GF256MulAdd()
+	{
+		GF256MemMulAdd(_a, 0x8e, _b, PACKET_BYTES);
+	}
+
+	void SipHash()
+	{
+		_sink += siphash24(_key, _a, PACKET_BYTES, 0);
+	}
+
+	void Base64Encode()
+	{
+		_sink += WriteBase64(_a, PACKET_BYTES, _encoded, sizeof(_encoded));
+	}
+
+	void Base64Decode()
+	{
+		_sink += ReadBase64(_encoded, _encoded_bytes, _b, PACKET_BYTES);
+	}
+
+	void HashLookup()
+	{
+		_sink += _table.Lookup(_lookup_key) != 0;
+	}
+
+	void AllocatorBatch()
+	{
+		BatchSet set;
+		_sink += _allocator.AcquireBatch(set, ALLOCATOR_BATCH);
+		_allocator.ReleaseBatch(set);
+	}
+
+	void RagdollParse()
+	{
+		ragdoll::File file;
+		_sink += file.Read(RAGDOLL_PATH);
+	}
+};
+
+
+//// RunBenchmarkSuite
+
+struct SuiteCase
+{
+	const char *name;
+	BenchmarkDelegate function;
+	u64 bytes;
+	int iterations;
+};
+
+bool cat::RunBenchmarkSuite(Clock *clock, std::ostream &output, int core)
+{
+	Benchmark bench;
+	if (!bench.Initialize(clock, core)) return false;
+
+	SuiteCases *cases = new (std::nothrow) SuiteCases;
+	if (!cases) return false;
+
+	if (!cases->Initialize())
+	{
+		delete cases;
+		return false;
+	}
+
+	const SuiteCase suite[] = {
+		{ "memxor/1500", BenchmarkDelegate::FromMember<SuiteCases, &SuiteCases::MemXOR>(cases), PACKET_BYTES, 100000 },
+		{ "GF256MemMulAdd/1500", BenchmarkDelegate::FromMember<SuiteCases, &SuiteCases::GF256MulAdd>(cases), PACKET_BYTES, 100000 },
+		{ "siphash24/1500", BenchmarkDelegate::FromMember<SuiteCases, &SuiteCases::SipHash>(cases), PACKET_BYTES, 100000 },
+		{ "WriteBase64/1500", BenchmarkDelegate::FromMember<SuiteCases, &SuiteCases::Base64Encode>(cases), PACKET_BYTES, 100000 },
+		{ "ReadBase64/1500", BenchmarkDelegate::FromMember<SuiteCases, &SuiteCases::Base64Decode>(cases), PACKET_BYTES, 100000 },
+		{ "HashTableBase::Lookup/1000", BenchmarkDelegate::FromMember<SuiteCases, &SuiteCases::HashLookup>(cases), 0, 100000 },
+		{ "ReuseAllocator/batch16", BenchmarkDelegate::FromMember<SuiteCases, &SuiteCases::AllocatorBatch>(cases), 0, 100000 },
+		{ "ragdoll::File::Read/1000", BenchmarkDelegate::FromMember<SuiteCases, &SuiteCases::RagdollParse>(cases), 0, 1000 },
+	};
+
+	bool success = true;
+
+	for (int ii = 0; ii < (int)(sizeof(suite) / sizeof(suite[0])); ++ii)
+	{
+		const SuiteCase &c = suite[ii];
+
+		BenchmarkResult result;
+		if (bench.Run(c.name, c.function, c.bytes, c.iterations, result))
+			Benchmark::Write(output, result);
+		else
+			success = false;
+	}
+
+	delete cases;
+
+	return success;
+}
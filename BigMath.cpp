@@ -0,0 +1,207 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "BigMath.hpp"
+#include "Enforcer.hpp"
+using namespace cat;
+
+
+//// Bignum Arrays
+
+u64 cat::BigAdd(u64 *r, const u64 *x, const u64 *y, int limbs)
+{
+	u128 sum;
+	u128_set(sum, 0);
+
+	for (int ii = 0; ii < limbs; ++ii)
+	{
+		u128_carry_add(sum, x[ii]);
+		u128_add(sum, y[ii]);
+		r[ii] = u128_low(sum);
+	}
+
+	return u128_high(sum);
+}
+
+u64 cat::BigSub(u64 *r, const u64 *x, const u64 *y, int limbs)
+{
+	u128 diff;
+	u128_set(diff, 0);
+
+	for (int ii = 0; ii < limbs; ++ii)
+	{
+		u128_borrow_add_sub(diff, x[ii], y[ii]);
+		r[ii] = u128_low(diff);
+	}
+
+	return 0 - u128_high(diff);
+}
+
+u64 cat::BigMulAdd(u64 *r, const u64 *x, u64 y, int limbs)
+{
+	u64 carry = 0;
+
+	for (int ii = 0; ii < limbs; ++ii)
+		r[ii] = u64_mac(x[ii], y, r[ii], carry);
+
+	return carry;
+}
+
+void cat::BigMultiply(u64 *r, const u64 *x, const u64 *y, int limbs)
+{
+	for (int ii = 0; ii < limbs; ++ii)
+		r[ii] = 0;
+
+	// One row of multiply-accumulate per limb of y
+	for (int ii = 0; ii < limbs; ++ii)
+		r[ii + limbs] = BigMulAdd(r + ii, x, y[ii], limbs);
+}
+
+int cat::BigCompare(const u64 *x, const u64 *y, int limbs)
+{
+	while (limbs-- > 0)
+	{
+		if (x[limbs] != y[limbs])
+			return x[limbs] < y[limbs] ? -1 : 1;
+	}
+
+	return 0;
+}
+
+
+//// Montgomery Arithmetic
+
+// r = t - m if t >= m, else t, where t has an extra top word
+// Runs in the same time either way
+static void FinalSubtract(u64 *r, const u64 *t, u64 t_top, const u64 *m, int limbs)
+{
+	u64 d[BIG_MAX_LIMBS];
+	u64 borrow = BigSub(d, t, m, limbs);
+
+	// Keep t only if the subtraction went negative
+	u64 keep = 0 - (u64)(borrow > t_top);
+
+	for (int ii = 0; ii < limbs; ++ii)
+		r[ii] = (t[ii] & keep) | (d[ii] & ~keep);
+}
+
+void cat::MontgomeryMultiply(u64 *r, const u64 *x, const u64 *y, const u64 *m, u64 m_inv, int limbs)
+{
+	CAT_DEBUG_ENFORCE(limbs > 0 && limbs <= BIG_MAX_LIMBS);
+
+	u64 t[BIG_MAX_LIMBS + 1] = { 0 };
+
+	// Interleave each row of the product with one step of reduction, so t
+	// stays at limbs + 1 words (CIOS)
+	for (int ii = 0; ii < limbs; ++ii)
+	{
+		u64 carry = 0;
+		for (int jj = 0; jj < limbs; ++jj)
+			t[jj] = u64_mac(x[jj], y[ii], t[jj], carry);
+
+		u128 top = u128_sum(t[limbs], carry);
+
+		// Add the multiple of m that clears the low word, and shift down
+		const u64 q = t[0] * m_inv;
+		carry = 0;
+		u64_mac(q, m[0], t[0], carry);
+
+		for (int jj = 1; jj < limbs; ++jj)
+			t[jj - 1] = u64_mac(q, m[jj], t[jj], carry);
+
+		u128_add(top, carry);
+		t[limbs - 1] = u128_low(top);
+		t[limbs] = u128_high(top);
+	}
+
+	FinalSubtract(r, t, t[limbs], m, limbs);
+}
+
+void cat::MontgomeryReduce(u64 *r, u64 *t, const u64 *m, u64 m_inv, int limbs)
+{
+	CAT_DEBUG_ENFORCE(limbs > 0 && limbs <= BIG_MAX_LIMBS);
+
+	u64 extra = 0;
+
+	for (int ii = 0; ii < limbs; ++ii)
+	{
+		// Clear word ii by adding a multiple of m
+		const u64 q = t[ii] * m_inv;
+		u64 carry = BigMulAdd(t + ii, m, q, limbs);
+
+		// Carry into the next word up, which the next row adds to again
+		u128 sum = u128_sum(t[ii + limbs], carry);
+		u128_add(sum, extra);
+		t[ii + limbs] = u128_low(sum);
+		extra = u128_high(sum);
+	}
+
+	FinalSubtract(r, t + limbs, extra, m, limbs);
+}
+
+bool Montgomery::Initialize(const u64 *modulus, int limbs)
+{
+	_limbs = 0;
+
+	// If the modulus is even or too wide,
+	if (limbs <= 0 || limbs > BIG_MAX_LIMBS || !(modulus[0] & 1))
+		return false;
+
+	for (int ii = 0; ii < limbs; ++ii)
+		_m[ii] = modulus[ii];
+
+	_m_inv = u64_mont_inverse(modulus[0]);
+
+	// R^2 mod m by doubling 1 until it reaches 2^(2 * 64 * limbs)
+	u64 *x = _r2;
+	x[0] = 1;
+	for (int ii = 1; ii < limbs; ++ii)
+		x[ii] = 0;
+
+	for (int bit = 0; bit < 128 * limbs; ++bit)
+	{
+		u64 top = BigAdd(x, x, x, limbs);
+		FinalSubtract(x, x, top, _m, limbs);
+	}
+
+	_limbs = limbs;
+	return true;
+}
+
+void Montgomery::FromMontgomery(u64 *r, const u64 *x)
+{
+	u64 t[2 * BIG_MAX_LIMBS];
+
+	for (int ii = 0; ii < _limbs; ++ii)
+	{
+		t[ii] = x[ii];
+		t[ii + _limbs] = 0;
+	}
+
+	MontgomeryReduce(r, t, _m, _m_inv, _limbs);
+}
@@ -155,6 +155,137 @@ CAT_INLINE void u128_clear_msb(u128 &r);
 #endif
 
 
+/*
+	Multiply-Accumulate
+
+	These build on u128_prod(), which compiles to a single MUL (or MULX
+	with BMI2) on x86-64, _umul128 on MSVC and MUL/UMULH on 64-bit ARM.
+	x * y + a + c never exceeds 128 bits, so one carry word is enough.
+*/
+
+// High 64 bits of x * y
+// With y = range and x a uniform hash, the result is uniform in [0, range)
+CAT_INLINE u64 u64_mulhi(const u64 x, const u64 y)
+{
+	return u128_high(u128_prod(x, y));
+}
+
+// Returns low 64 bits of x * y + a + carry, and sets carry to the high 64 bits
+CAT_INLINE u64 u64_mac(const u64 x, const u64 y, const u64 a, u64 &carry)
+{
+	u128 r = u128_prod_sum(x, y, a);
+	u128_add(r, carry);
+	carry = u128_high(r);
+	return u128_low(r);
+}
+
+// Returns -1 / m mod 2^64 for odd m, as used by Montgomery reduction
+CAT_INLINE u64 u64_mont_inverse(const u64 m)
+{
+	// Newton's method doubles the correct low bits each step, and
+	// m * m = 1 mod 8 gives the first 3 bits
+	u64 inv = m;
+	inv *= 2 - m * inv;
+	inv *= 2 - m * inv;
+	inv *= 2 - m * inv;
+	inv *= 2 - m * inv;
+	inv *= 2 - m * inv;
+	return 0 - inv;
+}
+
+// Returns x * y / 2^64 mod m in Montgomery form, for odd m and x, y < m
+// m_inv = u64_mont_inverse(m)
+CAT_INLINE u64 u64_mont_mul(const u64 x, const u64 y, const u64 m, const u64 m_inv)
+{
+	u128 t = u128_prod(x, y);
+	u64 q = u128_low(t) * m_inv;
+
+	// The low halves of t and q * m cancel, leaving only their carry
+	u128 s = u128_sum(u128_high(u128_prod(q, m)), u128_high(t));
+	u128_add(s, (u64)(u128_low(t) != 0));
+
+	// The sum is under 2m, so one subtraction reduces it
+	u128 d = u128_diff(s, m);
+	u64 keep = 0 - (u64)u128_is_neg(d);
+	return (u128_low(s) & keep) | (u128_low(d) & ~keep);
+}
+
+
+/*
+	Bignum Arrays
+
+	Numbers are little-endian arrays of 64-bit limbs.  Outputs may alias
+	inputs of the same length unless noted otherwise.
+*/
+
+// Largest modulus the Montgomery code accepts, in limbs (4096 bits)
+static const int BIG_MAX_LIMBS = 64;
+
+// r = x + y, returns carry out
+CAT_EXPORT u64 BigAdd(u64 *r, const u64 *x, const u64 *y, int limbs);
+
+// r = x - y, returns borrow out
+CAT_EXPORT u64 BigSub(u64 *r, const u64 *x, const u64 *y, int limbs);
+
+// r += x * y, returns carry out
+CAT_EXPORT u64 BigMulAdd(u64 *r, const u64 *x, u64 y, int limbs);
+
+// r[2 * limbs] = x * y, r must not alias x or y
+CAT_EXPORT void BigMultiply(u64 *r, const u64 *x, const u64 *y, int limbs);
+
+// Returns -1, 0 or 1 as x is less than, equal to or greater than y
+CAT_EXPORT int BigCompare(const u64 *x, const u64 *y, int limbs);
+
+
+/*
+	Montgomery Arithmetic
+
+	Multiplication modulo a fixed odd modulus without division.  Values are
+	kept in Montgomery form x * R mod m, where R = 2^(64 * limbs), and the
+	final subtraction is branch-free so timing does not depend on the data.
+*/
+
+// r = x * y / R mod m, for x, y < m
+// m_inv = u64_mont_inverse(m[0])
+CAT_EXPORT void MontgomeryMultiply(u64 *r, const u64 *x, const u64 *y, const u64 *m, u64 m_inv, int limbs);
+
+// r = t / R mod m, for t[2 * limbs] < m * R
+// t is overwritten, and r must not alias t
+CAT_EXPORT void MontgomeryReduce(u64 *r, u64 *t, const u64 *m, u64 m_inv, int limbs);
+
+class CAT_EXPORT Montgomery
+{
+	u64 _m[BIG_MAX_LIMBS];
+	u64 _r2[BIG_MAX_LIMBS];
+	u64 _m_inv;
+	int _limbs;
+
+public:
+	CAT_INLINE Montgomery() { _limbs = 0; }
+
+	// Returns false if the modulus is even or wider than BIG_MAX_LIMBS
+	bool Initialize(const u64 *modulus, int limbs);
+
+	CAT_INLINE int GetLimbs() { return _limbs; }
+	CAT_INLINE const u64 *GetModulus() { return _m; }
+
+	// r = x * R mod m, for x < m
+	CAT_INLINE void ToMontgomery(u64 *r, const u64 *x)
+	{
+		MontgomeryMultiply(r, x, _r2, _m, _m_inv, _limbs);
+	}
+
+	// r = x / R mod m
+	void FromMontgomery(u64 *r, const u64 *x);
+
+	// r = x * y in Montgomery form
+	CAT_INLINE void Multiply(u64 *r, const u64 *x, const u64 *y)
+	{
+		MontgomeryMultiply(r, x, y, _m, _m_inv, _limbs);
+	}
+};
+
+
 } // namespace cat
 
 #endif // CAT_BIG_MATH_HPP
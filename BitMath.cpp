@@ -27,8 +27,18 @@
 */
 
 #include "BitMath.hpp"
+#include "CPUFeatures.hpp"
 using namespace cat;
 
+// SSE2 is always there on x86-64, and the AVX2 and POPCNT kernels are picked
+// at run time from the CPU features
+#if defined(CAT_X86_DISPATCH)
+# define CAT_BITMATH_X86_DISPATCH
+# include <immintrin.h>
+#elif defined(CAT_HAS_SSE2)
+# include <emmintrin.h>
+#endif
+
 // Used by BSF32 if BitScanForward opcode is not available
 const int cat::MultiplyDeBruijnBitPosition2[32] = 
 {
@@ -47,3 +57,227 @@ const u8 cat::BIT_COUNT_TABLE[256] = {
 #undef B4
 #undef B6
 
+
+//// Bulk Counter Reconstruction
+
+/*
+	ReconstructCounter() is "((center & ~mask) | partial) + ahead - back"
+	where ahead and back are each 0 or msb and come from 32-bit lane math.
+	The 64-bit version computes them in 32-bit lanes and zero-extends them,
+	since msb = 2^31 does not fit a signed 32-bit adjustment.
+*/
+
+#if defined(CAT_HAS_SSE2)
+
+static CAT_INLINE __m128i AdjustSSE2(__m128i p, __m128i lo, __m128i msb, __m128i mask, __m128i half)
+{
+	__m128i diff = _mm_sub_epi32(p, lo);
+	__m128i back = _mm_and_si128(_mm_sub_epi32(half, _mm_and_si128(diff, mask)), msb);
+	return _mm_sub_epi32(_mm_and_si128(diff, msb), back);
+}
+
+static int Reconstruct32SSE2(u32 bits, u32 center_count, const u32 *partials, u32 *counters, int count)
+{
+	const u32 iv_msb = 1 << bits;
+	const __m128i msb = _mm_set1_epi32(iv_msb);
+	const __m128i mask = _mm_set1_epi32(iv_msb - 1);
+	const __m128i half = _mm_set1_epi32(iv_msb >> 1);
+	const __m128i lo = _mm_set1_epi32(center_count & (iv_msb - 1));
+	const __m128i hi = _mm_set1_epi32(center_count & ~(iv_msb - 1));
+
+	int ii = 0;
+	for (; ii + 4 <= count; ii += 4)
+	{
+		__m128i p = _mm_loadu_si128((const __m128i *)(partials + ii));
+		__m128i r = _mm_add_epi32(_mm_or_si128(hi, p), AdjustSSE2(p, lo, msb, mask, half));
+		_mm_storeu_si128((__m128i *)(counters + ii), r);
+	}
+
+	return ii;
+}
+
+#endif // CAT_HAS_SSE2
+
+#if defined(CAT_BITMATH_X86_DISPATCH)
+
+CAT_TARGET_AVX2 static int Reconstruct32AVX2(u32 bits, u32 center_count, const u32 *partials, u32 *counters, int count)
+{
+	const u32 iv_msb = 1 << bits;
+	const __m256i msb = _mm256_set1_epi32(iv_msb);
+	const __m256i mask = _mm256_set1_epi32(iv_msb - 1);
+	const __m256i half = _mm256_set1_epi32(iv_msb >> 1);
+	const __m256i lo = _mm256_set1_epi32(center_count & (iv_msb - 1));
+	const __m256i hi = _mm256_set1_epi32(center_count & ~(iv_msb - 1));
+
+	int ii = 0;
+	for (; ii + 8 <= count; ii += 8)
+	{
+		__m256i p = _mm256_loadu_si256((const __m256i *)(partials + ii));
+		__m256i diff = _mm256_sub_epi32(p, lo);
+		__m256i back = _mm256_and_si256(_mm256_sub_epi32(half, _mm256_and_si256(diff, mask)), msb);
+		__m256i adjust = _mm256_sub_epi32(_mm256_and_si256(diff, msb), back);
+		__m256i r = _mm256_add_epi32(_mm256_or_si256(hi, p), adjust);
+		_mm256_storeu_si256((__m256i *)(counters + ii), r);
+	}
+
+	return ii;
+}
+
+CAT_TARGET_AVX2 static int Reconstruct64AVX2(u32 bits, u64 center_count, const u32 *partials, u64 *counters, int count)
+{
+	const u32 iv_msb = 1 << bits;
+	const __m128i msb = _mm_set1_epi32(iv_msb);
+	const __m128i mask = _mm_set1_epi32(iv_msb - 1);
+	const __m128i half = _mm_set1_epi32(iv_msb >> 1);
+	const __m128i lo = _mm_set1_epi32((u32)center_count & (iv_msb - 1));
+	const __m256i hi = _mm256_set1_epi64x(center_count & ~(u64)(iv_msb - 1));
+
+	int ii = 0;
+	for (; ii + 4 <= count; ii += 4)
+	{
+		__m128i p = _mm_loadu_si128((const __m128i *)(partials + ii));
+		__m128i diff = _mm_sub_epi32(p, lo);
+		__m128i back = _mm_and_si128(_mm_sub_epi32(half, _mm_and_si128(diff, mask)), msb);
+		__m256i r = _mm256_or_si256(hi, _mm256_cvtepu32_epi64(p));
+		r = _mm256_add_epi64(r, _mm256_cvtepu32_epi64(_mm_and_si128(diff, msb)));
+		r = _mm256_sub_epi64(r, _mm256_cvtepu32_epi64(back));
+		_mm256_storeu_si256((__m256i *)(counters + ii), r);
+	}
+
+	return ii;
+}
+
+#endif // CAT_BITMATH_X86_DISPATCH
+
+void cat::ReconstructCounters(u32 bits, u32 center_count, const u32 *partials, u32 *counters, int count)
+{
+	int ii = 0;
+
+#if defined(CAT_BITMATH_X86_DISPATCH)
+	if (HasCPUFeatures(CPU_AVX2))
+		ii = Reconstruct32AVX2(bits, center_count, partials, counters, count);
+	else
+#endif
+#if defined(CAT_HAS_SSE2)
+		ii = Reconstruct32SSE2(bits, center_count, partials, counters, count);
+#endif
+
+	for (; ii < count; ++ii)
+		counters[ii] = ReconstructCounter(bits, center_count, partials[ii]);
+}
+
+void cat::ReconstructCounters(u32 bits, u64 center_count, const u32 *partials, u64 *counters, int count)
+{
+	int ii = 0;
+
+#if defined(CAT_BITMATH_X86_DISPATCH)
+	if (HasCPUFeatures(CPU_AVX2))
+		ii = Reconstruct64AVX2(bits, center_count, partials, counters, count);
+#endif
+
+	for (; ii < count; ++ii)
+		counters[ii] = ReconstructCounter(bits, center_count, partials[ii]);
+}
+
+
+//// Bitmaps
+
+#if defined(CAT_BITMATH_X86_DISPATCH) && defined(CAT_WORD_64)
+
+CAT_TARGET_POPCNT static u32 BitmapCountPOPCNT(const u64 *words, int count)
+{
+	// Four sums keep the POPCNT units busy
+	u64 a = 0, b = 0, c = 0, d = 0;
+
+	int ii = 0;
+	for (; ii + 4 <= count; ii += 4)
+	{
+		a += _mm_popcnt_u64(words[ii]);
+		b += _mm_popcnt_u64(words[ii + 1]);
+		c += _mm_popcnt_u64(words[ii + 2]);
+		d += _mm_popcnt_u64(words[ii + 3]);
+	}
+
+	for (; ii < count; ++ii)
+		a += _mm_popcnt_u64(words[ii]);
+
+	return (u32)(a + b + c + d);
+}
+
+#endif
+
+u32 cat::BitmapCount(const u64 *words, int count)
+{
+#if defined(CAT_BITMATH_X86_DISPATCH) && defined(CAT_WORD_64)
+	if (HasCPUFeatures(CPU_POPCNT))
+		return BitmapCountPOPCNT(words, count);
+#endif
+
+	u32 sum = 0;
+
+	for (int ii = 0; ii < count; ++ii)
+		sum += (u32)BitCount(words[ii]);
+
+	return sum;
+}
+
+// Shared by the first set/clear searches: flip = 0 to find ones, ~0 for zeros
+static int BitmapFirst(const u64 *words, int count, int start_bit, u64 flip)
+{
+	if (start_bit < 0)
+		start_bit = 0;
+
+	int ii = start_bit >> 6;
+	if (ii >= count)
+		return -1;
+
+	// Mask off bits before the start in the first word
+	u64 w = (words[ii] ^ flip) & ((u64)~(u64)0 << (start_bit & 63));
+
+	while (!w)
+	{
+		++ii;
+
+		// Skip runs of empty words four at a time
+		while (ii + 4 <= count &&
+			   ((words[ii] ^ flip) | (words[ii + 1] ^ flip) |
+				(words[ii + 2] ^ flip) | (words[ii + 3] ^ flip)) == 0)
+		{
+			ii += 4;
+		}
+
+		if (ii >= count)
+			return -1;
+
+		w = words[ii] ^ flip;
+	}
+
+	return (ii << 6) + (int)BSF64(w);
+}
+
+int cat::BitmapFirstSet(const u64 *words, int count, int start_bit)
+{
+	return BitmapFirst(words, count, start_bit, 0);
+}
+
+int cat::BitmapFirstClear(const u64 *words, int count, int start_bit)
+{
+	return BitmapFirst(words, count, start_bit, ~(u64)0);
+}
+
+int cat::BitmapLastSet(const u64 *words, int count)
+{
+	int ii = count - 1;
+
+	// Skip runs of empty words four at a time
+	while (ii >= 3 && (words[ii] | words[ii - 1] | words[ii - 2] | words[ii - 3]) == 0)
+		ii -= 4;
+
+	for (; ii >= 0; --ii)
+	{
+		if (words[ii])
+			return (ii << 6) + (int)BSR64(words[ii]);
+	}
+
+	return -1;
+}
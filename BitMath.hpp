@@ -131,6 +131,24 @@ template<int BITS, typename T> CAT_INLINE T BiasedReconstructCounter(T now, u32
 	return ReconstructCounter<BITS>(now - IV_OFFSET + future_tolerance, partial_low_bits);
 }
 
+/*
+	Bulk versions for a batch of received packets, which all share the same
+	center.  counters[i] is ReconstructCounter(bits, center_count, partials[i])
+	and partials must already be masked to the low bits.  bits < 32
+
+	These use SSE2 or AVX2 where available.  counters may alias partials for
+	the 32-bit version.
+*/
+void ReconstructCounters(u32 bits, u32 center_count, const u32 *partials, u32 *counters, int count);
+void ReconstructCounters(u32 bits, u64 center_count, const u32 *partials, u64 *counters, int count);
+
+template<typename T> CAT_INLINE void BiasedReconstructCounters(u32 bits, T now, u32 future_tolerance, const u32 *partials, T *counters, int count)
+{
+	u32 iv_offset = 1 << (bits - 1); // bits < 32
+
+	ReconstructCounters(bits, (T)(now - iv_offset + future_tolerance), partials, counters, count);
+}
+
 
 // Bit Scan Forward (BSF)
 // Scans from bit 0 to MSB, returns index 0-31 of the first set bit found
@@ -429,6 +447,25 @@ CAT_INLINE u64 NextHighestPow2(u64 n)
 }
 
 
+/*
+	Bitmaps stored as arrays of 64-bit words, where bit i is bit i % 64 of
+	word i / 64, as for ACK vectors.  The searches skip four empty words at
+	a time, and return -1 when no bit is found.
+*/
+
+// Returns the number of bits set, using POPCNT when the CPU has it
+u32 BitmapCount(const u64 *words, int count);
+
+// Returns the index of the first set bit at or after start_bit
+int BitmapFirstSet(const u64 *words, int count, int start_bit = 0);
+
+// Returns the index of the first clear bit at or after start_bit
+int BitmapFirstClear(const u64 *words, int count, int start_bit = 0);
+
+// Returns the index of the last set bit
+int BitmapLastSet(const u64 *words, int count);
+
+
 } // namespace cat
 
 #endif // CAT_BITMATH_HPP
@@ -0,0 +1,152 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "CPUFeatures.hpp"
+using namespace cat;
+
+#if defined(CAT_ISA_X86)
+# if defined(CAT_COMPILER_MSVC)
+#  include <intrin.h>
+#  include <immintrin.h> // _xgetbv
+# elif defined(CAT_COMPILER_GCC)
+#  include <cpuid.h>
+# endif
+#endif
+
+
+//// Detection
+
+#if defined(CAT_ISA_X86) && (defined(CAT_COMPILER_MSVC) || defined(CAT_COMPILER_GCC))
+
+static void CPUID(u32 *regs, u32 leaf, u32 subleaf)
+{
+#if defined(CAT_COMPILER_MSVC)
+	__cpuidex((int*)regs, (int)leaf, (int)subleaf);
+#else
+	__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static u64 XGETBV()
+{
+#if defined(CAT_COMPILER_MSVC)
+	return _xgetbv(0);
+#else
+	u32 lo, hi;
+	__asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0" : "=a" (lo), "=d" (hi) : "c" (0)); // xgetbv
+	return ((u64)hi << 32) | lo;
+#endif
+}
+
+#endif
+
+static u32 DetectCPUFeatures()
+{
+	u32 features = 0;
+
+#if defined(CAT_ISA_X86) && (defined(CAT_COMPILER_MSVC) || defined(CAT_COMPILER_GCC))
+
+	u32 regs[4];
+
+	CPUID(regs, 0, 0);
+	u32 max_leaf = regs[0];
+
+	if (max_leaf >= 1)
+	{
+		CPUID(regs, 1, 0);
+		u32 ecx = regs[2], edx = regs[3];
+
+		if (edx & (1 << 26)) features |= CPU_SSE2;
+		if (ecx & (1 << 9)) features |= CPU_SSSE3;
+		if (ecx & (1 << 19)) features |= CPU_SSE41;
+		if (ecx & (1 << 20)) features |= CPU_SSE42;
+		if (ecx & (1 << 23)) features |= CPU_POPCNT;
+		if (ecx & (1 << 1)) features |= CPU_PCLMUL;
+		if (ecx & (1 << 25)) features |= CPU_AESNI;
+
+		u32 ebx7 = 0;
+		if (max_leaf >= 7)
+		{
+			CPUID(regs, 7, 0);
+			ebx7 = regs[1];
+		}
+
+		if (ebx7 & (1 << 8)) features |= CPU_BMI2;
+
+		// If OSXSAVE and AVX, so the OS state can be checked,
+		if ((ecx & 0x18000000) == 0x18000000)
+		{
+			u64 xcr0 = XGETBV();
+
+			// If the OS saves XMM and YMM state,
+			if ((xcr0 & 6) == 6)
+			{
+				features |= CPU_AVX;
+
+				if (ebx7 & (1 << 5)) features |= CPU_AVX2;
+
+				// If the OS also saves opmask and ZMM state,
+				if ((xcr0 & 0xe0) == 0xe0 && (ebx7 & (1 << 16)))
+				{
+					features |= CPU_AVX512F;
+
+					if (ebx7 & (1 << 30)) features |= CPU_AVX512BW;
+				}
+			}
+		}
+	}
+
+#elif defined(CAT_HAS_NEON)
+
+	// The compiler is already emitting NEON unconditionally, and AArch64 always has it
+	features |= CPU_NEON;
+
+#endif
+
+	return features;
+}
+
+
+//// GetCPUFeatures
+
+// Set high bit marks the flags as detected
+static const u32 FEATURES_DETECTED = 0x80000000;
+static volatile u32 m_features = 0;
+
+u32 cat::GetCPUFeatures()
+{
+	u32 features = m_features;
+
+	if (!features)
+	{
+		features = DetectCPUFeatures() | FEATURES_DETECTED;
+		m_features = features;
+	}
+
+	return features & ~FEATURES_DETECTED;
+}
@@ -0,0 +1,128 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_CPU_FEATURES_HPP
+#define CAT_CPU_FEATURES_HPP
+
+#include "Platform.hpp"
+
+/*
+	Run-time CPU feature dispatch
+
+	Kernels are built for several instruction sets in one binary and pick
+	one the first time they are called:
+
+		CAT_TARGET_AVX2 static void XorAVX2(...) { ... }
+
+		static XorFunc DetectXor()
+		{
+			return HasCPUFeatures(CPU_AVX2) ? XorAVX2 : XorGeneric;
+		}
+
+		static XorFunc m_xor = 0;
+
+		BindKernel(m_xor, DetectXor)(...);
+
+	Detection runs once per process and is shared by every kernel, and
+	SystemInfo reports the same flags.  The CAT_TARGET_* macros are defined
+	when CAT_X86_DISPATCH is, and let the compiler emit those instructions
+	in one function without enabling them for the whole build.  Files that
+	use them include <immintrin.h> themselves.
+*/
+
+#if defined(CAT_ISA_X86) && (defined(CAT_COMPILER_GCC) || (defined(CAT_COMPILER_MSVC) && _MSC_VER >= 1910))
+# define CAT_X86_DISPATCH
+# if defined(CAT_COMPILER_MSVC)
+#  define CAT_TARGET_SSSE3
+#  define CAT_TARGET_POPCNT
+#  define CAT_TARGET_AVX2
+#  define CAT_TARGET_AVX512F
+#  define CAT_TARGET_AVX512
+# else
+#  define CAT_TARGET_SSSE3 __attribute__((target("ssse3")))
+#  define CAT_TARGET_POPCNT __attribute__((target("popcnt")))
+#  define CAT_TARGET_AVX2 __attribute__((target("avx2")))
+#  define CAT_TARGET_AVX512F __attribute__((target("avx512f")))
+#  define CAT_TARGET_AVX512 __attribute__((target("avx512f,avx512bw")))
+# endif
+#endif
+
+namespace cat {
+
+
+// CPU features that kernels can dispatch on at run time
+enum CPUFeatures
+{
+	CPU_SSE2 = 1 << 0,
+	CPU_SSSE3 = 1 << 1,
+	CPU_SSE41 = 1 << 2,
+	CPU_SSE42 = 1 << 3,
+	CPU_POPCNT = 1 << 4,
+	CPU_PCLMUL = 1 << 5,
+	CPU_AESNI = 1 << 6,
+	CPU_AVX = 1 << 7,		// Includes OS support for YMM state
+	CPU_AVX2 = 1 << 8,
+	CPU_BMI2 = 1 << 9,
+	CPU_AVX512F = 1 << 10,	// Includes OS support for ZMM state
+	CPU_AVX512BW = 1 << 11,
+	CPU_NEON = 1 << 12
+};
+
+// Returns the CPUFeatures supported by both the processor and the OS
+// Detected on the first call; racing first calls all compute the same value
+CAT_EXPORT u32 GetCPUFeatures();
+
+// Returns true if all of the CPUFeatures flags given are supported
+CAT_INLINE bool HasCPUFeatures(u32 features)
+{
+	return (GetCPUFeatures() & features) == features;
+}
+
+// Returns the kernel cached in slot, filling it from detect on first use.
+// Works for any pointer, such as a function or a table of them.  Racing
+// first calls all store the same pointer, so no lock is needed, and slot
+// is only ever seen as 0 or as that pointer.  If detect returns 0 it is
+// asked again next time, which costs only the cached feature test
+template<typename Kernel>
+CAT_INLINE Kernel BindKernel(Kernel volatile &slot, Kernel (*detect)())
+{
+	Kernel kernel = slot;
+
+	if (!kernel)
+	{
+		kernel = detect();
+		slot = kernel;
+	}
+
+	return kernel;
+}
+
+
+} // namespace cat
+
+#endif // CAT_CPU_FEATURES_HPP
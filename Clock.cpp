@@ -27,6 +27,8 @@
 */
 
 #include "Clock.hpp"
+#include "Atomic.hpp"
+#include "Thread.hpp"
 using namespace cat;
 
 #if defined(CAT_OS_WINDOWS)
@@ -54,7 +56,16 @@ using namespace cat;
 # include <mach/mach_time.h>
 #endif
 
+#if defined(CAT_ISA_X86)
+# if defined(CAT_COMPILER_MSVC)
+#  include <intrin.h>
+# elif defined(CAT_COMPILER_GCC)
+#  include <cpuid.h>
+# endif
+#endif
+
 #include <ctime>
+#include <new>
 using namespace std;
 
 
@@ -76,6 +87,17 @@ bool Clock::OnInitialize()
 	QueryPerformanceFrequency(&freq);
 	_inv_freq = 1.0 / static_cast<double>(freq.QuadPart);
 
+#endif
+
+	// If the tick counter cannot be used, nsec() falls back to the OS clock
+	_tsc_enabled = CalibrateTicks();
+
+	_ticker = 0;
+	_cached_version = 0;
+#if defined(CAT_WORD_64)
+	_cached_msec = 0;
+#else
+	_cached_msec_lo = _cached_msec_hi = 0;
 #endif
 
 	return true;
@@ -83,6 +105,8 @@ bool Clock::OnInitialize()
 
 void Clock::OnFinalize()
 {
+	StopTicker();
+
 #if defined(CAT_OS_WINDOWS)
 
 	if (_period <= LOWEST_ACCEPTABLE_PERIOD) timeEndPeriod(_period);
@@ -198,6 +222,413 @@ double Clock::usec()
 }
 
 
+//// Tick counter
+
+// Reference clock for calibration, and nsec() when ticks cannot be used
+static u64 MonotonicNsec()
+{
+#if defined(CAT_OS_WINDOWS)
+
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+
+	u64 f = freq.QuadPart, t = now.QuadPart;
+
+	return (t / f) * 1000000000 + (t % f) * 1000000000 / f;
+
+#elif defined(CAT_OS_OSX)
+
+	static mach_timebase_info_data_t timebase;
+	if (timebase.denom == 0) mach_timebase_info(&timebase);
+
+	u64 t = mach_absolute_time();
+
+	return (t / timebase.denom) * timebase.numer + (t % timebase.denom) * timebase.numer / timebase.denom;
+
+#else
+
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (u64)now.tv_sec * 1000000000 + now.tv_nsec;
+
+#endif
+}
+
+// Returns true if ticks() counts at a constant rate on all cores and
+// through power states.  Sets hz if the rate is known without measuring
+static bool TicksInvariant(u64 &hz)
+{
+	hz = 0;
+
+#if defined(CAT_ISA_X86) && defined(CAT_COMPILER_MSVC)
+
+	int regs[4];
+
+	__cpuid(regs, 0x80000000);
+	if ((u32)regs[0] < 0x80000007) return false;
+
+	__cpuid(regs, 0x80000007);
+	return (regs[3] & (1 << 8)) != 0;
+
+#elif defined(CAT_ISA_X86) && defined(CAT_COMPILER_GCC)
+
+	u32 a, b, c, d;
+
+	if (!__get_cpuid(0x80000007, &a, &b, &c, &d)) return false;
+	return (d & (1 << 8)) != 0;
+
+#elif defined(__aarch64__) && defined(CAT_ASM_ATT)
+
+	// The virtual counter always runs at the rate given by the system
+	CAT_ASM_BEGIN_VOLATILE "mrs %0, cntfrq_el0" : "=r"(hz) CAT_ASM_END
+
+	return hz != 0;
+
+#else
+
+	return false;
+
+#endif
+}
+
+u64 Clock::ticks()
+{
+#if defined(CAT_ISA_X86) && defined(CAT_COMPILER_MSVC)
+
+	return __rdtsc();
+
+#elif defined(CAT_ISA_X86) && defined(CAT_ASM_ATT)
+
+	u32 lo, hi;
+
+	CAT_ASM_BEGIN_VOLATILE
+		"rdtsc" : "=a"(lo), "=d"(hi)
+	CAT_ASM_END
+
+	return ((u64)hi << 32) | lo;
+
+#elif defined(__aarch64__) && defined(CAT_ASM_ATT)
+
+	u64 t;
+
+	// Keep the read from being hoisted above earlier instructions
+	CAT_ASM_BEGIN_VOLATILE
+		"isb\n\t"
+		"mrs %0, cntvct_el0" : "=r"(t) : : "memory"
+	CAT_ASM_END
+
+	return t;
+
+#else
+
+	return MonotonicNsec();
+
+#endif
+}
+
+// Read both clocks at nearly the same moment, keeping the tightest of a
+// few tries so that an interrupt between the reads does not skew them
+static void SampleClocks(u64 &t, u64 &n)
+{
+	u64 best = ~(u64)0;
+
+	for (int ii = 0; ii < 5; ++ii)
+	{
+		u64 a = Clock::ticks();
+		u64 m = MonotonicNsec();
+		u64 b = Clock::ticks();
+
+		if (b - a < best)
+		{
+			best = b - a;
+			t = a + best / 2;
+			n = m;
+		}
+	}
+}
+
+// Scale ticks by a 32.32 fixed-point rate.  Both are split into 32-bit
+// halves so no partial product overflows, even for a rate of 2^32 or more
+// (counters slower than 1 GHz).  The partial sums wrap only if the result
+// itself does not fit in 64 bits
+static CAT_INLINE u64 ScaleTicks(u64 ticks, u64 mult)
+{
+	u64 t_lo = ticks & 0xffffffff, t_hi = ticks >> 32;
+	u64 m_lo = mult & 0xffffffff, m_hi = mult >> 32;
+
+	return ((t_hi * m_hi) << 32) + t_hi * m_lo + t_lo * m_hi + ((t_lo * m_lo) >> 32);
+}
+
+bool Clock::CalibrateTicks()
+{
+	_tsc_version = 0;
+	_tsc_lock = 0;
+
+	u64 hz;
+	if (!TicksInvariant(hz)) return false;
+
+	u64 t0, n0;
+	SampleClocks(t0, n0);
+
+	u64 t1 = t0, n1 = n0;
+
+	// If the rate is unknown, measure it against the OS clock for a few
+	// milliseconds.  Recalibration refines it over a longer window later
+	if (hz == 0)
+	{
+		do SampleClocks(t1, n1);
+		while (n1 - n0 < 2000000);
+
+		if (t1 <= t0) return false;
+
+		hz = (u64)((double)(t1 - t0) * 1000000000.0 / (double)(n1 - n0));
+	}
+
+	// Reject rates that are clearly wrong: under 1 MHz or over 100 GHz
+	if (hz < 1000000 || hz > 100000000000ULL) return false;
+
+	_tsc_cal_ticks = t0;
+	_tsc_cal_nsec = n0;
+	_tsc_base_ticks = t1;
+	_tsc_base_nsec = n1;
+	_tsc_mult = (u64)(4294967296.0 * 1000000000.0 / (double)hz);
+	_tsc_recal_ticks = hz / 1000 * RECALIBRATE_MSEC;
+
+	return true;
+}
+
+void Clock::RecalibrateTicks()
+{
+	// If another thread is already recalibrating,
+	if (Atomic::Set(&_tsc_lock, 1)) return;
+
+	u64 t, n;
+	SampleClocks(t, n);
+
+	u64 base_ticks = _tsc_base_ticks;
+
+	// If it was already done after our caller read the tick counter,
+	if (t - base_ticks < _tsc_recal_ticks)
+	{
+		Atomic::Set(&_tsc_lock, 0);
+		return;
+	}
+
+	// Continue from where the current conversion is now, so time never goes back
+	u64 base_nsec = _tsc_base_nsec + ScaleTicks(t - base_ticks, _tsc_mult);
+
+	// Rate over the whole time since calibration
+	double mult = 4294967296.0 * (double)(n - _tsc_cal_nsec) / (double)(t - _tsc_cal_ticks);
+
+	// If behind the OS clock, catch up at once
+	if (n > base_nsec) base_nsec = n;
+
+	// If ahead, slow down to meet it over the next interval, by at most 500 ppm
+	double error = ((double)n - (double)base_nsec) / (double)_tsc_recal_ticks * 4294967296.0;
+	double limit = mult * 0.0005;
+	if (error < -limit) error = -limit;
+
+	Atomic::Add(&_tsc_version, 1);
+	Atomic::StoreMemoryBarrier();
+
+	_tsc_base_ticks = t;
+	_tsc_base_nsec = base_nsec;
+	_tsc_mult = (u64)(mult + error);
+
+	Atomic::StoreMemoryBarrier();
+	Atomic::Add(&_tsc_version, 1);
+
+	Atomic::Set(&_tsc_lock, 0);
+}
+
+// x86 keeps loads in order, so the sequence lock only needs the compiler
+// to keep them in order.  This also leaves the tick counter read unfenced
+#if defined(CAT_ISA_X86)
+# define CAT_CLOCK_LOAD_BARRIER() CAT_FENCE_COMPILER
+#else
+# define CAT_CLOCK_LOAD_BARRIER() Atomic::LoadMemoryBarrier()
+#endif
+
+u64 Clock::nsec()
+{
+	if (!_tsc_enabled) return MonotonicNsec();
+
+	u64 t, base_ticks, base_nsec, mult;
+	u32 version;
+
+	do
+	{
+		version = _tsc_version;
+		CAT_CLOCK_LOAD_BARRIER();
+
+		base_ticks = _tsc_base_ticks;
+		base_nsec = _tsc_base_nsec;
+		mult = _tsc_mult;
+		t = ticks();
+
+		CAT_CLOCK_LOAD_BARRIER();
+	} while ((version & 1) || version != _tsc_version);
+
+	// Another core may have rebased just past our reading
+	if (t < base_ticks) return base_nsec;
+
+	u64 elapsed = t - base_ticks;
+
+	if (CAT_UNLIKELY(elapsed >= _tsc_recal_ticks))
+		RecalibrateTicks();
+
+	return base_nsec + ScaleTicks(elapsed, mult);
+}
+
+
+//// ClockTicker
+
+class cat::ClockTicker : public Thread
+{
+	Clock *_clock;
+	u32 _interval;
+	volatile bool _stop;
+
+	bool Entrypoint(void *param)
+	{
+		while (!_stop)
+		{
+			Clock::sleep(_interval);
+
+			// This also keeps nsec() recalibrated when nothing else calls it
+			_clock->UpdateCachedMsec();
+		}
+
+		return true;
+	}
+
+public:
+	ClockTicker(Clock *clock, u32 interval_msec)
+	{
+		_clock = clock;
+		_interval = interval_msec > 0 ? interval_msec : 1;
+		_stop = false;
+	}
+
+	void Stop()
+	{
+		_stop = true;
+
+		WaitForThread();
+	}
+};
+
+// Raises the cached time to now.  Writers serialize on the version, so
+// the ticker and threads reading without it never move it back
+void Clock::AdvanceCachedMsec(u64 now)
+{
+	u32 version;
+
+	do version = _cached_version;
+	while ((version & 1) || !Atomic::CAS(&_cached_version, version, version + 1));
+
+#if defined(CAT_WORD_64)
+
+	if (now > _cached_msec)
+		_cached_msec = now;
+
+#else
+
+	if (now > (((u64)_cached_msec_hi << 32) | _cached_msec_lo))
+	{
+		_cached_msec_lo = (u32)now;
+		_cached_msec_hi = (u32)(now >> 32);
+	}
+
+#endif
+
+	Atomic::StoreMemoryBarrier();
+	_cached_version = version + 2;
+}
+
+void Clock::UpdateCachedMsec()
+{
+	AdvanceCachedMsec(nsec() / 1000000);
+}
+
+u64 Clock::ReadCachedMsec()
+{
+#if defined(CAT_WORD_64)
+
+	return _cached_msec;
+
+#else
+
+	u32 version, lo, hi;
+
+	do
+	{
+		version = _cached_version;
+		CAT_CLOCK_LOAD_BARRIER();
+
+		lo = _cached_msec_lo;
+		hi = _cached_msec_hi;
+
+		CAT_CLOCK_LOAD_BARRIER();
+	} while ((version & 1) || version != _cached_version);
+
+	return ((u64)hi << 32) | lo;
+
+#endif
+}
+
+// Without the ticker, raise the cached time as well, so that it stays at
+// or past anything returned here once the ticker starts
+u64 Clock::FallbackMsec()
+{
+	u64 now = nsec() / 1000000;
+	u64 cached = ReadCachedMsec();
+
+	// Another thread may have seen a later time already
+	if (now <= cached) return cached;
+
+	AdvanceCachedMsec(now);
+	return now;
+}
+
+bool Clock::StartTicker(u32 interval_msec)
+{
+	if (_ticker) return true;
+
+	// Readers see a current value as soon as they see the ticker
+	UpdateCachedMsec();
+
+	ClockTicker *ticker = new (std::nothrow) ClockTicker(this, interval_msec);
+	if (!ticker) return false;
+
+	if (!ticker->StartThread())
+	{
+		delete ticker;
+		return false;
+	}
+
+	Atomic::StoreMemoryBarrier();
+	_ticker = ticker;
+
+	return true;
+}
+
+void Clock::StopTicker()
+{
+	ClockTicker *ticker = _ticker;
+	if (!ticker) return;
+
+	// Readers go back to nsec() before the ticker stops
+	_ticker = 0;
+
+	ticker->Stop();
+	delete ticker;
+}
+
+
 void Clock::sleep(u32 milliseconds)
 {
 #if defined(CAT_OS_WINDOWS)
@@ -208,7 +639,7 @@ void Clock::sleep(u32 milliseconds)
 
 	struct timespec ts;
 	ts.tv_sec = milliseconds / 1000;
-	ts.tv_nsec = milliseconds * 1000000 - ts.tv_sec * 1000;
+	ts.tv_nsec = (milliseconds % 1000) * 1000000;
 	while (nanosleep(&ts, &ts) == -1);
 
 #endif
@@ -32,6 +32,7 @@
 //#define CAT_CLOCK_EXTRA
 
 #include "Platform.hpp"
+#include "Atomic.hpp"
 
 #ifdef CAT_CLOCK_EXTRA
 #include <string>
@@ -40,6 +41,8 @@
 namespace cat {
 
 
+class ClockTicker;
+
 class CAT_EXPORT Clock
 {
 #ifdef CAT_OS_WINDOWS
@@ -50,15 +53,78 @@ class CAT_EXPORT Clock
 	double _inv_freq;	// Performance counter frequency (does not change, so cache it)
 #endif
 
+	// Tick counter to nanosecond conversion for nsec(), guarded by a
+	// sequence lock that is odd while a recalibration is publishing
+	static const u32 RECALIBRATE_MSEC = 1000;
+
+	volatile u32 _tsc_version;
+	volatile u32 _tsc_lock;		// Held by the thread recalibrating
+	bool _tsc_enabled;			// Tick counter is invariant and calibrated
+	u64 _tsc_base_ticks;		// Conversion is continuous from this point
+	u64 _tsc_base_nsec;
+	u64 _tsc_mult;				// Nanoseconds per tick in 32.32 fixed-point
+	u64 _tsc_recal_ticks;		// Ticks between recalibrations
+	u64 _tsc_cal_ticks;			// First calibration point, so the
+	u64 _tsc_cal_nsec;			// measured rate improves over time
+
+	bool CalibrateTicks();
+	void RecalibrateTicks();
+
+	// Cached time in milliseconds.  It only moves forward, and is also the
+	// floor for msec_cached() while the ticker is stopped
+	friend class ClockTicker;
+
+	ClockTicker * volatile _ticker;
+	volatile u32 _cached_version;	// Odd while a writer holds it
+#if defined(CAT_WORD_64)
+	volatile u64 _cached_msec;	// Naturally aligned, so a plain load is atomic
+#else
+	volatile u32 _cached_msec_lo, _cached_msec_hi;
+#endif
+
+	u64 ReadCachedMsec();
+	void AdvanceCachedMsec(u64 now);
+	void UpdateCachedMsec();
+	u64 FallbackMsec();
+
 public:
 	bool OnInitialize();
 	void OnFinalize();
 
 	static u32 sec();						// Timestamp in seconds
     u32 msec_fast();						// Timestamp in milliseconds, less accurate than msec() but faster
+
+	// Start a background thread that refreshes msec_cached() on the given interval.
+	// Call from one thread at a time, as for OnInitialize()
+	bool StartTicker(u32 interval_msec = 10);
+	void StopTicker();
+
+	// 64-bit millisecond timestamp that never wraps, as of the last tick.
+	// It is a plain load while the ticker runs, and falls back to nsec()
+	// otherwise.  It never steps back when the ticker starts or stops
+	CAT_INLINE u64 msec_cached()
+	{
+		if (!_ticker) return FallbackMsec();
+
+		// Acquire: read the cached time after seeing the ticker that wrote it
+#if defined(CAT_ISA_X86)
+		CAT_FENCE_COMPILER
+#else
+		Atomic::LoadMemoryBarrier();
+#endif
+
+#if defined(CAT_WORD_64)
+		return _cached_msec;
+#else
+		return ReadCachedMsec();
+#endif
+	}
+
     u32 msec();								// Timestamp in milliseconds
 	double usec();							// Timestamp in microseconds
 	static u32 cycles(bool sync = true);	// Timestamp in cycles (optionally sync)
+	static u64 ticks();						// Raw 64-bit tick counter: TSC, or the ARM virtual counter
+	u64 nsec();								// Monotonic timestamp in nanoseconds, from ticks() when invariant
     static void sleep(u32 milliseconds);
 
 #ifdef CAT_CLOCK_EXTRA
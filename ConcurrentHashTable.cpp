@@ -0,0 +1,270 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "ConcurrentHashTable.hpp"
+#include "Atomic.hpp"
+#include <cstddef> // offsetof
+using namespace cat;
+
+
+//// ConcurrentHashTable
+
+ConcurrentHashTable::ConcurrentHashTable()
+{
+	for (u32 ii = 0; ii < SHARD_COUNT; ++ii)
+	{
+		Shard *shard = &_shards[ii];
+
+		shard->seq = 0;
+		shard->buckets = 0;
+		shard->used = 0;
+	}
+}
+
+ConcurrentHashTable::~ConcurrentHashTable()
+{
+	// For each shard,
+	for (u32 ii = 0; ii < SHARD_COUNT; ++ii)
+	{
+		Buckets *buckets = _shards[ii].buckets;
+		if (!buckets) continue;
+
+		// For each item in the current bucket array,
+		for (u32 jj = 0; jj < buckets->size; ++jj)
+		{
+			for (Item *next, *item = buckets->heads[jj]; item; item = next)
+			{
+				next = item->next;
+
+				delete item;
+			}
+		}
+
+		// Free current and retired bucket arrays
+		for (Buckets *next; buckets; buckets = next)
+		{
+			next = buckets->retired_next;
+
+			delete []reinterpret_cast<u8*>( buckets );
+		}
+	}
+}
+
+ConcurrentHashTable::Buckets *ConcurrentHashTable::AllocateBuckets(u32 size)
+{
+	u32 bytes = (u32)offsetof(Buckets, heads) + size * sizeof(Item*);
+
+	Buckets *buckets = reinterpret_cast<Buckets*>( new (std::nothrow) u8[bytes] );
+	if (!buckets) return 0;
+
+	buckets->retired_next = 0;
+	buckets->size = size;
+
+	for (u32 ii = 0; ii < size; ++ii)
+		buckets->heads[ii] = 0;
+
+	return buckets;
+}
+
+ConcurrentHashTable::Item *ConcurrentHashTable::Find(Buckets *buckets, const KeyAdapter &key)
+{
+	if (!buckets) return 0;
+
+	// Bound the walk so that a reader racing with growth cannot spin on a relinked chain
+	u32 steps = buckets->size * GROW_THRESH + 1;
+
+	for (Item *item = buckets->heads[key.Hash() & (buckets->size - 1)]; item; item = item->next)
+	{
+		// If the key matches,
+		if (*item == key)
+			return item;
+
+		if (--steps <= 0) break;
+	}
+
+	return 0;
+}
+
+bool ConcurrentHashTable::Grow(Shard *shard)
+{
+	Buckets *old_buckets = shard->buckets;
+	u32 new_size = old_buckets ? old_buckets->size * 2 : PREALLOC;
+
+	Buckets *new_buckets = AllocateBuckets(new_size);
+	if (!new_buckets) return false;
+
+	// If there are items to move,
+	if (old_buckets)
+	{
+		u32 mask = new_size - 1;
+
+		// For each old bucket,
+		for (u32 ii = 0; ii < old_buckets->size; ++ii)
+		{
+			// Relink each item into the new array
+			for (Item *next, *item = old_buckets->heads[ii]; item; item = next)
+			{
+				next = item->next;
+
+				u32 index = item->Hash() & mask;
+				item->next = new_buckets->heads[index];
+				new_buckets->heads[index] = item;
+			}
+		}
+
+		// Retire the old array instead of freeing it
+		new_buckets->retired_next = old_buckets;
+	}
+
+	Atomic::StoreMemoryBarrier();
+
+	shard->buckets = new_buckets;
+
+	return true;
+}
+
+bool ConcurrentHashTable::Read(const KeyAdapter &key, char *value, int &len)
+{
+	Shard *shard = GetShard(key.Hash());
+
+	CAT_FOREVER
+	{
+		u32 seq = shard->seq;
+
+		// If a writer is active, wait for it
+		if (seq & 1) continue;
+
+		Atomic::LoadMemoryBarrier();
+
+		Item *item = Find(shard->buckets, key);
+
+		// Copy the value out, bounded in case it is being rewritten
+		len = 0;
+		if (item)
+		{
+			const char *src = item->GetValueStr();
+			while (len < MAX_HASH_KEY_CHARS && src[len])
+			{
+				value[len] = src[len];
+				++len;
+			}
+		}
+		value[len] = '\0';
+
+		Atomic::LoadMemoryBarrier();
+
+		// If no writer interfered, the copy is consistent
+		if (shard->seq == seq)
+			return item != 0;
+	}
+}
+
+int ConcurrentHashTable::GetInt(const KeyAdapter &key, int default_value)
+{
+	char value[MAX_HASH_KEY_CHARS + 1];
+	int len;
+
+	if (!Read(key, value, len))
+		return default_value;
+
+	s32 x;
+	ParseDecimal(value, len, x);
+	return x;
+}
+
+bool ConcurrentHashTable::SetRangeStr(const KeyAdapter &key, const char *value, int len)
+{
+	Shard *shard = GetShard(key.Hash());
+
+	AutoMutex lock(shard->lock);
+
+	Item *item = Find(shard->buckets, key);
+
+	// If value already exists, rewrite it while readers are fenced off
+	if (item)
+	{
+		shard->seq++;
+		Atomic::StoreMemoryBarrier();
+
+		item->SetValueRangeStr(value, len);
+
+		Atomic::StoreMemoryBarrier();
+		shard->seq++;
+
+		return true;
+	}
+
+	// Build the new item completely before publishing it
+	item = new (std::nothrow) Item(key);
+	if (!item) return false;
+
+	item->SetValueRangeStr(value, len);
+
+	shard->seq++;
+	Atomic::StoreMemoryBarrier();
+
+	// If time to grow,
+	Buckets *buckets = shard->buckets;
+	if (!buckets || shard->used * GROW_THRESH >= buckets->size)
+	{
+		// If grow fails and there is no array to insert into,
+		if (!Grow(shard) && !buckets)
+		{
+			Atomic::StoreMemoryBarrier();
+			shard->seq++;
+
+			delete item;
+			return false;
+		}
+
+		buckets = shard->buckets;
+	}
+
+	u32 index = key.Hash() & (buckets->size - 1);
+	item->next = buckets->heads[index];
+
+	Atomic::StoreMemoryBarrier();
+
+	buckets->heads[index] = item;
+	++shard->used;
+
+	Atomic::StoreMemoryBarrier();
+	shard->seq++;
+
+	return true;
+}
+
+bool ConcurrentHashTable::SetInt(const KeyAdapter &key, int value)
+{
+	char str[16];
+
+	if (!IntegerToArray(value, str, sizeof(str)))
+		return false;
+
+	return SetStr(key, str);
+}
@@ -0,0 +1,134 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_CONCURRENT_HASH_TABLE_HPP
+#define CAT_CONCURRENT_HASH_TABLE_HPP
+
+#include "HashTable.hpp"
+#include "Mutex.hpp"
+
+namespace cat {
+
+
+/*
+	Concurrent read-mostly string table with lock-free readers.
+
+	Keys are split across SHARD_COUNT shards by the high bits of their hash.
+	Each shard is a chained table guarded by a sequence lock: writers take
+	the shard mutex and bump the sequence number to odd before changing
+	anything and back to even afterwards.  Readers never write shared memory;
+	they copy the value out and retry if the sequence number changed while
+	they were reading.  A reader only ever touches the cache lines of the
+	shard it is reading, and never contends with other readers.
+
+	To keep optimistic readers from touching freed memory, items are never
+	deleted and bucket arrays retired by growth are kept until the table is
+	destroyed (which at most doubles the bucket memory).
+
+	Values are limited to MAX_HASH_KEY_CHARS as in HashValue.
+*/
+
+class CAT_EXPORT ConcurrentHashTable
+{
+	CAT_NO_COPY(ConcurrentHashTable);
+
+	static const u32 SHARD_BITS = 4;
+	static const u32 SHARD_COUNT = 1 << SHARD_BITS;
+	static const u32 PREALLOC = 16;
+	static const u32 GROW_THRESH = 2;
+
+	struct Item : public HashKey, public HashValue
+	{
+		Item * volatile next;
+
+		CAT_INLINE Item(const KeyAdapter &key) : HashKey(key) {}
+	};
+
+	struct Buckets
+	{
+		Buckets *retired_next;
+		u32 size;
+		Item * volatile heads[1];	// Trailing
+	};
+
+	struct CAT_ALIGNED(CAT_DEFAULT_CACHE_LINE_SIZE) Shard
+	{
+		volatile u32 seq;			// Odd while a writer is changing the shard
+		Buckets * volatile buckets;
+		u32 used;
+		Mutex lock;
+	};
+
+	Shard _shards[SHARD_COUNT];
+
+	CAT_INLINE Shard *GetShard(u32 hash)
+	{
+		return &_shards[hash >> (32 - SHARD_BITS)];
+	}
+
+	static Buckets *AllocateBuckets(u32 size);
+
+	// Find item in the shard.  Writers call this with the shard lock held,
+	// readers call it optimistically and must validate the sequence number
+	static Item *Find(Buckets *buckets, const KeyAdapter &key);
+
+	// Call with the shard lock held
+	bool Grow(Shard *shard);
+
+	// Read a value out of the table, returning false if not found
+	bool Read(const KeyAdapter &key, char *value, int &len);
+
+public:
+	ConcurrentHashTable();
+	~ConcurrentHashTable();
+
+	// Copy the value into the buffer, which must have MAX_HASH_KEY_CHARS+1 bytes
+	// Returns false if key is not found
+	CAT_INLINE bool Get(const KeyAdapter &key, char *value)
+	{
+		int len;
+		return Read(key, value, len);
+	}
+
+	int GetInt(const KeyAdapter &key, int default_value = 0);
+
+	// Returns false on allocation failure
+	bool SetRangeStr(const KeyAdapter &key, const char *value, int len);
+
+	CAT_INLINE bool SetStr(const KeyAdapter &key, const char *value)
+	{
+		return SetRangeStr(key, value, (int)strlen(value));
+	}
+
+	bool SetInt(const KeyAdapter &key, int value);
+};
+
+
+} // namespace cat
+
+#endif // CAT_CONCURRENT_HASH_TABLE_HPP
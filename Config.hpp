@@ -61,6 +61,16 @@ namespace cat {
 #define CAT_DEFAULT_ALLOCATION_GRANULARITY CAT_DEFAULT_PAGE_SIZE
 #define CAT_DEFAULT_SECTOR_SIZE 512
 
+// Limits on the NUMA topology tracked by SystemInfo (nodes beyond these are folded into node 0)
+#define CAT_MAX_NUMA_NODES 8
+#define CAT_MAX_NUMA_PROCESSORS 256
+
+// Enable per-thread allocator counters (acquires, batches, heap fall-through, lock contention)
+//#define CAT_ALLOCATOR_STATS
+
+// Enable per-NUMA-node free lists in the pool allocators (adds a small header to each buffer)
+//#define CAT_NUMA_ALLOCATOR
+
 // Enable leak debug mode of the common runtime heap allocator
 #define CAT_DEBUG_LEAKS
 
@@ -80,6 +90,12 @@ namespace cat {
 #if !defined(CAT_SETTINGS_OVERRIDE_FILE)
 #define CAT_SETTINGS_OVERRIDE_FILE "Override.cfg"
 #endif
+#if !defined(CAT_SETTINGS_CACHE_FILE)
+#define CAT_SETTINGS_CACHE_FILE "Settings.cache"
+#endif
+
+// Longest wait in milliseconds between checks of the settings files when hot reload is enabled
+#define CAT_SETTINGS_WATCH_INTERVAL 500
 
 // Enable Ragdoll-based files to store empty keys
 #define CAT_RAGDOLL_STORE_EMPTY
@@ -27,8 +27,19 @@
 */
 
 #include "EndianNeutral.hpp"
+#include "CPUFeatures.hpp"
 using namespace cat;
 
+// Build the SSSE3 and AVX2 shuffle kernels where the compiler can target them
+// per function, and pick one at run time from the CPU features
+#if defined(CAT_X86_DISPATCH)
+# define CAT_ENDIAN_X86_DISPATCH
+# include <immintrin.h>
+#elif defined(CAT_HAS_NEON) && defined(__aarch64__)
+# define CAT_ENDIAN_NEON
+# include <arm_neon.h>
+#endif
+
 #if defined(CAT_ENDIAN_UNKNOWN)
 
 RuntimeEndianDetector Endianness::detector;
@@ -45,3 +56,176 @@ RuntimeEndianDetector::RuntimeEndianDetector()
 }
 
 #endif
+
+
+//// Bulk conversion
+
+// Vector kernels swap whole 16-byte blocks and return the bytes they handled
+typedef size_t (*SwapFunc)(u8 *dest, const u8 *src, size_t bytes, u32 width);
+
+static size_t SwapNone(u8 *, const u8 *, size_t, u32)
+{
+	return 0;
+}
+
+#if defined(CAT_ENDIAN_X86_DISPATCH)
+
+// PSHUFB masks that reverse each 2, 4 or 8-byte word in a block
+CAT_ALIGNED(16) static const u8 SWAP_MASKS[3][16] = {
+	{ 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 },
+	{ 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 },
+	{ 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 }
+};
+
+static CAT_INLINE const u8 *GetSwapMask(u32 width)
+{
+	return SWAP_MASKS[width == 2 ? 0 : (width == 4 ? 1 : 2)];
+}
+
+CAT_TARGET_SSSE3 static size_t SwapSSSE3(u8 *dest, const u8 *src, size_t bytes, u32 width)
+{
+	const __m128i mask = _mm_load_si128((const __m128i *)GetSwapMask(width));
+	size_t offset = 0;
+
+	for (; offset + 64 <= bytes; offset += 64)
+	{
+		__m128i x0 = _mm_loadu_si128((const __m128i *)(src + offset));
+		__m128i x1 = _mm_loadu_si128((const __m128i *)(src + offset + 16));
+		__m128i x2 = _mm_loadu_si128((const __m128i *)(src + offset + 32));
+		__m128i x3 = _mm_loadu_si128((const __m128i *)(src + offset + 48));
+		_mm_storeu_si128((__m128i *)(dest + offset), _mm_shuffle_epi8(x0, mask));
+		_mm_storeu_si128((__m128i *)(dest + offset + 16), _mm_shuffle_epi8(x1, mask));
+		_mm_storeu_si128((__m128i *)(dest + offset + 32), _mm_shuffle_epi8(x2, mask));
+		_mm_storeu_si128((__m128i *)(dest + offset + 48), _mm_shuffle_epi8(x3, mask));
+	}
+
+	for (; offset + 16 <= bytes; offset += 16)
+	{
+		__m128i x = _mm_loadu_si128((const __m128i *)(src + offset));
+		_mm_storeu_si128((__m128i *)(dest + offset), _mm_shuffle_epi8(x, mask));
+	}
+
+	return offset;
+}
+
+CAT_TARGET_AVX2 static size_t SwapAVX2(u8 *dest, const u8 *src, size_t bytes, u32 width)
+{
+	const __m256i mask = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)GetSwapMask(width)));
+	size_t offset = 0;
+
+	for (; offset + 128 <= bytes; offset += 128)
+	{
+		__m256i x0 = _mm256_loadu_si256((const __m256i *)(src + offset));
+		__m256i x1 = _mm256_loadu_si256((const __m256i *)(src + offset + 32));
+		__m256i x2 = _mm256_loadu_si256((const __m256i *)(src + offset + 64));
+		__m256i x3 = _mm256_loadu_si256((const __m256i *)(src + offset + 96));
+		_mm256_storeu_si256((__m256i *)(dest + offset), _mm256_shuffle_epi8(x0, mask));
+		_mm256_storeu_si256((__m256i *)(dest + offset + 32), _mm256_shuffle_epi8(x1, mask));
+		_mm256_storeu_si256((__m256i *)(dest + offset + 64), _mm256_shuffle_epi8(x2, mask));
+		_mm256_storeu_si256((__m256i *)(dest + offset + 96), _mm256_shuffle_epi8(x3, mask));
+	}
+
+	for (; offset + 32 <= bytes; offset += 32)
+	{
+		__m256i x = _mm256_loadu_si256((const __m256i *)(src + offset));
+		_mm256_storeu_si256((__m256i *)(dest + offset), _mm256_shuffle_epi8(x, mask));
+	}
+
+	return offset;
+}
+
+static SwapFunc DetectKernel()
+{
+	if (HasCPUFeatures(CPU_AVX2)) return SwapAVX2;
+	if (HasCPUFeatures(CPU_SSSE3)) return SwapSSSE3;
+	return SwapNone;
+}
+
+#elif defined(CAT_ENDIAN_NEON)
+
+static size_t SwapNEON(u8 *dest, const u8 *src, size_t bytes, u32 width)
+{
+	size_t offset = 0;
+
+	for (; offset + 16 <= bytes; offset += 16)
+	{
+		uint8x16_t x = vld1q_u8(src + offset);
+
+		if (width == 2) x = vrev16q_u8(x);
+		else if (width == 4) x = vrev32q_u8(x);
+		else x = vrev64q_u8(x);
+
+		vst1q_u8(dest + offset, x);
+	}
+
+	return offset;
+}
+
+static SwapFunc DetectKernel()
+{
+	return SwapNEON;
+}
+
+#else
+
+static SwapFunc DetectKernel()
+{
+	return SwapNone;
+}
+
+#endif
+
+static SwapFunc m_swap = 0;
+
+static CAT_INLINE SwapFunc GetKernel()
+{
+	return BindKernel(m_swap, DetectKernel);
+}
+
+void cat::SwapArray16(void *vdest, const void *vsrc, u32 count)
+{
+	u8 *dest = reinterpret_cast<u8*>( vdest );
+	const u8 *src = reinterpret_cast<const u8*>( vsrc );
+	size_t bytes = (size_t)count * 2;
+
+	// Finish the words the vector kernel left over
+	for (size_t offset = GetKernel()(dest, src, bytes, 2); offset < bytes; offset += 2)
+	{
+		u16 n;
+		memcpy(&n, src + offset, 2);
+		n = CAT_BOSWAP16(n);
+		memcpy(dest + offset, &n, 2);
+	}
+}
+
+void cat::SwapArray32(void *vdest, const void *vsrc, u32 count)
+{
+	u8 *dest = reinterpret_cast<u8*>( vdest );
+	const u8 *src = reinterpret_cast<const u8*>( vsrc );
+	size_t bytes = (size_t)count * 4;
+
+	// Finish the words the vector kernel left over
+	for (size_t offset = GetKernel()(dest, src, bytes, 4); offset < bytes; offset += 4)
+	{
+		u32 n;
+		memcpy(&n, src + offset, 4);
+		n = CAT_BOSWAP32(n);
+		memcpy(dest + offset, &n, 4);
+	}
+}
+
+void cat::SwapArray64(void *vdest, const void *vsrc, u32 count)
+{
+	u8 *dest = reinterpret_cast<u8*>( vdest );
+	const u8 *src = reinterpret_cast<const u8*>( vsrc );
+	size_t bytes = (size_t)count * 8;
+
+	// Finish the words the vector kernel left over
+	for (size_t offset = GetKernel()(dest, src, bytes, 8); offset < bytes; offset += 8)
+	{
+		u64 n;
+		memcpy(&n, src + offset, 8);
+		n = CAT_BOSWAP64(n);
+		memcpy(dest + offset, &n, 8);
+	}
+}
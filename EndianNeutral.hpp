@@ -30,6 +30,7 @@
 #define CAT_ENDIAN_NEUTRAL_HPP
 
 #include "Platform.hpp"
+#include <string.h> // memcpy
 
 namespace cat {
 
@@ -189,6 +190,76 @@ namespace cat {
 #endif
 
 
+//// Bulk conversion
+
+// SwapArray*() byte-swaps count words from src into dest
+// getLEArray*() and getBEArray*() convert between native byte order and the
+// given byte order, which is just a copy when the orders already match
+// dest may equal src to convert in place, but must not partially overlap it
+
+	CAT_EXPORT void SwapArray16(void *dest, const void *src, u32 count);
+	CAT_EXPORT void SwapArray32(void *dest, const void *src, u32 count);
+	CAT_EXPORT void SwapArray64(void *dest, const void *src, u32 count);
+
+	CAT_INLINE void CopyArrayBytes(void *dest, const void *src, size_t bytes)
+	{
+		if (dest != src) memcpy(dest, src, bytes);
+	}
+
+#if defined(CAT_ENDIAN_LITTLE)
+
+	CAT_INLINE void getLEArray16(void *dest, const void *src, u32 count) { CopyArrayBytes(dest, src, (size_t)count * 2); }
+	CAT_INLINE void getLEArray32(void *dest, const void *src, u32 count) { CopyArrayBytes(dest, src, (size_t)count * 4); }
+	CAT_INLINE void getLEArray64(void *dest, const void *src, u32 count) { CopyArrayBytes(dest, src, (size_t)count * 8); }
+	CAT_INLINE void getBEArray16(void *dest, const void *src, u32 count) { SwapArray16(dest, src, count); }
+	CAT_INLINE void getBEArray32(void *dest, const void *src, u32 count) { SwapArray32(dest, src, count); }
+	CAT_INLINE void getBEArray64(void *dest, const void *src, u32 count) { SwapArray64(dest, src, count); }
+
+#elif defined(CAT_ENDIAN_BIG)
+
+	CAT_INLINE void getBEArray16(void *dest, const void *src, u32 count) { CopyArrayBytes(dest, src, (size_t)count * 2); }
+	CAT_INLINE void getBEArray32(void *dest, const void *src, u32 count) { CopyArrayBytes(dest, src, (size_t)count * 4); }
+	CAT_INLINE void getBEArray64(void *dest, const void *src, u32 count) { CopyArrayBytes(dest, src, (size_t)count * 8); }
+	CAT_INLINE void getLEArray16(void *dest, const void *src, u32 count) { SwapArray16(dest, src, count); }
+	CAT_INLINE void getLEArray32(void *dest, const void *src, u32 count) { SwapArray32(dest, src, count); }
+	CAT_INLINE void getLEArray64(void *dest, const void *src, u32 count) { SwapArray64(dest, src, count); }
+
+#elif defined(CAT_ENDIAN_UNKNOWN)
+
+	CAT_INLINE void getLEArray16(void *dest, const void *src, u32 count)
+	{
+		if (IsLittleEndian()) CopyArrayBytes(dest, src, (size_t)count * 2);
+		else SwapArray16(dest, src, count);
+	}
+	CAT_INLINE void getLEArray32(void *dest, const void *src, u32 count)
+	{
+		if (IsLittleEndian()) CopyArrayBytes(dest, src, (size_t)count * 4);
+		else SwapArray32(dest, src, count);
+	}
+	CAT_INLINE void getLEArray64(void *dest, const void *src, u32 count)
+	{
+		if (IsLittleEndian()) CopyArrayBytes(dest, src, (size_t)count * 8);
+		else SwapArray64(dest, src, count);
+	}
+	CAT_INLINE void getBEArray16(void *dest, const void *src, u32 count)
+	{
+		if (IsBigEndian()) CopyArrayBytes(dest, src, (size_t)count * 2);
+		else SwapArray16(dest, src, count);
+	}
+	CAT_INLINE void getBEArray32(void *dest, const void *src, u32 count)
+	{
+		if (IsBigEndian()) CopyArrayBytes(dest, src, (size_t)count * 4);
+		else SwapArray32(dest, src, count);
+	}
+	CAT_INLINE void getBEArray64(void *dest, const void *src, u32 count)
+	{
+		if (IsBigEndian()) CopyArrayBytes(dest, src, (size_t)count * 8);
+		else SwapArray64(dest, src, count);
+	}
+
+#endif
+
+
 } // namespace cat
 
 #endif // CAT_ENDIAN_NEUTRAL_HPP
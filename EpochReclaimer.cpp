@@ -0,0 +1,261 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "EpochReclaimer.hpp"
+#include "Clock.hpp"
+using namespace cat;
+
+
+//// EpochParticipant
+
+EpochParticipant::EpochParticipant()
+{
+	_announce = 0;
+	_nesting = 0;
+	_owner = 0;
+	_slot = 0;
+	_pending = 0;
+	_next_free = 0;
+
+	for (u32 ii = 0; ii < 4; ++ii)
+	{
+		_buckets[ii].epoch = 0;
+		_buckets[ii].blocks = 0;
+	}
+}
+
+EpochParticipant::~EpochParticipant()
+{
+	// Unregister() has already released the buckets
+}
+
+void EpochParticipant::FreeBucket(Bucket *bucket)
+{
+	RetiredBlock *block = bucket->blocks;
+	bucket->blocks = 0;
+
+	while (block)
+	{
+		RetiredBlock *next = block->next;
+
+		for (u32 ii = 0; ii < block->count; ++ii)
+			block->items[ii].allocator->Release(block->items[ii].ptr);
+
+		_pending -= block->count;
+
+		delete block;
+		block = next;
+	}
+}
+
+bool EpochParticipant::Retire(void *ptr, IAllocator *allocator)
+{
+	if (!ptr) return true;
+
+	u32 epoch = _owner->_epoch;
+	Bucket *bucket = &_buckets[epoch & 3];
+
+	// If the bucket holds an older epoch, that one is at least four
+	// epochs old and safe to release
+	if (bucket->epoch != epoch)
+	{
+		FreeBucket(bucket);
+		bucket->epoch = epoch;
+	}
+
+	RetiredBlock *block = bucket->blocks;
+
+	// If the current block is full,
+	if (!block || block->count >= BLOCK_ITEMS)
+	{
+		// Try to make room first
+		if (block) Collect();
+
+		block = new (std::nothrow) RetiredBlock;
+		if (!block) return false;
+
+		block->count = 0;
+
+		// Collect() may have moved to a new epoch, so look the bucket up again
+		epoch = _owner->_epoch;
+		bucket = &_buckets[epoch & 3];
+
+		if (bucket->epoch != epoch)
+		{
+			FreeBucket(bucket);
+			bucket->epoch = epoch;
+		}
+
+		block->next = bucket->blocks;
+		bucket->blocks = block;
+	}
+
+	block->items[block->count].ptr = ptr;
+	block->items[block->count].allocator = allocator;
+	++block->count;
+	++_pending;
+
+	return true;
+}
+
+void EpochParticipant::Collect()
+{
+	_owner->TryAdvance();
+
+	u32 epoch = _owner->_epoch;
+
+	// Items retired two or more epochs ago are unreachable
+	for (u32 ii = 0; ii < 4; ++ii)
+	{
+		Bucket *bucket = &_buckets[ii];
+
+		if (bucket->blocks && (s32)(epoch - bucket->epoch) >= 2)
+			FreeBucket(bucket);
+	}
+}
+
+
+//// EpochReclaimer
+
+EpochReclaimer::EpochReclaimer()
+{
+	_epoch = 0;
+	_participants = 0;
+	_max_participants = 0;
+	_free_participants = 0;
+}
+
+EpochReclaimer::~EpochReclaimer()
+{
+	while (_free_participants)
+	{
+		EpochParticipant *next = _free_participants->_next_free;
+		delete _free_participants;
+		_free_participants = next;
+	}
+
+	delete []_participants;
+}
+
+bool EpochReclaimer::Initialize(u32 max_participants)
+{
+	AutoMutex lock(_lock);
+
+	if (_participants) return true;
+
+	EpochParticipant * volatile *participants = new (std::nothrow) EpochParticipant * volatile[max_participants];
+	if (!participants) return false;
+
+	for (u32 ii = 0; ii < max_participants; ++ii)
+		participants[ii] = 0;
+
+	_max_participants = max_participants;
+	_participants = participants;
+
+	return true;
+}
+
+void EpochReclaimer::TryAdvance()
+{
+	u32 epoch = _epoch;
+	u32 announce = (epoch << 1) | 1;
+
+	// Make sure the load of the epoch is done before the announcements
+	Atomic::DataMemoryBarrier();
+
+	for (u32 ii = 0; ii < _max_participants; ++ii)
+	{
+		EpochParticipant *participant = _participants[ii];
+		if (!participant) continue;
+
+		u32 seen = participant->_announce;
+
+		// If a reader is still inside a section that started in an older epoch,
+		if ((seen & 1) && seen != announce)
+			return;
+	}
+
+	// Racing collectors advance it only once
+	Atomic::CAS(&_epoch, epoch, epoch + 1);
+}
+
+EpochParticipant *EpochReclaimer::Register()
+{
+	AutoMutex lock(_lock);
+
+	for (u32 ii = 0; ii < _max_participants; ++ii)
+	{
+		if (!_participants[ii])
+		{
+			// Reuse an unregistered participant if there is one
+			EpochParticipant *participant = _free_participants;
+			if (participant)
+				_free_participants = participant->_next_free;
+			else
+			{
+				participant = new (std::nothrow) EpochParticipant;
+				if (!participant) return 0;
+			}
+
+			participant->_owner = this;
+			participant->_slot = ii;
+			participant->_next_free = 0;
+
+			// Publish the participant only once it is filled in
+			Atomic::StoreMemoryBarrier();
+
+			_participants[ii] = participant;
+			return participant;
+		}
+	}
+
+	return 0;
+}
+
+void EpochReclaimer::Unregister(EpochParticipant *participant)
+{
+	if (!participant) return;
+
+	// Wait for the other readers to let the epoch move past its items
+	while (participant->_pending > 0)
+	{
+		participant->Collect();
+
+		if (participant->_pending > 0)
+			Clock::sleep(1);
+	}
+
+	AutoMutex lock(_lock);
+
+	_participants[participant->_slot] = 0;
+
+	// A racing TryAdvance() may still read it, which is harmless since it
+	// is outside any read section
+	participant->_next_free = _free_participants;
+	_free_participants = participant;
+}
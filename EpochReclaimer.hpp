@@ -0,0 +1,195 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_EPOCH_RECLAIMER_HPP
+#define CAT_EPOCH_RECLAIMER_HPP
+
+#include "IAllocator.hpp"
+#include "Atomic.hpp"
+#include "Mutex.hpp"
+
+namespace cat {
+
+
+/*
+	Epoch-based memory reclamation
+
+	Lets lock-free readers use shared memory that writers unlink and free
+	concurrently, without a reference count.  Each thread registers an
+	EpochParticipant.  The participant announces the global epoch when it
+	enters a read section and clears the announcement when it leaves, which
+	is a store and a barrier on memory that only that thread writes.
+
+	A writer unlinks an item so that no new reader can reach it, and then
+	hands it to Retire().  The global epoch only advances once every thread
+	inside a read section has announced the current epoch.  After it has
+	advanced twice, no reader can still hold a pointer from before the
+	item was retired, and the memory is released to its IAllocator.
+
+	A thread that stays inside a read section holds back reclamation for
+	everyone, so keep read sections short.
+
+	TaskScheduler can register one participant per worker and run every
+	task inside a read section.
+*/
+
+class EpochReclaimer;
+
+
+// Per-thread state, returned by EpochReclaimer::Register()
+class CAT_EXPORT EpochParticipant
+{
+	friend class EpochReclaimer;
+
+	// Items retired at once before a collection is attempted
+	static const u32 BLOCK_ITEMS = 126;
+
+	struct RetiredBlock
+	{
+		RetiredBlock *next;
+		u32 count;
+		struct { void *ptr; IAllocator *allocator; } items[BLOCK_ITEMS];
+	};
+
+	// Items retired during one epoch
+	struct Bucket
+	{
+		u32 epoch;
+		RetiredBlock *blocks;
+	};
+
+	// Global epoch << 1 | 1 while inside a read section, or 0
+	volatile u32 _announce;
+	u32 _nesting;
+
+	EpochReclaimer *_owner;
+	u32 _slot;
+
+	// Indexed by epoch & 3.  Three epochs can be live at once, and four
+	// divides 2^32, so a bucket is only reused once its epoch is safe even
+	// after the counter wraps
+	Bucket _buckets[4];
+	u32 _pending;
+
+	// Next in the reclaimer's list of unregistered participants
+	EpochParticipant *_next_free;
+
+	// Keep other participants off this cache line
+	u8 _padding[CAT_DEFAULT_CACHE_LINE_SIZE];
+
+	void FreeBucket(Bucket *bucket);
+
+	CAT_NO_COPY(EpochParticipant);
+
+	EpochParticipant();
+	~EpochParticipant();
+
+public:
+	// Read sections may nest
+	CAT_INLINE void Enter();
+	CAT_INLINE void Leave();
+
+	CAT_INLINE bool InReadSection() { return _nesting != 0; }
+
+	// Release the memory to the allocator once no reader can be using it.
+	// Call after unlinking it from the shared structure.
+	// Returns false if out of memory, in which case it was not retired
+	bool Retire(void *ptr, IAllocator *allocator);
+
+	// Try to advance the global epoch and release what has become safe.
+	// Called automatically as items are retired
+	void Collect();
+
+	// Number of items waiting to be released
+	CAT_INLINE u32 GetPendingCount() { return _pending; }
+};
+
+
+class CAT_EXPORT EpochReclaimer
+{
+	friend class EpochParticipant;
+
+	volatile u32 _epoch;
+
+	Mutex _lock;	// Guards registration
+	EpochParticipant * volatile *_participants;
+	u32 _max_participants;
+
+	// TryAdvance() reads participants without the lock, so unregistered
+	// ones are kept here for reuse and freed with the reclaimer
+	EpochParticipant *_free_participants;
+
+	// Advance the global epoch if every reader has seen it
+	void TryAdvance();
+
+	CAT_NO_COPY(EpochReclaimer);
+
+public:
+	EpochReclaimer();
+	~EpochReclaimer();
+
+	// Room for up to max_participants threads.  Returns false on out of memory
+	bool Initialize(u32 max_participants = 64);
+
+	// Returns 0 if all slots are taken or out of memory
+	EpochParticipant *Register();
+
+	// Waits until everything the participant retired has been released.
+	// The calling thread must not be inside a read section
+	void Unregister(EpochParticipant *participant);
+};
+
+
+void EpochParticipant::Enter()
+{
+	if (_nesting++ == 0)
+	{
+		// Full barrier: the announcement is visible before any shared load
+		Atomic::Set(&_announce, (_owner->_epoch << 1) | 1);
+	}
+}
+
+void EpochParticipant::Leave()
+{
+	if (--_nesting == 0)
+	{
+		// Finish the section's loads before clearing the announcement
+#if defined(CAT_ISA_X86)
+		CAT_FENCE_COMPILER
+#else
+		Atomic::DataMemoryBarrier();
+#endif
+
+		_announce = 0;
+	}
+}
+
+
+} // namespace cat
+
+#endif // CAT_EPOCH_RECLAIMER_HPP
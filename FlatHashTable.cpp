@@ -0,0 +1,354 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "FlatHashTable.hpp"
+#include "BitMath.hpp"
+#include <cstddef> // offsetof
+using namespace cat;
+
+#if defined(CAT_HAS_SSE2)
+# include <emmintrin.h>
+#elif defined(CAT_HAS_NEON)
+# include <arm_neon.h>
+#endif
+
+// Shared empty value so that new entries need no value buffer
+static char m_empty_value[1] = { '\0' };
+
+
+//// Group matching
+
+/*
+	Compare a group of 16 fingerprints against a tag and against the empty
+	tag at once, producing bitmasks with one bit per matching slot.
+	GROUP_INDEX() converts the lowest set bit of a mask to a slot offset.
+*/
+
+#if defined(CAT_HAS_SSE2)
+
+typedef u32 GroupMask;
+#define GROUP_INDEX(mask) BSF32(mask)
+
+static CAT_INLINE void MatchGroup(const u8 *tags, u8 tag, GroupMask &match, GroupMask &empty)
+{
+	__m128i group = _mm_loadu_si128((const __m128i *)tags);
+
+	match = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)tag)));
+	empty = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_setzero_si128()));
+}
+
+#elif defined(CAT_HAS_NEON)
+
+// NEON has no movemask, so narrow each byte to a nibble and keep one bit of each
+typedef u64 GroupMask;
+#define GROUP_INDEX(mask) (BSF64(mask) >> 2)
+
+static CAT_INLINE GroupMask NibbleMask(uint8x16_t eq)
+{
+	uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(eq), 4);
+	return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0) & 0x8888888888888888ULL;
+}
+
+static CAT_INLINE void MatchGroup(const u8 *tags, u8 tag, GroupMask &match, GroupMask &empty)
+{
+	uint8x16_t group = vld1q_u8(tags);
+
+	match = NibbleMask(vceqq_u8(group, vdupq_n_u8(tag)));
+	empty = NibbleMask(vceqq_u8(group, vdupq_n_u8(0)));
+}
+
+#else
+
+typedef u32 GroupMask;
+#define GROUP_INDEX(mask) BSF32(mask)
+
+static CAT_INLINE void MatchGroup(const u8 *tags, u8 tag, GroupMask &match, GroupMask &empty)
+{
+	match = 0;
+	empty = 0;
+
+	for (u32 ii = 0; ii < 16; ++ii)
+	{
+		match |= (GroupMask)(tags[ii] == tag) << ii;
+		empty |= (GroupMask)(tags[ii] == 0) << ii;
+	}
+}
+
+#endif
+
+
+//// FlatHashTable
+
+FlatHashTable::FlatHashTable()
+{
+	_allocated = 0;
+	_used = 0;
+	_tags = 0;
+	_entries = 0;
+
+	_arena.Initialize();
+}
+
+FlatHashTable::~FlatHashTable()
+{
+	delete []_tags;
+	delete []_entries;
+}
+
+void FlatHashTable::Clear()
+{
+	delete []_tags;
+	delete []_entries;
+
+	_tags = 0;
+	_entries = 0;
+	_allocated = 0;
+	_used = 0;
+
+	_arena.Reset();
+}
+
+bool FlatHashTable::Grow()
+{
+	// Calculate growth rate
+	u32 old_size = _allocated;
+	u32 new_size = old_size * 2;
+	if (new_size < PREALLOC) new_size = PREALLOC;
+
+	CAT_INANE("FlatHashTable") << "Growing to " << new_size << " slots";
+
+	// Allocate larger arrays
+	u8 *new_tags = new (std::nothrow) u8[new_size + GROUP_SIZE];
+	FlatHashEntry **new_entries = new (std::nothrow) FlatHashEntry*[new_size];
+	if (!new_tags || !new_entries)
+	{
+		delete []new_tags;
+		delete []new_entries;
+		return false;
+	}
+
+	memset(new_tags, EMPTY_TAG, new_size + GROUP_SIZE);
+	memset(new_entries, 0, new_size * sizeof(FlatHashEntry*));
+
+	// For each used slot,
+	u32 mask = new_size - 1;
+	for (u32 ii = 0; ii < old_size; ++ii)
+	{
+		FlatHashEntry *entry = _entries[ii];
+		if (!entry) continue;
+
+		// Probe for an empty slot in the new arrays
+		u32 slot = entry->_hash & mask;
+		while (new_tags[slot] != EMPTY_TAG)
+			slot = (slot + 1) & mask;
+
+		SetTag(new_tags, new_size, slot, _tags[ii]);
+		new_entries[slot] = entry;
+	}
+
+	// Free old arrays
+	delete []_tags;
+	delete []_entries;
+
+	_tags = new_tags;
+	_entries = new_entries;
+	_allocated = new_size;
+
+	return true;
+}
+
+u32 FlatHashTable::FindSlot(const KeyAdapter &key)
+{
+	const u32 mask = _allocated - 1;
+	const u8 tag = GetTag(key.Hash());
+
+	u32 slot = key.Hash() & mask;
+
+	// Table is never full, so this always finds a match or an empty slot
+	CAT_FOREVER
+	{
+		GroupMask match, empty;
+		MatchGroup(_tags + slot, tag, match, empty);
+
+		// Probe sequence for the key ends at the first empty slot
+		u32 first_empty = empty ? GROUP_INDEX(empty) : GROUP_SIZE;
+
+		// Only compare keys when the fingerprint matches
+		while (match)
+		{
+			u32 offset = GROUP_INDEX(match);
+			if (offset > first_empty) break;
+
+			u32 candidate = (slot + offset) & mask;
+			if (*_entries[candidate] == key)
+				return candidate;
+
+			match &= match - 1;
+		}
+
+		// If empty slot found, key is not in table
+		if (empty)
+			return (slot + first_empty) & mask;
+
+		slot = (slot + GROUP_SIZE) & mask;
+	}
+}
+
+FlatHashEntry *FlatHashTable::Lookup(const KeyAdapter &key)
+{
+	// If nothing allocated,
+	if (!_allocated) return 0;
+
+	return _entries[FindSlot(key)];
+}
+
+FlatHashEntry *FlatHashTable::Create(const KeyAdapter &key)
+{
+	// If time to grow,
+	if ((_used + 1) * MAX_LOAD_DEN > _allocated * MAX_LOAD_NUM)
+	{
+		// If grow fails,
+		if (!Grow()) return 0;
+	}
+
+	u32 slot = FindSlot(key);
+
+	// If it already exists,
+	FlatHashEntry *entry = _entries[slot];
+	if (entry) return entry;
+
+	// Clip key length like HashKey does
+	int len = key.Length();
+	if (len > MAX_HASH_KEY_CHARS)
+		len = MAX_HASH_KEY_CHARS;
+
+	// Pack entry with its key in the arena
+	entry = reinterpret_cast<FlatHashEntry*>( _arena.Acquire((u32)(offsetof(FlatHashEntry, _key) + len + 1)) );
+	if (!entry) return 0;
+
+	entry->_hash = key.Hash();
+	entry->_key_len = (u16)len;
+	entry->_value_len = 0;
+	entry->_value_capacity = 0;
+	entry->_value_ref = 0;
+	entry->_value = m_empty_value;
+	memcpy(entry->_key, key.Key(), len);
+	entry->_key[len] = '\0';
+
+	SetTag(_tags, _allocated, slot, GetTag(key.Hash()));
+	_entries[slot] = entry;
+
+	// Increment used count to keep track of when to grow
+	++_used;
+
+	return entry;
+}
+
+bool FlatHashTable::SetValueRangeStr(FlatHashEntry *entry, const char *value, int len)
+{
+	if (len < 0) len = 0;
+	if (len > MAX_VALUE_CHARS) len = MAX_VALUE_CHARS;
+
+	char *buffer = entry->_value;
+
+	// If the new value does not fit in the old buffer or the old value is not ours,
+	if (len > entry->_value_capacity || entry->_value_ref)
+	{
+		// Old buffer is abandoned in the arena until Clear()
+		buffer = reinterpret_cast<char*>( _arena.Acquire((u32)len + 1) );
+		if (!buffer) return false;
+
+		entry->_value = buffer;
+		entry->_value_capacity = (u16)len;
+		entry->_value_ref = 0;
+	}
+
+	memcpy(buffer, value, len);
+	buffer[len] = '\0';
+	entry->_value_len = (u16)len;
+
+	return true;
+}
+
+bool FlatHashTable::SetValueInt(FlatHashEntry *entry, int ivalue)
+{
+	char value[16];
+
+	if (!IntegerToArray(ivalue, value, sizeof(value)))
+		return false;
+
+	return SetValueStr(entry, value);
+}
+
+bool FlatHashTable::SetValueReference(FlatHashEntry *entry, const char *value, int len)
+{
+	if (len < 0) len = 0;
+	if (len > MAX_VALUE_CHARS) len = MAX_VALUE_CHARS;
+
+	// Old buffer is abandoned in the arena until Clear()
+	entry->_value = const_cast<char*>( value );
+	entry->_value_len = (u16)len;
+	entry->_value_capacity = 0;
+	entry->_value_ref = 1;
+
+	return true;
+}
+
+bool FlatHashTable::Materialize(FlatHashEntry *entry)
+{
+	// If already materialized,
+	if (!entry->_value_ref) return true;
+
+	return SetValueRangeStr(entry, entry->_value, entry->_value_len);
+}
+
+
+//// FlatHashTable::Iterator
+
+void FlatHashTable::Iterator::IterateNext()
+{
+	while (_remaining)
+	{
+		--_remaining;
+		++_entry;
+
+		if (_remaining && *_entry) return;
+	}
+}
+
+FlatHashTable::Iterator::Iterator(FlatHashTable &table)
+{
+	_remaining = table._allocated;
+	_entry = table._entries;
+
+	// If first slot is empty,
+	if (_remaining && !*_entry)
+	{
+		IterateNext();
+	}
+}
@@ -0,0 +1,226 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_FLAT_HASH_TABLE_HPP
+#define CAT_FLAT_HASH_TABLE_HPP
+
+#include "HashTable.hpp"
+#include "ArenaAllocator.hpp"
+
+namespace cat {
+
+
+/*
+	Open-addressing alternative to HashTable for read-heavy string tables.
+
+	HashTable chains HashItems that each embed a 257-byte key and a 257-byte
+	value, so a lookup chases a pointer into a half-kilobyte node.  Here the
+	table itself is two dense arrays: one byte of hash fingerprint per slot
+	and one entry pointer per slot.  Lookups probe linearly through the
+	fingerprint array and only touch an entry when its fingerprint matches,
+	so most lookups are one or two cache-line reads.
+
+	Fingerprints are compared GROUP_SIZE at a time with SSE2 or NEON where
+	available, so a miss usually costs one vector compare and no key
+	comparisons at all.  The first GROUP_SIZE fingerprints are mirrored past
+	the end of the array so that a group can start at any slot.
+
+	Entries are packed into an ArenaAllocator with their key stored inline
+	and sized to fit, and their value stored in a separate arena buffer that
+	is re-used when a new value fits and replaced otherwise.  Entry pointers
+	are stable for the lifetime of the table.
+
+	A value may instead reference memory owned by the caller, such as a
+	memory-mapped file, and is copied into the arena on demand.
+
+	Keys are limited to MAX_HASH_KEY_CHARS as in HashTable.  Values may be
+	up to MAX_VALUE_CHARS.
+
+	Not thread-safe.
+*/
+
+class FlatHashTable;
+
+
+//// FlatHashEntry
+
+class CAT_EXPORT FlatHashEntry
+{
+	friend class FlatHashTable;
+
+	CAT_NO_COPY(FlatHashEntry);
+
+	u32 _hash;
+	u16 _key_len;
+	u16 _value_len, _value_capacity;
+	u16 _value_ref;	// Value points into external memory and is not nul-terminated
+	char *_value;
+	char _key[1];	// Trailing, nul-terminated
+
+	CAT_INLINE FlatHashEntry() {}
+
+public:
+	CAT_INLINE const char *Key() const { return _key; }
+	CAT_INLINE int Length() const { return _key_len; }
+	CAT_INLINE u32 Hash() const { return _hash; }
+
+	CAT_INLINE bool IsValueReference() const { return _value_ref != 0; }
+
+	// NOTE: Referenced values must be materialized before these are used
+	CAT_INLINE const char *GetValueStr() const { return _value; }
+	CAT_INLINE int GetValueLength() const { return _value_len; }
+	CAT_INLINE int GetValueInt() const { return ParseInt(_value); }
+
+	CAT_INLINE bool operator==(const KeyAdapter &key) const
+	{
+		return _hash == key.Hash() &&
+			   _key_len == key.Length() &&
+			   memcmp(_key, key.Key(), _key_len) == 0;
+	}
+};
+
+
+//// FlatHashTable
+
+class CAT_EXPORT FlatHashTable
+{
+	CAT_NO_COPY(FlatHashTable);
+
+	static const u32 PREALLOC = 64;
+
+	// Grow when more than 3/4 of the slots are used
+	static const u32 MAX_LOAD_NUM = 3;
+	static const u32 MAX_LOAD_DEN = 4;
+
+	// Fingerprint for an empty slot; used slots always have the high bit set
+	static const u8 EMPTY_TAG = 0;
+
+	CAT_INLINE static u8 GetTag(u32 hash)
+	{
+		return (u8)(0x80 | (hash >> 25));
+	}
+
+	// Number of fingerprints matched at once
+	static const u32 GROUP_SIZE = 16;
+
+	// Set a fingerprint, keeping the mirrored copy in sync
+	CAT_INLINE static void SetTag(u8 *tags, u32 allocated, u32 slot, u8 tag)
+	{
+		tags[slot] = tag;
+		if (slot < GROUP_SIZE)
+			tags[allocated + slot] = tag;
+	}
+
+	u32 _allocated, _used;
+	u8 *_tags;
+	FlatHashEntry **_entries;
+
+	ArenaAllocator _arena;
+
+	bool Grow();
+
+	// Returns the slot the entry for the key is in, or the empty slot it would go in
+	u32 FindSlot(const KeyAdapter &key);
+
+public:
+	static const int MAX_VALUE_CHARS = 65535;
+
+	FlatHashTable();
+	~FlatHashTable();
+
+	CAT_INLINE u32 Count() { return _used; }
+
+	FlatHashEntry *Lookup(const KeyAdapter &key); // Returns 0 if key not found
+	FlatHashEntry *Create(const KeyAdapter &key); // Creates if it does not exist yet
+
+	// Returns false on failure, in which case the old value is kept
+	bool SetValueRangeStr(FlatHashEntry *entry, const char *value, int len);
+
+	CAT_INLINE bool SetValueStr(FlatHashEntry *entry, const char *value)
+	{
+		return SetValueRangeStr(entry, value, (int)strlen(value));
+	}
+
+	bool SetValueInt(FlatHashEntry *entry, int ivalue);
+
+	// Point the value at memory owned by the caller instead of copying it.
+	// The memory must outlive the table or the next write to the value
+	bool SetValueReference(FlatHashEntry *entry, const char *value, int len);
+
+	// Copy a referenced value into the table so it is nul-terminated.
+	// Returns false on out of memory, in which case the reference is kept
+	bool Materialize(FlatHashEntry *entry);
+
+	// Get the value bytes without materializing a referenced value
+	CAT_INLINE static const char *GetValueRange(FlatHashEntry *entry, int &len)
+	{
+		len = entry->_value_len;
+		return entry->_value;
+	}
+
+	// Remove all entries
+	void Clear();
+
+	// Iterator
+	class CAT_EXPORT Iterator
+	{
+		u32 _remaining;
+		FlatHashEntry **_entry;
+
+		void IterateNext();
+
+	public:
+		Iterator(FlatHashTable &table);
+
+		CAT_INLINE operator FlatHashEntry *()
+		{
+			return _remaining ? *_entry : 0;
+		}
+
+		CAT_INLINE FlatHashEntry *operator->()
+		{
+			return *_entry;
+		}
+
+		CAT_INLINE Iterator &operator++() // pre-increment
+		{
+			IterateNext();
+			return *this;
+		}
+
+		CAT_INLINE Iterator &operator++(int) // post-increment
+		{
+			return ++*this;
+		}
+	};
+};
+
+
+} // namespace cat
+
+#endif // CAT_FLAT_HASH_TABLE_HPP
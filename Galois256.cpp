@@ -28,9 +28,22 @@
 
 #include "Galois256.hpp"
 #include "MemXOR.hpp"
+#include "MemSwap.hpp"
+#include "Atomic.hpp"
+#include "CPUFeatures.hpp"
 using namespace cat;
 
-#include <stdlib.h> // malloc
+#include <string.h> // memset
+
+// Build the SSSE3, AVX2 and AVX-512 kernels where the compiler can target
+// them per function, and pick one at run time from the CPU features
+#if defined(CAT_X86_DISPATCH)
+# define CAT_GF256_X86_DISPATCH
+# include <immintrin.h>
+#elif defined(CAT_HAS_NEON) && defined(__aarch64__)
+# define CAT_GF256_NEON
+# include <arm_neon.h>
+#endif
 
 
 //// Bootstrap tables
@@ -111,62 +124,28 @@ const u8 cat::GF256_INV_TABLE[256] = {
 
 //// Mul/Div tables
 
-u8 * CAT_RESTRICT cat::GF256_MUL_TABLE = 0;
-u8 * CAT_RESTRICT cat::GF256_DIV_TABLE = 0;
-
-
-// Unpack 256x256 multiplication tables
-void cat::GF256Init() {
-	// If initialized already,
-	if (GF256_MUL_TABLE) {
-		return;
-	}
-
-	// Allocate table memory 65KB x 2
-	GF256_MUL_TABLE = (u8 *)malloc(256 * 256 * 2);
-	GF256_DIV_TABLE = GF256_MUL_TABLE + 256 * 256;
-	u8 *m = GF256_MUL_TABLE, *d = GF256_DIV_TABLE;
-
-	// Unroll y = 0 subtable
-	for (int x = 0; x < 256; ++x) {
-		m[x] = d[x] = 0;
-	}
-
-	// For each other y value,
-	for (int y = 1; y < 256; ++y) {
-		// Calculate log(y) for mult and 255 - log(y) for div
-		const u8 log_y = (u8)GF256_LOG_TABLE[y];
-		const u8 log_yn = 255 - log_y;
-
-		// Next subtable
-		m += 256;
-		d += 256;
+// Static so nothing is allocated, and aligned so each 256-byte row for one
+// y value covers whole cache lines
+static struct CAT_ALIGNED(CAT_DEFAULT_CACHE_LINE_SIZE) GF256Tables {
+	u8 mul[256 * 256];
+	u8 div[256 * 256];
+	u8 split[256 * 32];
+} m_tables;
 
-		// Unroll x = 0
-		m[0] = 0;
-		d[0] = 0;
+u8 * CAT_RESTRICT cat::GF256_MUL_TABLE = m_tables.mul;
+u8 * CAT_RESTRICT cat::GF256_DIV_TABLE = m_tables.div;
+u8 * CAT_RESTRICT cat::GF256_SPLIT_TABLE = m_tables.split;
 
-		// Calculate x * y, x / y
-		for (int x = 1; x < 256; ++x) {
-			int log_x = GF256_LOG_TABLE[x];
+volatile bool cat::GF256_READY = false;
 
-			m[x] = GF256_EXP_TABLE[log_x + log_y];
-			d[x] = GF256_EXP_TABLE[log_x + log_yn];
-		}
-	}
-}
+// Held by the thread generating the tables
+static volatile u32 m_init_lock = 0;
 
-// Performs "dest[] += src[] * x" operation in GF(256)
-void cat::GF256MemMulAdd(void * CAT_RESTRICT vdest, u8 x, const void * CAT_RESTRICT vsrc, int bytes) {
-	if (x == 0) {
-		return;
-	}
 
-	if (x == 1) {
-		memxor(vdest, vsrc, bytes);
-		return;
-	}
+//// Table kernels
 
+// Performs "dest[] += src[] * x" operation in GF(256) for x > 1
+static void MulAddTable(void * CAT_RESTRICT vdest, u8 x, const void * CAT_RESTRICT vsrc, int bytes) {
 	u8 * CAT_RESTRICT dest = reinterpret_cast<u8*>( vdest );
 	const u8 * CAT_RESTRICT src = reinterpret_cast<const u8*>( vsrc );
 	const u8 * CAT_RESTRICT table = GF256_MUL_TABLE + ((u32)x << 8);
@@ -209,7 +188,7 @@ void cat::GF256MemMulAdd(void * CAT_RESTRICT vdest, u8 x, const void * CAT_RESTR
 }
 
 // Performs "dest[] /= x" operation in GF(256)
-void cat::GF256MemDivide(void * CAT_RESTRICT vdest, u8 x, int bytes) {
+static void DivideTable(void * CAT_RESTRICT vdest, u8 x, int bytes) {
 	u8 * CAT_RESTRICT dest = reinterpret_cast<u8*>( vdest );
 	const u8 * CAT_RESTRICT table = GF256_DIV_TABLE + ((u32)x << 8);
 
@@ -250,3 +229,813 @@ void cat::GF256MemDivide(void * CAT_RESTRICT vdest, u8 x, int bytes) {
 	}
 }
 
+
+//// Split-table kernels
+
+/*
+	x * s = x * (s & 15) ^ x * (s >> 4 << 4), so two 16-entry tables per x
+	cover every s, and a byte shuffle looks up 16, 32 or 64 bytes at once.
+	Division by x is multiplication by its inverse.  Tails shorter than one
+	vector use the byte tables, except on AVX-512 which masks them.
+*/
+
+#if defined(CAT_GF256_X86_DISPATCH)
+
+CAT_TARGET_SSSE3 static void MulAddSSSE3(void * CAT_RESTRICT vdest, u8 x, const void * CAT_RESTRICT vsrc, int bytes) {
+	u8 * CAT_RESTRICT dest = reinterpret_cast<u8*>( vdest );
+	const u8 * CAT_RESTRICT src = reinterpret_cast<const u8*>( vsrc );
+	const u8 *split = GF256_SPLIT_TABLE + ((u32)x << 5);
+
+	const __m128i table_lo = _mm_loadu_si128((const __m128i *)split);
+	const __m128i table_hi = _mm_loadu_si128((const __m128i *)(split + 16));
+	const __m128i clr_mask = _mm_set1_epi8(0x0f);
+
+	while (bytes >= 16) {
+		__m128i s = _mm_loadu_si128((const __m128i *)src);
+		__m128i lo = _mm_shuffle_epi8(table_lo, _mm_and_si128(s, clr_mask));
+		__m128i hi = _mm_shuffle_epi8(table_hi, _mm_and_si128(_mm_srli_epi64(s, 4), clr_mask));
+		__m128i d = _mm_loadu_si128((const __m128i *)dest);
+		_mm_storeu_si128((__m128i *)dest, _mm_xor_si128(d, _mm_xor_si128(lo, hi)));
+
+		src += 16;
+		dest += 16;
+		bytes -= 16;
+	}
+
+	if (bytes > 0) {
+		MulAddTable(dest, x, src, bytes);
+	}
+}
+
+CAT_TARGET_SSSE3 static void DivideSSSE3(void * CAT_RESTRICT vdest, u8 x, int bytes) {
+	u8 * CAT_RESTRICT dest = reinterpret_cast<u8*>( vdest );
+	const u8 *split = GF256_SPLIT_TABLE + ((u32)GF256_INV_TABLE[x] << 5);
+
+	const __m128i table_lo = _mm_loadu_si128((const __m128i *)split);
+	const __m128i table_hi = _mm_loadu_si128((const __m128i *)(split + 16));
+	const __m128i clr_mask = _mm_set1_epi8(0x0f);
+
+	while (bytes >= 16) {
+		__m128i d = _mm_loadu_si128((const __m128i *)dest);
+		__m128i lo = _mm_shuffle_epi8(table_lo, _mm_and_si128(d, clr_mask));
+		__m128i hi = _mm_shuffle_epi8(table_hi, _mm_and_si128(_mm_srli_epi64(d, 4), clr_mask));
+		_mm_storeu_si128((__m128i *)dest, _mm_xor_si128(lo, hi));
+
+		dest += 16;
+		bytes -= 16;
+	}
+
+	if (bytes > 0) {
+		DivideTable(dest, x, bytes);
+	}
+}
+
+CAT_TARGET_AVX2 static void MulAddAVX2(void * CAT_RESTRICT vdest, u8 x, const void * CAT_RESTRICT vsrc, int bytes) {
+	u8 * CAT_RESTRICT dest = reinterpret_cast<u8*>( vdest );
+	const u8 * CAT_RESTRICT src = reinterpret_cast<const u8*>( vsrc );
+	const u8 *split = GF256_SPLIT_TABLE + ((u32)x << 5);
+
+	const __m256i table_lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)split));
+	const __m256i table_hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(split + 16)));
+	const __m256i clr_mask = _mm256_set1_epi8(0x0f);
+
+	while (bytes >= 32) {
+		__m256i s = _mm256_loadu_si256((const __m256i *)src);
+		__m256i lo = _mm256_shuffle_epi8(table_lo, _mm256_and_si256(s, clr_mask));
+		__m256i hi = _mm256_shuffle_epi8(table_hi, _mm256_and_si256(_mm256_srli_epi64(s, 4), clr_mask));
+		__m256i d = _mm256_loadu_si256((const __m256i *)dest);
+		_mm256_storeu_si256((__m256i *)dest, _mm256_xor_si256(d, _mm256_xor_si256(lo, hi)));
+
+		src += 32;
+		dest += 32;
+		bytes -= 32;
+	}
+
+	if (bytes > 0) {
+		MulAddTable(dest, x, src, bytes);
+	}
+}
+
+CAT_TARGET_AVX2 static void DivideAVX2(void * CAT_RESTRICT vdest, u8 x, int bytes) {
+	u8 * CAT_RESTRICT dest = reinterpret_cast<u8*>( vdest );
+	const u8 *split = GF256_SPLIT_TABLE + ((u32)GF256_INV_TABLE[x] << 5);
+
+	const __m256i table_lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)split));
+	const __m256i table_hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(split + 16)));
+	const __m256i clr_mask = _mm256_set1_epi8(0x0f);
+
+	while (bytes >= 32) {
+		__m256i d = _mm256_loadu_si256((const __m256i *)dest);
+		__m256i lo = _mm256_shuffle_epi8(table_lo, _mm256_and_si256(d, clr_mask));
+		__m256i hi = _mm256_shuffle_epi8(table_hi, _mm256_and_si256(_mm256_srli_epi64(d, 4), clr_mask));
+		_mm256_storeu_si256((__m256i *)dest, _mm256_xor_si256(lo, hi));
+
+		dest += 32;
+		bytes -= 32;
+	}
+
+	if (bytes > 0) {
+		DivideTable(dest, x, bytes);
+	}
+}
+
+CAT_TARGET_AVX512 static void MulAddAVX512(void * CAT_RESTRICT vdest, u8 x, const void * CAT_RESTRICT vsrc, int bytes) {
+	u8 * CAT_RESTRICT dest = reinterpret_cast<u8*>( vdest );
+	const u8 * CAT_RESTRICT src = reinterpret_cast<const u8*>( vsrc );
+	const u8 *split = GF256_SPLIT_TABLE + ((u32)x << 5);
+
+	const __m512i table_lo = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)split));
+	const __m512i table_hi = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)(split + 16)));
+	const __m512i clr_mask = _mm512_set1_epi8(0x0f);
+
+	while (bytes >= 64) {
+		__m512i s = _mm512_loadu_si512((const void *)src);
+		__m512i lo = _mm512_shuffle_epi8(table_lo, _mm512_and_si512(s, clr_mask));
+		__m512i hi = _mm512_shuffle_epi8(table_hi, _mm512_and_si512(_mm512_srli_epi64(s, 4), clr_mask));
+		__m512i d = _mm512_loadu_si512((const void *)dest);
+		_mm512_storeu_si512((void *)dest, _mm512_ternarylogic_epi64(d, lo, hi, 0x96));
+
+		src += 64;
+		dest += 64;
+		bytes -= 64;
+	}
+
+	if (bytes > 0) {
+		__mmask64 mask = (__mmask64)(((u64)1 << bytes) - 1);
+		__m512i s = _mm512_maskz_loadu_epi8(mask, src);
+		__m512i lo = _mm512_shuffle_epi8(table_lo, _mm512_and_si512(s, clr_mask));
+		__m512i hi = _mm512_shuffle_epi8(table_hi, _mm512_and_si512(_mm512_srli_epi64(s, 4), clr_mask));
+		__m512i d = _mm512_maskz_loadu_epi8(mask, dest);
+		_mm512_mask_storeu_epi8(dest, mask, _mm512_ternarylogic_epi64(d, lo, hi, 0x96));
+	}
+}
+
+CAT_TARGET_AVX512 static void DivideAVX512(void * CAT_RESTRICT vdest, u8 x, int bytes) {
+	u8 * CAT_RESTRICT dest = reinterpret_cast<u8*>( vdest );
+	const u8 *split = GF256_SPLIT_TABLE + ((u32)GF256_INV_TABLE[x] << 5);
+
+	const __m512i table_lo = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)split));
+	const __m512i table_hi = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)(split + 16)));
+	const __m512i clr_mask = _mm512_set1_epi8(0x0f);
+
+	while (bytes >= 64) {
+		__m512i d = _mm512_loadu_si512((const void *)dest);
+		__m512i lo = _mm512_shuffle_epi8(table_lo, _mm512_and_si512(d, clr_mask));
+		__m512i hi = _mm512_shuffle_epi8(table_hi, _mm512_and_si512(_mm512_srli_epi64(d, 4), clr_mask));
+		_mm512_storeu_si512((void *)dest, _mm512_xor_si512(lo, hi));
+
+		dest += 64;
+		bytes -= 64;
+	}
+
+	if (bytes > 0) {
+		__mmask64 mask = (__mmask64)(((u64)1 << bytes) - 1);
+		__m512i d = _mm512_maskz_loadu_epi8(mask, dest);
+		__m512i lo = _mm512_shuffle_epi8(table_lo, _mm512_and_si512(d, clr_mask));
+		__m512i hi = _mm512_shuffle_epi8(table_hi, _mm512_and_si512(_mm512_srli_epi64(d, 4), clr_mask));
+		_mm512_mask_storeu_epi8(dest, mask, _mm512_xor_si512(lo, hi));
+	}
+}
+
+// Multi-source kernels keep a tile of the destination in registers while
+// every source is folded in.  They cover whole tiles from offset towards
+// end and return where they stopped.  Accumulators start from the
+// destination when add is set
+
+#define CAT_GF256_MULADD128(acc, s) \
+	acc = _mm_xor_si128(acc, _mm_xor_si128( \
+		_mm_shuffle_epi8(table_lo, _mm_and_si128(s, clr_mask)), \
+		_mm_shuffle_epi8(table_hi, _mm_and_si128(_mm_srli_epi64(s, 4), clr_mask))));
+
+CAT_TARGET_SSSE3 static int MulAddNSSSE3(u8 * CAT_RESTRICT dest, const u8 *coeffs, const u8 * const *srcs, int count, int offset, int end, bool add) {
+	const __m128i clr_mask = _mm_set1_epi8(0x0f);
+
+	for (; offset + 64 <= end; offset += 64) {
+		u8 *d = dest + offset;
+		__m128i x0, x1, x2, x3;
+
+		if (add) {
+			x0 = _mm_loadu_si128((const __m128i *)d);
+			x1 = _mm_loadu_si128((const __m128i *)(d + 16));
+			x2 = _mm_loadu_si128((const __m128i *)(d + 32));
+			x3 = _mm_loadu_si128((const __m128i *)(d + 48));
+		} else {
+			x0 = x1 = x2 = x3 = _mm_setzero_si128();
+		}
+
+		for (int ii = 0; ii < count; ++ii) {
+			const u8 c = coeffs[ii];
+			if (c == 0) {
+				continue;
+			}
+
+			const u8 *split = GF256_SPLIT_TABLE + ((u32)c << 5);
+			const __m128i table_lo = _mm_loadu_si128((const __m128i *)split);
+			const __m128i table_hi = _mm_loadu_si128((const __m128i *)(split + 16));
+			const u8 *src = srcs[ii] + offset;
+
+			__m128i s0 = _mm_loadu_si128((const __m128i *)src);
+			__m128i s1 = _mm_loadu_si128((const __m128i *)(src + 16));
+			__m128i s2 = _mm_loadu_si128((const __m128i *)(src + 32));
+			__m128i s3 = _mm_loadu_si128((const __m128i *)(src + 48));
+			CAT_GF256_MULADD128(x0, s0);
+			CAT_GF256_MULADD128(x1, s1);
+			CAT_GF256_MULADD128(x2, s2);
+			CAT_GF256_MULADD128(x3, s3);
+		}
+
+		_mm_storeu_si128((__m128i *)d, x0);
+		_mm_storeu_si128((__m128i *)(d + 16), x1);
+		_mm_storeu_si128((__m128i *)(d + 32), x2);
+		_mm_storeu_si128((__m128i *)(d + 48), x3);
+	}
+
+	return offset;
+}
+
+#undef CAT_GF256_MULADD128
+
+#define CAT_GF256_MULADD256(acc, s) \
+	acc = _mm256_xor_si256(acc, _mm256_xor_si256( \
+		_mm256_shuffle_epi8(table_lo, _mm256_and_si256(s, clr_mask)), \
+		_mm256_shuffle_epi8(table_hi, _mm256_and_si256(_mm256_srli_epi64(s, 4), clr_mask))));
+
+CAT_TARGET_AVX2 static int MulAddNAVX2(u8 * CAT_RESTRICT dest, const u8 *coeffs, const u8 * const *srcs, int count, int offset, int end, bool add) {
+	const __m256i clr_mask = _mm256_set1_epi8(0x0f);
+
+	for (; offset + 128 <= end; offset += 128) {
+		u8 *d = dest + offset;
+		__m256i x0, x1, x2, x3;
+
+		if (add) {
+			x0 = _mm256_loadu_si256((const __m256i *)d);
+			x1 = _mm256_loadu_si256((const __m256i *)(d + 32));
+			x2 = _mm256_loadu_si256((const __m256i *)(d + 64));
+			x3 = _mm256_loadu_si256((const __m256i *)(d + 96));
+		} else {
+			x0 = x1 = x2 = x3 = _mm256_setzero_si256();
+		}
+
+		for (int ii = 0; ii < count; ++ii) {
+			const u8 c = coeffs[ii];
+			if (c == 0) {
+				continue;
+			}
+
+			const u8 *split = GF256_SPLIT_TABLE + ((u32)c << 5);
+			const __m256i table_lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)split));
+			const __m256i table_hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(split + 16)));
+			const u8 *src = srcs[ii] + offset;
+
+			__m256i s0 = _mm256_loadu_si256((const __m256i *)src);
+			__m256i s1 = _mm256_loadu_si256((const __m256i *)(src + 32));
+			__m256i s2 = _mm256_loadu_si256((const __m256i *)(src + 64));
+			__m256i s3 = _mm256_loadu_si256((const __m256i *)(src + 96));
+			CAT_GF256_MULADD256(x0, s0);
+			CAT_GF256_MULADD256(x1, s1);
+			CAT_GF256_MULADD256(x2, s2);
+			CAT_GF256_MULADD256(x3, s3);
+		}
+
+		_mm256_storeu_si256((__m256i *)d, x0);
+		_mm256_storeu_si256((__m256i *)(d + 32), x1);
+		_mm256_storeu_si256((__m256i *)(d + 64), x2);
+		_mm256_storeu_si256((__m256i *)(d + 96), x3);
+	}
+
+	return offset;
+}
+
+#undef CAT_GF256_MULADD256
+
+#define CAT_GF256_MULADD512(acc, s) \
+	acc = _mm512_ternarylogic_epi64(acc, \
+		_mm512_shuffle_epi8(table_lo, _mm512_and_si512(s, clr_mask)), \
+		_mm512_shuffle_epi8(table_hi, _mm512_and_si512(_mm512_srli_epi64(s, 4), clr_mask)), 0x96);
+
+CAT_TARGET_AVX512 static int MulAddNAVX512(u8 * CAT_RESTRICT dest, const u8 *coeffs, const u8 * const *srcs, int count, int offset, int end, bool add) {
+	const __m512i clr_mask = _mm512_set1_epi8(0x0f);
+
+	for (; offset + 256 <= end; offset += 256) {
+		u8 *d = dest + offset;
+		__m512i x0, x1, x2, x3;
+
+		if (add) {
+			x0 = _mm512_loadu_si512((const void *)d);
+			x1 = _mm512_loadu_si512((const void *)(d + 64));
+			x2 = _mm512_loadu_si512((const void *)(d + 128));
+			x3 = _mm512_loadu_si512((const void *)(d + 192));
+		} else {
+			x0 = x1 = x2 = x3 = _mm512_setzero_si512();
+		}
+
+		for (int ii = 0; ii < count; ++ii) {
+			const u8 c = coeffs[ii];
+			if (c == 0) {
+				continue;
+			}
+
+			const u8 *split = GF256_SPLIT_TABLE + ((u32)c << 5);
+			const __m512i table_lo = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)split));
+			const __m512i table_hi = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)(split + 16)));
+			const u8 *src = srcs[ii] + offset;
+
+			__m512i s0 = _mm512_loadu_si512((const void *)src);
+			__m512i s1 = _mm512_loadu_si512((const void *)(src + 64));
+			__m512i s2 = _mm512_loadu_si512((const void *)(src + 128));
+			__m512i s3 = _mm512_loadu_si512((const void *)(src + 192));
+			CAT_GF256_MULADD512(x0, s0);
+			CAT_GF256_MULADD512(x1, s1);
+			CAT_GF256_MULADD512(x2, s2);
+			CAT_GF256_MULADD512(x3, s3);
+		}
+
+		_mm512_storeu_si512((void *)d, x0);
+		_mm512_storeu_si512((void *)(d + 64), x1);
+		_mm512_storeu_si512((void *)(d + 128), x2);
+		_mm512_storeu_si512((void *)(d + 192), x3);
+	}
+
+	return offset;
+}
+
+#undef CAT_GF256_MULADD512
+
+enum GF256Kernel {
+	GF256_KERNEL_TABLE,
+	GF256_KERNEL_SSSE3,
+	GF256_KERNEL_AVX2,
+	GF256_KERNEL_AVX512
+};
+
+static GF256Kernel DetectKernel() {
+	if (HasCPUFeatures(CPU_AVX512F | CPU_AVX512BW)) {
+		return GF256_KERNEL_AVX512;
+	}
+	if (HasCPUFeatures(CPU_AVX2)) {
+		return GF256_KERNEL_AVX2;
+	}
+	if (HasCPUFeatures(CPU_SSSE3)) {
+		return GF256_KERNEL_SSSE3;
+	}
+	return GF256_KERNEL_TABLE;
+}
+
+#endif // CAT_GF256_X86_DISPATCH
+
+#if defined(CAT_GF256_NEON)
+
+static void MulAddNEON(void * CAT_RESTRICT vdest, u8 x, const void * CAT_RESTRICT vsrc, int bytes) {
+	u8 * CAT_RESTRICT dest = reinterpret_cast<u8*>( vdest );
+	const u8 * CAT_RESTRICT src = reinterpret_cast<const u8*>( vsrc );
+	const u8 *split = GF256_SPLIT_TABLE + ((u32)x << 5);
+
+	const uint8x16_t table_lo = vld1q_u8(split);
+	const uint8x16_t table_hi = vld1q_u8(split + 16);
+	const uint8x16_t clr_mask = vdupq_n_u8(0x0f);
+
+	while (bytes >= 16) {
+		uint8x16_t s = vld1q_u8(src);
+		uint8x16_t lo = vqtbl1q_u8(table_lo, vandq_u8(s, clr_mask));
+		uint8x16_t hi = vqtbl1q_u8(table_hi, vshrq_n_u8(s, 4));
+		vst1q_u8(dest, veorq_u8(vld1q_u8(dest), veorq_u8(lo, hi)));
+
+		src += 16;
+		dest += 16;
+		bytes -= 16;
+	}
+
+	if (bytes > 0) {
+		MulAddTable(dest, x, src, bytes);
+	}
+}
+
+static void DivideNEON(void * CAT_RESTRICT vdest, u8 x, int bytes) {
+	u8 * CAT_RESTRICT dest = reinterpret_cast<u8*>( vdest );
+	const u8 *split = GF256_SPLIT_TABLE + ((u32)GF256_INV_TABLE[x] << 5);
+
+	const uint8x16_t table_lo = vld1q_u8(split);
+	const uint8x16_t table_hi = vld1q_u8(split + 16);
+	const uint8x16_t clr_mask = vdupq_n_u8(0x0f);
+
+	while (bytes >= 16) {
+		uint8x16_t d = vld1q_u8(dest);
+		uint8x16_t lo = vqtbl1q_u8(table_lo, vandq_u8(d, clr_mask));
+		uint8x16_t hi = vqtbl1q_u8(table_hi, vshrq_n_u8(d, 4));
+		vst1q_u8(dest, veorq_u8(lo, hi));
+
+		dest += 16;
+		bytes -= 16;
+	}
+
+	if (bytes > 0) {
+		DivideTable(dest, x, bytes);
+	}
+}
+
+#define CAT_GF256_MULADDNEON(acc, s) \
+	acc = veorq_u8(acc, veorq_u8( \
+		vqtbl1q_u8(table_lo, vandq_u8(s, clr_mask)), \
+		vqtbl1q_u8(table_hi, vshrq_n_u8(s, 4))));
+
+static int MulAddNNEON(u8 * CAT_RESTRICT dest, const u8 *coeffs, const u8 * const *srcs, int count, int offset, int end, bool add) {
+	const uint8x16_t clr_mask = vdupq_n_u8(0x0f);
+
+	for (; offset + 64 <= end; offset += 64) {
+		u8 *d = dest + offset;
+		uint8x16_t x0, x1, x2, x3;
+
+		if (add) {
+			x0 = vld1q_u8(d);
+			x1 = vld1q_u8(d + 16);
+			x2 = vld1q_u8(d + 32);
+			x3 = vld1q_u8(d + 48);
+		} else {
+			x0 = x1 = x2 = x3 = vdupq_n_u8(0);
+		}
+
+		for (int ii = 0; ii < count; ++ii) {
+			const u8 c = coeffs[ii];
+			if (c == 0) {
+				continue;
+			}
+
+			const u8 *split = GF256_SPLIT_TABLE + ((u32)c << 5);
+			const uint8x16_t table_lo = vld1q_u8(split);
+			const uint8x16_t table_hi = vld1q_u8(split + 16);
+			const u8 *src = srcs[ii] + offset;
+
+			uint8x16_t s0 = vld1q_u8(src);
+			uint8x16_t s1 = vld1q_u8(src + 16);
+			uint8x16_t s2 = vld1q_u8(src + 32);
+			uint8x16_t s3 = vld1q_u8(src + 48);
+			CAT_GF256_MULADDNEON(x0, s0);
+			CAT_GF256_MULADDNEON(x1, s1);
+			CAT_GF256_MULADDNEON(x2, s2);
+			CAT_GF256_MULADDNEON(x3, s3);
+		}
+
+		vst1q_u8(d, x0);
+		vst1q_u8(d + 16, x1);
+		vst1q_u8(d + 32, x2);
+		vst1q_u8(d + 48, x3);
+	}
+
+	return offset;
+}
+
+#undef CAT_GF256_MULADDNEON
+
+#endif // CAT_GF256_NEON
+
+
+//// Dispatch
+
+typedef void (*MulAddFunc)(void * CAT_RESTRICT, u8, const void * CAT_RESTRICT, int);
+typedef void (*DivideFunc)(void * CAT_RESTRICT, u8, int);
+typedef int (*MulAddNFunc)(u8 * CAT_RESTRICT, const u8 *, const u8 * const *, int, int, int, bool);
+
+// No vector kernel: every byte goes through the remainder path
+static int MulAddNNone(u8 * CAT_RESTRICT, const u8 *, const u8 * const *, int, int offset, int, bool) {
+	return offset;
+}
+
+static MulAddFunc m_muladd = MulAddTable;
+static DivideFunc m_divide = DivideTable;
+static MulAddNFunc m_muladdn = MulAddNNone;
+
+static void BindKernels() {
+#if defined(CAT_GF256_X86_DISPATCH)
+	switch (DetectKernel()) {
+	case GF256_KERNEL_AVX512:
+		m_muladd = MulAddAVX512;
+		m_divide = DivideAVX512;
+		m_muladdn = MulAddNAVX512;
+		break;
+	case GF256_KERNEL_AVX2:
+		m_muladd = MulAddAVX2;
+		m_divide = DivideAVX2;
+		m_muladdn = MulAddNAVX2;
+		break;
+	case GF256_KERNEL_SSSE3:
+		m_muladd = MulAddSSSE3;
+		m_divide = DivideSSSE3;
+		m_muladdn = MulAddNSSSE3;
+		break;
+	default:
+		break;
+	}
+#elif defined(CAT_GF256_NEON)
+	m_muladd = MulAddNEON;
+	m_divide = DivideNEON;
+	m_muladdn = MulAddNNEON;
+#endif
+}
+
+
+//// Initialization
+
+// Unpack 256x256 multiplication tables
+static void GenerateTables() {
+	u8 *m = m_tables.mul, *d = m_tables.div;
+
+	// Unroll y = 0 subtable
+	for (int x = 0; x < 256; ++x) {
+		m[x] = d[x] = 0;
+	}
+
+	// For each other y value,
+	for (int y = 1; y < 256; ++y) {
+		// Calculate log(y) for mult and 255 - log(y) for div
+		const u8 log_y = (u8)GF256_LOG_TABLE[y];
+		const u8 log_yn = 255 - log_y;
+
+		// Next subtable
+		m += 256;
+		d += 256;
+
+		// Unroll x = 0
+		m[0] = 0;
+		d[0] = 0;
+
+		// Calculate x * y, x / y
+		for (int x = 1; x < 256; ++x) {
+			int log_x = GF256_LOG_TABLE[x];
+
+			m[x] = GF256_EXP_TABLE[log_x + log_y];
+			d[x] = GF256_EXP_TABLE[log_x + log_yn];
+		}
+	}
+
+	// Products of each y with every low nibble and every high nibble
+	u8 *split = m_tables.split;
+	for (int y = 0; y < 256; ++y) {
+		const u8 *row = m_tables.mul + (y << 8);
+
+		for (int n = 0; n < 16; ++n) {
+			split[n] = row[n];
+			split[16 + n] = row[n << 4];
+		}
+
+		split += 32;
+	}
+}
+
+void cat::GF256Init() {
+	// If initialized already,
+	if (GF256_READY) {
+		// Read the tables and kernels only after the flag
+		Atomic::LoadMemoryBarrier();
+		return;
+	}
+
+	// Generation takes microseconds, so later callers just spin on the lock
+	while (Atomic::Set(&m_init_lock, 1) != 0) {
+	}
+
+	// If another thread finished while this one waited,
+	if (GF256_READY) {
+		Atomic::LoadMemoryBarrier();
+	} else {
+		GenerateTables();
+		BindKernels();
+
+		// Tables and kernels must be visible before the flag
+		Atomic::StoreMemoryBarrier();
+
+		GF256_READY = true;
+	}
+
+	Atomic::Set(&m_init_lock, 0);
+}
+
+// Generate the tables before main() so that threads started later see
+// GF256_READY set by the time they run the inline checks
+static struct GF256StartupInit {
+	GF256StartupInit() {
+		GF256Init();
+	}
+} m_startup_init;
+
+
+//// Memory operations
+
+// Performs "dest[] += src[] * x" operation in GF(256)
+void cat::GF256MemMulAdd(void * CAT_RESTRICT vdest, u8 x, const void * CAT_RESTRICT vsrc, int bytes) {
+	if (CAT_UNLIKELY(!GF256_READY)) {
+		GF256Init();
+	}
+
+	if (x == 0) {
+		return;
+	}
+
+	if (x == 1) {
+		memxor(vdest, vsrc, bytes);
+		return;
+	}
+
+	m_muladd(vdest, x, vsrc, bytes);
+}
+
+// Performs "dest[] /= x" operation in GF(256)
+void cat::GF256MemDivide(void * CAT_RESTRICT vdest, u8 x, int bytes) {
+	if (CAT_UNLIKELY(!GF256_READY)) {
+		GF256Init();
+	}
+
+	if (x == 1) {
+		return;
+	}
+
+	m_divide(vdest, x, bytes);
+}
+
+// Bytes of each destination finished against all sources before moving on,
+// so the destination chunk stays in L1 on the table and remainder paths
+static const int MULADDN_CHUNK = 2048;
+
+static void MulAddNChunk(u8 * CAT_RESTRICT dest, const u8 *coeffs, const u8 * const *srcs, int count, int offset, int end, bool add) {
+	// Vector tiles first
+	int done = m_muladdn(dest, coeffs, srcs, count, offset, end, add);
+
+	// Then each source in turn over the partial tile
+	if (done < end) {
+		int remaining = end - done;
+
+		if (!add) {
+			memset(dest + done, 0, remaining);
+		}
+
+		for (int ii = 0; ii < count; ++ii) {
+			GF256MemMulAdd(dest + done, coeffs[ii], srcs[ii] + done, remaining);
+		}
+	}
+}
+
+// Performs "dest[] += srcs[0][] * coeffs[0] + ... + srcs[count-1][] * coeffs[count-1]" in GF(256)
+void cat::GF256MemMulAddN(void * CAT_RESTRICT vdest, const u8 *coeffs, const void * const *vsrcs, int count, int bytes) {
+	if (CAT_UNLIKELY(!GF256_READY)) {
+		GF256Init();
+	}
+
+	u8 * CAT_RESTRICT dest = reinterpret_cast<u8*>( vdest );
+	const u8 * const *srcs = reinterpret_cast<const u8 * const *>( vsrcs );
+
+	for (int offset = 0; offset < bytes; offset += MULADDN_CHUNK) {
+		int end = offset + MULADDN_CHUNK;
+		if (end > bytes) {
+			end = bytes;
+		}
+
+		MulAddNChunk(dest, coeffs, srcs, count, offset, end, true);
+	}
+}
+
+// Performs "dests[r][] = sum over c of srcs[c][] * matrix[r * cols + c]" in GF(256)
+void cat::GF256MatrixMultiply(void * const *vdests, const u8 *matrix, int rows, const void * const *vsrcs, int cols, int bytes) {
+	if (CAT_UNLIKELY(!GF256_READY)) {
+		GF256Init();
+	}
+
+	u8 * const *dests = reinterpret_cast<u8 * const *>( vdests );
+	const u8 * const *srcs = reinterpret_cast<const u8 * const *>( vsrcs );
+
+	// Every row reads the same chunk of each source while it is still cached
+	for (int offset = 0; offset < bytes; offset += MULADDN_CHUNK) {
+		int end = offset + MULADDN_CHUNK;
+		if (end > bytes) {
+			end = bytes;
+		}
+
+		for (int row = 0; row < rows; ++row) {
+			MulAddNChunk(dests[row], matrix + row * cols, srcs, cols, offset, end, false);
+		}
+	}
+}
+
+
+//// Linear systems
+
+bool cat::GF256Solve(u8 *matrix, int n, void **blocks, int bytes) {
+	if (n <= 0 || n > GF256_MAX_SOLVE) {
+		return false;
+	}
+
+	u8 perm[GF256_MAX_SOLVE];
+	for (int ii = 0; ii < n; ++ii) {
+		perm[ii] = (u8)ii;
+	}
+
+	// Factor the matrix into L and U in place before touching any block, so
+	// a singular matrix leaves the blocks as they were
+	for (int k = 0; k < n; ++k) {
+		// Pick the pivot row with the fewest remaining non-zeros so sparse
+		// (systematic) rows are used first and cause no fill-in
+		int pivot_row = -1, pivot_count = n + 1;
+
+		for (int r = k; r < n; ++r) {
+			const u8 *row = matrix + r * n;
+			if (row[k] == 0) {
+				continue;
+			}
+
+			int count = 0;
+			for (int c = k; c < n; ++c) {
+				count += row[c] != 0;
+			}
+
+			if (count < pivot_count) {
+				pivot_row = r;
+				pivot_count = count;
+
+				// Can't do better than the pivot alone
+				if (count == 1) {
+					break;
+				}
+			}
+		}
+
+		// If the column is all zeros,
+		if (pivot_row < 0) {
+			return false;
+		}
+
+		u8 *pivot = matrix + k * n;
+
+		if (pivot_row != k) {
+			memswap_rows(matrix, n, k, pivot_row, n);
+
+			u8 t = perm[k];
+			perm[k] = perm[pivot_row];
+			perm[pivot_row] = t;
+		}
+
+		const u8 pivot_value = pivot[k];
+
+		// Eliminate below the pivot, keeping each multiplier in place of the zero
+		for (int r = k + 1; r < n; ++r) {
+			u8 *row = matrix + r * n;
+			if (row[k] == 0) {
+				continue;
+			}
+
+			const u8 m = GF256Divide(row[k], pivot_value);
+			row[k] = m;
+
+			GF256MemMulAdd(row + k + 1, m, pivot + k + 1, n - k - 1);
+		}
+	}
+
+	// Put the blocks in pivot order
+	void *ordered[GF256_MAX_SOLVE];
+	for (int ii = 0; ii < n; ++ii) {
+		ordered[ii] = blocks[perm[ii]];
+	}
+	for (int ii = 0; ii < n; ++ii) {
+		blocks[ii] = ordered[ii];
+	}
+
+	u8 coeffs[GF256_MAX_SOLVE];
+	const void *srcs[GF256_MAX_SOLVE];
+
+	// Forward substitution with L: "y[r] = b[r] + sum of L[r][p] * y[p] for p < r"
+	for (int r = 1; r < n; ++r) {
+		const u8 *row = matrix + r * n;
+		int count = 0;
+
+		for (int p = 0; p < r; ++p) {
+			if (row[p] != 0) {
+				coeffs[count] = row[p];
+				srcs[count] = blocks[p];
+				++count;
+			}
+		}
+
+		if (count > 0) {
+			GF256MemMulAddN(blocks[r], coeffs, srcs, count, bytes);
+		}
+	}
+
+	// Back substitution with U: "x[i] = (y[i] + sum of U[i][j] * x[j] for j > i) / U[i][i]"
+	for (int ii = n - 1; ii >= 0; --ii) {
+		const u8 *row = matrix + ii * n;
+		int count = 0;
+
+		for (int jj = ii + 1; jj < n; ++jj) {
+			if (row[jj] != 0) {
+				coeffs[count] = row[jj];
+				srcs[count] = blocks[jj];
+				++count;
+			}
+		}
+
+		if (count > 0) {
+			GF256MemMulAddN(blocks[ii], coeffs, srcs, count, bytes);
+		}
+
+		GF256MemDivide(blocks[ii], row[ii], bytes);
+	}
+
+	return true;
+}
@@ -66,22 +66,41 @@ extern const u16 GF256_LOG_TABLE[256];
 extern const u8 GF256_EXP_TABLE[512*2+1];
 extern const u8 GF256_INV_TABLE[256];
 
-// Generated tables
+// Generated tables, in static storage with each row for one y value
+// starting on a cache line.  They are filled in on first use
 extern u8 * CAT_RESTRICT GF256_MUL_TABLE;
 extern u8 * CAT_RESTRICT GF256_DIV_TABLE;
 
-// Call this function to initialize the tables
+// 32 bytes per y: y times each low nibble, then y times each high nibble
+extern u8 * CAT_RESTRICT GF256_SPLIT_TABLE;
+
+// Set once the generated tables are ready, which is during static
+// initialization unless a static constructor calls in here first
+extern volatile bool GF256_READY;
+
+// Generates the tables if needed.  Thread-safe; all the functions below call
+// it on first use, and it runs once before main() in any case.
+// It also selects the fastest GF256Mem*() kernels the CPU supports:
+// AVX-512, AVX2 or SSSE3 shuffles on x86, NEON on ARM64, else table lookups
 void GF256Init();
 
 // return x * y in GF(256)
 // For repeated multiplication by a constant, it is faster to put the constant in y.
 static CAT_INLINE u8 GF256Multiply(u8 x, u8 y) {
+	if (CAT_UNLIKELY(!GF256_READY)) {
+		GF256Init();
+	}
+
 	return GF256_MUL_TABLE[((u32)y << 8) + x];
 }
 
 // return x / y in GF(256)
 // Memory-access optimized for constant divisors in y.
 static CAT_INLINE u8 GF256Divide(u8 x, u8 y) {
+	if (CAT_UNLIKELY(!GF256_READY)) {
+		GF256Init();
+	}
+
 	return GF256_DIV_TABLE[((u32)y << 8) + x];
 }
 
@@ -91,6 +110,27 @@ extern void GF256MemMulAdd(void * CAT_RESTRICT vdest, u8 x, const void * CAT_RES
 // Performs "dest[] /= x" operation in GF(256)
 extern void GF256MemDivide(void * CAT_RESTRICT vdest, u8 x, int bytes);
 
+// Performs "dest[] += srcs[0][] * coeffs[0] + ... + srcs[count-1][] * coeffs[count-1]"
+// in GF(256), reading and writing each destination byte once
+extern void GF256MemMulAddN(void * CAT_RESTRICT vdest, const u8 *coeffs, const void * const *vsrcs, int count, int bytes);
+
+// Performs "dests[r][] = sum over c of srcs[c][] * matrix[r * cols + c]" for
+// each of the rows in GF(256), where matrix is stored row by row.
+// Destinations must not overlap the sources
+extern void GF256MatrixMultiply(void * const *vdests, const u8 *matrix, int rows, const void * const *vsrcs, int cols, int bytes);
+
+// Largest system GF256Solve() accepts
+static const int GF256_MAX_SOLVE = 256;
+
+// Solves "matrix * X = B" over data blocks in GF(256), where matrix is n x n
+// stored row by row and blocks[i] holds row i of B, each of the given bytes.
+// Pivot rows are chosen to keep elimination sparse, so with a mostly
+// systematic matrix the received original blocks are only read once.
+// On success the matrix is overwritten and the blocks[] pointers are
+// reordered so that blocks[i] holds row i of X.
+// Returns false if the matrix is singular, leaving the blocks untouched
+extern bool GF256Solve(u8 *matrix, int n, void **blocks, int bytes);
+
 
 } // namespace cat
 
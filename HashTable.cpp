@@ -34,123 +34,17 @@ using namespace cat;
 
 int cat::SanitizeKeyStringCase(const char *key, /*char *sanitized_string,*/ char *case_string)
 {
-	char ch, /* *outs = sanitized_string,*/ *outc = case_string;
-	bool seen_punct = false;
-
-	while ((ch = *key++))
-	{
-		if (ch >= 'A' && ch <= 'Z')
-		{
-			if (seen_punct)
-			{
-				//*outs++ = '.';
-				*outc++ = '.';
-				seen_punct = false;
-			}
-			*outc++ = ch;
-			//*outs++ = ch + 'a' - 'A';
-		}
-		else if (ch >= 'a' && ch <= 'z' ||
-			ch >= '0' && ch <= '9')
-		{
-			if (seen_punct)
-			{
-				//*outs++ = '.';
-				*outc++ = '.';
-				seen_punct = false;
-			}
-			*outc++ = ch;
-			//*outs++ = ch;
-		}
-		else
-		{
-			if (outc != case_string)
-				seen_punct = true;
-		}
-	}
-
-	*outc = '\0';
-	//*outs = '\0';
-
-	return (int)(outc - case_string);
+	return CopySanitizedString(key, -1, case_string, false);
 }
 
 int cat::SanitizeKeyString(const char *key, char *sanitized_string)
 {
-	char ch, *outs = sanitized_string;
-	bool seen_punct = false;
-
-	while ((ch = *key++))
-	{
-		if (ch >= 'A' && ch <= 'Z')
-		{
-			if (seen_punct)
-			{
-				*outs++ = '.';
-				seen_punct = false;
-			}
-			*outs++ = ch + 'a' - 'A';
-		}
-		else if (ch >= 'a' && ch <= 'z' ||
-			ch >= '0' && ch <= '9')
-		{
-			if (seen_punct)
-			{
-				*outs++ = '.';
-				seen_punct = false;
-			}
-			*outs++ = ch;
-		}
-		else
-		{
-			if (outs != sanitized_string)
-				seen_punct = true;
-		}
-	}
-
-	*outs = '\0';
-
-	return (int)(outs - sanitized_string);
+	return CopySanitizedString(key, -1, sanitized_string, true);
 }
 
 int cat::SanitizeKeyRangeString(const char *key, int len, char *sanitized_string)
 {
-	char ch, *outs = sanitized_string;
-	bool seen_punct = false;
-
-	while (len-- > 0)
-	{
-		ch = *key++;
-
-		if (ch >= 'A' && ch <= 'Z')
-		{
-			if (seen_punct)
-			{
-				*outs++ = '.';
-				seen_punct = false;
-			}
-			*outs++ = ch + 'a' - 'A';
-		}
-		else if (ch >= 'a' && ch <= 'z' ||
-			ch >= '0' && ch <= '9')
-		{
-			if (seen_punct)
-			{
-				*outs++ = '.';
-				seen_punct = false;
-			}
-			*outs++ = ch;
-		}
-		else
-		{
-			if (outs != sanitized_string)
-				seen_punct = true;
-		}
-	}
-
-	*outs = '\0';
-
-	return (int)(outs - sanitized_string);
+	return CopySanitizedString(key, len > 0 ? len : 0, sanitized_string, true);
 }
 
 
@@ -199,12 +93,10 @@ HashItem::HashItem(const KeyAdapter &key)
 
 //// HashTableBase
 
-bool HashTableBase::Grow()
+bool HashTableBase::Grow(u32 new_size, bool incremental)
 {
-	// Calculate growth rate
-	u32 old_size = _allocated;
-	u32 new_size = old_size * GROW_RATE;
-	if (new_size < PREALLOC) new_size = PREALLOC;
+	// Finish any growth still in progress
+	FinishMigration();
 
 	CAT_INANE("HashTable") << "Growing to " << new_size << " buckets";
 
@@ -212,27 +104,80 @@ bool HashTableBase::Grow()
 	SListForward *new_buckets = new (std::nothrow) SListForward[new_size];
 	if (!new_buckets) return false;
 
-	if (_buckets)
+	SListForward *old_buckets = _buckets;
+	u32 old_size = _allocated;
+
+	_buckets = new_buckets;
+	_allocated = new_size;
+
+	if (old_buckets)
+	{
+		_old_buckets = old_buckets;
+		_old_allocated = old_size;
+		_migrate_index = 0;
+
+		// If not spreading the work out, migrate everything now
+		if (!incremental)
+			FinishMigration();
+	}
+
+	return true;
+}
+
+bool HashTableBase::Grow()
+{
+	// Calculate growth rate
+	u32 new_size = _allocated * GROW_RATE;
+	if (new_size < PREALLOC) new_size = PREALLOC;
+
+	return Grow(new_size, _incremental);
+}
+
+void HashTableBase::Migrate(u32 count)
+{
+	u32 mask = _allocated - 1;
+
+	// For each old bucket to migrate,
+	while (count-- > 0 && _migrate_index < _old_allocated)
 	{
-		// For each bucket,
-		u32 mask = new_size - 1;
-		for (u32 jj = 0; jj < old_size; ++jj)
+		// For each bucket item,
+		for (iter ii = _old_buckets[_migrate_index++]; ii; ++ii)
 		{
-			// For each bucket item,
-			for (iter ii = _buckets[jj]; ii; ++ii)
-			{
-				new_buckets[ii->Hash() & mask].PushFront(ii);
-			}
+			_buckets[ii->Hash() & mask].PushFront(ii);
 		}
+	}
 
+	// If all old buckets have been migrated,
+	if (_migrate_index >= _old_allocated)
+	{
 		// Free old array
-		delete []_buckets;
+		delete []_old_buckets;
+		_old_buckets = 0;
+		_old_allocated = 0;
+		_migrate_index = 0;
 	}
+}
 
-	_buckets = new_buckets;
-	_allocated = new_size;
+bool HashTableBase::Reserve(u32 count)
+{
+	// Find the smallest size that will not need to grow
+	u32 new_size = _allocated ? _allocated : PREALLOC;
 
-	return true;
+	// If the threshold would overflow,
+	if (count >= 0x80000000 / GROW_THRESH) return false;
+
+	while (count * GROW_THRESH >= new_size)
+	{
+		// If it would overflow,
+		if (new_size >= 0x80000000) return false;
+
+		new_size *= GROW_RATE;
+	}
+
+	// If already large enough,
+	if (new_size <= _allocated) return true;
+
+	return Grow(new_size, false);
 }
 
 HashTableBase::HashTableBase()
@@ -240,10 +185,18 @@ HashTableBase::HashTableBase()
 	_buckets = 0;
 	_allocated = 0;
 	_used = 0;
+
+	_incremental = false;
+	_old_buckets = 0;
+	_old_allocated = 0;
+	_migrate_index = 0;
 }
 
 HashTableBase::~HashTableBase()
 {
+	// Collect any items still waiting in the old array
+	FinishMigration();
+
 	// If any buckets are allocated,
 	if (_buckets)
 	{
@@ -274,6 +227,8 @@ HashItem *HashTableBase::Lookup(const KeyAdapter &key)
 	// If nothing allocated,
 	if (!_allocated) return 0;
 
+	// Lookup() does not migrate so that it is safe under a shared read lock
+
 	// Search used table indices after hash
 	u32 ii = key.Hash() & (_allocated - 1);
 
@@ -288,6 +243,27 @@ HashItem *HashTableBase::Lookup(const KeyAdapter &key)
 		}
 	}
 
+	// If still growing,
+	if (_old_buckets)
+	{
+		u32 old_index = key.Hash() & (_old_allocated - 1);
+
+		// If its old bucket has not been migrated yet,
+		if (old_index >= _migrate_index)
+		{
+			// For each item in the old bucket,
+			for (iter jj = _old_buckets[old_index]; jj; ++jj)
+			{
+				// If the key matches,
+				if (*jj == key)
+				{
+					// Found it!
+					return jj;
+				}
+			}
+		}
+	}
+
 	return 0;
 }
 
@@ -300,6 +276,10 @@ HashItem *HashTableBase::Create(const KeyAdapter &key)
 	HashItem *item = Allocate(key);
 	if (!item) return 0;
 
+	// If growing incrementally, do a bit more of the work
+	if (_old_buckets)
+		Migrate(MIGRATE_STEP);
+
 	// If time to grow,
 	if (_used * GROW_THRESH >= _allocated)
 	{
@@ -333,10 +313,25 @@ void HashTableBase::Iterator::IterateNext()
 		if (_ii) return;
 	}
 
-	while (_remaining)
+	for (;;)
 	{
-		--_remaining;
-		++_bucket;
+		while (_remaining > 1)
+		{
+			--_remaining;
+			++_bucket;
+
+			_ii = *_bucket;
+
+			if (_ii) return;
+		}
+
+		// If no old buckets are left to visit,
+		if (!_old_remaining) return;
+
+		// Continue with the old buckets not migrated yet
+		_remaining = _old_remaining;
+		_bucket = _old_bucket;
+		_old_remaining = 0;
 
 		_ii = *_bucket;
 
@@ -346,6 +341,24 @@ void HashTableBase::Iterator::IterateNext()
 
 HashTableBase::Iterator::Iterator(HashTableBase &head)
 {
+	// Iteration does not migrate, so walk the unmigrated old buckets last
+	_old_remaining = 0;
+	_old_bucket = 0;
+
+	if (head._old_buckets && head._migrate_index < head._old_allocated)
+	{
+		_old_remaining = head._old_allocated - head._migrate_index;
+		_old_bucket = head._old_buckets + head._migrate_index;
+	}
+
+	// If nothing allocated,
+	if (!head._allocated)
+	{
+		_remaining = 0;
+		_bucket = 0;
+		return;
+	}
+
 	_remaining = head._allocated;
 	_bucket = head._buckets;
 	_ii = *_bucket;
@@ -64,6 +64,32 @@ public:
 };
 
 
+//// StaticKey
+
+/*
+	A SanitizedKey that also remembers the original string, for keys that
+	are looked up over and over, such as string literals.  Declaring one
+	static means the key is sanitized and hashed only once:
+
+		static const StaticKey KEY_BUFFER_COUNT("IOThreads.BufferCount");
+
+		int buffer_count = Settings::ref()->getInt(KEY_BUFFER_COUNT, 1000);
+
+	The original string is referenced rather than copied, since it is only
+	needed for the capitalization of new keys, so it must outlive the key.
+*/
+
+class CAT_EXPORT StaticKey : public SanitizedKey
+{
+	const char *_name;
+
+public:
+	CAT_INLINE StaticKey(const char *name) : SanitizedKey(name) { _name = name; }
+
+	CAT_INLINE const char *Name() const { return _name; }
+};
+
+
 //// KeyAdapter
 
 class CAT_EXPORT KeyAdapter
@@ -73,7 +99,7 @@ class CAT_EXPORT KeyAdapter
 	u32 _hash;
 
 public:
-	CAT_INLINE KeyAdapter::KeyAdapter(SanitizedKey &key)
+	CAT_INLINE KeyAdapter(const SanitizedKey &key)
 	{
 		_key = key.Key();
 		_len = key.Length();
@@ -133,7 +159,7 @@ public:
 
 	CAT_INLINE void ClearValue() { _value.Clear(); }
 
-	CAT_INLINE int GetValueInt() { return atoi(_value); }
+	CAT_INLINE int GetValueInt() { return ParseInt(_value); }
 
 	CAT_INLINE const char *GetValueStr() { return _value; }
 
@@ -174,6 +200,21 @@ public:
 
 //// HashTable
 
+/*
+	Chained hash table of HashItems.
+
+	By default the bucket array is rehashed in one pass when it grows.
+	With SetIncrementalGrowth(true), growing instead keeps the old bucket
+	array around and each Create() migrates MIGRATE_STEP old buckets into
+	the new array, so no single call pays for the whole rehash.  Items not
+	migrated yet are still found in the old array.
+
+	Lookup() and Iterator never modify the table, so they may run under a
+	shared read lock.  Create() needs exclusive access.
+
+	Reserve() presizes the table so that it does not need to grow at all.
+*/
+
 class CAT_EXPORT HashTableBase
 {
 	friend class Iterator;
@@ -183,13 +224,29 @@ class CAT_EXPORT HashTableBase
 	static const u32 PREALLOC = 64;
 	static const u32 GROW_THRESH = 2;
 	static const u32 GROW_RATE = 2;
+	static const u32 MIGRATE_STEP = 4;
 
 	u32 _allocated, _used;
 	SListForward *_buckets;
 	typedef SListForward::Iterator<HashItem> iter;
 
+	// Incremental growth state
+	bool _incremental;
+	u32 _old_allocated, _migrate_index;
+	SListForward *_old_buckets;
+
+	bool Grow(u32 new_size, bool incremental);
 	bool Grow();
 
+	// Move up to count buckets from the old array to the new one
+	void Migrate(u32 count);
+
+	CAT_INLINE void FinishMigration()
+	{
+		if (_old_buckets)
+			Migrate(_old_allocated);
+	}
+
 protected:
 	CAT_INLINE virtual HashItem *Allocate(const KeyAdapter &key)
 	{
@@ -203,11 +260,18 @@ public:
 	HashItem *Lookup(const KeyAdapter &key); // Returns 0 if key not found
 	HashItem *Create(const KeyAdapter &key); // Creates if it does not exist yet
 
+	// Spread rehashing across Create() calls instead of stopping to grow
+	CAT_INLINE void SetIncrementalGrowth(bool incremental) { _incremental = incremental; }
+
+	// Presize so that count items can be created without growing
+	// Returns false on allocation failure
+	bool Reserve(u32 count);
+
 	// Iterator
 	class CAT_EXPORT Iterator
 	{
-		u32 _remaining;
-		SListForward *_bucket;
+		u32 _remaining, _old_remaining;
+		SListForward *_bucket, *_old_bucket;
 		iter _ii;
 
 		void IterateNext();
@@ -261,6 +325,46 @@ public:
 	{
 		return static_cast<T*>( HashTableBase::Create(key) );
 	}
+
+	CAT_INLINE void SetIncrementalGrowth(bool incremental)
+	{
+		HashTableBase::SetIncrementalGrowth(incremental);
+	}
+
+	CAT_INLINE bool Reserve(u32 count)
+	{
+		return HashTableBase::Reserve(count);
+	}
+
+	// Iterator
+	class CAT_EXPORT Iterator
+	{
+		HashTableBase::Iterator _ii;
+
+	public:
+		CAT_INLINE Iterator(HashTable &table) : _ii(table) {}
+
+		CAT_INLINE operator T *()
+		{
+			return static_cast<T*>( (HashItem*)_ii );
+		}
+
+		CAT_INLINE T *operator->()
+		{
+			return static_cast<T*>( (HashItem*)_ii );
+		}
+
+		CAT_INLINE Iterator &operator++() // pre-increment
+		{
+			++_ii;
+			return *this;
+		}
+
+		CAT_INLINE Iterator &operator++(int) // post-increment
+		{
+			return ++*this;
+		}
+	};
 };
 
 
@@ -0,0 +1,406 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "IORing.hpp"
+
+#if defined(CAT_OS_LINUX)
+
+#include "ReuseAllocator.hpp"
+#include "Atomic.hpp"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cstring>
+#include <errno.h>
+using namespace cat;
+
+static int io_uring_setup(u32 entries, io_uring_params *p)
+{
+	return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, u32 to_submit, u32 min_complete, u32 flags)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, 0, 0);
+}
+
+static int io_uring_register(int fd, u32 opcode, void *arg, u32 nr_args)
+{
+	return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void ReleaseBuffer(ReuseAllocator *allocator, u8 *buffer)
+{
+	allocator->ReleaseBatch(BatchSet(reinterpret_cast<BatchHead*>( buffer )));
+}
+
+
+//// IORing
+
+IORing::IORing()
+{
+	_fd = -1;
+	_sq_ring = 0;
+	_cq_ring = 0;
+	_sqes = 0;
+
+	_fixed_allocator = 0;
+	_fixed = 0;
+	_fixed_count = 0;
+
+	_ring_allocator = 0;
+	_buf_ring = 0;
+	_ring_buffers = 0;
+	_ring_entries = 0;
+	_ring_count = 0;
+	_ring_bytes = 0;
+}
+
+IORing::~IORing()
+{
+	Finalize();
+}
+
+bool IORing::Initialize(u32 entries)
+{
+	Finalize();
+
+	io_uring_params params;
+	CAT_OBJCLR(params);
+
+	int fd = io_uring_setup(entries, &params);
+	if (fd < 0) return false;
+
+	_fd = fd;
+	_entries = params.sq_entries;
+
+	_sq_ring_bytes = params.sq_off.array + params.sq_entries * sizeof(u32);
+	_cq_ring_bytes = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+	// If both rings share one mapping,
+	bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (single_mmap)
+	{
+		if (_cq_ring_bytes > _sq_ring_bytes)
+			_sq_ring_bytes = _cq_ring_bytes;
+		_cq_ring_bytes = _sq_ring_bytes;
+	}
+
+	void *sq_ring = mmap(0, _sq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (sq_ring == MAP_FAILED)
+	{
+		Finalize();
+		return false;
+	}
+	_sq_ring = (u8*)sq_ring;
+
+	if (single_mmap)
+		_cq_ring = _sq_ring;
+	else
+	{
+		void *cq_ring = mmap(0, _cq_ring_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (cq_ring == MAP_FAILED)
+		{
+			Finalize();
+			return false;
+		}
+		_cq_ring = (u8*)cq_ring;
+	}
+
+	void *sqes = mmap(0, params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (sqes == MAP_FAILED)
+	{
+		Finalize();
+		return false;
+	}
+	_sqes = (io_uring_sqe*)sqes;
+
+	_sq_head = (volatile u32*)(_sq_ring + params.sq_off.head);
+	_sq_tail = (volatile u32*)(_sq_ring + params.sq_off.tail);
+	_sq_mask = *(u32*)(_sq_ring + params.sq_off.ring_mask);
+	_sq_array = (u32*)(_sq_ring + params.sq_off.array);
+	_sq_local_tail = *_sq_tail;
+	_sq_submitted = _sq_local_tail;
+
+	_cq_head = (volatile u32*)(_cq_ring + params.cq_off.head);
+	_cq_tail = (volatile u32*)(_cq_ring + params.cq_off.tail);
+	_cq_mask = *(u32*)(_cq_ring + params.cq_off.ring_mask);
+	_cqes = (io_uring_cqe*)(_cq_ring + params.cq_off.cqes);
+
+	return true;
+}
+
+void IORing::Finalize()
+{
+	if (_fd >= 0)
+	{
+		// Closing the ring also unregisters its buffers
+		close(_fd);
+		_fd = -1;
+	}
+
+	FreeBuffers();
+
+	if (_sqes)
+	{
+		munmap(_sqes, _entries * sizeof(io_uring_sqe));
+		_sqes = 0;
+	}
+
+	if (_cq_ring && _cq_ring != _sq_ring)
+		munmap(_cq_ring, _cq_ring_bytes);
+	_cq_ring = 0;
+
+	if (_sq_ring)
+	{
+		munmap(_sq_ring, _sq_ring_bytes);
+		_sq_ring = 0;
+	}
+}
+
+void IORing::FreeBuffers()
+{
+	if (_fixed)
+	{
+		for (u32 ii = 0; ii < _fixed_count; ++ii)
+			ReleaseBuffer(_fixed_allocator, _fixed[ii]);
+
+		delete []_fixed;
+		_fixed = 0;
+		_fixed_count = 0;
+	}
+
+	if (_ring_buffers)
+	{
+		for (u32 ii = 0; ii < _ring_count; ++ii)
+			ReleaseBuffer(_ring_allocator, _ring_buffers[ii]);
+
+		delete []_ring_buffers;
+		_ring_buffers = 0;
+		_ring_count = 0;
+	}
+
+	if (_buf_ring)
+	{
+		munmap(_buf_ring, _ring_entries * sizeof(io_uring_buf));
+		_buf_ring = 0;
+		_ring_entries = 0;
+	}
+}
+
+io_uring_sqe *IORing::GetSQE()
+{
+	u32 head = *_sq_head;
+	Atomic::LoadMemoryBarrier();
+
+	// If the queue is full,
+	if (_sq_local_tail - head >= _entries)
+		return 0;
+
+	u32 index = _sq_local_tail & _sq_mask;
+	++_sq_local_tail;
+
+	io_uring_sqe *sqe = &_sqes[index];
+	CAT_OBJCLR(*sqe);
+
+	_sq_array[index] = index;
+
+	return sqe;
+}
+
+bool IORing::Submit(u32 wait_count)
+{
+	u32 to_submit = _sq_local_tail - _sq_submitted;
+
+	// Publish the new entries before the tail that covers them
+	Atomic::StoreMemoryBarrier();
+	*_sq_tail = _sq_local_tail;
+
+	if (to_submit == 0 && wait_count == 0)
+		return true;
+
+	int result = io_uring_enter(_fd, to_submit, wait_count, wait_count ? IORING_ENTER_GETEVENTS : 0);
+
+	if (result < 0)
+		return errno == EINTR || errno == EAGAIN || errno == EBUSY;
+
+	_sq_submitted += (u32)result;
+	return true;
+}
+
+bool IORing::Wait(u32 wait_count)
+{
+	int result = io_uring_enter(_fd, 0, wait_count, IORING_ENTER_GETEVENTS);
+
+	return result >= 0 || errno == EINTR;
+}
+
+io_uring_cqe *IORing::PeekCQE()
+{
+	u32 head = *_cq_head;
+	u32 tail = *_cq_tail;
+	Atomic::LoadMemoryBarrier();
+
+	if (head == tail)
+		return 0;
+
+	return &_cqes[head & _cq_mask];
+}
+
+void IORing::SeenCQE()
+{
+	// Finish reading the entry before the kernel may reuse it
+	Atomic::DataMemoryBarrier();
+	*_cq_head = *_cq_head + 1;
+}
+
+bool IORing::RegisterBuffers(ReuseAllocator *allocator, u32 count)
+{
+	if (_fixed || count == 0) return false;
+
+	_fixed = new (std::nothrow) u8*[count];
+	iovec *iovs = new (std::nothrow) iovec[count];
+	if (!_fixed || !iovs)
+	{
+		delete []iovs;
+		delete []_fixed;
+		_fixed = 0;
+		return false;
+	}
+
+	_fixed_allocator = allocator;
+	_fixed_count = 0;
+
+	for (u32 ii = 0; ii < count; ++ii)
+	{
+		u8 *buffer = (u8*)allocator->Acquire();
+		if (!buffer) break;
+
+		_fixed[_fixed_count++] = buffer;
+
+		iovs[ii].iov_base = buffer;
+		iovs[ii].iov_len = allocator->GetBufferBytes();
+	}
+
+	bool success = _fixed_count == count &&
+				   io_uring_register(_fd, IORING_REGISTER_BUFFERS, iovs, count) == 0;
+
+	delete []iovs;
+
+	if (!success)
+	{
+		for (u32 ii = 0; ii < _fixed_count; ++ii)
+			ReleaseBuffer(allocator, _fixed[ii]);
+
+		delete []_fixed;
+		_fixed = 0;
+		_fixed_count = 0;
+	}
+
+	return success;
+}
+
+void IORing::PrepareReadFixed(io_uring_sqe *sqe, int fd, u32 index, u32 bytes, u64 offset)
+{
+	sqe->opcode = IORING_OP_READ_FIXED;
+	sqe->fd = fd;
+	sqe->off = offset;
+	sqe->addr = (u64)(uintptr_t)_fixed[index];
+	sqe->len = bytes;
+	sqe->buf_index = (u16)index;
+}
+
+bool IORing::SetupBufferRing(ReuseAllocator *allocator, u32 count)
+{
+	// Must be a power of two that fits the 16-bit buffer id
+	if (_buf_ring || count == 0 || count > 32768 || (count & (count - 1)))
+		return false;
+
+	void *ring = mmap(0, count * sizeof(io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ring == MAP_FAILED) return false;
+
+	_ring_buffers = new (std::nothrow) u8*[count];
+	if (!_ring_buffers)
+	{
+		munmap(ring, count * sizeof(io_uring_buf));
+		return false;
+	}
+
+	_buf_ring = (io_uring_buf*)ring;
+	_ring_entries = count;
+	_ring_allocator = allocator;
+	_ring_bytes = allocator->GetBufferBytes();
+	_ring_count = 0;
+	_ring_tail = 0;
+
+	for (u32 ii = 0; ii < count; ++ii)
+	{
+		u8 *buffer = (u8*)allocator->Acquire();
+		if (!buffer)
+		{
+			FreeBuffers();
+			return false;
+		}
+
+		_ring_buffers[_ring_count++] = buffer;
+	}
+
+	io_uring_buf_reg reg;
+	CAT_OBJCLR(reg);
+	reg.ring_addr = (u64)(uintptr_t)ring;
+	reg.ring_entries = count;
+	reg.bgid = BUFFER_GROUP;
+
+	if (io_uring_register(_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+	{
+		FreeBuffers();
+		return false;
+	}
+
+	// Hand every buffer to the kernel
+	for (u32 ii = 0; ii < count; ++ii)
+		RecycleRingBuffer((u16)ii);
+
+	return true;
+}
+
+void IORing::RecycleRingBuffer(u16 id)
+{
+	io_uring_buf *buf = &_buf_ring[_ring_tail & (_ring_entries - 1)];
+
+	buf->addr = (u64)(uintptr_t)_ring_buffers[id];
+	buf->len = _ring_bytes;
+	buf->bid = id;
+
+	// Make the buffer visible before the tail that covers it
+	Atomic::StoreMemoryBarrier();
+	*(volatile u16*)&_buf_ring[0].resv = ++_ring_tail;
+}
+
+#endif // CAT_OS_LINUX
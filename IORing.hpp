@@ -0,0 +1,161 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_IO_RING_HPP
+#define CAT_IO_RING_HPP
+
+#include "Platform.hpp"
+
+#if defined(CAT_OS_LINUX)
+# include <linux/io_uring.h>
+#endif
+
+/*
+	Thin wrapper around a Linux io_uring submission/completion ring pair,
+	using the system calls directly so no extra library is needed.
+
+	Submission queue entries are filled in place and handed to the kernel in
+	batches by Submit(), so many operations cost one system call.
+
+	Two kinds of buffers can be registered from a ReuseAllocator:
+
+	+ Fixed buffers, pinned once with IORING_REGISTER_BUFFERS, for reads
+	  and writes that name the buffer by index (IORING_OP_READ_FIXED)
+	  instead of pinning user pages on every operation.
+
+	+ A provided buffer ring (IORING_REGISTER_PBUF_RING), from which the
+	  kernel picks a buffer for each completion of a multishot receive.
+
+	A ring is not thread-safe; wrap it in a lock to share it.
+*/
+
+namespace cat {
+
+
+class ReuseAllocator;
+
+
+#if defined(CAT_OS_LINUX)
+
+class CAT_EXPORT IORing
+{
+	int _fd;
+	u32 _entries;
+
+	// Submission queue
+	u8 *_sq_ring;
+	u32 _sq_ring_bytes;
+	volatile u32 *_sq_head, *_sq_tail;
+	u32 _sq_mask;
+	u32 *_sq_array;
+	io_uring_sqe *_sqes;
+	u32 _sq_local_tail, _sq_submitted;
+
+	// Completion queue
+	u8 *_cq_ring;
+	u32 _cq_ring_bytes;
+	volatile u32 *_cq_head, *_cq_tail;
+	u32 _cq_mask;
+	io_uring_cqe *_cqes;
+
+	// Fixed buffers
+	ReuseAllocator *_fixed_allocator;
+	u8 **_fixed;
+	u32 _fixed_count;
+
+	// Provided buffer ring
+	ReuseAllocator *_ring_allocator;
+	// Ring entries; the tail overlays the reserved field of entry 0.
+	// io_uring_buf_ring is not used since its flexible array member is
+	// laid out differently by C++ compilers
+	io_uring_buf *_buf_ring;
+	u8 **_ring_buffers;
+	u32 _ring_entries, _ring_count, _ring_bytes;
+	u16 _ring_tail;
+
+	void FreeBuffers();
+
+public:
+	// Buffer group used by SetupBufferRing()
+	static const u16 BUFFER_GROUP = 0;
+
+	IORing();
+	~IORing();
+
+	// Returns false if io_uring is not available
+	bool Initialize(u32 entries);
+	void Finalize();
+
+	CAT_INLINE bool Valid() { return _fd >= 0; }
+
+	// Returns a cleared entry to fill in, or 0 if the queue is full
+	io_uring_sqe *GetSQE();
+
+	CAT_INLINE u32 GetPendingCount() { return _sq_local_tail - _sq_submitted; }
+
+	// Hand new entries to the kernel and optionally wait for completions.
+	// Returns false on error
+	bool Submit(u32 wait_count = 0);
+
+	// Wait for completions without touching the submission queue, so it
+	// may run while another thread holds the lock that guards submission
+	bool Wait(u32 wait_count = 1);
+
+	// Returns the oldest completion, or 0 if there are none
+	io_uring_cqe *PeekCQE();
+
+	// Release the completion returned by PeekCQE()
+	void SeenCQE();
+
+	// Register buffers from the allocator as fixed buffers with indices
+	// 0..count-1; returns false on failure
+	bool RegisterBuffers(ReuseAllocator *allocator, u32 count);
+
+	CAT_INLINE u32 GetFixedCount() { return _fixed_count; }
+	CAT_INLINE u8 *GetFixedBuffer(u32 index) { return _fixed[index]; }
+
+	// Prepare a file read into a fixed buffer
+	void PrepareReadFixed(io_uring_sqe *sqe, int fd, u32 index, u32 bytes, u64 offset);
+
+	// Register a provided buffer ring of count buffers (power of two);
+	// returns false on failure
+	bool SetupBufferRing(ReuseAllocator *allocator, u32 count);
+
+	CAT_INLINE u32 GetRingBufferBytes() { return _ring_bytes; }
+	CAT_INLINE u8 *GetRingBuffer(u16 id) { return _ring_buffers[id]; }
+
+	// Give a buffer picked by the kernel back to the ring
+	void RecycleRingBuffer(u16 id);
+};
+
+#endif // CAT_OS_LINUX
+
+
+} // namespace cat
+
+#endif // CAT_IO_RING_HPP
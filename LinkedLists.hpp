@@ -662,6 +662,8 @@ class CAT_EXPORT SListItem
 {
 	friend class SListForward;
 	friend class SListIteratorBase;
+	friend class MPSCQueue;
+	friend class LockFreeStack;
 
 protected:
 	SListItem *_sl_next;
@@ -0,0 +1,154 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "LockFree.hpp"
+using namespace cat;
+
+// Next pointers are written by one thread and read by another
+static CAT_INLINE SListItem *ReadNext(SListItem **next)
+{
+	return *(SListItem * volatile *)next;
+}
+
+
+//// MPSCQueue
+
+/*
+	Dmitry Vyukov's intrusive MPSC queue
+
+	Producers exchange the head pointer for their item and then link the
+	previous head to it.  The consumer walks from the tail.  A stub item
+	keeps the list from ever becoming empty, so producers never touch the
+	tail.
+*/
+
+MPSCQueue::MPSCQueue()
+{
+	_stub._sl_next = 0;
+	_head = &_stub;
+	_tail = &_stub;
+}
+
+void MPSCQueue::Push(SListItem *item)
+{
+	item->_sl_next = 0;
+
+	// Full barrier: the cleared next pointer is visible before the item is
+	SListItem *prev = (SListItem*)Atomic::SetPointer((void * volatile *)&_head, item);
+
+	*(SListItem * volatile *)&prev->_sl_next = item;
+}
+
+SListItem *MPSCQueue::Pop()
+{
+	SListItem *tail = _tail;
+	SListItem *next = ReadNext(&tail->_sl_next);
+
+	// Skip over the stub
+	if (tail == &_stub)
+	{
+		if (!next) return 0;
+
+		_tail = next;
+		tail = next;
+		next = ReadNext(&next->_sl_next);
+	}
+
+	CAT_LOCK_FREE_ACQUIRE();
+
+	if (next)
+	{
+		_tail = next;
+		return tail;
+	}
+
+	// If a producer has swapped in a new head but not linked it yet,
+	if (tail != _head) return 0;
+
+	// Tail is the last item: push the stub behind it so it can be unlinked
+	Push(&_stub);
+
+	next = ReadNext(&tail->_sl_next);
+
+	CAT_LOCK_FREE_ACQUIRE();
+
+	if (next)
+	{
+		_tail = next;
+		return tail;
+	}
+
+	return 0;
+}
+
+
+//// LockFreeStack
+
+LockFreeStack::LockFreeStack()
+{
+	_head.item = 0;
+	_head.tag = 0;
+}
+
+void LockFreeStack::Push(SListItem *item)
+{
+	Head old_head, new_head;
+
+	new_head.item = item;
+
+	do
+	{
+		// A torn read just fails the CAS2
+		old_head.tag = _head.tag;
+		old_head.item = _head.item;
+
+		item->_sl_next = old_head.item;
+		new_head.tag = old_head.tag + 1;
+	} while (!Atomic::CAS2(&_head, &old_head, &new_head));
+}
+
+SListItem *LockFreeStack::Pop()
+{
+	Head old_head, new_head;
+
+	do
+	{
+		old_head.tag = _head.tag;
+		CAT_LOCK_FREE_ACQUIRE();
+		old_head.item = _head.item;
+
+		if (!old_head.item) return 0;
+
+		// May be stale if another thread popped it first, but then the tag
+		// has changed and the CAS2 fails
+		new_head.item = ReadNext(&old_head.item->_sl_next);
+		new_head.tag = old_head.tag + 1;
+	} while (!Atomic::CAS2(&_head, &old_head, &new_head));
+
+	return old_head.item;
+}
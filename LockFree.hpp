@@ -0,0 +1,231 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_LOCK_FREE_HPP
+#define CAT_LOCK_FREE_HPP
+
+#include "LinkedLists.hpp"
+#include "Atomic.hpp"
+#include <new>
+
+namespace cat {
+
+
+/*
+	Lock-free containers for handing work between threads
+
+	SPSCQueue: Bounded ring between one producer and one consumer thread
+	MPSCQueue: Unbounded intrusive FIFO of SListItem objects, fed by any
+			   number of producer threads and drained by one consumer
+	LockFreeStack: Intrusive LIFO of SListItem objects for any number of
+				   threads, with a tagged head pointer updated by CAS2
+
+	The intrusive containers do not own their items.  An SListItem must be
+	in at most one container at a time.
+*/
+
+// x86 does not reorder loads with loads or stores with stores, or later
+// stores before earlier loads, so only the compiler needs to be fenced
+#if defined(CAT_ISA_X86)
+# define CAT_LOCK_FREE_ACQUIRE() CAT_FENCE_COMPILER
+# define CAT_LOCK_FREE_RELEASE() CAT_FENCE_COMPILER
+#else
+# define CAT_LOCK_FREE_ACQUIRE() Atomic::DataMemoryBarrier()
+# define CAT_LOCK_FREE_RELEASE() Atomic::DataMemoryBarrier()
+#endif
+
+
+//// SPSCQueue
+
+template<class T>
+class SPSCQueue
+{
+	T *_ring;
+	u32 _mask;
+
+	// Producer side
+	volatile u32 _write;
+	u32 _read_cache;	// Last read index seen by the producer
+	u8 _producer_padding[CAT_DEFAULT_CACHE_LINE_SIZE];
+
+	// Consumer side
+	volatile u32 _read;
+	u32 _write_cache;	// Last write index seen by the consumer
+	u8 _consumer_padding[CAT_DEFAULT_CACHE_LINE_SIZE];
+
+	CAT_NO_COPY(SPSCQueue);
+
+public:
+	CAT_INLINE SPSCQueue()
+	{
+		_ring = 0;
+		_mask = 0;
+		_write = 0;
+		_read_cache = 0;
+		_read = 0;
+		_write_cache = 0;
+	}
+	CAT_INLINE ~SPSCQueue()
+	{
+		delete []_ring;
+	}
+
+	// Holds up to 2^size_log2 items.  Returns false on out of memory
+	bool Initialize(u32 size_log2)
+	{
+		delete []_ring;
+
+		_ring = new (std::nothrow) T[(u32)1 << size_log2];
+		_mask = ((u32)1 << size_log2) - 1;
+		_write = _read_cache = 0;
+		_read = _write_cache = 0;
+
+		return _ring != 0;
+	}
+
+	// Producer thread only.  Returns false if the queue is full
+	bool Push(const T &item)
+	{
+		u32 w = _write;
+
+		// Only look at the consumer's index when the cached one says full
+		if (w - _read_cache > _mask)
+		{
+			_read_cache = _read;
+			CAT_LOCK_FREE_ACQUIRE();
+
+			if (w - _read_cache > _mask) return false;
+		}
+
+		_ring[w & _mask] = item;
+
+		// Publish the item before the new write index
+		CAT_LOCK_FREE_RELEASE();
+
+		_write = w + 1;
+
+		return true;
+	}
+
+	// Consumer thread only.  Returns false if the queue is empty
+	bool Pop(T &item)
+	{
+		u32 r = _read;
+
+		// Only look at the producer's index when the cached one says empty
+		if (r == _write_cache)
+		{
+			_write_cache = _write;
+			CAT_LOCK_FREE_ACQUIRE();
+
+			if (r == _write_cache) return false;
+		}
+
+		item = _ring[r & _mask];
+
+		// Finish reading the slot before handing it back to the producer
+		CAT_LOCK_FREE_RELEASE();
+
+		_read = r + 1;
+
+		return true;
+	}
+};
+
+
+//// MPSCQueue
+
+class CAT_EXPORT MPSCQueue
+{
+	// Producers swap themselves in here
+	SListItem * volatile _head;
+	u8 _padding[CAT_DEFAULT_CACHE_LINE_SIZE];
+
+	// Consumer side
+	SListItem *_tail;
+	SListItem _stub;
+
+	CAT_NO_COPY(MPSCQueue);
+
+public:
+	MPSCQueue();
+
+	// Any thread.  Wait-free: one atomic exchange
+	void Push(SListItem *item);
+
+	// Consumer thread only.  Returns 0 if the queue is empty.
+	// May also return 0 for a moment while a producer is between its
+	// exchange and its link, so treat 0 as "try again later"
+	SListItem *Pop();
+};
+
+
+//// LockFreeStack
+
+class CAT_EXPORT LockFreeStack
+{
+#if defined(CAT_WORD_64)
+	typedef u64 Tag;
+# define CAT_LOCK_FREE_HEAD_ALIGN 16
+#else
+	typedef u32 Tag;
+# define CAT_LOCK_FREE_HEAD_ALIGN 8
+#endif
+
+	// The tag changes on every update, so a head that was popped, freed
+	// and pushed again between a thread's read and its CAS2 is not mistaken
+	// for the one it read (the ABA problem)
+	struct CAT_ALIGNED(CAT_LOCK_FREE_HEAD_ALIGN) Head
+	{
+		SListItem * volatile item;
+		volatile Tag tag;
+	};
+
+#undef CAT_LOCK_FREE_HEAD_ALIGN
+
+	Head _head;
+
+	CAT_NO_COPY(LockFreeStack);
+
+public:
+	LockFreeStack();
+
+	// Any thread
+	void Push(SListItem *item);
+
+	// Any thread.  Returns 0 if the stack is empty.
+	// Pop() reads the next pointer of an item that another thread may be
+	// popping at the same time, so items must not be returned to the OS
+	// while the stack is in use: recycle them from a pool instead
+	SListItem *Pop();
+};
+
+
+} // namespace cat
+
+#endif // CAT_LOCK_FREE_HPP
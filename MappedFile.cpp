@@ -27,6 +27,7 @@
 */
 
 #include "MappedFile.hpp"
+#include "AdaptiveMutex.hpp"
 using namespace cat;
 
 #ifdef CAT_COMPILE_MMAP
@@ -152,7 +153,6 @@ bool MappedFile::OpenWrite(const char *path, u64 size)
 	Close();
 
 	_readonly = false;
-	_len = size;
 
 #if defined(CAT_OS_WINDOWS)
 
@@ -164,8 +164,30 @@ bool MappedFile::OpenWrite(const char *path, u64 size)
 		return false;
 	}
 
-	// Set file size
-	if (!SetFilePointerEx(_file, *(LARGE_INTEGER*)&_len, 0, FILE_BEGIN)) {
+#else
+
+	_file = open(path, O_RDWR|O_CREAT|O_TRUNC, (mode_t)0666);
+
+	if (_file == -1) {
+		return false;
+	}
+
+#endif
+
+	return size != 0 && SetLength(size);
+}
+
+bool MappedFile::SetLength(u64 size)
+{
+	if (_readonly) return false;
+
+#if defined(CAT_OS_WINDOWS)
+
+	if (_file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	if (!SetFilePointerEx(_file, *(LARGE_INTEGER*)&size, 0, FILE_BEGIN)) {
 		return false;
 	}
 	if (!SetEndOfFile(_file)) {
@@ -174,25 +196,41 @@ bool MappedFile::OpenWrite(const char *path, u64 size)
 
 #else
 
-	_file = open(path, O_RDWR|O_CREAT|O_TRUNC, (mode_t)0666);
-
 	if (_file == -1) {
 		return false;
-	} else {
-		if (-1 == lseek(_file, size - 1, SEEK_SET)) {
-			return false;
-		} else {
-			if (1 != write(_file, "", 1)) {
-				return false;
-			}
-		}
+	}
+
+	if (0 != ftruncate(_file, (off_t)size)) {
+		return false;
 	}
 
 #endif
 
+	_len = size;
+
 	return true;
 }
 
+bool MappedFile::Grow(u64 min_size)
+{
+	if (min_size <= _len) return !_readonly && IsValid();
+
+	u64 size = _len ? _len : GetAllocationGranularity();
+	while (size < min_size)
+	{
+		// If doubling would overflow,
+		if (size * 2 < size)
+		{
+			size = min_size;
+			break;
+		}
+
+		size *= 2;
+	}
+
+	return SetLength(size);
+}
+
 void MappedFile::Close()
 {
 #if defined(CAT_OS_WINDOWS)
@@ -218,8 +256,39 @@ void MappedFile::Close()
 
 //// MappedView
 
+// Ask the OS to start paging in a range
+static bool AdviseWillNeed(u8 *address, u64 length)
+{
+#if defined(CAT_OS_WINDOWS)
+
+# if defined(_WIN32_WINNT) && (_WIN32_WINNT >= 0x0602) // Windows 8+
+	WIN32_MEMORY_RANGE_ENTRY range;
+	range.VirtualAddress = address;
+	range.NumberOfBytes = (SIZE_T)length;
+
+	return PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0) != 0;
+# else
+	return false;
+# endif
+
+#else
+
+	return 0 == madvise(address, (size_t)length, MADV_WILLNEED);
+
+#endif
+}
+
 MappedView::MappedView()
 {
+	_file = 0;
+	_flusher = 0;
+	_flush_next = 0;
+	_flush_offset = 0;
+	_flush_end = 0;
+	_flush_queued = false;
+	_flushing = 0;
+	_base = 0;
+	_base_length = 0;
 	_data = 0;
 	_length = 0;
 	_offset = 0;
@@ -262,24 +331,28 @@ bool MappedView::Open(MappedFile *file)
 	return true;
 }
 
-u8 *MappedView::MapView(u64 offset, u32 length)
+u8 *MappedView::MapView(u64 offset, u64 length, u32 hints)
 {
+	Unmap();
+
+	if (!_file) return 0;
+
+	u64 file_length = _file->GetLength();
+	if (offset >= file_length) return 0;
+
 	if (length == 0) {
-		length = static_cast<u32>( _file->GetLength() );
+		length = file_length - offset;
 	}
 
-	if (offset) {
-		u32 granularity = GetAllocationGranularity();
+	// Bring offset back to the previous allocation granularity
+	u32 mask = GetAllocationGranularity() - 1;
+	u32 masked = (u32)offset & mask;
+	u64 base_offset = offset - masked;
+	u64 base_length = length + masked;
 
-		// Bring offset back to the previous allocation granularity
-		u32 mask = granularity - 1;
-		u32 masked = (u32)offset & mask;
-		if (masked)
-		{
-			offset -= masked;
-			length += masked;
-		}
-	}
+	// If the view does not fit in the address space, fail rather than map
+	// a shorter view than the caller asked for
+	if (base_length != (size_t)base_length) return 0;
 
 #if defined(CAT_OS_WINDOWS)
 
@@ -288,12 +361,17 @@ u8 *MappedView::MapView(u64 offset, u32 length)
 		flags |= FILE_MAP_WRITE;
 	}
 
-	_data = (u8*)MapViewOfFile(_map, flags, (u32)(offset >> 32), (u32)offset, length);
-	if (!_data)
+	_base = (u8*)MapViewOfFile(_map, flags, (u32)(base_offset >> 32), (u32)base_offset, (SIZE_T)base_length);
+	if (!_base)
 	{
 		return 0;
 	}
 
+	// Access pattern is chosen when the file is opened
+	if (hints & (HINT_WILLNEED | HINT_POPULATE)) {
+		AdviseWillNeed(_base, base_length);
+	}
+
 #else
 
 	int prot = PROT_READ;
@@ -301,51 +379,353 @@ u8 *MappedView::MapView(u64 offset, u32 length)
 		prot |= PROT_WRITE;
 	}
 
-	_map = mmap(0, length, prot, MAP_SHARED, _file->_file, offset);
+	int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+	if (hints & HINT_POPULATE) {
+		flags |= MAP_POPULATE;
+	}
+#else
+	if (hints & HINT_POPULATE) {
+		hints |= HINT_WILLNEED;
+	}
+#endif
+
+	_map = mmap(0, (size_t)base_length, prot, flags, _file->_file, (off_t)base_offset);
 
 	if (_map == MAP_FAILED) {
 		return 0;
 	}
 
-	_data = reinterpret_cast<u8*>( _map );
+	_base = reinterpret_cast<u8*>( _map );
+
+	// Hints are best-effort so failures are ignored
+	if (hints & HINT_SEQUENTIAL) {
+		madvise(_map, (size_t)base_length, MADV_SEQUENTIAL);
+	} else if (hints & HINT_RANDOM) {
+		madvise(_map, (size_t)base_length, MADV_RANDOM);
+	}
+
+#ifdef MADV_HUGEPAGE
+	if (hints & HINT_HUGEPAGE) {
+		madvise(_map, (size_t)base_length, MADV_HUGEPAGE);
+	}
+#endif
+
+	if (hints & HINT_WILLNEED) {
+		AdviseWillNeed(_base, base_length);
+	}
 
 #endif
 
+	_base_length = base_length;
+	_data = _base + masked;
 	_offset = offset;
 	_length = length;
 
 	return _data;
 }
 
-void MappedView::Close()
+u8 *MappedView::AlignRange(u64 offset, u64 &length)
+{
+	// Bring start of range back to a page boundary
+	u64 start = (u64)(_data - _base) + offset;
+	u32 mask = GetAllocationGranularity() - 1;
+	u32 masked = (u32)start & mask;
+
+	length += masked;
+	return _base + start - masked;
+}
+
+bool MappedView::Prefetch(u64 offset, u64 length)
+{
+	if (!_data || offset > _length || length > _length - offset) return false;
+
+	if (length == 0) return true;
+
+	u8 *start = AlignRange(offset, length);
+
+	return AdviseWillNeed(start, length);
+}
+
+u8 *MappedView::Grow(u64 min_length, u32 hints)
 {
+	if (!_file || _file->IsReadOnly()) return 0;
+
+	// If already in view,
+	if (_data && min_length <= _length) return _data;
+
+	MappedFile *file = _file;
+	u64 offset = _offset;
+
+	if (!file->Grow(offset + min_length)) return 0;
+
+	// Reopen so that the mapping covers the new file length
+	if (!Open(file)) return 0;
+
+	return MapView(offset, 0, hints);
+}
+
+bool MappedView::Flush(u64 offset, u64 length)
+{
+	if (!_data || _file->IsReadOnly() || offset > _length) return false;
+
+	if (length == 0) {
+		length = _length - offset;
+	} else if (length > _length - offset) {
+		return false;
+	}
+
+	if (length == 0) return true;
+
+	u8 *start = AlignRange(offset, length);
+
 #if defined(CAT_OS_WINDOWS)
 
-	if (_data)
+	if (!FlushViewOfFile(start, (SIZE_T)length)) {
+		return false;
+	}
+
+	// FlushViewOfFile() only starts the writes
+	return FlushFileBuffers(_file->_file) != 0;
+
+#else
+
+	return 0 == msync(start, (size_t)length, MS_SYNC);
+
+#endif
+}
+
+bool MappedView::FlushAsync(MappedFlusher *flusher, u64 offset, u64 length)
+{
+	if (!flusher || !_data || _file->IsReadOnly() || offset > _length) return false;
+
+	if (length == 0) {
+		length = _length - offset;
+	} else if (length > _length - offset) {
+		return false;
+	}
+
+	if (length == 0) return true;
+
+	return flusher->Queue(this, offset, offset + length);
+}
+
+void MappedView::Unmap()
+{
+	// Finish writing any ranges queued on a flusher while still mapped
+	if (_flusher)
 	{
-		UnmapViewOfFile(_data);
-		_data = 0;
+		_flusher->Dequeue(this);
 	}
-	if (_map)
+
+#if defined(CAT_OS_WINDOWS)
+
+	if (_base)
 	{
-		CloseHandle(_map);
-		_map = 0;
+		UnmapViewOfFile(_base);
 	}
 
 #else
 
 	if (_map != MAP_FAILED)
 	{
-		munmap(_map, _length);
+		munmap(_map, (size_t)_base_length);
 		_map = MAP_FAILED;
 	}
-	_data = 0;
 
 #endif
 
+	_base = 0;
+	_base_length = 0;
+	_data = 0;
 	_length = 0;
 	_offset = 0;
 }
 
-#endif // CAT_COMPILE_MMAP
+void MappedView::Close()
+{
+	Unmap();
+
+#if defined(CAT_OS_WINDOWS)
+
+	if (_map)
+	{
+		CloseHandle(_map);
+		_map = 0;
+	}
+
+#endif
+}
+
+
+//// MappedFlusher
+
+MappedFlusher::MappedFlusher()
+{
+	_head = _tail = 0;
+	_stop = false;
+	_started = false;
+}
+
+MappedFlusher::~MappedFlusher()
+{
+	Shutdown();
+}
+
+bool MappedFlusher::Initialize()
+{
+	Shutdown();
+
+	if (!_lock.Valid() || !_wake.Valid()) return false;
+
+	_stop = false;
+
+	if (!StartThread())
+		return false;
+
+	_started = true;
+
+	return true;
+}
+
+void MappedFlusher::Shutdown()
+{
+	if (!_started) return;
+
+	_stop = true;
+	_wake.Set();
+
+	WaitForThread();
+
+	_started = false;
+}
+
+bool MappedFlusher::Queue(MappedView *view, u64 offset, u64 end)
+{
+	AutoMutex lock(_lock);
+
+	// If queued on another flusher or this one is stopping,
+	if ((view->_flusher && view->_flusher != this) || _stop)
+	{
+		lock.Release();
+		return view->Flush(offset, end - offset);
+	}
+
+	// If already queued, merge with the pending range
+	if (view->_flush_queued)
+	{
+		if (view->_flush_offset > offset) view->_flush_offset = offset;
+		if (view->_flush_end < end) view->_flush_end = end;
+		return true;
+	}
+
+	view->_flusher = this;
+	view->_flush_queued = true;
+	view->_flush_offset = offset;
+	view->_flush_end = end;
+	view->_flush_next = 0;
+
+	if (_tail) _tail->_flush_next = view;
+	else _head = view;
+	_tail = view;
+
+	lock.Release();
+
+	_wake.Set();
+
+	return true;
+}
+
+void MappedFlusher::Dequeue(MappedView *view)
+{
+	bool queued;
+	u64 offset, end;
+
+	_lock.Enter();
+
+	queued = view->_flush_queued;
+	offset = view->_flush_offset;
+	end = view->_flush_end;
+
+	// If still queued, unlink it and write the range here instead
+	if (queued)
+	{
+		MappedView *prev = 0;
+		for (MappedView *next = _head; next != view; next = next->_flush_next)
+			prev = next;
+
+		if (prev) prev->_flush_next = view->_flush_next;
+		else _head = view->_flush_next;
+		if (_tail == view) _tail = prev;
+
+		view->_flush_queued = false;
+	}
+
+	// Wait for the flusher thread to finish writing this view
+	while (view->_flushing)
+	{
+		_lock.Leave();
+		Futex::Wait(&view->_flushing, 1);
+		_lock.Enter();
+	}
+
+	view->_flusher = 0;
+
+	_lock.Leave();
 
+	if (queued)
+	{
+		view->Flush(offset, end - offset);
+	}
+}
+
+bool MappedFlusher::Entrypoint(void *param)
+{
+	for (;;)
+	{
+		_lock.Enter();
+
+		MappedView *view = _head;
+		u64 offset = 0, end = 0;
+
+		// If a view is queued,
+		if (view)
+		{
+			_head = view->_flush_next;
+			if (!_head) _tail = 0;
+
+			offset = view->_flush_offset;
+			end = view->_flush_end;
+			view->_flush_queued = false;
+			view->_flushing = 1;
+		}
+
+		_lock.Leave();
+
+		if (!view)
+		{
+			// Only stop once the queue is empty
+			if (_stop) break;
+
+			_wake.Wait();
+			continue;
+		}
+
+		view->Flush(offset, end - offset);
+
+		// Wake under the lock so the view cannot go away in between
+		_lock.Enter();
+
+		view->_flushing = 0;
+		if (!view->_flush_queued)
+			view->_flusher = 0;
+
+		Futex::Wake(&view->_flushing, true);
+
+		_lock.Leave();
+	}
+
+	return true;
+}
+
+#endif // CAT_COMPILE_MMAP
@@ -33,6 +33,10 @@
 
 #ifdef CAT_COMPILE_MMAP
 
+#include "Thread.hpp"
+#include "Mutex.hpp"
+#include "WaitableFlag.hpp"
+
 #ifdef CAT_OS_WINDOWS
 #include "WindowsInclude.hpp"
 #endif
@@ -49,8 +53,10 @@
 	great alternative with low overhead and similar performance.
 
 	For random file access, use MappedView with a MappedFile that has been
-	opened with random_access = true.  Random access is usually used for a
-	database-like file type, which is much better implemented using asynch io.
+	opened with read_ahead = false.  MapView() hints and Prefetch() can be
+	used to avoid page-fault stalls on first touch of large files.  Random
+	access is usually used for a database-like file type, which is much
+	better implemented using asynch io.
 */
 
 namespace cat {
@@ -58,6 +64,7 @@ namespace cat {
 
 class MappedFile;
 class MappedView;
+class MappedFlusher;
 
 
 // Read-only memory mapped file
@@ -85,6 +92,14 @@ public:
 	// Creates and opens the file for exclusive read/write access
 	bool OpenWrite(const char *path, u64 size);
 
+	// Change the length of a file opened for writing
+	// Views must be remapped to see the new length
+	// A length of zero empties the file, after which IsValid() is false
+	bool SetLength(u64 size);
+
+	// Double the length of a file opened for writing until it holds min_size bytes
+	bool Grow(u64 min_size);
+
 	void Close();
 
 	CAT_INLINE bool IsReadOnly() { return _readonly; }
@@ -96,6 +111,8 @@ public:
 // View of a portion of the memory mapped file
 class CAT_EXPORT MappedView
 {
+	friend class MappedFlusher;
+
 #if defined(CAT_OS_WINDOWS)
 	HANDLE _map;
 #else
@@ -103,23 +120,96 @@ class CAT_EXPORT MappedView
 #endif
 
 	MappedFile *_file;
+	u8 *_base;
+	u64 _base_length;
 	u8 *_data;
 	u64 _offset;
-	u32 _length;
+	u64 _length;
+
+	// Async flush state, guarded by the flusher lock
+	MappedFlusher *_flusher;
+	MappedView *_flush_next;
+	u64 _flush_offset, _flush_end;
+	bool _flush_queued;
+	volatile u32 _flushing;
+
+	u8 *AlignRange(u64 offset, u64 &length);
+	void Unmap();
 
 public:
 	MappedView();
 	~MappedView();
 
+	// Access hints for MapView()
+	enum Hints
+	{
+		HINT_SEQUENTIAL = 1,	// Pages will be touched in order (aggressive read-ahead)
+		HINT_RANDOM = 2,		// Pages will be touched at random (no read-ahead)
+		HINT_WILLNEED = 4,		// Start reading the whole view in the background
+		HINT_POPULATE = 8,		// Fault in the whole view before MapView() returns
+		HINT_HUGEPAGE = 16		// Back the view with huge pages where the OS supports it
+	};
+
 	bool Open(MappedFile *file); // Returns false on error
-	u8 *MapView(u64 offset = 0, u32 length = 0); // Returns 0 on error, 0 length means whole file
+
+	// Returns 0 on error, 0 length means rest of file
+	// Any previous view is unmapped first
+	u8 *MapView(u64 offset = 0, u64 length = 0, u32 hints = 0);
+
+	// Start paging in a range of the view, given relative to GetFront()
+	// Returns false if the range is outside the view or the OS refuses
+	bool Prefetch(u64 offset, u64 length);
+
+	// Grow the file if needed and remap it from GetOffset() to the end of the
+	// file so that at least min_length bytes are in view
+	// Returns the new front, which may have moved, or 0 on error
+	u8 *Grow(u64 min_length, u32 hints = 0);
+
+	// Write a range of the view, given relative to GetFront(), to disk
+	// Returns after the data is written.  0 length means rest of view
+	bool Flush(u64 offset = 0, u64 length = 0);
+
+	// Queue a range of the view to be written to disk by a flusher thread
+	// Returns immediately.  Queued ranges are merged until the flusher gets
+	// to them, and unmapping the view waits for them to be written
+	bool FlushAsync(MappedFlusher *flusher, u64 offset = 0, u64 length = 0);
+
 	void Close();
 
 	CAT_INLINE bool IsValid() { return _data != 0; }
 	CAT_INLINE MappedFile *GetFile() { return _file; }
 	CAT_INLINE u8 *GetFront() { return _data; }
 	CAT_INLINE u64 GetOffset() { return _offset; }
-	CAT_INLINE u32 GetLength() { return _length; }
+	CAT_INLINE u64 GetLength() { return _length; }
+};
+
+
+// Background thread that writes ranges queued by MappedView::FlushAsync()
+class CAT_EXPORT MappedFlusher : public Thread
+{
+	friend class MappedView;
+
+	Mutex _lock;
+	WaitableFlag _wake;
+	MappedView *_head, *_tail;
+	volatile bool _stop;
+	bool _started;
+
+	CAT_NO_COPY(MappedFlusher);
+
+	bool Queue(MappedView *view, u64 offset, u64 end);
+	void Dequeue(MappedView *view);
+
+	bool Entrypoint(void *param);
+
+public:
+	MappedFlusher();
+	~MappedFlusher();
+
+	bool Initialize();
+
+	// Writes out everything still queued and stops the thread
+	void Shutdown();
 };
 
 
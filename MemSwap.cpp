@@ -27,9 +27,23 @@
 */
 
 #include "MemSwap.hpp"
+#include "CPUFeatures.hpp"
 using namespace cat;
 
-void cat::memswap(void * CAT_RESTRICT vx, void * CAT_RESTRICT vy, int bytes)
+// Build the AVX2 and AVX-512 kernels where the compiler can target them per
+// function, and pick one at run time from the CPU features
+#if defined(CAT_X86_DISPATCH)
+# define CAT_MEMSWAP_X86_DISPATCH
+# include <immintrin.h>
+#elif defined(CAT_HAS_NEON)
+# define CAT_MEMSWAP_NEON
+# include <arm_neon.h>
+#endif
+
+
+//// Generic
+
+static void memswap_generic(void * CAT_RESTRICT vx, void * CAT_RESTRICT vy, int bytes)
 {
 #ifdef CAT_ISA_ARM
     // Primary engine
@@ -82,3 +96,271 @@ void cat::memswap(void * CAT_RESTRICT vx, void * CAT_RESTRICT vy, int bytes)
 #endif
 }
 
+
+//// AVX2 / AVX-512
+
+#if defined(CAT_MEMSWAP_X86_DISPATCH)
+
+/*
+	A swap cannot finish with an overlapping vector like a copy can, since
+	the overlapped bytes would be swapped back.  So large buffers first swap
+	a short head to bring x up to vector alignment, which keeps half of the
+	accesses from splitting cache lines, and the tail drops to narrower
+	vectors and then the generic code.
+*/
+
+#define CAT_MEMSWAP_HEAD_MIN 256
+
+#define CAT_LOAD128(p) _mm_loadu_si128((const __m128i *)(p))
+#define CAT_STORE128(p, x) _mm_storeu_si128((__m128i *)(p), x)
+#define CAT_LOAD256(p) _mm256_loadu_si256((const __m256i *)(p))
+#define CAT_STORE256(p, x) _mm256_storeu_si256((__m256i *)(p), x)
+
+// Bytes to swap before x reaches a multiple of align
+static CAT_INLINE int HeadBytes(const void *x, int align)
+{
+#ifdef CAT_WORD_64
+	return (align - ((u32)(u64)x & (align - 1))) & (align - 1);
+#else
+	return (align - ((u32)x & (align - 1))) & (align - 1);
+#endif
+}
+
+CAT_TARGET_AVX2 static void memswap_avx2(void * CAT_RESTRICT vx, void * CAT_RESTRICT vy, int bytes)
+{
+	u8 * CAT_RESTRICT x = reinterpret_cast<u8 *>( vx );
+	u8 * CAT_RESTRICT y = reinterpret_cast<u8 *>( vy );
+
+	if (bytes >= CAT_MEMSWAP_HEAD_MIN)
+	{
+		int head = HeadBytes(x, 32);
+		if (head > 0)
+		{
+			memswap_generic(x, y, head);
+			x += head;
+			y += head;
+			bytes -= head;
+		}
+	}
+
+	while (bytes >= 128)
+	{
+		__m256i x0 = CAT_LOAD256(x), y0 = CAT_LOAD256(y);
+		__m256i x1 = CAT_LOAD256(x + 32), y1 = CAT_LOAD256(y + 32);
+		__m256i x2 = CAT_LOAD256(x + 64), y2 = CAT_LOAD256(y + 64);
+		__m256i x3 = CAT_LOAD256(x + 96), y3 = CAT_LOAD256(y + 96);
+		CAT_STORE256(x, y0);
+		CAT_STORE256(x + 32, y1);
+		CAT_STORE256(x + 64, y2);
+		CAT_STORE256(x + 96, y3);
+		CAT_STORE256(y, x0);
+		CAT_STORE256(y + 32, x1);
+		CAT_STORE256(y + 64, x2);
+		CAT_STORE256(y + 96, x3);
+		x += 128;
+		y += 128;
+		bytes -= 128;
+	}
+
+	while (bytes >= 32)
+	{
+		__m256i x0 = CAT_LOAD256(x), y0 = CAT_LOAD256(y);
+		CAT_STORE256(x, y0);
+		CAT_STORE256(y, x0);
+		x += 32;
+		y += 32;
+		bytes -= 32;
+	}
+
+	if (bytes >= 16)
+	{
+		__m128i x0 = CAT_LOAD128(x), y0 = CAT_LOAD128(y);
+		CAT_STORE128(x, y0);
+		CAT_STORE128(y, x0);
+		x += 16;
+		y += 16;
+		bytes -= 16;
+	}
+
+	if (bytes > 0)
+		memswap_generic(x, y, bytes);
+}
+
+#undef CAT_LOAD128
+#undef CAT_STORE128
+#undef CAT_LOAD256
+#undef CAT_STORE256
+
+#define CAT_LOAD512(p) _mm512_loadu_si512((const void *)(p))
+#define CAT_STORE512(p, x) _mm512_storeu_si512((void *)(p), x)
+
+// Mask selecting the low 1..63 bytes of a vector
+#define CAT_TAIL_MASK(bytes) ((__mmask64)(((u64)1 << (bytes)) - 1))
+
+CAT_TARGET_AVX512 static void memswap_avx512(void * CAT_RESTRICT vx, void * CAT_RESTRICT vy, int bytes)
+{
+	u8 * CAT_RESTRICT x = reinterpret_cast<u8 *>( vx );
+	u8 * CAT_RESTRICT y = reinterpret_cast<u8 *>( vy );
+
+	// Masked head so the main loop stores to x on whole cache lines
+	if (bytes >= CAT_MEMSWAP_HEAD_MIN)
+	{
+		int head = HeadBytes(x, 64);
+		if (head > 0)
+		{
+			__mmask64 mask = CAT_TAIL_MASK(head);
+			__m512i x0 = _mm512_maskz_loadu_epi8(mask, x);
+			__m512i y0 = _mm512_maskz_loadu_epi8(mask, y);
+			_mm512_mask_storeu_epi8(x, mask, y0);
+			_mm512_mask_storeu_epi8(y, mask, x0);
+			x += head;
+			y += head;
+			bytes -= head;
+		}
+	}
+
+	while (bytes >= 256)
+	{
+		__m512i x0 = CAT_LOAD512(x), y0 = CAT_LOAD512(y);
+		__m512i x1 = CAT_LOAD512(x + 64), y1 = CAT_LOAD512(y + 64);
+		__m512i x2 = CAT_LOAD512(x + 128), y2 = CAT_LOAD512(y + 128);
+		__m512i x3 = CAT_LOAD512(x + 192), y3 = CAT_LOAD512(y + 192);
+		CAT_STORE512(x, y0);
+		CAT_STORE512(x + 64, y1);
+		CAT_STORE512(x + 128, y2);
+		CAT_STORE512(x + 192, y3);
+		CAT_STORE512(y, x0);
+		CAT_STORE512(y + 64, x1);
+		CAT_STORE512(y + 128, x2);
+		CAT_STORE512(y + 192, x3);
+		x += 256;
+		y += 256;
+		bytes -= 256;
+	}
+
+	while (bytes >= 64)
+	{
+		__m512i x0 = CAT_LOAD512(x), y0 = CAT_LOAD512(y);
+		CAT_STORE512(x, y0);
+		CAT_STORE512(y, x0);
+		x += 64;
+		y += 64;
+		bytes -= 64;
+	}
+
+	if (bytes > 0)
+	{
+		__mmask64 mask = CAT_TAIL_MASK(bytes);
+		__m512i x0 = _mm512_maskz_loadu_epi8(mask, x);
+		__m512i y0 = _mm512_maskz_loadu_epi8(mask, y);
+		_mm512_mask_storeu_epi8(x, mask, y0);
+		_mm512_mask_storeu_epi8(y, mask, x0);
+	}
+}
+
+#undef CAT_TAIL_MASK
+#undef CAT_LOAD512
+#undef CAT_STORE512
+#undef CAT_MEMSWAP_HEAD_MIN
+
+#endif // CAT_MEMSWAP_X86_DISPATCH
+
+
+//// NEON
+
+#if defined(CAT_MEMSWAP_NEON)
+
+static void memswap_neon(void * CAT_RESTRICT vx, void * CAT_RESTRICT vy, int bytes)
+{
+	u8 * CAT_RESTRICT x = reinterpret_cast<u8 *>( vx );
+	u8 * CAT_RESTRICT y = reinterpret_cast<u8 *>( vy );
+
+	while (bytes >= 64)
+	{
+		uint8x16_t x0 = vld1q_u8(x), y0 = vld1q_u8(y);
+		uint8x16_t x1 = vld1q_u8(x + 16), y1 = vld1q_u8(y + 16);
+		uint8x16_t x2 = vld1q_u8(x + 32), y2 = vld1q_u8(y + 32);
+		uint8x16_t x3 = vld1q_u8(x + 48), y3 = vld1q_u8(y + 48);
+		vst1q_u8(x, y0);
+		vst1q_u8(x + 16, y1);
+		vst1q_u8(x + 32, y2);
+		vst1q_u8(x + 48, y3);
+		vst1q_u8(y, x0);
+		vst1q_u8(y + 16, x1);
+		vst1q_u8(y + 32, x2);
+		vst1q_u8(y + 48, x3);
+		x += 64;
+		y += 64;
+		bytes -= 64;
+	}
+
+	while (bytes >= 16)
+	{
+		uint8x16_t x0 = vld1q_u8(x), y0 = vld1q_u8(y);
+		vst1q_u8(x, y0);
+		vst1q_u8(y, x0);
+		x += 16;
+		y += 16;
+		bytes -= 16;
+	}
+
+	if (bytes > 0)
+		memswap_generic(x, y, bytes);
+}
+
+#endif // CAT_MEMSWAP_NEON
+
+
+//// Dispatch
+
+typedef void (*MemSwapFunc)(void * CAT_RESTRICT, void * CAT_RESTRICT, int);
+
+#if defined(CAT_MEMSWAP_X86_DISPATCH)
+
+static MemSwapFunc DetectKernel()
+{
+	if (HasCPUFeatures(CPU_AVX512F | CPU_AVX512BW))
+		return memswap_avx512;
+	if (HasCPUFeatures(CPU_AVX2))
+		return memswap_avx2;
+	return memswap_generic;
+}
+
+static MemSwapFunc m_memswap = 0;
+
+static CAT_INLINE MemSwapFunc GetKernel()
+{
+	return BindKernel(m_memswap, DetectKernel);
+}
+
+#elif defined(CAT_MEMSWAP_NEON)
+
+static CAT_INLINE MemSwapFunc GetKernel()
+{
+	return memswap_neon;
+}
+
+#else
+
+static CAT_INLINE MemSwapFunc GetKernel()
+{
+	return memswap_generic;
+}
+
+#endif
+
+void cat::memswap(void * CAT_RESTRICT vx, void * CAT_RESTRICT vy, int bytes)
+{
+	GetKernel()(vx, vy, bytes);
+}
+
+void cat::memswap_rows(void *base, int stride, int row_a, int row_b, int bytes)
+{
+	// Swapping a row with itself is a no-op, and would alias x and y
+	if (row_a == row_b)
+		return;
+
+	u8 *rows = reinterpret_cast<u8 *>( base );
+
+	GetKernel()(rows + row_a * stride, rows + row_b * stride, bytes);
+}
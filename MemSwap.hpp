@@ -34,9 +34,19 @@
 namespace cat {
 
 
+/*
+	These pick the fastest kernel the CPU supports on first use: AVX-512 or
+	AVX2 on x86, NEON where the build targets it, and portable 64-bit code
+	otherwise.  Buffers need no particular alignment.
+*/
+
 // In-place swap of two buffers
 void memswap(void * CAT_RESTRICT vx, void * CAT_RESTRICT vy, int bytes);
 
+// Swap the first bytes of two rows in a matrix whose rows start stride
+// bytes apart, as for pivoting during elimination.  Rows must not overlap
+void memswap_rows(void *base, int stride, int row_a, int row_b, int bytes);
+
 
 } // namespace cat
 
@@ -27,13 +27,24 @@
 */
 
 #include "MemXOR.hpp"
+#include "CPUFeatures.hpp"
 using namespace cat;
 
+// Build the AVX2 and AVX-512 kernels where the compiler can target them per
+// function, and pick one at run time from the CPU features
+#if defined(CAT_X86_DISPATCH)
+# define CAT_MEMXOR_X86_DISPATCH
+# include <immintrin.h>
+#elif defined(CAT_HAS_NEON)
+# define CAT_MEMXOR_NEON
+# include <arm_neon.h>
+#endif
+
 #ifdef CAT_HAS_VECTOR_EXTENSIONS
 typedef u64 vec_block CAT_VECTOR_SIZE(u64, 16);
 #endif
 
-void cat::memxor(void * CAT_RESTRICT voutput, const void * CAT_RESTRICT vinput, int bytes)
+static void memxor_generic(void * CAT_RESTRICT voutput, const void * CAT_RESTRICT vinput, int bytes)
 {
 	/*
 		Often times the output is XOR'd in-place so this version is
@@ -129,7 +140,7 @@ void cat::memxor(void * CAT_RESTRICT voutput, const void * CAT_RESTRICT vinput,
 	}
 }
 
-void cat::memxor_set(void * CAT_RESTRICT voutput, const void * CAT_RESTRICT va, const void * CAT_RESTRICT vb, int bytes)
+static void memxor_set_generic(void * CAT_RESTRICT voutput, const void * CAT_RESTRICT va, const void * CAT_RESTRICT vb, int bytes)
 {
 	/*
 		This version exists to avoid an expensive memory copy operation when
@@ -227,7 +238,7 @@ void cat::memxor_set(void * CAT_RESTRICT voutput, const void * CAT_RESTRICT va,
 	}
 }
 
-void cat::memxor_add(void * CAT_RESTRICT voutput, const void * CAT_RESTRICT va, const void * CAT_RESTRICT vb, int bytes)
+static void memxor_add_generic(void * CAT_RESTRICT voutput, const void * CAT_RESTRICT va, const void * CAT_RESTRICT vb, int bytes)
 {
 	/*
 		This version adds to the output instead of overwriting it.
@@ -324,3 +335,418 @@ void cat::memxor_add(void * CAT_RESTRICT voutput, const void * CAT_RESTRICT va,
 	}
 }
 
+
+
+//// AVX2 / AVX-512
+
+#if defined(CAT_MEMXOR_X86_DISPATCH)
+
+/*
+	Unaligned loads cost the same as aligned ones on AVX2-class CPUs, so
+	buffers are processed from wherever they start.  AVX2 leaves a tail
+	under 32 bytes to the generic code, and AVX-512 finishes the tail with
+	one masked load and store.
+*/
+
+#define CAT_LOAD256(p) _mm256_loadu_si256((const __m256i *)(p))
+#define CAT_STORE256(p, x) _mm256_storeu_si256((__m256i *)(p), x)
+
+CAT_TARGET_AVX2 static void memxor_avx2(void * CAT_RESTRICT voutput, const void * CAT_RESTRICT vinput, int bytes)
+{
+	u8 * CAT_RESTRICT output = reinterpret_cast<u8 *>( voutput );
+	const u8 * CAT_RESTRICT input = reinterpret_cast<const u8 *>( vinput );
+
+	while (bytes >= 128)
+	{
+		__m256i x0 = _mm256_xor_si256(CAT_LOAD256(output), CAT_LOAD256(input));
+		__m256i x1 = _mm256_xor_si256(CAT_LOAD256(output + 32), CAT_LOAD256(input + 32));
+		__m256i x2 = _mm256_xor_si256(CAT_LOAD256(output + 64), CAT_LOAD256(input + 64));
+		__m256i x3 = _mm256_xor_si256(CAT_LOAD256(output + 96), CAT_LOAD256(input + 96));
+		CAT_STORE256(output, x0);
+		CAT_STORE256(output + 32, x1);
+		CAT_STORE256(output + 64, x2);
+		CAT_STORE256(output + 96, x3);
+		output += 128;
+		input += 128;
+		bytes -= 128;
+	}
+
+	while (bytes >= 32)
+	{
+		CAT_STORE256(output, _mm256_xor_si256(CAT_LOAD256(output), CAT_LOAD256(input)));
+		output += 32;
+		input += 32;
+		bytes -= 32;
+	}
+
+	if (bytes > 0)
+		memxor_generic(output, input, bytes);
+}
+
+CAT_TARGET_AVX2 static void memxor_set_avx2(void * CAT_RESTRICT voutput, const void * CAT_RESTRICT va, const void * CAT_RESTRICT vb, int bytes)
+{
+	u8 * CAT_RESTRICT output = reinterpret_cast<u8 *>( voutput );
+	const u8 * CAT_RESTRICT a = reinterpret_cast<const u8 *>( va );
+	const u8 * CAT_RESTRICT b = reinterpret_cast<const u8 *>( vb );
+
+	while (bytes >= 128)
+	{
+		__m256i x0 = _mm256_xor_si256(CAT_LOAD256(a), CAT_LOAD256(b));
+		__m256i x1 = _mm256_xor_si256(CAT_LOAD256(a + 32), CAT_LOAD256(b + 32));
+		__m256i x2 = _mm256_xor_si256(CAT_LOAD256(a + 64), CAT_LOAD256(b + 64));
+		__m256i x3 = _mm256_xor_si256(CAT_LOAD256(a + 96), CAT_LOAD256(b + 96));
+		CAT_STORE256(output, x0);
+		CAT_STORE256(output + 32, x1);
+		CAT_STORE256(output + 64, x2);
+		CAT_STORE256(output + 96, x3);
+		output += 128;
+		a += 128;
+		b += 128;
+		bytes -= 128;
+	}
+
+	while (bytes >= 32)
+	{
+		CAT_STORE256(output, _mm256_xor_si256(CAT_LOAD256(a), CAT_LOAD256(b)));
+		output += 32;
+		a += 32;
+		b += 32;
+		bytes -= 32;
+	}
+
+	if (bytes > 0)
+		memxor_set_generic(output, a, b, bytes);
+}
+
+CAT_TARGET_AVX2 static void memxor_add_avx2(void * CAT_RESTRICT voutput, const void * CAT_RESTRICT va, const void * CAT_RESTRICT vb, int bytes)
+{
+	u8 * CAT_RESTRICT output = reinterpret_cast<u8 *>( voutput );
+	const u8 * CAT_RESTRICT a = reinterpret_cast<const u8 *>( va );
+	const u8 * CAT_RESTRICT b = reinterpret_cast<const u8 *>( vb );
+
+	while (bytes >= 128)
+	{
+		__m256i x0 = _mm256_xor_si256(CAT_LOAD256(a), CAT_LOAD256(b));
+		__m256i x1 = _mm256_xor_si256(CAT_LOAD256(a + 32), CAT_LOAD256(b + 32));
+		__m256i x2 = _mm256_xor_si256(CAT_LOAD256(a + 64), CAT_LOAD256(b + 64));
+		__m256i x3 = _mm256_xor_si256(CAT_LOAD256(a + 96), CAT_LOAD256(b + 96));
+		CAT_STORE256(output, _mm256_xor_si256(CAT_LOAD256(output), x0));
+		CAT_STORE256(output + 32, _mm256_xor_si256(CAT_LOAD256(output + 32), x1));
+		CAT_STORE256(output + 64, _mm256_xor_si256(CAT_LOAD256(output + 64), x2));
+		CAT_STORE256(output + 96, _mm256_xor_si256(CAT_LOAD256(output + 96), x3));
+		output += 128;
+		a += 128;
+		b += 128;
+		bytes -= 128;
+	}
+
+	while (bytes >= 32)
+	{
+		__m256i x = _mm256_xor_si256(CAT_LOAD256(a), CAT_LOAD256(b));
+		CAT_STORE256(output, _mm256_xor_si256(CAT_LOAD256(output), x));
+		output += 32;
+		a += 32;
+		b += 32;
+		bytes -= 32;
+	}
+
+	if (bytes > 0)
+		memxor_add_generic(output, a, b, bytes);
+}
+
+#undef CAT_LOAD256
+#undef CAT_STORE256
+
+#define CAT_LOAD512(p) _mm512_loadu_si512((const void *)(p))
+#define CAT_STORE512(p, x) _mm512_storeu_si512((void *)(p), x)
+
+// Mask selecting the low 1..63 bytes of a vector
+#define CAT_TAIL_MASK(bytes) ((__mmask64)(((u64)1 << (bytes)) - 1))
+
+CAT_TARGET_AVX512 static void memxor_avx512(void * CAT_RESTRICT voutput, const void * CAT_RESTRICT vinput, int bytes)
+{
+	u8 * CAT_RESTRICT output = reinterpret_cast<u8 *>( voutput );
+	const u8 * CAT_RESTRICT input = reinterpret_cast<const u8 *>( vinput );
+
+	while (bytes >= 256)
+	{
+		__m512i x0 = _mm512_xor_si512(CAT_LOAD512(output), CAT_LOAD512(input));
+		__m512i x1 = _mm512_xor_si512(CAT_LOAD512(output + 64), CAT_LOAD512(input + 64));
+		__m512i x2 = _mm512_xor_si512(CAT_LOAD512(output + 128), CAT_LOAD512(input + 128));
+		__m512i x3 = _mm512_xor_si512(CAT_LOAD512(output + 192), CAT_LOAD512(input + 192));
+		CAT_STORE512(output, x0);
+		CAT_STORE512(output + 64, x1);
+		CAT_STORE512(output + 128, x2);
+		CAT_STORE512(output + 192, x3);
+		output += 256;
+		input += 256;
+		bytes -= 256;
+	}
+
+	while (bytes >= 64)
+	{
+		CAT_STORE512(output, _mm512_xor_si512(CAT_LOAD512(output), CAT_LOAD512(input)));
+		output += 64;
+		input += 64;
+		bytes -= 64;
+	}
+
+	if (bytes > 0)
+	{
+		__mmask64 mask = CAT_TAIL_MASK(bytes);
+		__m512i x = _mm512_xor_si512(_mm512_maskz_loadu_epi8(mask, output), _mm512_maskz_loadu_epi8(mask, input));
+		_mm512_mask_storeu_epi8(output, mask, x);
+	}
+}
+
+CAT_TARGET_AVX512 static void memxor_set_avx512(void * CAT_RESTRICT voutput, const void * CAT_RESTRICT va, const void * CAT_RESTRICT vb, int bytes)
+{
+	u8 * CAT_RESTRICT output = reinterpret_cast<u8 *>( voutput );
+	const u8 * CAT_RESTRICT a = reinterpret_cast<const u8 *>( va );
+	const u8 * CAT_RESTRICT b = reinterpret_cast<const u8 *>( vb );
+
+	while (bytes >= 256)
+	{
+		__m512i x0 = _mm512_xor_si512(CAT_LOAD512(a), CAT_LOAD512(b));
+		__m512i x1 = _mm512_xor_si512(CAT_LOAD512(a + 64), CAT_LOAD512(b + 64));
+		__m512i x2 = _mm512_xor_si512(CAT_LOAD512(a + 128), CAT_LOAD512(b + 128));
+		__m512i x3 = _mm512_xor_si512(CAT_LOAD512(a + 192), CAT_LOAD512(b + 192));
+		CAT_STORE512(output, x0);
+		CAT_STORE512(output + 64, x1);
+		CAT_STORE512(output + 128, x2);
+		CAT_STORE512(output + 192, x3);
+		output += 256;
+		a += 256;
+		b += 256;
+		bytes -= 256;
+	}
+
+	while (bytes >= 64)
+	{
+		CAT_STORE512(output, _mm512_xor_si512(CAT_LOAD512(a), CAT_LOAD512(b)));
+		output += 64;
+		a += 64;
+		b += 64;
+		bytes -= 64;
+	}
+
+	if (bytes > 0)
+	{
+		__mmask64 mask = CAT_TAIL_MASK(bytes);
+		__m512i x = _mm512_xor_si512(_mm512_maskz_loadu_epi8(mask, a), _mm512_maskz_loadu_epi8(mask, b));
+		_mm512_mask_storeu_epi8(output, mask, x);
+	}
+}
+
+CAT_TARGET_AVX512 static void memxor_add_avx512(void * CAT_RESTRICT voutput, const void * CAT_RESTRICT va, const void * CAT_RESTRICT vb, int bytes)
+{
+	u8 * CAT_RESTRICT output = reinterpret_cast<u8 *>( voutput );
+	const u8 * CAT_RESTRICT a = reinterpret_cast<const u8 *>( va );
+	const u8 * CAT_RESTRICT b = reinterpret_cast<const u8 *>( vb );
+
+	while (bytes >= 256)
+	{
+		__m512i x0 = _mm512_ternarylogic_epi64(CAT_LOAD512(output), CAT_LOAD512(a), CAT_LOAD512(b), 0x96);
+		__m512i x1 = _mm512_ternarylogic_epi64(CAT_LOAD512(output + 64), CAT_LOAD512(a + 64), CAT_LOAD512(b + 64), 0x96);
+		__m512i x2 = _mm512_ternarylogic_epi64(CAT_LOAD512(output + 128), CAT_LOAD512(a + 128), CAT_LOAD512(b + 128), 0x96);
+		__m512i x3 = _mm512_ternarylogic_epi64(CAT_LOAD512(output + 192), CAT_LOAD512(a + 192), CAT_LOAD512(b + 192), 0x96);
+		CAT_STORE512(output, x0);
+		CAT_STORE512(output + 64, x1);
+		CAT_STORE512(output + 128, x2);
+		CAT_STORE512(output + 192, x3);
+		output += 256;
+		a += 256;
+		b += 256;
+		bytes -= 256;
+	}
+
+	while (bytes >= 64)
+	{
+		CAT_STORE512(output, _mm512_ternarylogic_epi64(CAT_LOAD512(output), CAT_LOAD512(a), CAT_LOAD512(b), 0x96));
+		output += 64;
+		a += 64;
+		b += 64;
+		bytes -= 64;
+	}
+
+	if (bytes > 0)
+	{
+		__mmask64 mask = CAT_TAIL_MASK(bytes);
+		__m512i x = _mm512_ternarylogic_epi64(_mm512_maskz_loadu_epi8(mask, output),
+											  _mm512_maskz_loadu_epi8(mask, a),
+											  _mm512_maskz_loadu_epi8(mask, b), 0x96);
+		_mm512_mask_storeu_epi8(output, mask, x);
+	}
+}
+
+#undef CAT_TAIL_MASK
+#undef CAT_LOAD512
+#undef CAT_STORE512
+
+enum MemXorKernel
+{
+	MEMXOR_GENERIC,
+	MEMXOR_AVX2,
+	MEMXOR_AVX512
+};
+
+static MemXorKernel DetectKernel()
+{
+	if (HasCPUFeatures(CPU_AVX512F | CPU_AVX512BW))
+		return MEMXOR_AVX512;
+	if (HasCPUFeatures(CPU_AVX2))
+		return MEMXOR_AVX2;
+	return MEMXOR_GENERIC;
+}
+
+#endif // CAT_MEMXOR_X86_DISPATCH
+
+
+//// NEON
+
+#if defined(CAT_MEMXOR_NEON)
+
+static void memxor_neon(void * CAT_RESTRICT voutput, const void * CAT_RESTRICT vinput, int bytes)
+{
+	u8 * CAT_RESTRICT output = reinterpret_cast<u8 *>( voutput );
+	const u8 * CAT_RESTRICT input = reinterpret_cast<const u8 *>( vinput );
+
+	while (bytes >= 64)
+	{
+		uint8x16_t x0 = veorq_u8(vld1q_u8(output), vld1q_u8(input));
+		uint8x16_t x1 = veorq_u8(vld1q_u8(output + 16), vld1q_u8(input + 16));
+		uint8x16_t x2 = veorq_u8(vld1q_u8(output + 32), vld1q_u8(input + 32));
+		uint8x16_t x3 = veorq_u8(vld1q_u8(output + 48), vld1q_u8(input + 48));
+		vst1q_u8(output, x0);
+		vst1q_u8(output + 16, x1);
+		vst1q_u8(output + 32, x2);
+		vst1q_u8(output + 48, x3);
+		output += 64;
+		input += 64;
+		bytes -= 64;
+	}
+
+	while (bytes >= 16)
+	{
+		vst1q_u8(output, veorq_u8(vld1q_u8(output), vld1q_u8(input)));
+		output += 16;
+		input += 16;
+		bytes -= 16;
+	}
+
+	if (bytes > 0)
+		memxor_generic(output, input, bytes);
+}
+
+static void memxor_set_neon(void * CAT_RESTRICT voutput, const void * CAT_RESTRICT va, const void * CAT_RESTRICT vb, int bytes)
+{
+	u8 * CAT_RESTRICT output = reinterpret_cast<u8 *>( voutput );
+	const u8 * CAT_RESTRICT a = reinterpret_cast<const u8 *>( va );
+	const u8 * CAT_RESTRICT b = reinterpret_cast<const u8 *>( vb );
+
+	while (bytes >= 16)
+	{
+		vst1q_u8(output, veorq_u8(vld1q_u8(a), vld1q_u8(b)));
+		output += 16;
+		a += 16;
+		b += 16;
+		bytes -= 16;
+	}
+
+	if (bytes > 0)
+		memxor_set_generic(output, a, b, bytes);
+}
+
+static void memxor_add_neon(void * CAT_RESTRICT voutput, const void * CAT_RESTRICT va, const void * CAT_RESTRICT vb, int bytes)
+{
+	u8 * CAT_RESTRICT output = reinterpret_cast<u8 *>( voutput );
+	const u8 * CAT_RESTRICT a = reinterpret_cast<const u8 *>( va );
+	const u8 * CAT_RESTRICT b = reinterpret_cast<const u8 *>( vb );
+
+	while (bytes >= 16)
+	{
+		uint8x16_t x = veorq_u8(vld1q_u8(a), vld1q_u8(b));
+		vst1q_u8(output, veorq_u8(vld1q_u8(output), x));
+		output += 16;
+		a += 16;
+		b += 16;
+		bytes -= 16;
+	}
+
+	if (bytes > 0)
+		memxor_add_generic(output, a, b, bytes);
+}
+
+#endif // CAT_MEMXOR_NEON
+
+
+//// Dispatch
+
+typedef void (*MemXorFunc)(void * CAT_RESTRICT, const void * CAT_RESTRICT, int);
+typedef void (*MemXorFunc3)(void * CAT_RESTRICT, const void * CAT_RESTRICT, const void * CAT_RESTRICT, int);
+
+// Kernels that are picked together
+struct MemXorKernels
+{
+	MemXorFunc memxor;
+	MemXorFunc3 memxor_set;
+	MemXorFunc3 memxor_add;
+};
+
+#if defined(CAT_MEMXOR_X86_DISPATCH)
+
+static const MemXorKernels *DetectKernels()
+{
+	static const MemXorKernels AVX512 = { memxor_avx512, memxor_set_avx512, memxor_add_avx512 };
+	static const MemXorKernels AVX2 = { memxor_avx2, memxor_set_avx2, memxor_add_avx2 };
+	static const MemXorKernels GENERIC = { memxor_generic, memxor_set_generic, memxor_add_generic };
+
+	switch (DetectKernel())
+	{
+	case MEMXOR_AVX512: return &AVX512;
+	case MEMXOR_AVX2: return &AVX2;
+	default: return &GENERIC;
+	}
+}
+
+static const MemXorKernels *m_kernels = 0;
+
+static CAT_INLINE const MemXorKernels *GetKernels()
+{
+	return BindKernel(m_kernels, DetectKernels);
+}
+
+#elif defined(CAT_MEMXOR_NEON)
+
+static const MemXorKernels m_neon = { memxor_neon, memxor_set_neon, memxor_add_neon };
+
+static CAT_INLINE const MemXorKernels *GetKernels()
+{
+	return &m_neon;
+}
+
+#else
+
+static const MemXorKernels m_generic = { memxor_generic, memxor_set_generic, memxor_add_generic };
+
+static CAT_INLINE const MemXorKernels *GetKernels()
+{
+	return &m_generic;
+}
+
+#endif
+
+void cat::memxor(void * CAT_RESTRICT voutput, const void * CAT_RESTRICT vinput, int bytes)
+{
+	GetKernels()->memxor(voutput, vinput, bytes);
+}
+
+void cat::memxor_set(void * CAT_RESTRICT voutput, const void * CAT_RESTRICT va, const void * CAT_RESTRICT vb, int bytes)
+{
+	GetKernels()->memxor_set(voutput, va, vb, bytes);
+}
+
+void cat::memxor_add(void * CAT_RESTRICT voutput, const void * CAT_RESTRICT va, const void * CAT_RESTRICT vb, int bytes)
+{
+	GetKernels()->memxor_add(voutput, va, vb, bytes);
+}
@@ -34,6 +34,12 @@
 namespace cat {
 
 
+/*
+	These pick the fastest kernel the CPU supports on first use: AVX-512 or
+	AVX2 on x86, NEON where the build targets it, and portable 64-bit code
+	otherwise.  Buffers need no particular alignment.
+*/
+
 // In-place XOR of voutput buffer by vinput buffer
 void memxor(void * CAT_RESTRICT voutput, const void * CAT_RESTRICT vinput, int bytes);
 
@@ -148,62 +148,341 @@ bool MersenneTwister::Initialize(u32 *seeds, u32 words)
     return true;
 }
 
-// r != n, 0 < bits < 32
-void MersenneTwister::shiftLeft128(MT128 *r, MT128 *n, u32 bits)
+//// Recursion
+
+/*
+    SFMT-19937 parameters.  The state holds N128 128-bit words and each new
+    word is MTMIX(w[i - N128], w[i - N128 + POS1], w[i - 2], w[i - 1]):
+
+    r = a ^ (a << SL2 bytes) ^ ((b >> SR1) & MSK) ^ (c >> SR2 bytes) ^ (d{0..3} << SL1)
+
+    The 128-bit shifts are byte shifts of the whole word and the others act
+    on each 32-bit lane, so one SSE2 or NEON register holds a whole word.
+    Each word depends on the previous two, so wider vectors do not help.
+*/
+static const u32 POS1 = 122;
+static const u32 SL1 = 18;
+static const u32 SL2 = 1;
+static const u32 SR1 = 11;
+static const u32 SR2 = 1;
+static const u32 MSK1 = 0xdfffffefU;
+static const u32 MSK2 = 0xddfecb7fU;
+static const u32 MSK3 = 0xbffaffffU;
+static const u32 MSK4 = 0xbffffff6U;
+
+#if defined(CAT_HAS_SSE2)
+
+#include <emmintrin.h>
+
+typedef __m128i MTVector;
+
+static CAT_INLINE MTVector MTLoad(const u32 *p)
+{
+    return _mm_loadu_si128((const __m128i *)p);
+}
+
+static CAT_INLINE void MTStore(u32 *p, MTVector v)
+{
+    _mm_storeu_si128((__m128i *)p, v);
+}
+
+static CAT_INLINE MTVector MTMix(MTVector a, MTVector b, MTVector c, MTVector d)
+{
+    const __m128i mask = _mm_set_epi32(MSK4, MSK3, MSK2, MSK1);
+
+    __m128i x = _mm_xor_si128(a, _mm_slli_si128(a, SL2));
+    __m128i y = _mm_and_si128(_mm_srli_epi32(b, SR1), mask);
+    __m128i z = _mm_xor_si128(_mm_srli_si128(c, SR2), _mm_slli_epi32(d, SL1));
+
+    return _mm_xor_si128(_mm_xor_si128(x, y), z);
+}
+
+#elif defined(CAT_HAS_NEON)
+
+#include <arm_neon.h>
+
+typedef uint32x4_t MTVector;
+
+static CAT_INLINE MTVector MTLoad(const u32 *p)
+{
+    return vld1q_u32(p);
+}
+
+static CAT_INLINE void MTStore(u32 *p, MTVector v)
 {
-    r->u[0] = n->u[0] << bits;
-    r->u[1] = (n->u[1] << bits) | (n->u[0] >> (32 - bits)); 
-    r->u[2] = (n->u[2] << bits) | (n->u[1] >> (32 - bits)); 
-    r->u[3] = (n->u[3] << bits) | (n->u[2] >> (32 - bits)); 
+    vst1q_u32(p, v);
 }
 
-// r != n, 0 < bits < 32
-void MersenneTwister::shiftRight128(MT128 *r, MT128 *n, u32 bits)
+static CAT_INLINE MTVector MTMix(MTVector a, MTVector b, MTVector c, MTVector d)
 {
-    r->u[0] = (n->u[0] >> bits) | (n->u[1] << (32 - bits));
-    r->u[1] = (n->u[1] >> bits) | (n->u[2] << (32 - bits));
-    r->u[2] = (n->u[2] >> bits) | (n->u[3] << (32 - bits));
-    r->u[3] = n->u[3] >> bits; 
+    static const u32 MASK[4] = { MSK1, MSK2, MSK3, MSK4 };
+    const uint8x16_t zero = vdupq_n_u8(0);
+
+    // Whole-register byte shifts
+    uint8x16_t al = vextq_u8(zero, vreinterpretq_u8_u32(a), 16 - SL2);
+    uint8x16_t cr = vextq_u8(vreinterpretq_u8_u32(c), zero, SR2);
+
+    uint32x4_t x = veorq_u32(a, vreinterpretq_u32_u8(al));
+    uint32x4_t y = vandq_u32(vshrq_n_u32(b, SR1), vld1q_u32(MASK));
+    uint32x4_t z = veorq_u32(vreinterpretq_u32_u8(cr), vshlq_n_u32(d, SL1));
+
+    return veorq_u32(veorq_u32(x, y), z);
 }
 
-// a ^= (a << SL2BITS) ^ ((b >> SR1) & MSK) ^ (c >> SR2BITS) ^ (d{0..3} << SL1)
-void MersenneTwister::round(MT128 *a, MT128 *b, MT128 *c, MT128 *d)
+#else
+
+struct MTVector {
+    u32 u[4];
+};
+
+// Buffers handed to Generate() may not be aligned
+static CAT_INLINE MTVector MTLoad(const u32 *p)
 {
-    MT128 x, y;
+    MTVector v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
 
-    shiftLeft128(&x, a, SL2BITS);
-    shiftRight128(&y, c, SR2BITS);
+static CAT_INLINE void MTStore(u32 *p, MTVector v)
+{
+    memcpy(p, &v, sizeof(v));
+}
 
-    a->u[0] ^= x.u[0] ^ ((b->u[0] >> SR1) & MSK1) ^ y.u[0] ^ (d->u[0] << SL1);
-    a->u[1] ^= x.u[1] ^ ((b->u[1] >> SR1) & MSK2) ^ y.u[1] ^ (d->u[1] << SL1);
-    a->u[2] ^= x.u[2] ^ ((b->u[2] >> SR1) & MSK3) ^ y.u[2] ^ (d->u[2] << SL1);
-    a->u[3] ^= x.u[3] ^ ((b->u[3] >> SR1) & MSK4) ^ y.u[3] ^ (d->u[3] << SL1);
+static CAT_INLINE MTVector MTMix(MTVector a, MTVector b, MTVector c, MTVector d)
+{
+    static const u32 SL2BITS = SL2*8, SR2BITS = SR2*8;
+    MTVector r;
+
+    r.u[0] = a.u[0] ^ (a.u[0] << SL2BITS)
+           ^ ((b.u[0] >> SR1) & MSK1)
+           ^ ((c.u[0] >> SR2BITS) | (c.u[1] << (32 - SR2BITS)))
+           ^ (d.u[0] << SL1);
+    r.u[1] = a.u[1] ^ ((a.u[1] << SL2BITS) | (a.u[0] >> (32 - SL2BITS)))
+           ^ ((b.u[1] >> SR1) & MSK2)
+           ^ ((c.u[1] >> SR2BITS) | (c.u[2] << (32 - SR2BITS)))
+           ^ (d.u[1] << SL1);
+    r.u[2] = a.u[2] ^ ((a.u[2] << SL2BITS) | (a.u[1] >> (32 - SL2BITS)))
+           ^ ((b.u[2] >> SR1) & MSK3)
+           ^ ((c.u[2] >> SR2BITS) | (c.u[3] << (32 - SR2BITS)))
+           ^ (d.u[2] << SL1);
+    r.u[3] = a.u[3] ^ ((a.u[3] << SL2BITS) | (a.u[2] >> (32 - SL2BITS)))
+           ^ ((b.u[3] >> SR1) & MSK4)
+           ^ (c.u[3] >> SR2BITS)
+           ^ (d.u[3] << SL1);
+
+    return r;
 }
 
+#endif
+
 // permute the existing state into a new one
 void MersenneTwister::update()
 {
-    MT128 *r1 = state + N128 - 2;
-    MT128 *r2 = state + N128 - 1;
+    u32 *w = state32;
+    MTVector r1 = MTLoad(w + (N128 - 2) * 4);
+    MTVector r2 = MTLoad(w + (N128 - 1) * 4);
     u32 ii;
 
     for (ii = 0; ii < N128 - POS1; ++ii)
     {
-        round(state + ii, state + ii + POS1, r1, r2);
+        MTVector r = MTMix(MTLoad(w + ii*4), MTLoad(w + (ii + POS1)*4), r1, r2);
+        MTStore(w + ii*4, r);
         r1 = r2;
-        r2 = state + ii;
+        r2 = r;
     }
 
     for (; ii < N128; ++ii)
     {
-        round(state + ii, state + ii + POS1 - N128, r1, r2);
+        MTVector r = MTMix(MTLoad(w + ii*4), MTLoad(w + (ii + POS1 - N128)*4), r1, r2);
+        MTStore(w + ii*4, r);
         r1 = r2;
-        r2 = state + ii;
+        r2 = r;
     }
 
     used = 0;
 }
 
+// generate count >= N128 128-bit words straight into the array,
+// leaving the last N128 of them as the new state
+void MersenneTwister::generateArray(u32 *array, u32 count)
+{
+    const u32 *w = state32;
+    MTVector r1 = MTLoad(w + (N128 - 2) * 4);
+    MTVector r2 = MTLoad(w + (N128 - 1) * 4);
+    u32 ii;
+
+    for (ii = 0; ii < N128 - POS1; ++ii)
+    {
+        MTVector r = MTMix(MTLoad(w + ii*4), MTLoad(w + (ii + POS1)*4), r1, r2);
+        MTStore(array + ii*4, r);
+        r1 = r2;
+        r2 = r;
+    }
+
+    for (; ii < N128; ++ii)
+    {
+        MTVector r = MTMix(MTLoad(w + ii*4), MTLoad(array + (ii + POS1 - N128)*4), r1, r2);
+        MTStore(array + ii*4, r);
+        r1 = r2;
+        r2 = r;
+    }
+
+    // From here on every input comes from the array itself
+    for (; ii < count; ++ii)
+    {
+        MTVector r = MTMix(MTLoad(array + (ii - N128)*4), MTLoad(array + (ii + POS1 - N128)*4), r1, r2);
+        MTStore(array + ii*4, r);
+        r1 = r2;
+        r2 = r;
+    }
+
+    memcpy(state, array + (count - N128)*4, sizeof(state));
+    used = N32;
+}
+
+/*
+    The recursion is linear over GF(2), so stepping the state J times is the
+    same as evaluating (x^^J mod phi(x)) at the transition, where phi(x) is
+    its characteristic polynomial (degree 19968) by Cayley-Hamilton.
+
+    STREAM_JUMP holds the coefficients of x^^J mod phi(x) for J = 156 * 2^^100,
+    which is 2^^100 calls to update(), with bit i of the table for x^^i.
+    It was computed offline: Berlekamp-Massey on the output bits for phi(x),
+    then x^^156 squared 100 times modulo phi(x).
+*/
+static const u32 STREAM_JUMP[624] = {
+    0xb76cfdb0, 0xe3ac2dca, 0x4b9742d7, 0xba0600e6, 0x9d6a25cf, 0xaec60577, 0x347800aa, 0x872f40c5,
+    0x3fa0dd21, 0xafd55806, 0x4df97514, 0x626e3852, 0xf82f4461, 0x2ead86c6, 0x5dd0e9df, 0xc6294c83,
+    0x02649e2e, 0x86a5e8f4, 0xd92c6bda, 0x825c1c4e, 0xe6d622a3, 0xc326c379, 0xec4d120e, 0xa2a14a8b,
+    0x5bce044c, 0x608d0e8f, 0x804d70d6, 0x5ef217cd, 0xc2906b21, 0xf9ae271c, 0x75eaffc0, 0x22e0150e,
+    0x7de0f0a0, 0xefd52881, 0xed92fe61, 0xa0ca425d, 0x703f89a0, 0x029113c8, 0x7fa8ede9, 0xa2537e8a,
+    0xaee347ac, 0x4d48d34c, 0xca941134, 0x893d3597, 0xa5943ec1, 0x29a2a533, 0xcd96c64a, 0x9b231776,
+    0x86ee8ba2, 0xb700f182, 0x2631297f, 0x9fff7d67, 0xa162509f, 0x8c4e6fa8, 0x56a31e9c, 0x504550f5,
+    0x9a2c4cff, 0x07a38f43, 0x8f4c903a, 0xc377fdde, 0x829a992e, 0x16dc5787, 0x47123b36, 0x6d00bd7e,
+    0xea26fe74, 0x9944fd1e, 0xfa08c42c, 0x986018f5, 0x63daf456, 0x4cb7ec88, 0x1c80e5da, 0xf5d17485,
+    0xac6aab3f, 0x77a55e50, 0xec171f24, 0x2cc7fda5, 0x364fd424, 0xfc60f956, 0x1fe0ca92, 0x032d7845,
+    0xd4f67d93, 0x7158db6c, 0xd8c5d64f, 0xa24a334a, 0x13453f3d, 0xf4be86bd, 0x787df617, 0xb6790537,
+    0x51ec1c19, 0x77e132dc, 0x0a6649e0, 0xa617320b, 0x47339e8a, 0x38d342c5, 0x3349c5b6, 0x6860786f,
+    0xe254fa70, 0x61e86b5b, 0xa69d961d, 0x0f3c1258, 0xc23e2382, 0xa112b0ce, 0xde13f5b0, 0xa3dd7d64,
+    0xa37213f5, 0x3491568d, 0x83133922, 0x14d99ec8, 0x5899f393, 0xc8dc7e62, 0x85d306fc, 0x9143c4b5,
+    0xa9e991c7, 0x119a30ef, 0xb5f98857, 0x44857d18, 0x1fcd5c25, 0x3f052597, 0x277548e2, 0x9afa2756,
+    0x9a99967a, 0x9cc5bb1a, 0x4e34d90d, 0x5ad9c400, 0x440a44e5, 0xd8ded28d, 0xec6c0181, 0x4ff618c3,
+    0xd88da115, 0x5b2226fe, 0x925ee9cd, 0xbc47d6b1, 0xde81b3a6, 0x6f185755, 0xe9a1255b, 0x8a348878,
+    0x6fd00cdb, 0xf9aaef5d, 0x88e6892c, 0x1f4a354b, 0xdc2bc7f5, 0x4cef0caf, 0xfd7a1079, 0xb9a1aa1e,
+    0xa664d846, 0x65fbac63, 0xbcf6b9d2, 0x9765945d, 0x2bfcfe58, 0x90ebf68e, 0x2c75fb60, 0x778a3761,
+    0xb0369196, 0x91a8ef92, 0xa7fd738f, 0xe8b454e9, 0x5fc03356, 0x328860e6, 0x2b09dbe5, 0xff7701ba,
+    0x35c8ab6f, 0x7673c5d7, 0x21bd6e9b, 0x0a0bebbf, 0x3260860f, 0x661ed1c1, 0x020e3ac1, 0x42061e02,
+    0x09db4046, 0xdae715f0, 0xe0bd1042, 0x1c6bd125, 0xec020017, 0x4f609e2d, 0x82344891, 0x67fe8674,
+    0x85fada90, 0x0ea9f4e1, 0x3dc43325, 0x3dbc0c74, 0xa6ef9df8, 0x46b4d7ee, 0x96d2f2dd, 0x4ead7d1e,
+    0x34533f96, 0xe76dec75, 0xee4333da, 0x0186523b, 0x1d39aabf, 0x331a97da, 0x8436b005, 0xf891d0d2,
+    0x6619d69f, 0x9bfdaed6, 0x81febdc3, 0xd9548080, 0x3468559e, 0xa606dc1b, 0x1afad1dd, 0x6c96b8dd,
+    0xd9c35e08, 0xf412caf2, 0xd7ad668f, 0xce8a0a7a, 0x2b17c4b8, 0x997eb745, 0x70dd6a96, 0xc30e56db,
+    0xf19a0a85, 0xbc03174b, 0x5d832d0a, 0x979257a5, 0x4855fcf5, 0x5b4b8dcd, 0xcee52749, 0x1a18acdf,
+    0xf870754e, 0x218c26fc, 0xe286ed6b, 0x89668081, 0x8305bbd5, 0xc88d75a3, 0x1550743c, 0x928f6e25,
+    0x1998a72b, 0x3f44a2f8, 0x4f3bf74f, 0x5c8b4368, 0x461f3549, 0x8e121e99, 0x35cff305, 0x42d8b7e9,
+    0x06fa8e99, 0x9046125f, 0x64356212, 0x85ba83bd, 0xf9a2f004, 0xd374313e, 0x137407e3, 0x21a65968,
+    0x2f79c77e, 0x6ca33807, 0xd5374d1c, 0xb70426ea, 0x3cc6c3c4, 0x1c79ec02, 0xf46adb05, 0xbfa6b326,
+    0xd36cc21a, 0x558421a6, 0xecd40fa1, 0x2fa07528, 0xf32fd43c, 0xde13e73f, 0xce5e7668, 0xbe9c8f18,
+    0xa81d8b09, 0x1ff0402b, 0x5dcb0489, 0x5ce01267, 0x18e304b2, 0xa3af384a, 0x902f56b8, 0x45607bc7,
+    0xbc27aa71, 0x99696144, 0xabf43b23, 0xdb59c5e3, 0x7ede659a, 0x578cc475, 0xf54fe2dc, 0x93ea8543,
+    0x919688fc, 0x09cd2fce, 0xe33ee775, 0x927cc324, 0xa299e01f, 0x14e63500, 0x0f5beee0, 0x5ec16268,
+    0xb6546062, 0x16a5e11a, 0xb9896391, 0xcc9b8ccc, 0xa2b6816c, 0x1b49eefd, 0x39411eb1, 0xa0063f3e,
+    0x4f046b08, 0xcc225909, 0xa1c4c866, 0x4e2ce9d5, 0xb0f58588, 0xc76f6ad8, 0x8d95fd9e, 0x69fc38bb,
+    0xddb44f37, 0x88f1f941, 0x34442553, 0x039812ef, 0x2d97afe3, 0x9ec37066, 0xe56682af, 0xfe079f80,
+    0xb223874e, 0xf378676c, 0x37acbb37, 0x5302f2f2, 0xff20bd72, 0x49de1a9f, 0xcb4252fa, 0x5be5fbf8,
+    0xdc8d0a51, 0xf128366d, 0x1c844c70, 0x87409361, 0x744a7a85, 0xbdbba3b5, 0xdbd157b1, 0x0e700c5c,
+    0x84d26a0a, 0x192e26a1, 0xc850516e, 0x5266469c, 0x6dfadde3, 0x71ba94b4, 0xefe31e93, 0x98f03369,
+    0x43be4dde, 0xa47e9c06, 0x6bf3a2c7, 0x56b2b2ee, 0xc07e126b, 0x6e60820e, 0x395fd47c, 0x78750b74,
+    0x848ca97b, 0x578b17d3, 0x307146ad, 0x3188a920, 0x873cbd39, 0x18161e13, 0x13d6bce4, 0x772b61a1,
+    0x1946e32c, 0xf75fc8db, 0x4489807a, 0x5fde8706, 0xff6adb07, 0x7ec0225e, 0x7e932e02, 0x0e9bd274,
+    0x58cea8d3, 0xf9d05ded, 0x789df7d1, 0xa59007b1, 0xefd6888f, 0x97939539, 0x13347c52, 0x2e8985ff,
+    0x83732f9f, 0x33054b39, 0xd835cd97, 0x98d81876, 0xce4aea5c, 0x549607d7, 0x424acf91, 0xb8c3182d,
+    0xaf1e9bec, 0x8b3744a4, 0x28dcf4f4, 0xe0b84115, 0x82c1baf8, 0xf691e914, 0x4d41df92, 0x2cab17d8,
+    0x964b41e0, 0x3f737f1d, 0x4a40705a, 0x690a8724, 0xca08660b, 0x3d17ae25, 0x7d6a562e, 0xf7938489,
+    0xaec98681, 0x166b3166, 0x0f847e14, 0x91fb72c9, 0x4e8aed0f, 0x8f2baebb, 0x9f4d9aa6, 0x0624b492,
+    0xfa6c71b1, 0x2881808b, 0x88a52d4b, 0x75b1a9ea, 0x1e0607cc, 0xe09f57b6, 0x0c0fd13e, 0xecba9324,
+    0x8616d1a6, 0x0ee45e24, 0x285bb545, 0x0046c555, 0xe0ccae57, 0xe9ec785b, 0x1a0274cd, 0x9092151f,
+    0xbe9e97c2, 0xbf3601a9, 0xd7085035, 0x48bfdb6f, 0x592dc4f9, 0xdd1a613a, 0xa9a6a040, 0x50644a85,
+    0x6ac19a6b, 0x431f7372, 0xda4c2ba3, 0x6dd5bff8, 0x0abbe614, 0x76dcb5bc, 0x2c84399d, 0xdc571a11,
+    0x16669b93, 0x863ed644, 0xfc30181e, 0x61bad857, 0x8611019f, 0x0dc97f1f, 0x4b0d191f, 0x0f4b77cc,
+    0xc6d263d2, 0x7adb90a1, 0x0aff18a1, 0x29de8016, 0xa2837c20, 0xdd0b2cfa, 0x287ecd97, 0x7e4ca42b,
+    0x24ca752b, 0x93de2863, 0xb7012ab2, 0xb65f9a37, 0xc96ee824, 0xa88b7f79, 0x77758426, 0x5bbe4f39,
+    0x192f31a4, 0x6985d9db, 0x234c3f95, 0xc133d272, 0xeadb126f, 0x5d3110f2, 0x0b44e36b, 0x399c9310,
+    0x253968fb, 0x47747727, 0x901a2be7, 0x092ad7eb, 0x929cf153, 0xc429c71e, 0xbb6cde5b, 0x9345ba49,
+    0x2f7e5eee, 0x43faf61b, 0x980941a4, 0x5a5e5fe4, 0xc34dfa59, 0x227a9fc9, 0x6c191f07, 0x76c7f2b2,
+    0xf4da6670, 0xde2af823, 0x36e060c9, 0x695f0ae0, 0x3cd82f8d, 0xf256a189, 0x3b7194c4, 0x5c2324a3,
+    0x7efeec19, 0x9f15dde7, 0xbf0e72c2, 0x07250a91, 0xbd4089a6, 0xaccd3197, 0x90c8fc4c, 0x2b02297d,
+    0x6853dd52, 0xd83e5ddb, 0x3b3729e6, 0x5988658d, 0x26b07b46, 0x1ea55324, 0x37665c4c, 0x2a2e645c,
+    0xe4c98097, 0xa5628184, 0x278ca91b, 0x85aa92ef, 0xb65f144a, 0xa0163e61, 0xa4dc737d, 0x6bda56ef,
+    0x596c5bff, 0x75f9d2d6, 0x3e0ec519, 0xe6efbb60, 0xe06d9852, 0x4d0335f1, 0x02e54f27, 0x2a39ba76,
+    0x516839f3, 0x7b5166ce, 0xe6077571, 0x92062e54, 0x0a2c1fee, 0xd23859c8, 0xe8740d0a, 0xf9f504c9,
+    0x2a38bff2, 0x37d74c8d, 0x69269153, 0x0f880c10, 0x3f5aad37, 0x2ce18c2c, 0x69350480, 0xada28dc3,
+    0x9107f280, 0x4ef4ee1c, 0x9b2539ac, 0x75f04db4, 0xbb54374f, 0x0a6e53dd, 0x308cf6d3, 0x23fd2fe6,
+    0x84c2f6a1, 0xebe1aabc, 0x48e679cf, 0xb09071ba, 0x90ce21df, 0x24acd734, 0xcd091545, 0x650e94d5,
+    0x4288e87b, 0x2eb29555, 0x1965f49c, 0x12b4912f, 0xba91f5e4, 0xae683950, 0xf2ef49d9, 0xc446ef35,
+    0x201c36d6, 0x7c120e4e, 0x8eff0bc7, 0x94761620, 0x4e4519fc, 0xb3cec8ba, 0xd346b8a8, 0xb8414e7f,
+    0x764993a2, 0xc6b7db34, 0x35040066, 0xe6ba65f7, 0x515081e9, 0x87554f28, 0x7de9de18, 0x84ba29ee,
+    0xcbc286fb, 0xb4f4cc93, 0x803ba455, 0x42cb0baf, 0x3f241ae3, 0x9b359d9d, 0xf5562e4e, 0xc331df47,
+    0xb68d7bd6, 0xeb2fa919, 0x0c9867c8, 0x0ffe5528, 0xa397c2a9, 0x600a1942, 0xfbc2a88d, 0x1cbecf86,
+    0xf4431d6f, 0x0ab2a9db, 0x5fc67f09, 0x6e378b13, 0x0ef9c31d, 0xd5befe63, 0xa7a5146d, 0xaf20d847,
+    0xb0509db5, 0x2abc8451, 0xd7fadc13, 0x29e86732, 0x6682e09d, 0x8c8ec523, 0x8e06ed7e, 0xd002f1a4,
+    0x6365e1c4, 0x59a9891a, 0xd122d851, 0xe0ff7e9a, 0x7e3afc1d, 0x7d04bd75, 0x45dbca8f, 0x241851be,
+    0xfaeacabf, 0x87eea36e, 0x5bb040ac, 0x6a692e30, 0xe838cd97, 0x349702d1, 0x67764529, 0x7de73368,
+    0xf7527d1b, 0xfebc4034, 0x91aa9e17, 0x0a12dbfe, 0xe8f6d66c, 0x92e17e7e, 0xbafa9a62, 0x1b5acea7
+};
+
+// apply a jump polynomial to the state by Horner's rule
+void MersenneTwister::jump(const u32 *polynomial)
+{
+    MT128 work[N128];
+    memset(work, 0, sizeof(work));
+
+    // Find the highest coefficient
+    u32 bits = N32 * 32;
+    while (bits > 0 && !(polynomial[(bits - 1) >> 5] & (1 << ((bits - 1) & 31))))
+        --bits;
+
+    // The state is treated as a ring whose oldest element is state[index]
+    u32 index = 0;
+
+    for (u32 ii = 0; ii < bits; ++ii)
+    {
+        // If this coefficient is set, accumulate the current state
+        if (polynomial[ii >> 5] & (1 << (ii & 31)))
+        {
+            for (u32 jj = 0, kk = index; jj < N128; ++jj)
+            {
+                work[jj].u[0] ^= state[kk].u[0];
+                work[jj].u[1] ^= state[kk].u[1];
+                work[jj].u[2] ^= state[kk].u[2];
+                work[jj].u[3] ^= state[kk].u[3];
+                if (++kk >= N128) kk = 0;
+            }
+        }
+
+        // Replace the oldest element with the next one in the sequence
+        u32 b = index + POS1, c = index + N128 - 2, d = index + N128 - 1;
+        if (b >= N128) b -= N128;
+        if (c >= N128) c -= N128;
+        if (d >= N128) d -= N128;
+
+        u32 *w = state32;
+        MTStore(w + index*4, MTMix(MTLoad(w + index*4), MTLoad(w + b*4), MTLoad(w + c*4), MTLoad(w + d*4)));
+        if (++index >= N128) index = 0;
+    }
+
+    memcpy(state, work, sizeof(state));
+}
+
+// skip past the given number of non-overlapping streams
+void MersenneTwister::JumpStreams(u32 count)
+{
+    // The unread part of the current block stays in place, so
+    // the next output is exactly one stream further along
+    while (count--)
+        jump(STREAM_JUMP);
+}
+
 // generate a 32-bit random number
 u32 MersenneTwister::Generate()
 {
@@ -219,6 +498,22 @@ void MersenneTwister::Generate(void *buffer, int bytes)
     u8 *buffer8 = (u8 *)buffer;
     u32 words = bytes / 4;
 
+    // For large buffers, use up the current block and then
+    // run the recursion directly on the buffer
+    if (words >= N32 + (N32 - used))
+    {
+        u32 remaining = N32 - used;
+
+        memcpy(buffer8, state32 + used, remaining*4);
+        words -= remaining;
+        buffer8 += remaining*4;
+
+        u32 count = words / 4;
+        generateArray((u32 *)buffer8, count);
+        words -= count*4;
+        buffer8 += count*16;
+    }
+
     while (words > 0)
     {
         if (used >= N32)
@@ -46,18 +46,6 @@ class CAT_EXPORT MersenneTwister
     static const u32 N128 = MEXP/128 + 1;
     static const u32 N64 = N128 * 2;
     static const u32 N32 = N128 * 4;
-    static const u32 POS1 = 122;
-    static const u32 SL1 = 18;
-    static const u32 SL2 = 1;
-    static const u32 SL2BITS = SL2*8;
-    static const u32 SR1 = 11;
-    static const u32 SR2 = 1;
-    static const u32 SR2BITS = SR2*8;
-    static const u32 MSK1 = 0xdfffffefU;
-    static const u32 MSK2 = 0xddfecb7fU;
-    static const u32 MSK3 = 0xbffaffffU;
-    static const u32 MSK4 = 0xbffffff6U;
-
     struct MT128 {
         u32 u[4];
     };
@@ -66,12 +54,10 @@ class CAT_EXPORT MersenneTwister
     u32 *state32;
     u32 used;
 
-    CAT_INLINE void shiftLeft128(MT128 *r, MT128 *n, u32 bits);
-    CAT_INLINE void shiftRight128(MT128 *r, MT128 *n, u32 bits);
-
     void enforcePeriod(); // make corrections to ensure that the generator has the full period
-    void round(MT128 *a, MT128 *b, MT128 *c, MT128 *d); // a = MTMIX(a,b,c,d)
     void update(); // permute the existing state into a new one
+    void generateArray(u32 *array, u32 count); // generate count >= N128 128-bit words into array
+    void jump(const u32 *polynomial); // apply a jump polynomial to the state
 
 public:
     MersenneTwister();
@@ -83,6 +69,15 @@ public:
     u32 Generate(); // generate a 32-bit number
     void Generate(void *buffer, int bytes); // generate a series of random numbers
 
+    // Each stream is 2^^STREAM_LOG2_UPDATES state updates long (624 outputs each)
+    static const int STREAM_LOG2_UPDATES = 100;
+
+    // Skip past the given number of streams.
+    // To give each thread its own stream, seed one generator and hand out
+    // copies of it, jumping each copy one stream past the previous one.
+    // One jump costs about as much as generating 20,000 words.
+    void JumpStreams(u32 count = 1);
+
 	// Generate a 32-bit random number in the range [low..high] inclusive
 	u32 GenerateUnbiased(u32 low, u32 high)
 	{
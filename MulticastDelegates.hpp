@@ -30,32 +30,262 @@
 #define CAT_MULTICAST_DELEGATES_HPP
 
 #include <cat/lang/Delegates.hpp>
+#include <cat/threads/Atomic.hpp>
+#include <cat/threads/Mutex.hpp>
+#include <cat/threads/EpochReclaimer.hpp>
+#include <cstring>
+#include <new>
 
 /*
 	Multicast Delegate
 
 	Contains several delegates and can invoke all of them when the associated
 	event occurs.
+
+	Invocation takes no lock: it loads the current listener list and walks
+	it as a plain array.  Lists are never changed in a way a reader could
+	see half-done.  A listener is added by writing the slot past the end and
+	then publishing the larger count, or by publishing a copy when the list
+	is full.  A listener is removed by publishing a copy without it.
+
+	The first PREALLOC_COUNT listeners live inside the object.  When a list
+	is replaced, an invocation in progress may still be walking it, so
+	replaced lists are kept until the MulticastDelegate is destroyed.
+	Listeners are assumed to change rarely compared to invocations.
+
+	If every invocation runs inside a read section of one EpochReclaimer,
+	as TaskScheduler tasks do, pass the caller's EpochParticipant when
+	changing listeners and replaced lists are retired through it instead.
+
+	An invocation that overlaps a RemoveListener() may still call the
+	removed listener once.
 */
 
 namespace cat {
 
 
+// Releases listener lists retired through an EpochParticipant.  It has no
+// state, so one instance serves every delegate and outlives all of them.
+// Only Acquire() and Release() are used
+class MulticastListHeap : public IAllocator
+{
+public:
+	static CAT_INLINE MulticastListHeap *ref()
+	{
+		static MulticastListHeap heap;
+		return &heap;
+	}
+
+	void *Acquire(u32 bytes) { return new (std::nothrow) u8[bytes]; }
+	void *Resize(void *, u32) { return 0; }
+	void Release(void *ptr) { delete [](u8*)ptr; }
+	u32 AcquireBatch(BatchSet &, u32, u32) { return 0; }
+	void ReleaseBatch(const BatchSet &) {}
+};
+
+
 template<class T>
 class MulticastDelegate
 {
-	static const int PREALLOC_COUNT = 2;
+	static const u32 PREALLOC_COUNT = 2;
+
+	struct List
+	{
+		volatile u32 count;
+		u32 capacity;
+		List *retired_next;
+		T delegates[PREALLOC_COUNT];	// Trailing for heap lists
+	};
+
+	List * volatile _list;
+	List *_retired;
+	List _prealloc;
+	Mutex _lock;	// Serializes listener changes
+
+	static List *AllocateList(u32 capacity)
+	{
+		u32 bytes = sizeof(List);
+		if (capacity > PREALLOC_COUNT)
+			bytes += (capacity - PREALLOC_COUNT) * sizeof(T);
+
+		List *list = reinterpret_cast<List*>( MulticastListHeap::ref()->Acquire(bytes) );
+		if (!list) return 0;
+
+		list->count = 0;
+		list->capacity = capacity;
+		list->retired_next = 0;
+
+		return list;
+	}
+
+	// Call with the lock held
+	void Publish(List *list, EpochParticipant *epoch)
+	{
+		// Finish writing the list before readers can see it
+		Atomic::StoreMemoryBarrier();
+
+		List *old_list = _list;
+		_list = list;
+
+		// If readers are covered by the epoch, free it once they are done
+		if (old_list != &_prealloc &&
+			!(epoch && epoch->Retire(old_list, MulticastListHeap::ref())))
+		{
+			old_list->retired_next = _retired;
+			_retired = old_list;
+		}
+	}
+
+	CAT_INLINE List *GetList(u32 &count) const
+	{
+		List *list = _list;
+		CAT_FENCE_COMPILER
+		count = list->count;
+
+		// Acquire: read the delegates after the count that covers them
+#if defined(CAT_ISA_X86)
+		CAT_FENCE_COMPILER
+#else
+		Atomic::DataMemoryBarrier();
+#endif
+
+		return list;
+	}
 
-	T _prealloc[PREALLOC_COUNT];
-	T *_extended;
-	int _count;
+	CAT_NO_COPY(MulticastDelegate);
 
 public:
-	MulticastDelegate();
-	~MulticastDelegate();
+	MulticastDelegate()
+	{
+		_prealloc.count = 0;
+		_prealloc.capacity = PREALLOC_COUNT;
+		_prealloc.retired_next = 0;
+
+		_list = &_prealloc;
+		_retired = 0;
+	}
+
+	~MulticastDelegate()
+	{
+		if (_list != &_prealloc)
+			delete [](u8*)_list;
+
+		while (_retired)
+		{
+			List *next = _retired->retired_next;
+			delete [](u8*)_retired;
+			_retired = next;
+		}
+	}
 
-	bool AddListener(const T &element)
+	// Returns false on out of memory
+	bool AddListener(const T &element, EpochParticipant *epoch = 0)
 	{
+		AutoMutex lock(_lock);
+
+		List *list = _list;
+		u32 count = list->count;
+
+		// If there is room past the end,
+		if (count < list->capacity)
+		{
+			list->delegates[count] = element;
+
+			// Publish the delegate before the count that covers it
+			Atomic::StoreMemoryBarrier();
+
+			list->count = count + 1;
+			return true;
+		}
+
+		List *grown = AllocateList(list->capacity * 2);
+		if (!grown) return false;
+
+		memcpy(grown->delegates, list->delegates, count * sizeof(T));
+		grown->delegates[count] = element;
+		grown->count = count + 1;
+
+		Publish(grown, epoch);
+
+		return true;
+	}
+
+	// Returns false if the listener was not found or on out of memory
+	bool RemoveListener(const T &element, EpochParticipant *epoch = 0)
+	{
+		AutoMutex lock(_lock);
+
+		List *list = _list;
+		u32 count = list->count;
+
+		u32 index = 0;
+		while (index < count && list->delegates[index] != element)
+			++index;
+
+		if (index >= count) return false;
+
+		List *shrunk = AllocateList(list->capacity);
+		if (!shrunk) return false;
+
+		memcpy(shrunk->delegates, list->delegates, index * sizeof(T));
+		memcpy(shrunk->delegates + index, list->delegates + index + 1, (count - index - 1) * sizeof(T));
+		shrunk->count = count - 1;
+
+		Publish(shrunk, epoch);
+
+		return true;
+	}
+
+	CAT_INLINE u32 GetListenerCount() const
+	{
+		return _list->count;
+	}
+
+	CAT_INLINE bool Empty() const
+	{
+		return _list->count == 0;
+	}
+
+	// Invoke every listener.  Arguments are passed through by const reference,
+	// so listeners cannot take non-const reference parameters
+
+	void operator()() const
+	{
+		u32 count;
+		List *list = GetList(count);
+
+		for (u32 ii = 0; ii < count; ++ii)
+			list->delegates[ii]();
+	}
+
+	template<class A1>
+	void operator()(const A1 &a1) const
+	{
+		u32 count;
+		List *list = GetList(count);
+
+		for (u32 ii = 0; ii < count; ++ii)
+			list->delegates[ii](a1);
+	}
+
+	template<class A1, class A2>
+	void operator()(const A1 &a1, const A2 &a2) const
+	{
+		u32 count;
+		List *list = GetList(count);
+
+		for (u32 ii = 0; ii < count; ++ii)
+			list->delegates[ii](a1, a2);
+	}
+
+	template<class A1, class A2, class A3>
+	void operator()(const A1 &a1, const A2 &a2, const A3 &a3) const
+	{
+		u32 count;
+		List *list = GetList(count);
+
+		for (u32 ii = 0; ii < count; ++ii)
+			list->delegates[ii](a1, a2, a3);
 	}
 };
 
@@ -59,6 +59,9 @@ public:
 
     CAT_INLINE bool Enter();
     CAT_INLINE bool Leave();
+
+	// Returns true if the lock was acquired without blocking
+	CAT_INLINE bool TryEnter();
 };
 
 
@@ -116,6 +119,33 @@ CAT_INLINE bool Mutex::Leave()
 #endif
 }
 
+CAT_INLINE bool Mutex::TryEnter()
+{
+#if defined(CAT_OS_WINDOWS)
+
+	CAT_FENCE_COMPILER
+
+	bool result = TryEnterCriticalSection(&cs) != 0;
+
+	CAT_FENCE_COMPILER
+
+	return result;
+
+#else
+
+	if (init_failure) return false;
+
+	CAT_FENCE_COMPILER
+
+	bool result = pthread_mutex_trylock(&mx) == 0;
+
+	CAT_FENCE_COMPILER
+
+	return result;
+
+#endif
+}
+
 
 // RAII Mutex wrapper
 class AutoMutex
@@ -0,0 +1,295 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "PeerTable.hpp"
+#include "BitMath.hpp"
+#include "Clock.hpp"
+using namespace cat;
+
+#if defined(CAT_OS_WINDOWS)
+# include <bcrypt.h>
+# if defined(CAT_COMPILER_MSVC)
+#  pragma comment(lib, "bcrypt.lib")
+# endif
+#else
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+
+//// Key generation
+
+static void GenerateKey(u64 key[2])
+{
+	// Something unpredictable to fall back on if the OS source fails
+	u64 local = 0;
+	key[0] = ((u64)Clock::cycles(false) << 32) ^ (u64)(uintptr_t)&local;
+	key[1] = ((u64)(uintptr_t)key << 32) ^ Clock::cycles(false);
+
+	u64 random[2];
+
+#if defined(CAT_OS_WINDOWS)
+	if (BCryptGenRandom(0, (PUCHAR)random, sizeof(random), BCRYPT_USE_SYSTEM_PREFERRED_RNG) != 0)
+		return;
+#else
+	int fd = open("/dev/urandom", O_RDONLY);
+	if (fd < 0) return;
+
+	ssize_t bytes = read(fd, random, sizeof(random));
+	close(fd);
+
+	if (bytes != (ssize_t)sizeof(random))
+		return;
+#endif
+
+	key[0] ^= random[0];
+	key[1] ^= random[1];
+}
+
+
+//// PeerTable
+
+PeerTable::PeerTable()
+{
+	_key[0] = _key[1] = 0;
+	_slots = 0;
+	_mask = 0;
+	_used = 0;
+}
+
+PeerTable::~PeerTable()
+{
+	delete []_slots;
+}
+
+bool PeerTable::Grow(u32 allocated)
+{
+	Slot *slots = new (std::nothrow) Slot[allocated];
+	if (!slots) return false;
+
+	for (u32 ii = 0; ii < allocated; ++ii)
+		slots[ii].value = 0;
+
+	// Choose the key with the first allocation so idle tables cost nothing
+	if (!_slots)
+		GenerateKey(_key);
+
+	u32 mask = allocated - 1;
+
+	// Move existing entries over, reusing their stored hashes
+	if (_slots)
+	{
+		for (u32 ii = 0; ii <= _mask; ++ii)
+		{
+			Slot *slot = &_slots[ii];
+			if (!slot->value) continue;
+
+			u32 jj = slot->hash & mask;
+			while (slots[jj].value)
+				jj = (jj + 1) & mask;
+
+			slots[jj] = *slot;
+		}
+
+		delete []_slots;
+	}
+
+	_slots = slots;
+	_mask = mask;
+
+	return true;
+}
+
+bool PeerTable::Reserve(u32 count)
+{
+	u32 allocated = _slots ? _mask + 1 : 0;
+
+	// If it already fits,
+	if (count * MAX_LOAD_DEN <= allocated * MAX_LOAD_NUM)
+		return true;
+
+	u32 needed = count * MAX_LOAD_DEN / MAX_LOAD_NUM + 1;
+	if (needed < PREALLOC) needed = PREALLOC;
+
+	return Grow(NextHighestPow2(needed - 1));
+}
+
+PeerTable::Slot *PeerTable::FindSlot(const UNetAddr &addr, u64 ip0, u64 ip1, u32 hash)
+{
+	u32 mask = _mask;
+	u32 ii = hash & mask;
+
+	for (;;)
+	{
+		Slot *slot = &_slots[ii];
+
+		if (!slot->value ||
+			(slot->hash == hash &&
+			 slot->valid == addr._valid &&
+			 slot->ip[0] == ip0 &&
+			 slot->ip[1] == ip1))
+		{
+			return slot;
+		}
+
+		ii = (ii + 1) & mask;
+	}
+}
+
+// Canonical form of the address, matching UNetAddr::operator==
+#define PEER_ADDR_WORDS(addr, ip0, ip1) \
+	u64 ip0, ip1; \
+	if ((addr)._family == AF_INET) { \
+		ip0 = (addr)._ip.v4; \
+		ip1 = 0; \
+	} else { \
+		ip0 = (addr)._ip.v6[0]; \
+		ip1 = (addr)._ip.v6[1]; \
+	}
+
+void *PeerTable::Lookup(const UNetAddr &addr)
+{
+	if (!_used || !addr.Valid()) return 0;
+
+	PEER_ADDR_WORDS(addr, ip0, ip1);
+
+	return FindSlot(addr, ip0, ip1, (u32)addr.Hash(_key))->value;
+}
+
+bool PeerTable::Insert(const UNetAddr &addr, void *value)
+{
+	if (!value || !addr.Valid()) return false;
+
+	// Grow when the new peer would pass the load limit
+	if (!Reserve(_used + 1)) return false;
+
+	PEER_ADDR_WORDS(addr, ip0, ip1);
+
+	u32 hash = (u32)addr.Hash(_key);
+	Slot *slot = FindSlot(addr, ip0, ip1, hash);
+
+	// If the address is new,
+	if (!slot->value)
+	{
+		slot->ip[0] = ip0;
+		slot->ip[1] = ip1;
+		slot->valid = addr._valid;
+		slot->hash = hash;
+		++_used;
+	}
+
+	slot->value = value;
+
+	return true;
+}
+
+void *PeerTable::Remove(const UNetAddr &addr)
+{
+	if (!_used || !addr.Valid()) return 0;
+
+	PEER_ADDR_WORDS(addr, ip0, ip1);
+
+	Slot *slot = FindSlot(addr, ip0, ip1, (u32)addr.Hash(_key));
+	void *value = slot->value;
+	if (!value) return 0;
+
+	// Shift later entries of the run back over the hole so no probe
+	// sequence is broken
+	u32 mask = _mask;
+	u32 hole = (u32)(slot - _slots);
+	u32 ii = hole;
+
+	for (;;)
+	{
+		ii = (ii + 1) & mask;
+
+		Slot *next = &_slots[ii];
+		if (!next->value) break;
+
+		// If the entry's home slot is not between the hole and itself,
+		u32 home = next->hash & mask;
+		if (((ii - home) & mask) >= ((ii - hole) & mask))
+		{
+			_slots[hole] = *next;
+			hole = ii;
+		}
+	}
+
+	_slots[hole].value = 0;
+	--_used;
+
+	return value;
+}
+
+#undef PEER_ADDR_WORDS
+
+void PeerTable::Clear()
+{
+	if (!_slots) return;
+
+	for (u32 ii = 0; ii <= _mask; ++ii)
+		_slots[ii].value = 0;
+
+	_used = 0;
+}
+
+
+//// PeerTable::Iterator
+
+PeerTable::Iterator::Iterator(PeerTable &table)
+{
+	_slot = table._slots;
+	_end = table._slots ? table._slots + table._mask + 1 : 0;
+
+	Skip();
+}
+
+void PeerTable::Iterator::Skip()
+{
+	while (_slot < _end && !_slot->value)
+		++_slot;
+}
+
+void PeerTable::Iterator::GetAddress(UNetAddr &addr)
+{
+	addr._valid = _slot->valid;
+
+	// Undo PEER_ADDR_WORDS, which keeps an IPv4 address in the low word
+	if (addr._family == AF_INET)
+	{
+		addr._ip.v4 = (u32)_slot->ip[0];
+		addr._ip.v4_padding[0] = 0;
+		addr._ip.v4_padding[1] = 0;
+		addr._ip.v4_padding[2] = 0;
+	}
+	else
+	{
+		addr._ip.v6[0] = _slot->ip[0];
+		addr._ip.v6[1] = _slot->ip[1];
+	}
+}
@@ -0,0 +1,131 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_PEER_TABLE_HPP
+#define CAT_PEER_TABLE_HPP
+
+#include "Sockets.hpp"
+
+namespace cat {
+
+
+/*
+	Open-addressing table from NetAddr to a peer pointer, for per-packet
+	peer lookup after receive.
+
+	Slots hold the address, its hash and the value together in 32 bytes, so
+	a lookup usually reads one cache line and never converts the address to
+	a string.  Probing is linear and removal shifts later entries back
+	instead of leaving tombstones, so tables with heavy peer churn do not
+	slow down over time.
+
+	Addresses are hashed with UNetAddr::Hash() under a random key chosen
+	per table from the operating system, so remote hosts cannot flood one
+	probe sequence with chosen source addresses.
+
+	Values may not be null.  Not thread-safe.
+*/
+class CAT_EXPORT PeerTable
+{
+	CAT_NO_COPY(PeerTable);
+
+	struct Slot
+	{
+		u64 ip[2];
+		u32 valid;	// Port and family, as in UNetAddr
+		u32 hash;
+		void *value;	// Null for an empty slot
+	};
+
+	static const u32 PREALLOC = 64;
+
+	// Grow when more than 3/4 of the slots are used
+	static const u32 MAX_LOAD_NUM = 3;
+	static const u32 MAX_LOAD_DEN = 4;
+
+	u64 _key[2];
+	Slot *_slots;
+	u32 _mask, _used;
+
+	bool Grow(u32 allocated);
+
+	// Returns the slot holding the address, or the empty slot it would go in
+	Slot *FindSlot(const UNetAddr &addr, u64 ip0, u64 ip1, u32 hash);
+
+public:
+	PeerTable();
+	~PeerTable();
+
+	CAT_INLINE u32 Count() { return _used; }
+
+	// Make room for count peers without growing; returns false on out of memory
+	bool Reserve(u32 count);
+
+	// Returns 0 if the address is not found
+	void *Lookup(const UNetAddr &addr);
+
+	// Adds or replaces the value for the address.
+	// Returns false on out of memory
+	bool Insert(const UNetAddr &addr, void *value);
+
+	// Returns the removed value, or 0 if the address was not found
+	void *Remove(const UNetAddr &addr);
+
+	// Remove all peers, keeping the memory
+	void Clear();
+
+	// Iterator; the table must not be modified while iterating
+	class CAT_EXPORT Iterator
+	{
+		Slot *_slot, *_end;
+
+		void Skip();
+
+	public:
+		Iterator(PeerTable &table);
+
+		CAT_INLINE operator bool() { return _slot < _end; }
+
+		CAT_INLINE void *GetValue() { return _slot->value; }
+
+		// Rebuild the address of the current peer
+		void GetAddress(UNetAddr &addr);
+
+		CAT_INLINE Iterator &operator++() // pre-increment
+		{
+			++_slot;
+			Skip();
+			return *this;
+		}
+	};
+};
+
+
+} // namespace cat
+
+#endif // CAT_PEER_TABLE_HPP
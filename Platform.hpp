@@ -743,7 +743,7 @@ template<typename T> CAT_INLINE T AbsVal(const T &x)
 #pragma intrinsic(_byteswap_ushort, _byteswap_ulong, _byteswap_uint64)
 #pragma intrinsic(_BitScanForward, _BitScanReverse, _bittestandset)
 #pragma intrinsic(__emulu)
-#pragma intrinsic(_InterlockedExchange)
+#pragma intrinsic(_InterlockedExchange, _InterlockedCompareExchange)
 #pragma intrinsic(_interlockedbittestandset)
 #pragma intrinsic(_interlockedbittestandreset)
 #pragma intrinsic(_mm_sfence, _mm_lfence, _mm_mfence)
@@ -754,6 +754,7 @@ template<typename T> CAT_INLINE T AbsVal(const T &x)
 #pragma intrinsic(__shiftleft128, __shiftright128)
 #pragma intrinsic(_BitScanForward64, _BitScanReverse64, _bittestandset64)
 #pragma intrinsic(_InterlockedCompareExchange128)
+#pragma intrinsic(_InterlockedExchangePointer, _InterlockedCompareExchangePointer)
 #else
 #pragma intrinsic(_InterlockedCompareExchange64)
 #endif
@@ -812,6 +813,26 @@ private: \
 #endif
 
 
+//// SIMD Instruction Sets ////
+
+// Defined when the compiler is allowed to emit these instructions unconditionally
+#if defined(CAT_ISA_X86)
+# if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define CAT_HAS_SSE2
+# endif
+# if defined(__SSSE3__)
+#  define CAT_HAS_SSSE3
+# endif
+# if defined(__AVX2__)
+#  define CAT_HAS_AVX2
+# endif
+#elif defined(CAT_ISA_ARM)
+# if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#  define CAT_HAS_NEON
+# endif
+#endif
+
+
 //// Vector Extensions ////
 
 #if !defined __has_extension
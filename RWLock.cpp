@@ -0,0 +1,145 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "RWLock.hpp"
+using namespace cat;
+
+// Reader slot for this thread plus one, or 0 if not assigned yet
+static CAT_TLS u32 m_reader_slot = 0;
+
+static volatile u32 m_next_reader_slot = 0;
+
+static CAT_INLINE u32 GetReaderSlot(u32 slot_count)
+{
+	u32 slot = m_reader_slot;
+
+	if (!slot)
+	{
+		slot = Atomic::Add(&m_next_reader_slot, 1) % slot_count + 1;
+		m_reader_slot = slot;
+	}
+
+	return slot - 1;
+}
+
+
+//// RWLock
+
+RWLock::RWLock()
+{
+	for (u32 ii = 0; ii < READER_SLOTS; ++ii)
+		_readers[ii].count = 0;
+
+	_write.writer = 0;
+	_write.drained = 0;
+}
+
+bool RWLock::ReadersDrained()
+{
+	for (u32 ii = 0; ii < READER_SLOTS; ++ii)
+		if (_readers[ii].count)
+			return false;
+
+	return true;
+}
+
+void RWLock::ReadLock()
+{
+	volatile u32 *count = &_readers[GetReaderSlot(READER_SLOTS)].count;
+
+	for (;;)
+	{
+		// Add is a full barrier: either this reader sees the writer flag,
+		// or the writer sees this reader's count
+		Atomic::Add(count, 1);
+
+		if (!_write.writer) return;
+
+		// Back off so the writer can drain the slots
+		ReadUnlock();
+
+		for (u32 ii = 0;; ++ii)
+		{
+			u32 writer = _write.writer;
+			if (!writer) break;
+
+			if (ii < SPIN_COUNT)
+			{
+				Futex::SpinPause();
+				continue;
+			}
+
+			// Tell the writer to wake us when it is done
+			if (writer == 1 && !Atomic::CAS(&_write.writer, 1, 2))
+				continue;
+
+			Futex::Wait(&_write.writer, 2);
+		}
+	}
+}
+
+void RWLock::ReadUnlock()
+{
+	Atomic::Add(&_readers[GetReaderSlot(READER_SLOTS)].count, -1);
+
+	// If a writer is waiting for readers to drain,
+	if (_write.writer)
+	{
+		Atomic::Add(&_write.drained, 1);
+		Futex::Wake(&_write.drained, false);
+	}
+}
+
+void RWLock::WriteLock()
+{
+	_write.lock.Enter();
+
+	// Full barrier before reading the reader slots
+	Atomic::Set(&_write.writer, 1);
+
+	for (u32 ii = 0;; ++ii)
+	{
+		// Read the drain count first: a reader leaving after this point bumps
+		// it, which makes the wait below return immediately
+		u32 drained = _write.drained;
+		Atomic::LoadMemoryBarrier();
+
+		if (ReadersDrained()) break;
+
+		if (ii < SPIN_COUNT) Futex::SpinPause();
+		else Futex::Wait(&_write.drained, drained);
+	}
+}
+
+void RWLock::WriteUnlock()
+{
+	if (Atomic::Set(&_write.writer, 0) == 2)
+		Futex::Wake(&_write.writer, true);
+
+	_write.lock.Leave();
+}
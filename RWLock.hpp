@@ -0,0 +1,155 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_RW_LOCK_HPP
+#define CAT_RW_LOCK_HPP
+
+#include "AdaptiveMutex.hpp"
+
+namespace cat {
+
+
+/*
+	Reader-writer lock for read-mostly data (a big-reader lock)
+
+	Each reading thread counts itself in one of READER_SLOTS counters that
+	sit on separate cache lines, so readers on different cores do not
+	bounce a shared line between them.  Threads are assigned slots
+	round-robin the first time they read.
+
+	A writer announces itself, then waits for every slot to drain.  New
+	readers back off while a writer is waiting, so writers are not starved,
+	but a thread must not take a read lock it already holds.
+
+	Waiting readers and writers spin briefly before parking on a futex.
+*/
+class CAT_EXPORT RWLock
+{
+	// Threads beyond this many share slots
+	static const u32 READER_SLOTS = 16;
+
+	// Pause instructions to spend spinning before parking
+	static const u32 SPIN_COUNT = 128;
+
+	struct CAT_ALIGNED(CAT_DEFAULT_CACHE_LINE_SIZE) ReaderSlot
+	{
+		volatile u32 count;
+	};
+
+	ReaderSlot _readers[READER_SLOTS];
+
+	struct CAT_ALIGNED(CAT_DEFAULT_CACHE_LINE_SIZE) WriterState
+	{
+		// 0 = no writer, 1 = writer, 2 = writer and readers may be parked
+		volatile u32 writer;
+
+		// Bumped by readers that leave while a writer is waiting
+		volatile u32 drained;
+
+		// Serializes writers
+		AdaptiveMutex lock;
+	};
+
+	WriterState _write;
+
+	bool ReadersDrained();
+
+	CAT_NO_COPY(RWLock);
+
+public:
+	RWLock();
+
+	void ReadLock();
+	void ReadUnlock();
+
+	void WriteLock();
+	void WriteUnlock();
+};
+
+
+// RAII read lock wrapper
+class AutoReadLock
+{
+	RWLock *_lock;
+
+public:
+	CAT_INLINE AutoReadLock(RWLock &lock)
+	{
+		_lock = &lock;
+		lock.ReadLock();
+	}
+
+	CAT_INLINE ~AutoReadLock()
+	{
+		Release();
+	}
+
+	CAT_INLINE bool Release()
+	{
+		if (!_lock) return false;
+
+		_lock->ReadUnlock();
+		_lock = 0;
+
+		return true;
+	}
+};
+
+
+// RAII write lock wrapper
+class AutoWriteLock
+{
+	RWLock *_lock;
+
+public:
+	CAT_INLINE AutoWriteLock(RWLock &lock)
+	{
+		_lock = &lock;
+		lock.WriteLock();
+	}
+
+	CAT_INLINE ~AutoWriteLock()
+	{
+		Release();
+	}
+
+	CAT_INLINE bool Release()
+	{
+		if (!_lock) return false;
+
+		_lock->WriteUnlock();
+		_lock = 0;
+
+		return true;
+	}
+};
+
+
+} // namespace cat
+
+#endif // CAT_RW_LOCK_HPP
@@ -0,0 +1,363 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <cat/io/RagdollCache.hpp>
+#include <cat/io/Log.hpp>
+#include <cat/hash/Murmur.hpp>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+
+#if defined(CAT_OS_WINDOWS)
+# include <cat/port/WindowsInclude.hpp>
+#endif
+
+using namespace cat;
+using namespace std;
+using namespace ragdoll;
+
+// Records are padded so that the next record header is aligned
+static CAT_INLINE u32 RecordBytes(u32 key_len, u32 value_len)
+{
+	return ((u32)sizeof(CacheRecord) + key_len + 1 + value_len + 1 + 3) & ~(u32)3;
+}
+
+
+//// ragdoll::CacheFile
+
+CacheFile::CacheFile()
+{
+	_front = 0;
+	_header = 0;
+	_slots = 0;
+}
+
+CacheFile::~CacheFile()
+{
+	Close();
+}
+
+bool CacheFile::GetSourceStamp(const char *source_path, u64 &bytes, u64 &time)
+{
+#if defined(CAT_OS_WINDOWS)
+	struct _stat64 st;
+	if (_stat64(source_path, &st) != 0)
+		return false;
+
+	time = (u64)st.st_mtime;
+#else
+	struct stat st;
+	if (stat(source_path, &st) != 0)
+		return false;
+
+# if defined(CAT_OS_LINUX)
+	// Use nanoseconds so an edit within the same second is noticed
+	time = (u64)st.st_mtim.tv_sec * 1000000000 + (u64)st.st_mtim.tv_nsec;
+# else
+	time = (u64)st.st_mtime;
+# endif
+#endif
+
+	bytes = (u64)st.st_size;
+	return true;
+}
+
+bool CacheFile::Open(const char *cache_path, const char *source_path)
+{
+	CAT_DEBUG_ENFORCE(cache_path && source_path);
+
+	Close();
+
+	u64 source_bytes, source_time;
+	if (!GetSourceStamp(source_path, source_bytes, source_time))
+		return false;
+
+	// If there is no cache image yet,
+	if (!_file.OpenRead(cache_path))
+		return false;
+
+	u64 image_bytes = _file.GetLength();
+	if (image_bytes < sizeof(CacheHeader) || image_bytes > 0xffffffff)
+	{
+		CAT_WARN("Ragdoll") << "Ignoring cache with invalid size " << cache_path;
+		Close();
+		return false;
+	}
+
+	if (!_view.Open(&_file) || !_view.MapView(0, (u32)image_bytes))
+	{
+		CAT_WARN("Ragdoll") << "Unable to map view of " << cache_path;
+		Close();
+		return false;
+	}
+
+	const u8 *front = _view.GetFront();
+	const CacheHeader *header = reinterpret_cast<const CacheHeader*>( front );
+
+	// If written by another version or for another source text,
+	if (header->magic != CACHE_MAGIC ||
+		header->version != CACHE_VERSION ||
+		header->image_bytes != image_bytes ||
+		header->source_bytes != source_bytes ||
+		header->source_time != source_time)
+	{
+		CAT_INFO("Ragdoll") << "Ignoring stale cache " << cache_path;
+		Close();
+		return false;
+	}
+
+	// If the index does not fit, or the image was torn by a concurrent writer,
+	u32 slot_count = header->slot_count;
+	if (slot_count == 0 || (slot_count & (slot_count - 1)) != 0 ||
+		slot_count > (image_bytes - sizeof(CacheHeader)) / sizeof(u32) ||
+		header->check != MurmurHash(front + sizeof(CacheHeader), (int)(image_bytes - sizeof(CacheHeader))).Get32())
+	{
+		CAT_WARN("Ragdoll") << "Ignoring corrupted cache " << cache_path;
+		Close();
+		return false;
+	}
+
+	_front = front;
+	_header = header;
+	_slots = reinterpret_cast<const u32*>( header + 1 );
+
+	return true;
+}
+
+void CacheFile::Close()
+{
+	_front = 0;
+	_header = 0;
+	_slots = 0;
+
+	_view.Close();
+	_file.Close();
+}
+
+const CacheRecord *CacheFile::FindRecord(const KeyAdapter &key)
+{
+	if (!_header) return 0;
+
+	const u32 mask = _header->slot_count - 1;
+
+	// Index is never full, so this always ends at a match or an empty slot
+	for (u32 slot = key.Hash() & mask;; slot = (slot + 1) & mask)
+	{
+		u32 offset = _slots[slot];
+		if (!offset) return 0;
+
+		const CacheRecord *record = reinterpret_cast<const CacheRecord*>( _front + offset );
+
+		if (record->hash == key.Hash() &&
+			record->key_len == key.Length() &&
+			memcmp(record->Key(), key.Key(), record->key_len) == 0)
+		{
+			return record;
+		}
+	}
+}
+
+bool CacheFile::GetRange(const StaticKey &key, const char *&value, int &len)
+{
+	const CacheRecord *record = FindRecord(key);
+	if (!record) return false;
+
+	value = record->Value();
+	len = record->value_len;
+	return true;
+}
+
+const char *CacheFile::Get(const StaticKey &key, const char *defaultValue)
+{
+	const CacheRecord *record = FindRecord(key);
+
+	return record ? record->Value() : defaultValue;
+}
+
+int CacheFile::GetInt(const StaticKey &key, int defaultValue)
+{
+	const CacheRecord *record = FindRecord(key);
+
+	return record ? ParseInt(record->Value()) : defaultValue;
+}
+
+bool CacheFile::Load(File *file)
+{
+	CAT_DEBUG_ENFORCE(file);
+
+	if (!_header) return false;
+
+	file->_table.Reserve(_header->count);
+
+	// Records follow the index in order
+	const u8 *record_data = reinterpret_cast<const u8*>( _slots + _header->slot_count );
+
+	for (u32 ii = 0, count = _header->count; ii < count; ++ii)
+	{
+		const CacheRecord *record = reinterpret_cast<const CacheRecord*>( record_data );
+		record_data += RecordBytes(record->key_len, record->value_len);
+
+		KeyAdapter key(record->Key(), record->key_len, record->hash);
+		LineItem *item = file->_table.Create(key);
+		if (!item) return false;
+
+		item->_sort_value = record->key_end_offset;
+		item->_eol_offset = record->eol_offset;
+		item->_depth = record->depth;
+
+		if (record->value_len > 0)
+			item->SetValueRangeStr(record->Value(), record->value_len);
+		else
+			item->ClearValue();
+
+		// If the key was repeated in the source text,
+		if (record->flags & RECORD_MODDED)
+		{
+			// Restore it onto the modded list as the parser left it
+			CAT_FSLL_PUSH_FRONT(file->_modded, item, _sort_next);
+			item->_enlisted = true;
+		}
+		else
+			item->_enlisted = false;
+	}
+
+	return true;
+}
+
+bool CacheFile::Write(const char *cache_path, const char *source_path, File *file)
+{
+	CAT_DEBUG_ENFORCE(cache_path && source_path && file);
+
+	u64 source_bytes, source_time;
+	if (!GetSourceStamp(source_path, source_bytes, source_time))
+		return false;
+
+	// Size the image
+	u32 count = 0;
+	u64 record_bytes = 0;
+	for (SettingsTable::Iterator ii(file->_table); ii; ++ii)
+	{
+		record_bytes += RecordBytes(ii->Length(), (u32)strlen(ii->GetValueStr()));
+		++count;
+	}
+
+	// Keep the index at most half full
+	u32 slot_count = 16;
+	while (slot_count < count * 2)
+		slot_count *= 2;
+
+	u64 image_bytes = sizeof(CacheHeader) + (u64)slot_count * sizeof(u32) + record_bytes;
+	if (image_bytes > 0xffffffff)
+	{
+		CAT_WARN("Ragdoll") << "Too many keys to cache " << source_path;
+		return false;
+	}
+
+	u8 *image = new (std::nothrow) u8[(u32)image_bytes];
+	if (!image) return false;
+
+	memset(image, 0, (u32)image_bytes);
+
+	CacheHeader *header = reinterpret_cast<CacheHeader*>( image );
+	u32 *slots = reinterpret_cast<u32*>( header + 1 );
+	u32 offset = (u32)(sizeof(CacheHeader) + slot_count * sizeof(u32));
+
+	// For each key,
+	const u32 mask = slot_count - 1;
+	for (SettingsTable::Iterator ii(file->_table); ii; ++ii)
+	{
+		const char *value = ii->GetValueStr();
+		u32 key_len = ii->Length();
+		u32 value_len = (u32)strlen(value);
+
+		// Fill in the record with its key and value
+		CacheRecord *record = reinterpret_cast<CacheRecord*>( image + offset );
+		record->hash = ii->Hash();
+		record->key_end_offset = ii->KeyEndOffset();
+		record->eol_offset = ii->EOLOffset();
+		record->key_len = (u16)key_len;
+		record->value_len = (u16)value_len;
+		record->depth = (u16)ii->Depth();
+		record->flags = ii->_enlisted ? RECORD_MODDED : 0;
+
+		char *key_data = reinterpret_cast<char*>( record + 1 );
+		memcpy(key_data, ii->Key(), key_len + 1);
+		memcpy(key_data + key_len + 1, value, value_len + 1);
+
+		// Index the record
+		u32 slot = record->hash & mask;
+		while (slots[slot])
+			slot = (slot + 1) & mask;
+		slots[slot] = offset;
+
+		offset += RecordBytes(key_len, value_len);
+	}
+
+	header->magic = CACHE_MAGIC;
+	header->version = CACHE_VERSION;
+	header->source_bytes = source_bytes;
+	header->source_time = source_time;
+	header->image_bytes = (u32)image_bytes;
+	header->count = count;
+	header->slot_count = slot_count;
+	header->check = MurmurHash(image + sizeof(CacheHeader), (int)(image_bytes - sizeof(CacheHeader))).Get32();
+
+	// Write to a temporary file first so readers never map a partial image
+	string temp_path = cache_path;
+	temp_path += ".tmp";
+
+	ofstream out(temp_path.c_str(), ios::binary);
+	if (out) out.write(reinterpret_cast<const char*>( image ), (streamsize)image_bytes);
+	out.close();
+
+	delete []image;
+
+	if (!out)
+	{
+		CAT_WARN("Ragdoll") << "Unable to write cache " << cache_path;
+		std::remove(temp_path.c_str());
+		return false;
+	}
+
+	// Move it over the final path in one step, so readers see either the
+	// old image or the new one
+#if defined(CAT_OS_WINDOWS)
+	if (!MoveFileExA(temp_path.c_str(), cache_path, MOVEFILE_REPLACE_EXISTING))
+#else
+	if (0 != std::rename(temp_path.c_str(), cache_path))
+#endif
+	{
+		CAT_WARN("Ragdoll") << "Unable to replace cache " << cache_path;
+		std::remove(temp_path.c_str());
+		return false;
+	}
+
+	return true;
+}
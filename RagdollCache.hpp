@@ -0,0 +1,141 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_RAGDOLL_CACHE_HPP
+#define CAT_RAGDOLL_CACHE_HPP
+
+#include <cat/io/RagdollFile.hpp>
+
+/*
+	Binary cache image for Ragdoll files
+
+	Parsing the same settings text in every process at startup is wasted
+	work, so a parsed ragdoll::File can be written out as a binary image
+	that is memory-mapped and used directly the next time:
+
+		CacheHeader
+		u32 slots[slot_count]	Open-addressed index of record offsets, 0 = empty
+		CacheRecord...			Each followed by its nul-terminated key and value
+
+	Keys are stored sanitized with their hash, so lookups in the image need
+	no parsing and no copies.  The header records the size and modification
+	time of the source text, and the image is ignored when either changes or
+	when it was written by a different version or byte order.
+
+	The image is written to a temporary file and renamed into place, and a
+	hash of the image catches one torn by processes writing it at once.
+*/
+
+namespace cat {
+
+namespace ragdoll {
+
+
+//// ragdoll::CacheHeader
+
+struct CacheHeader
+{
+	u32 magic;			// CACHE_MAGIC in host byte order
+	u32 version;		// CACHE_VERSION
+	u64 source_bytes;	// Size of the source text
+	u64 source_time;	// Modification time of the source text
+	u32 image_bytes;	// Size of the whole image
+	u32 check;			// Hash of the image after the header
+	u32 count;			// Number of records
+	u32 slot_count;		// Number of index slots, a power of two
+};
+
+
+//// ragdoll::CacheRecord
+
+struct CacheRecord
+{
+	u32 hash;			// Hash of the sanitized key
+	u32 key_end_offset;	// LineItem offsets into the source text
+	u32 eol_offset;
+	u16 key_len;
+	u16 value_len;
+	u16 depth;
+	u16 flags;			// RECORD_MODDED
+
+	CAT_INLINE const char *Key() const { return reinterpret_cast<const char*>( this + 1 ); }
+	CAT_INLINE const char *Value() const { return Key() + key_len + 1; }
+};
+
+
+//// ragdoll::CacheFile
+
+class CAT_EXPORT CacheFile
+{
+	static const u32 CACHE_MAGIC = 0x43476452; // "RdGC"
+	static const u32 CACHE_VERSION = 1;
+
+	// Record was a repeated key in the source text, so File keeps it on the modded list
+	static const u16 RECORD_MODDED = 1;
+
+	MappedFile _file;
+	MappedView _view;
+
+	const u8 *_front;
+	const CacheHeader *_header;
+	const u32 *_slots;
+
+	const CacheRecord *FindRecord(const KeyAdapter &key);
+
+public:
+	// Size and modification time of a source file, used to detect edits
+	static bool GetSourceStamp(const char *source_path, u64 &bytes, u64 &time);
+
+	CacheFile();
+	~CacheFile();
+
+	// Returns false if the image is missing, corrupt or older than the source text
+	bool Open(const char *cache_path, const char *source_path);
+	void Close();
+
+	CAT_INLINE bool IsValid() { return _header != 0; }
+	CAT_INLINE u32 Count() { return _header ? _header->count : 0; }
+
+	// Zero-copy accessors; values are nul-terminated in the image
+	bool GetRange(const StaticKey &key, const char *&value, int &len);
+	const char *Get(const StaticKey &key, const char *defaultValue = "");
+	int GetInt(const StaticKey &key, int defaultValue = 0);
+
+	// Fill the table of a File that has its source text mapped but not parsed
+	bool Load(File *file);
+
+	// Write an image of a File just read from the source text
+	static bool Write(const char *cache_path, const char *source_path, File *file);
+};
+
+
+} // namespace ragdoll
+
+} // namespace cat
+
+#endif // CAT_RAGDOLL_CACHE_HPP
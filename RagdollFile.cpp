@@ -27,43 +27,131 @@
 */
 
 #include <cat/io/RagdollFile.hpp>
+#include <cat/io/RagdollCache.hpp>
 #include <cat/parse/BufferTok.hpp>
 #include <cat/io/Log.hpp>
 #include <cat/hash/Murmur.hpp>
+#include <cat/math/BitMath.hpp>
+#include <cat/threads/Thread.hpp>
 #include <fstream>
 #include <cstring>
+#include <cstddef> // offsetof
 #include <cstdlib>
 using namespace cat;
 using namespace std;
 using namespace ragdoll;
 
+#if defined(CAT_HAS_AVX2)
+# include <immintrin.h>
+#elif defined(CAT_HAS_SSE2)
+# include <emmintrin.h>
+#elif defined(CAT_HAS_NEON)
+# include <arm_neon.h>
+#endif
+
 
 // Keep in synch with MAX_TAB_RECURSION_DEPTH
 static const char *TAB_STRING = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
 
 
-//// ragdoll::Parser
+//// Delimiter scanning
 
-char *Parser::FindEOL(char *data, char *eof)
+/*
+	Lines are split on CR/LF and tokens on spaces and tabs.  MatchDelimiters()
+	classifies SCAN_BYTES bytes at once, producing a mask with one bit per
+	delimiter byte, and DELIM_INDEX() converts the lowest set bit to an offset.
+	Without SIMD the scalar loop in ScanDelimiters() does all of the work.
+*/
+
+#if defined(CAT_HAS_AVX2)
+
+#define SCAN_BYTES 32
+typedef u32 DelimMask;
+#define DELIM_INDEX(mask) BSF32(mask)
+
+static CAT_INLINE DelimMask MatchDelimiters(const char *data, bool spaces)
 {
-	// While data pointer is within file,
+	__m256i chunk = _mm256_loadu_si256((const __m256i *)data);
+
+	__m256i match = _mm256_or_si256(_mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\n')),
+									 _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\r')));
+	if (spaces)
+	{
+		match = _mm256_or_si256(match, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8(' ')));
+		match = _mm256_or_si256(match, _mm256_cmpeq_epi8(chunk, _mm256_set1_epi8('\t')));
+	}
+
+	return (u32)_mm256_movemask_epi8(match);
+}
+
+#elif defined(CAT_HAS_SSE2)
+
+#define SCAN_BYTES 16
+typedef u32 DelimMask;
+#define DELIM_INDEX(mask) BSF32(mask)
+
+static CAT_INLINE DelimMask MatchDelimiters(const char *data, bool spaces)
+{
+	__m128i chunk = _mm_loadu_si128((const __m128i *)data);
+
+	__m128i match = _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\n')),
+								 _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\r')));
+	if (spaces)
+	{
+		match = _mm_or_si128(match, _mm_cmpeq_epi8(chunk, _mm_set1_epi8(' ')));
+		match = _mm_or_si128(match, _mm_cmpeq_epi8(chunk, _mm_set1_epi8('\t')));
+	}
+
+	return (u32)_mm_movemask_epi8(match);
+}
+
+#elif defined(CAT_HAS_NEON)
+
+// NEON has no movemask, so narrow each byte to a nibble and keep one bit of each
+#define SCAN_BYTES 16
+typedef u64 DelimMask;
+#define DELIM_INDEX(mask) (BSF64(mask) >> 2)
+
+static CAT_INLINE DelimMask MatchDelimiters(const char *data, bool spaces)
+{
+	uint8x16_t chunk = vld1q_u8((const u8 *)data);
+
+	uint8x16_t match = vorrq_u8(vceqq_u8(chunk, vdupq_n_u8('\n')),
+								vceqq_u8(chunk, vdupq_n_u8('\r')));
+	if (spaces)
+	{
+		match = vorrq_u8(match, vceqq_u8(chunk, vdupq_n_u8(' ')));
+		match = vorrq_u8(match, vceqq_u8(chunk, vdupq_n_u8('\t')));
+	}
+
+	uint8x8_t narrowed = vshrn_n_u16(vreinterpretq_u16_u8(match), 4);
+	return vget_lane_u64(vreinterpret_u64_u8(narrowed), 0) & 0x8888888888888888ULL;
+}
+
+#endif
+
+// Return pointer to the first CR/LF (or space/tab) at or after data, or eof if none
+static CAT_INLINE char *ScanDelimiters(char *data, char *eof, bool spaces)
+{
+#if defined(SCAN_BYTES)
+	while (eof - data >= SCAN_BYTES)
+	{
+		DelimMask mask = MatchDelimiters(data, spaces);
+		if (mask) return data + DELIM_INDEX(mask);
+
+		data += SCAN_BYTES;
+	}
+#endif
+
+	// Scalar scan for the tail, or the whole buffer without SIMD
 	while (data < eof)
 	{
-		// Grab current character and point to next character
 		char ch = *data;
 
-		if (ch == '\n')
-		{
-			if (++data >= eof) break;
-			if (*data == '\r') ++data;
+		if (ch == '\n' || ch == '\r')
 			break;
-		}
-		else if (ch == '\r')
-		{
-			if (++data >= eof) break;
-			if (*data == '\n') ++data;
+		if (spaces && (ch == ' ' || ch == '\t'))
 			break;
-		}
 
 		++data;
 	}
@@ -71,115 +159,92 @@ char *Parser::FindEOL(char *data, char *eof)
 	return data;
 }
 
-char *Parser::FindSecondTokenEnd(char *data, char *eof)
+// Step past a CR, LF, CRLF or LFCR line ending
+static CAT_INLINE char *SkipEOL(char *eol, char *eof)
 {
-	char *second = data;
-	char *eol = second;
-	int len = 0;
-	while (++eol < eof)
-	{
-		char ch = *eol;
+	char ch = *eol;
 
-		if (ch == '\r')
-		{
-			--len;
-			if (++eol >= eof) break;
-			if (*eol == '\n')
-			{
-				++eol;
-				--len;
-			}
-			break;
-		}
-		else if (ch == '\n')
-		{
-			--len;
-			if (++eol >= eof) break;
-			if (*eol == '\r')
-			{
-				++eol;
-				--len;
-			}
-			break;
-		}
+	if (++eol < eof)
+	{
+		char pair = *eol;
+		if (pair != ch && (pair == '\n' || pair == '\r')) ++eol;
 	}
 
-	_second_len = len + (int)(eol - second);
-	_eol = _second + _second_len;
-	return second;
+	return eol;
+}
+
+
+//// ragdoll::Parser
+
+char *Parser::FindEOL(char *data, char *eof)
+{
+	data = ScanDelimiters(data, eof, false);
+
+	// If line ending was found,
+	if (data < eof)
+		data = SkipEOL(data, eof);
+
+	return data;
+}
+
+char *Parser::FindSecondTokenEnd(char *data, char *eof)
+{
+	// Second token runs to the end of the line
+	char *eol = ScanDelimiters(data + 1, eof, false);
+
+	_second_len = (int)(eol - data);
+	_eol = eol;
+
+	// Continue with the next line
+	if (eol < eof)
+		eol = SkipEOL(eol, eof);
+
+	return eol;
 }
 
 bool Parser::FindSecondToken(char *&data, char *eof)
 {
 	// Find the start of whitespace after first token
 	char *first = data;
-	char *second = first;
-	int len = 0;
+	char *second = ScanDelimiters(first + 1, eof, true);
+
+	_first_len = (int)(second - first);
+
+	// If no delimiter found,
+	if (second >= eof)
+	{
+		data = second;
+		return false;
+	}
+
+	// If first token ends the line,
+	char ch = *second;
+	if (ch == '\r' || ch == '\n')
+	{
+		_eol = second;
+		data = SkipEOL(second, eof);
+		return false;
+	}
+
+	// Otherwise a space or tab follows, so hunt for the beginning of the second token
 	while (++second < eof)
 	{
-		char ch = *second;
+		ch = *second;
 
-		if (ch == '\r')
-		{
-			_eol = second;
-			--len;
-			if (++second >= eof) break;
-			if (*second == '\n')
-			{
-				++second;
-				--len;
-			}
-			break;
-		}
-		else if (ch == '\n')
+		if (ch == '\r' || ch == '\n')
 		{
 			_eol = second;
-			--len;
-			if (++second >= eof) break;
-			if (*second == '\r')
-			{
-				++second;
-				--len;
-			}
+			second = SkipEOL(second, eof);
 			break;
 		}
-		else if (ch == ' ' || ch == '\t')
+		else if (ch != ' ' && ch != '\t')
 		{
-			_first_len = (int)(second - first);
-
-			// Now hunt for the beginning of the second token
-			while (++second < eof)
-			{
-				char ch = *second;
-
-				if (ch == '\r')
-				{
-					_eol = second;
-					if (++second >= eof) break;
-					if (*second == '\n') ++second;
-					break;
-				}
-				else if (ch == '\n')
-				{
-					_eol = second;
-					if (++second >= eof) break;
-					if (*second == '\r') ++second;
-					break;
-				}
-				else if (ch != ' ' && ch != '\t')
-				{
-					data = second;
-					_second = second;
-					return true;
-				}
-			}
-
 			data = second;
-			return false;
+			_second = second;
+			return true;
 		}
 	}
 
-	_first_len = len + (int)(second - first);
 	data = second;
 	return false;
 }
@@ -257,6 +322,88 @@ bool Parser::NextLine()
 	return FindFirstToken(_file_data, _eof);
 }
 
+void Parser::AddItem(int key_len)
+{
+	// Add this path to the hash table
+	SanitizedKey san_key(_root_key, key_len);
+	KeyAdapter key_input(san_key);
+	LineItem *item = _output_file->_table.Lookup(key_input);
+	if (!item)
+	{
+		// Create a new item for this key
+		item = _output_file->_table.Create(key_input);
+		item->_runtime = false;
+
+		if (!_is_override)
+			item->_enlisted = false;
+		else
+		{
+			// Push onto the new list
+			CAT_FSLL_PUSH_FRONT(_output_file->_newest, item, _sort_next);
+			item->_enlisted = true;
+
+			item->_case_key.SetFromRangeString(_root_key, key_len);
+		}
+	}
+	else
+	{
+		if (!item->_enlisted)
+		{
+			// Push onto the modded list
+			CAT_FSLL_PUSH_FRONT(_output_file->_modded, item, _sort_next);
+			item->_enlisted = true;
+		}
+	}
+
+	// Update item value
+	if (item)
+	{
+		if (!_is_override)
+		{
+			// Calculate key end offset and end of line offset
+			u32 key_end_offset = (u32)(_first + _first_len - _file_front);
+			u32 eol_offset;
+
+			if (!_eol)
+				eol_offset = (u32)(_eof - _file_front);
+			else
+				eol_offset = (u32)(_eol - _file_front);
+
+			item->_sort_value = key_end_offset;
+			item->_eol_offset = eol_offset;
+		}
+
+		item->_depth = _depth;
+
+		// If second token is set,
+		if (_second_len > 0)
+			item->SetValueRangeStr(_second, _second_len);
+		else
+			item->ClearValue();
+	}
+}
+
+void Parser::AddLazyItem(int key_len)
+{
+	SanitizedKey san_key(_root_key, key_len);
+	KeyAdapter key_input(san_key);
+	FlatHashEntry *entry = _lazy_file->_table.Create(key_input);
+	if (!entry)
+	{
+		CAT_WARN("Parser") << "Out of memory adding key " << _root_key;
+		return;
+	}
+
+	// Reference the second token in place, which overrides any earlier value
+	_lazy_file->_table.SetValueReference(entry, _second_len > 0 ? _second : "", _second_len);
+}
+
+void Parser::AddLayerItem(int key_len)
+{
+	if (!_layer->Add(_root_key, key_len, _second_len > 0 ? _second : "", _second_len, _depth))
+		CAT_WARN("Parser") << "Out of memory adding key " << _root_key;
+}
+
 int Parser::ReadTokens(int root_key_len, int root_depth)
 {
 	int eof = 0;
@@ -286,196 +433,534 @@ int Parser::ReadTokens(int root_key_len, int root_depth)
 		write_key[_first_len] = '\0';
 
 		// Add this path to the hash table
-		SanitizedKey san_key(_root_key, key_len);
-		KeyAdapter key_input(san_key);
-		LineItem *item = _output_file->_table.Lookup(key_input);
+		if (_lazy_file)
+			AddLazyItem(key_len);
+		else if (_layer)
+			AddLayerItem(key_len);
+		else
+			AddItem(key_len);
+
+		// For each line until EOF,
+		eof = 0;
+		int depth = _depth;
+		while (NextLine())
+		{
+			// Skip blank lines
+			if (_first_len == 0) continue;
+
+			// If new line depth is at or beneath the root,
+			if (root_depth >= _depth)
+				eof = 1; // Pass it back to the root to handle
+			// If new line is a child of current depth,
+			else if (depth < _depth)
+			{
+				// Otherwise the new line depth is deeper, so recurse and add onto the key
+				eof = ReadTokens(key_len, depth);
+
+				// If not EOF,
+				if (eof != 0)
+				{
+					// If new line depth is at the same level as current token,
+					if (root_depth < _depth)
+						eof = 2; // Repeat whole routine again at this depth
+					else
+						eof = 1; // Pass it back to the root to handle
+				}
+			}
+			else // New line depth is at about the same level as current
+				eof = 2; // Repeat whole routine again at this depth
+
+			break;
+		}
+
+		// Remove appended token
+		_root_key[root_key_len] = '\0';
+	} while (eof == 2);
+
+	return eof;
+}
+
+bool Parser::Map(const char *file_path, MappedFile *file, MappedView *view, u64 max_size)
+{
+	// Open the file
+	if (!file->OpenRead(file_path, true))
+	{
+		CAT_INFO("Parser") << "Unable to open " << file_path;
+		return false;
+	}
+
+	// Ensure file is not too large
+	u64 file_length = file->GetLength();
+	if (file_length > max_size)
+	{
+		CAT_WARN("Parser") << "Size too large for " << file_path;
+		return false;
+	}
+
+	// Ensure file is not empty
+	u32 nominal_length = (u32)file_length;
+	if (nominal_length <= 0)
+	{
+		CAT_INFO("Parser") << "Ignoring empty file " << file_path;
+		return false;
+	}
+
+	// Open a view of the file
+	if (!view->Open(file))
+	{
+		CAT_WARN("Parser") << "Unable to open view of " << file_path;
+		return false;
+	}
+
+	// Map a view of the entire file
+	if (!view->MapView(0, nominal_length))
+	{
+		CAT_WARN("Parser") << "Unable to map view of " << file_path;
+		return false;
+	}
+
+	return true;
+}
+
+bool Parser::Parse(const char *file_path, MappedFile *file, MappedView *view, u64 max_size)
+{
+	if (!Map(file_path, file, view, max_size))
+		return false;
+
+	// Initialize parser
+	_file_front = _file_data = (char*)view->GetFront();
+	_eof = _file_data + view->GetLength();
+	_root_key[0] = '\0';
+
+	// Kick off the parsing
+	if (!NextLine())
+		return false;
+
+	// Bump tokens back to the next level while not EOF
+	while (1 == ReadTokens(0, 0));
+
+	return true;
+}
+
+bool Parser::Read(const char *file_path, File *output_file, bool is_override)
+{
+	CAT_DEBUG_ENFORCE(file_path && output_file);
+
+	_output_file = output_file;
+	_lazy_file = 0;
+	_layer = 0;
+	_is_override = is_override;
+
+	MappedFile local_file, *file;
+	MappedView local_view, *view;
+
+	// If using local mapped file,
+	if (is_override)
+	{
+		file = &local_file;
+		view = &local_view;
+	}
+	else
+	{
+		file = &_output_file->_file;
+		view = &_output_file->_view;
+	}
+
+	return Parse(file_path, file, view, MAX_FILE_SIZE);
+}
+
+bool Parser::Read(const char *file_path, LazyFile *output_file)
+{
+	CAT_DEBUG_ENFORCE(file_path && output_file);
+
+	_output_file = 0;
+	_lazy_file = output_file;
+	_layer = 0;
+	_is_override = false;
+
+	// Limited by the 32-bit length of a single view
+	return Parse(file_path, &output_file->_file, &output_file->_view, 0xffffffff);
+}
+
+bool Parser::Read(const char *file_path, Layer *output_layer)
+{
+	CAT_DEBUG_ENFORCE(file_path && output_layer);
+
+	_output_file = 0;
+	_lazy_file = 0;
+	_layer = output_layer;
+	_is_override = true;
+
+	// Values are copied into the layer, so the view is only needed while parsing
+	MappedFile file;
+	MappedView view;
+
+	return Parse(file_path, &file, &view, MAX_FILE_SIZE);
+}
+
+
+//// ragdoll::Layer
+
+// Parses one override file on a worker thread
+class LayerReader : public Thread
+{
+	Layer *_layer;
+	const char *_file_path;
+	bool _started;
+
+	bool Entrypoint(void *)
+	{
+		_layer->Read(_file_path);
+		return true;
+	}
+
+public:
+	void Start(Layer *layer, const char *file_path)
+	{
+		_layer = layer;
+		_file_path = file_path;
+		_started = StartThread();
+
+		// If no thread could be started, parse it now instead
+		if (!_started)
+			layer->Read(file_path);
+	}
+
+	void Finish()
+	{
+		if (_started)
+			WaitForThread();
+	}
+};
+
+Layer::Layer()
+{
+	_head = _tail = 0;
+	_count = 0;
+
+	_arena.Initialize();
+}
+
+void Layer::Clear()
+{
+	_head = _tail = 0;
+	_count = 0;
+
+	_arena.Reset();
+}
+
+bool Layer::Read(const char *file_path)
+{
+	CAT_DEBUG_ENFORCE(file_path);
+
+	Clear();
+
+	return Parser().Read(file_path, this);
+}
+
+bool Layer::Add(const char *case_key, int key_len, const char *value, int value_len, int depth)
+{
+	if (value_len < 0) value_len = 0;
+	if (value_len > MAX_CHARS) value_len = MAX_CHARS;
+
+	SanitizedKey san_key(case_key, key_len);
+	key_len = san_key.Length();
+
+	// Pack the item with its keys and value in the arena
+	Item *item = reinterpret_cast<Item*>( _arena.Acquire((u32)(offsetof(Item, data) + (key_len + 1) * 2 + value_len + 1)) );
+	if (!item) return false;
+
+	item->next = 0;
+	item->hash = san_key.Hash();
+	item->key_len = (u16)key_len;
+	item->value_len = (u16)value_len;
+	item->depth = depth;
+
+	char *data = item->data;
+	memcpy(data, san_key.Key(), key_len);
+	data[key_len] = '\0';
+	data += key_len + 1;
+	memcpy(data, case_key, key_len);
+	data[key_len] = '\0';
+	data += key_len + 1;
+	memcpy(data, value, value_len);
+	data[value_len] = '\0';
+
+	// Keep lines in file order so that later lines win when merged
+	if (_tail) _tail->next = item;
+	else _head = item;
+	_tail = item;
+
+	++_count;
+
+	return true;
+}
+
+void Layer::ReadAll(Layer *layers, const char *const *file_paths, int count)
+{
+	if (count <= 0) return;
+
+	LayerReader *readers = 0;
+	if (count > 1)
+		readers = new (std::nothrow) LayerReader[count - 1];
+
+	// Start parsing all but the first file in the background
+	if (readers)
+	{
+		for (int ii = 1; ii < count; ++ii)
+			readers[ii - 1].Start(&layers[ii], file_paths[ii]);
+	}
+
+	layers[0].Read(file_paths[0]);
+
+	// If no readers could be allocated, parse the rest here
+	if (!readers)
+	{
+		for (int ii = 1; ii < count; ++ii)
+			layers[ii].Read(file_paths[ii]);
+	}
+	else
+	{
+		for (int ii = 1; ii < count; ++ii)
+			readers[ii - 1].Finish();
+
+		delete []readers;
+	}
+}
+
+
+//// ragdoll::File
+
+File::File()
+{
+	_modded = 0;
+	_newest = 0;
+
+	CAT_DEBUG_ENFORCE(strlen(TAB_STRING) > Parser::MAX_TAB_RECURSION_DEPTH) << "Need to add more tabs to TAB_STRING";
+}
+
+File::~File()
+{
+}
+
+bool File::Read(const char *file_path)
+{
+	CAT_DEBUG_ENFORCE(file_path);
+
+	if (!Parser().Read(file_path, this))
+		return false;
+
+	_file_path = file_path;
+	return true;
+}
+
+bool File::Read(const char *file_path, const char *cache_path)
+{
+	CAT_DEBUG_ENFORCE(file_path && cache_path);
+
+	// If the cache image is current, map the text for Write() and load the keys from the image
+	CacheFile cache;
+	if (cache.Open(cache_path, file_path) &&
+		Parser::Map(file_path, &_file, &_view, Parser::MAX_FILE_SIZE))
+	{
+		_file_path = file_path;
+		return cache.Load(this);
+	}
+
+	if (!Read(file_path))
+		return false;
+
+	// Write a cache image for the next run, which is allowed to fail
+	CacheFile::Write(cache_path, file_path, this);
+
+	return true;
+}
+
+// Returns true if the item already holds the given value
+static bool SameValue(LineItem *item, const char *value, int len)
+{
+	// Values are truncated the same way when they are stored
+	if (len > MAX_HASH_KEY_CHARS)
+		len = MAX_HASH_KEY_CHARS;
+
+	const char *old_value = item->GetValueStr();
+
+	return memcmp(old_value, value, len) == 0 && old_value[len] == '\0';
+}
+
+bool File::Merge(Layer &layer, int *changes)
+{
+	int changed = 0;
+
+	// For each line of the override file in order,
+	for (Layer::Item *ii = layer._head; ii; ii = ii->next)
+	{
+		// Same as parsing the line as an override
+		KeyAdapter key_input(ii->Key(), ii->key_len, ii->hash);
+		LineItem *item = _table.Lookup(key_input);
 		if (!item)
 		{
 			// Create a new item for this key
-			item = _output_file->_table.Create(key_input);
+			item = _table.Create(key_input);
+			if (!item) return false;
 
-			if (!_is_override)
-				item->_enlisted = false;
-			else
-			{
-				// Push onto the new list
-				CAT_FSLL_PUSH_FRONT(_output_file->_newest, item, _sort_next);
-				item->_enlisted = true;
+			// Push onto the new list
+			CAT_FSLL_PUSH_FRONT(_newest, item, _sort_next);
+			item->_enlisted = true;
+			item->_runtime = false;
 
-				item->_case_key.SetFromRangeString(_root_key, key_len);
-			}
+			item->_case_key.SetFromRangeString(ii->CaseKey(), ii->key_len);
 		}
 		else
 		{
+			// If the override does not change anything, leave the item alone
+			if (item->_depth == ii->depth && SameValue(item, ii->Value(), ii->value_len))
+				continue;
+
 			if (!item->_enlisted)
 			{
 				// Push onto the modded list
-				CAT_FSLL_PUSH_FRONT(_output_file->_modded, item, _sort_next);
+				CAT_FSLL_PUSH_FRONT(_modded, item, _sort_next);
 				item->_enlisted = true;
 			}
 		}
 
-		// Update item value
-		if (item)
-		{
-			if (!_is_override)
-			{
-				// Calculate key end offset and end of line offset
-				u32 key_end_offset = (u32)(_first + _first_len - _file_front);
-				u32 eol_offset;
-
-				if (!_eol)
-					eol_offset = (u32)(_eof - _file_front);
-				else
-					eol_offset = (u32)(_eol - _file_front);
-
-				item->_sort_value = key_end_offset;
-				item->_eol_offset = eol_offset;
-			}
-
-			item->_depth = _depth;
-
-			// If second token is set,
-			if (_second_len > 0)
-				item->SetValueRangeStr(_second, _second_len);
-			else
-				item->ClearValue();
-		}
-
-		// For each line until EOF,
-		eof = 0;
-		int depth = _depth;
-		while (NextLine())
-		{
-			// Skip blank lines
-			if (_first_len == 0) continue;
-
-			// If new line depth is at or beneath the root,
-			if (root_depth >= _depth)
-				eof = 1; // Pass it back to the root to handle
-			// If new line is a child of current depth,
-			else if (depth < _depth)
-			{
-				// Otherwise the new line depth is deeper, so recurse and add onto the key
-				eof = ReadTokens(key_len, depth);
+		item->_depth = ii->depth;
 
-				// If not EOF,
-				if (eof != 0)
-				{
-					// If new line depth is at the same level as current token,
-					if (root_depth < _depth)
-						eof = 2; // Repeat whole routine again at this depth
-					else
-						eof = 1; // Pass it back to the root to handle
-				}
-			}
-			else // New line depth is at about the same level as current
-				eof = 2; // Repeat whole routine again at this depth
+		// If value is set,
+		if (ii->value_len > 0)
+			item->SetValueRangeStr(ii->Value(), ii->value_len);
+		else
+			item->ClearValue();
 
-			break;
-		}
+		++changed;
+	}
 
-		// Remove appended token
-		_root_key[root_key_len] = '\0';
-	} while (eof == 2);
+	if (changes) *changes += changed;
 
-	return eof;
+	return true;
 }
 
-bool Parser::Read(const char *file_path, File *output_file, bool is_override)
+bool File::ReadLayers(const char *const *file_paths, int count, const char *cache_path)
 {
-	CAT_DEBUG_ENFORCE(file_path && output_file);
+	CAT_DEBUG_ENFORCE(file_paths && count > 0);
 
-	_output_file = output_file;
-	_is_override = is_override;
+	if (count <= 0) return false;
 
-	MappedFile local_file, *file;
-	MappedView local_view, *view;
+	Layer *layers = 0;
+	LayerReader *readers = 0;
 
-	// If using local mapped file,
-	if (is_override)
-	{
-		file = &local_file;
-		view = &local_view;
-	}
-	else
+	int layer_count = count - 1;
+	if (layer_count > 0)
 	{
-		file = &_output_file->_file;
-		view = &_output_file->_view;
+		layers = new (std::nothrow) Layer[layer_count];
+		readers = new (std::nothrow) LayerReader[layer_count];
 	}
 
-	// Open the file
-	if (!file->Open(file_path))
+	// If the override files can be parsed in the background,
+	if (layers && readers)
 	{
-		CAT_INFO("Parser") << "Unable to open " << file_path;
-		return false;
+		for (int ii = 0; ii < layer_count; ++ii)
+			readers[ii].Start(&layers[ii], file_paths[ii + 1]);
 	}
 
-	// Ensure file is not too large
-	u64 file_length = file->GetLength();
-	if (file_length > MAX_FILE_SIZE)
-	{
-		CAT_WARN("Parser") << "Size too large for " << file_path;
-		return false;
-	}
+	// Read the first file on this thread meanwhile
+	bool success = cache_path ? Read(file_paths[0], cache_path) : Read(file_paths[0]);
 
-	// Ensure file is not empty
-	u32 nominal_length = (u32)file_length;
-	if (nominal_length <= 0)
+	if (layers && readers)
 	{
-		CAT_INFO("Parser") << "Ignoring empty file " << file_path;
-		return false;
+		// Apply overrides in order
+		for (int ii = 0; ii < layer_count; ++ii)
+		{
+			readers[ii].Finish();
+			Merge(layers[ii]);
+		}
 	}
-
-	// Open a view of the file
-	if (!view->Open(file))
+	else
 	{
-		CAT_WARN("Parser") << "Unable to open view of " << file_path;
-		return false;
+		// Fall back to reading them one at a time
+		for (int ii = 0; ii < layer_count; ++ii)
+			Override(file_paths[ii + 1]);
 	}
 
-	// Map a view of the entire file
-	if (!view->MapView(0, nominal_length))
+	delete []readers;
+	delete []layers;
+
+	return success;
+}
+
+int File::Adopt(File &old_file, const KeyChanged &changed)
+{
+	int changes = 0;
+
+	// For each key created at runtime in the old copy,
+	for (LineItem *ii = old_file._newest; ii; ii->_sort_next->Unwrap(ii))
 	{
-		CAT_WARN("Parser") << "Unable to map view of " << file_path;
-		return false;
-	}
+		// Keys that came from an override file are only kept if it still has them
+		if (!ii->_runtime) continue;
 
-	// Initialize parser
-	_file_front = _file_data = (char*)view->GetFront();
-	_eof = _file_data + nominal_length;
-	_root_key[0] = '\0';
+		KeyAdapter key(ii->Key(), ii->Length(), ii->Hash());
 
-	// Kick off the parsing
-	if (!NextLine())
-		return false;
+		// If the files now name it, their value wins
+		if (_table.Lookup(key)) continue;
 
-	// Bump tokens back to the next level while not EOF
-	while (1 == ReadTokens(0, 0));
+		// Create a new item for this key
+		LineItem *item = _table.Create(key);
+		if (!item) return -1;
 
-	return true;
-}
+		// Push onto the new list
+		CAT_FSLL_PUSH_FRONT(_newest, item, _sort_next);
+		item->_enlisted = true;
+		item->_runtime = true;
 
+		item->_case_key.SetFromRangeString(ii->CaseKey(), ii->Length());
+		item->_depth = ii->_depth;
+		item->SetValueStr(ii->GetValueStr());
+	}
 
-//// ragdoll::File
+	// For each key in this copy,
+	for (SettingsTable::Iterator ii(_table); ii; ++ii)
+	{
+		LineItem *old_item = old_file._table.Lookup(KeyAdapter(ii->Key(), ii->Length(), ii->Hash()));
 
-File::File()
-{
-	_modded = 0;
-	_newest = 0;
+		// If it is new or its value differs,
+		if (!old_item || strcmp(old_item->GetValueStr(), ii->GetValueStr()) != 0)
+		{
+			changed(ii->Hash());
+			++changes;
+		}
+	}
 
-	CAT_DEBUG_ENFORCE(strlen(TAB_STRING) > Parser::MAX_TAB_RECURSION_DEPTH) << "Need to add more tabs to TAB_STRING";
+	// For each key in the old copy,
+	for (SettingsTable::Iterator ii(old_file._table); ii; ++ii)
+	{
+		// If it was removed from the files,
+		if (!_table.Lookup(KeyAdapter(ii->Key(), ii->Length(), ii->Hash())))
+		{
+			changed(ii->Hash());
+			++changes;
+		}
+	}
+
+	return changes;
 }
 
-File::~File()
+bool File::Find(const StaticKey &key, std::string &out_value)
 {
+	LineItem *item = _table.Lookup(KeyAdapter(key));
+	if (!item) return false;
+
+	out_value = item->GetValueStr();
+	return true;
 }
 
-bool File::Read(const char *file_path)
+bool File::FindInt(const StaticKey &key, int &out_value)
 {
-	CAT_DEBUG_ENFORCE(file_path);
+	LineItem *item = _table.Lookup(KeyAdapter(key));
+	if (!item) return false;
 
-	return Parser().Read(file_path, this);
+	out_value = item->GetValueInt();
+	return true;
 }
 
 bool File::Override(const char *file_path)
@@ -485,13 +970,12 @@ bool File::Override(const char *file_path)
 	return Parser().Read(file_path, this, true);
 }
 
-void File::Set(const char *key, const char *value)
+void File::Set(const StaticKey &key, const char *value)
 {
-	CAT_DEBUG_ENFORCE(key && value);
+	CAT_DEBUG_ENFORCE(key.Name() && value);
 
 	// Add this path to the hash table
-	SanitizedKey san_key(key);
-	KeyAdapter key_input(san_key);
+	KeyAdapter key_input(key);
 	LineItem *item = _table.Lookup(key_input);
 	if (!item)
 	{
@@ -506,8 +990,9 @@ void File::Set(const char *key, const char *value)
 			// Push onto the new list
 			CAT_FSLL_PUSH_FRONT(_newest, item, _sort_next);
 			item->_enlisted = true;
+			item->_runtime = true;
 
-			SanitizeKeyStringCase(key, item->CaseKey());
+			SanitizeKeyStringCase(key.Name(), item->CaseKey());
 
 			item->SetValueStr(value);
 		}
@@ -525,13 +1010,12 @@ void File::Set(const char *key, const char *value)
 	}
 }
 
-const char *File::Get(const char *key, const char *defaultValue)
+const char *File::Get(const StaticKey &key, const char *defaultValue)
 {
-	CAT_DEBUG_ENFORCE(key && defaultValue);
+	CAT_DEBUG_ENFORCE(key.Name() && defaultValue);
 
 	// Add this path to the hash table
-	SanitizedKey san_key(key);
-	KeyAdapter key_input(san_key);
+	KeyAdapter key_input(key);
 	LineItem *item = _table.Lookup(key_input);
 	if (item) return item->GetValueStr();
 
@@ -547,8 +1031,9 @@ const char *File::Get(const char *key, const char *defaultValue)
 			// Push onto the new list
 			CAT_FSLL_PUSH_FRONT(_newest, item, _sort_next);
 			item->_enlisted = true;
+			item->_runtime = true;
 
-			SanitizeKeyStringCase(key, item->CaseKey());
+			SanitizeKeyStringCase(key.Name(), item->CaseKey());
 
 			item->SetValueStr(defaultValue);
 		}
@@ -557,13 +1042,12 @@ const char *File::Get(const char *key, const char *defaultValue)
 	return defaultValue;
 }
 
-void File::SetInt(const char *key, int value)
+void File::SetInt(const StaticKey &key, int value)
 {
-	CAT_DEBUG_ENFORCE(key);
+	CAT_DEBUG_ENFORCE(key.Name());
 
 	// Add this path to the hash table
-	SanitizedKey san_key(key);
-	KeyAdapter key_input(san_key);
+	KeyAdapter key_input(key);
 	LineItem *item = _table.Lookup(key_input);
 	if (!item)
 	{
@@ -578,8 +1062,9 @@ void File::SetInt(const char *key, int value)
 			// Push onto the new list
 			CAT_FSLL_PUSH_FRONT(_newest, item, _sort_next);
 			item->_enlisted = true;
+			item->_runtime = true;
 
-			SanitizeKeyStringCase(key, item->CaseKey());
+			SanitizeKeyStringCase(key.Name(), item->CaseKey());
 
 			item->SetValueInt(value);
 		}
@@ -597,13 +1082,12 @@ void File::SetInt(const char *key, int value)
 	}
 }
 
-int File::GetInt(const char *key, int defaultValue)
+int File::GetInt(const StaticKey &key, int defaultValue)
 {
-	CAT_DEBUG_ENFORCE(key);
+	CAT_DEBUG_ENFORCE(key.Name());
 
 	// Add this path to the hash table
-	SanitizedKey san_key(key);
-	KeyAdapter key_input(san_key);
+	KeyAdapter key_input(key);
 	LineItem *item = _table.Lookup(key_input);
 	if (item) return item->GetValueInt();
 
@@ -619,8 +1103,9 @@ int File::GetInt(const char *key, int defaultValue)
 			// Push onto the new list
 			CAT_FSLL_PUSH_FRONT(_newest, item, _sort_next);
 			item->_enlisted = true;
+			item->_runtime = true;
 
-			SanitizeKeyStringCase(key, item->CaseKey());
+			SanitizeKeyStringCase(key.Name(), item->CaseKey());
 
 			item->SetValueInt(defaultValue);
 		}
@@ -629,15 +1114,14 @@ int File::GetInt(const char *key, int defaultValue)
 	return defaultValue;
 }
 
-void File::Set(const char *key, const char *value, RWLock *lock)
+void File::Set(const StaticKey &key, const char *value, RWLock *lock)
 {
-	CAT_DEBUG_ENFORCE(key && lock && value);
+	CAT_DEBUG_ENFORCE(key.Name() && lock && value);
 
 	lock->WriteLock();
 
 	// Add this path to the hash table
-	SanitizedKey san_key(key);
-	KeyAdapter key_input(san_key);
+	KeyAdapter key_input(key);
 	LineItem *item = _table.Lookup(key_input);
 	if (!item)
 	{
@@ -652,8 +1136,9 @@ void File::Set(const char *key, const char *value, RWLock *lock)
 				// Push onto the new list
 				CAT_FSLL_PUSH_FRONT(_newest, item, _sort_next);
 				item->_enlisted = true;
+				item->_runtime = true;
 
-				SanitizeKeyStringCase(key, item->CaseKey());
+				SanitizeKeyStringCase(key.Name(), item->CaseKey());
 
 				item->SetValueStr(value);
 			}
@@ -674,15 +1159,14 @@ void File::Set(const char *key, const char *value, RWLock *lock)
 	lock->WriteUnlock();
 }
 
-void File::Get(const char *key, const char *defaultValue, std::string &out_value, RWLock *lock)
+void File::Get(const StaticKey &key, const char *defaultValue, std::string &out_value, RWLock *lock)
 {
-	CAT_DEBUG_ENFORCE(key && lock && defaultValue);
+	CAT_DEBUG_ENFORCE(key.Name() && lock && defaultValue);
 
 	lock->ReadLock();
 
 	// Add this path to the hash table
-	SanitizedKey san_key(key);
-	KeyAdapter key_input(san_key);
+	KeyAdapter key_input(key);
 	LineItem *item = _table.Lookup(key_input);
 	if (item)
 	{
@@ -707,8 +1191,9 @@ void File::Get(const char *key, const char *defaultValue, std::string &out_value
 			// Push onto the new list
 			CAT_FSLL_PUSH_FRONT(_newest, item, _sort_next);
 			item->_enlisted = true;
+			item->_runtime = true;
 
-			SanitizeKeyStringCase(key, item->CaseKey());
+			SanitizeKeyStringCase(key.Name(), item->CaseKey());
 
 			item->SetValueStr(defaultValue);
 		}
@@ -719,15 +1204,14 @@ void File::Get(const char *key, const char *defaultValue, std::string &out_value
 	out_value = defaultValue;
 }
 
-void File::SetInt(const char *key, int value, RWLock *lock)
+void File::SetInt(const StaticKey &key, int value, RWLock *lock)
 {
-	CAT_DEBUG_ENFORCE(key && lock);
+	CAT_DEBUG_ENFORCE(key.Name() && lock);
 
 	lock->WriteLock();
 
 	// Add this path to the hash table
-	SanitizedKey san_key(key);
-	KeyAdapter key_input(san_key);
+	KeyAdapter key_input(key);
 	LineItem *item = _table.Lookup(key_input);
 	if (!item)
 	{
@@ -742,8 +1226,9 @@ void File::SetInt(const char *key, int value, RWLock *lock)
 				// Push onto the new list
 				CAT_FSLL_PUSH_FRONT(_newest, item, _sort_next);
 				item->_enlisted = true;
+				item->_runtime = true;
 
-				SanitizeKeyStringCase(key, item->CaseKey());
+				SanitizeKeyStringCase(key.Name(), item->CaseKey());
 
 				item->SetValueInt(value);
 			}
@@ -764,15 +1249,14 @@ void File::SetInt(const char *key, int value, RWLock *lock)
 	lock->WriteUnlock();
 }
 
-int File::GetInt(const char *key, int defaultValue, RWLock *lock)
+int File::GetInt(const StaticKey &key, int defaultValue, RWLock *lock)
 {
-	CAT_DEBUG_ENFORCE(key && lock);
+	CAT_DEBUG_ENFORCE(key.Name() && lock);
 
 	lock->ReadLock();
 
 	// Add this path to the hash table
-	SanitizedKey san_key(key);
-	KeyAdapter key_input(san_key);
+	KeyAdapter key_input(key);
 	LineItem *item = _table.Lookup(key_input);
 	if (item)
 	{
@@ -797,8 +1281,9 @@ int File::GetInt(const char *key, int defaultValue, RWLock *lock)
 			// Push onto the new list
 			CAT_FSLL_PUSH_FRONT(_newest, item, _sort_next);
 			item->_enlisted = true;
+			item->_runtime = true;
 
-			SanitizeKeyStringCase(key, item->CaseKey());
+			SanitizeKeyStringCase(key.Name(), item->CaseKey());
 
 			item->SetValueInt(defaultValue);
 		}
@@ -809,6 +1294,48 @@ int File::GetInt(const char *key, int defaultValue, RWLock *lock)
 	return defaultValue;
 }
 
+// Accessors that sanitize the key on each call
+
+void File::Set(const char *key, const char *value)
+{
+	Set(StaticKey(key), value);
+}
+
+const char *File::Get(const char *key, const char *defaultValue)
+{
+	return Get(StaticKey(key), defaultValue);
+}
+
+void File::SetInt(const char *key, int value)
+{
+	SetInt(StaticKey(key), value);
+}
+
+int File::GetInt(const char *key, int defaultValue)
+{
+	return GetInt(StaticKey(key), defaultValue);
+}
+
+void File::Set(const char *key, const char *value, RWLock *lock)
+{
+	Set(StaticKey(key), value, lock);
+}
+
+void File::Get(const char *key, const char *defaultValue, std::string &out_value, RWLock *lock)
+{
+	Get(StaticKey(key), defaultValue, out_value, lock);
+}
+
+void File::SetInt(const char *key, int value, RWLock *lock)
+{
+	SetInt(StaticKey(key), value, lock);
+}
+
+int File::GetInt(const char *key, int defaultValue, RWLock *lock)
+{
+	return GetInt(StaticKey(key), defaultValue, lock);
+}
+
 u32 File::WriteNewKey(const char *case_key, const char *key, int key_len, LineItem *front, LineItem *end)
 {
 	// Strip off dotted parts until we find it in the hash table
@@ -864,6 +1391,7 @@ u32 File::WriteNewKey(const char *case_key, const char *key, int key_len, LineIt
 
 			// Go ahead and fill in the item
 			item->_enlisted = true;
+			item->_runtime = false;
 			item->_sort_value = offset;
 			item->_eol_offset = 0; // Indicate it is a new item that needs new item processing
 			item->_sort_next = front;
@@ -889,7 +1417,7 @@ u32 File::WriteNewKey(const char *case_key, const char *key, int key_len, LineIt
 	return 0;
 }
 
-static void WriteFinalKeyPart(LineItem *item, ofstream &file)
+static void WriteFinalKeyPart(LineItem *item, ostream &file)
 {
 	// Cache key
 	const char *key = item->CaseKey();
@@ -905,7 +1433,7 @@ static void WriteFinalKeyPart(LineItem *item, ofstream &file)
 	if (write_count > 0) file.write(key + ii + 1, write_count);
 }
 
-static void WriteItemValue(LineItem *item, ofstream &file)
+static void WriteItemValue(LineItem *item, ostream &file)
 {
 	const char *value = item->GetValueStr();
 
@@ -919,7 +1447,7 @@ static void WriteItemValue(LineItem *item, ofstream &file)
 	file.write(value, (int)strlen(value));
 }
 
-static void WriteItem(LineItem *item, ofstream &file)
+static void WriteItem(LineItem *item, ostream &file)
 {
 	// Write a new line
 	file.write("\n", 1);
@@ -933,15 +1461,86 @@ static void WriteItem(LineItem *item, ofstream &file)
 	WriteItemValue(item, file);
 }
 
+bool File::Flatten(FlatHashTable &table)
+{
+	table.Clear();
+
+	// For each key in the table,
+	for (SettingsTable::Iterator ii(_table); ii; ++ii)
+	{
+		KeyAdapter key(ii->Key(), ii->Length(), ii->Hash());
+
+		// Copy key and value into the flat table
+		FlatHashEntry *entry = table.Create(key);
+		if (!entry || !table.SetValueStr(entry, ii->GetValueStr()))
+			return false;
+	}
+
+	return true;
+}
+
+bool File::Patch(const char *file_path)
+{
+	// If the original file is not open at that path,
+	if (!_view.GetFront() || _file_path != file_path)
+		return false;
+
+	// For each modified item,
+	for (LineItem *ii = _modded; ii; ii->_sort_next->Unwrap(ii))
+	{
+		// NOTE: EOL offset points at the next character after the original value
+		u32 eol_offset = ii->_eol_offset;
+		if (!eol_offset) return false;
+
+		// Same bytes as WriteItemValue() would produce
+		const char *value = ii->GetValueStr();
+		u32 value_bytes = value[0] ? 1 + (u32)strlen(value) : 0;
+
+		// If it does not fit exactly over the original value,
+		if (eol_offset - ii->_sort_value != value_bytes)
+			return false;
+	}
+
+	// Open the original file for update without truncating it
+	fstream file(file_path, ios::in | ios::out | ios::binary);
+	if (!file) return false;
+
+	for (LineItem *ii = _modded; ii; ii->_sort_next->Unwrap(ii))
+	{
+		file.seekp(ii->_sort_value);
+		WriteItemValue(ii, file);
+	}
+
+	file.flush();
+	bool success = !file.fail();
+	file.close();
+
+	// If patching failed, the full rewrite below will overwrite any partial patch
+	if (!success) return false;
+
+	// Clear the list of modded entries
+	for (LineItem *next, *ii = _modded; ii; ii = next)
+	{
+		ii->_sort_next->Unwrap(next);
+		ii->_enlisted = false;
+	}
+	_modded = 0;
+
+	return true;
+}
+
 bool File::Write(const char *file_path, bool force)
 {
 	CAT_DEBUG_ENFORCE(file_path);
 
 	if (!force && (!_newest && !_modded)) return true;
 
+	// If only existing values changed, try patching them in place
+	if (!force && !_newest && Patch(file_path)) return true;
+
 	// Cache view
 	const char *front = (const char*)_view.GetFront();
-	u32 file_length = _view.GetLength();
+	u32 file_length = (u32)_view.GetLength();
 
 	CAT_DEBUG_ENFORCE(front || !_modded) << "Modded items but no open file";
 
@@ -981,7 +1580,7 @@ bool File::Write(const char *file_path, bool force)
 	// Sort the modified items in increasing order and merge the merge-items
 	u32 copy_start = 0;
 	LineItem *ii;
-	HashItem::MergeSort(_modded)->Unwrap(ii);
+	HashItem::Sort(_modded)->Unwrap(ii);
 	for (; ii; ii->_sort_next->Unwrap(ii))
 	{
 		u32 key_end_offset = ii->_sort_value;
@@ -1040,6 +1639,7 @@ bool File::Write(const char *file_path, bool force)
 	// Close view of actual file
 	_view.Close();
 	_file.Close();
+	_file_path.clear();
 
 	// Delete file
 	std::remove(file_path);
@@ -1053,3 +1653,60 @@ bool File::Write(const char *file_path, bool force)
 
 	return true;
 }
+
+
+//// ragdoll::LazyFile
+
+LazyFile::LazyFile()
+{
+}
+
+LazyFile::~LazyFile()
+{
+	Close();
+}
+
+bool LazyFile::Read(const char *file_path)
+{
+	CAT_DEBUG_ENFORCE(file_path);
+
+	Close();
+
+	return Parser().Read(file_path, this);
+}
+
+void LazyFile::Close()
+{
+	// Drop references into the view before unmapping it
+	_table.Clear();
+
+	_view.Close();
+	_file.Close();
+}
+
+bool LazyFile::GetRange(const StaticKey &key, const char *&value, int &len)
+{
+	FlatHashEntry *entry = _table.Lookup(key);
+	if (!entry) return false;
+
+	value = FlatHashTable::GetValueRange(entry, len);
+	return true;
+}
+
+const char *LazyFile::Get(const StaticKey &key, const char *defaultValue)
+{
+	FlatHashEntry *entry = _table.Lookup(key);
+	if (!entry || !_table.Materialize(entry))
+		return defaultValue;
+
+	return entry->GetValueStr();
+}
+
+int LazyFile::GetInt(const StaticKey &key, int defaultValue)
+{
+	FlatHashEntry *entry = _table.Lookup(key);
+	if (!entry || !_table.Materialize(entry))
+		return defaultValue;
+
+	return entry->GetValueInt();
+}
@@ -33,6 +33,9 @@
 #include <cat/lang/Strings.hpp>
 #include <cat/lang/MergeSort.hpp>
 #include <cat/lang/HashTable.hpp>
+#include <cat/lang/FlatHashTable.hpp>
+#include <cat/lang/Delegates.hpp>
+#include <cat/mem/ArenaAllocator.hpp>
 #include <cat/threads/RWLock.hpp>
 #include <cat/io/MappedFile.hpp>
 #include <string>
@@ -101,7 +104,10 @@ namespace ragdoll {
 
 
 class File;
+class LazyFile;
+class Layer;
 class Parser;
+class CacheFile;
 
 
 static const int MAX_CHARS = MAX_HASH_KEY_CHARS;
@@ -113,6 +119,7 @@ class CAT_EXPORT LineItem : public HashItem
 {
 	friend class File;
 	friend class Parser;
+	friend class CacheFile;
 
 	// Pointer to next modified item in _sort_next
 	// Location of key value in original file stored in _sort_value
@@ -127,6 +134,9 @@ class CAT_EXPORT LineItem : public HashItem
 	// Next item in the modified list
 	bool _enlisted;
 
+	// Created by Set() or a Get() default rather than read from a file
+	bool _runtime;
+
 	// If in the new list, this is populated with the correct case for the key
 	NulTermFixedStr<MAX_CHARS> _case_key;
 
@@ -161,6 +171,8 @@ class CAT_EXPORT Parser
 	// Output data
 	bool _is_override;
 	ragdoll::File *_output_file;
+	ragdoll::LazyFile *_lazy_file;
+	ragdoll::Layer *_layer;
 
 	// Return pointer to the next character after the EOL starting from data, or returns eof if not found
 	static char *FindEOL(char *data, char *eof);
@@ -178,11 +190,77 @@ protected:
 	bool NextLine();
 	int ReadTokens(int root_key_len, int root_depth);
 
+	// Store the current line under the key built in _root_key
+	void AddItem(int key_len);
+	void AddLazyItem(int key_len);
+	void AddLayerItem(int key_len);
+
+	// Map the whole file and parse it
+	bool Parse(const char *file_path, MappedFile *file, MappedView *view, u64 max_size);
+
 public:
+	// Map a view of the whole file without parsing it
+	static bool Map(const char *file_path, MappedFile *file, MappedView *view, u64 max_size);
+
 	static const int MAX_TAB_RECURSION_DEPTH = 16; // Maximum number of layers in a key (change TAB_STRING in .cpp if this changes!)
 	static const int MAX_FILE_SIZE = 4000000; // Maximum number of bytes in file allowed
 
 	bool Read(const char *file_path, File *output_file, bool is_override = false);
+
+	// Lazy files are not limited to MAX_FILE_SIZE
+	bool Read(const char *file_path, LazyFile *output_file);
+
+	bool Read(const char *file_path, Layer *output_layer);
+};
+
+
+//// ragdoll::Layer
+
+/*
+	Override file parsed on its own so that it can be merged into a File later.
+
+	Parsing does not touch the File, so several override files can be parsed
+	at once on worker threads and merged in order afterwards, holding a lock
+	on the File only for the merge.  Lines are kept in file order with their
+	sanitized key, capitalized key, depth and value.
+*/
+
+class CAT_EXPORT Layer
+{
+	friend class ragdoll::Parser;
+	friend class ragdoll::File;
+
+	struct Item
+	{
+		Item *next;
+		u32 hash;
+		u16 key_len, value_len;
+		int depth;
+		char data[1]; // Sanitized key, capitalized key and value, each nul-terminated
+
+		CAT_INLINE const char *Key() { return data; }
+		CAT_INLINE const char *CaseKey() { return data + key_len + 1; }
+		CAT_INLINE const char *Value() { return data + (key_len + 1) * 2; }
+	};
+
+	ArenaAllocator _arena;
+	Item *_head, *_tail;
+	u32 _count;
+
+	bool Add(const char *case_key, int key_len, const char *value, int value_len, int depth);
+
+public:
+	Layer();
+
+	// Returns false if the file could not be read
+	bool Read(const char *file_path);
+
+	void Clear();
+
+	CAT_INLINE u32 Count() { return _count; }
+
+	// Parse several override files at once, using a worker thread for each but the first
+	static void ReadAll(Layer *layers, const char *const *file_paths, int count);
 };
 
 
@@ -191,6 +269,7 @@ public:
 class CAT_EXPORT File
 {
 	friend class ragdoll::Parser;
+	friend class ragdoll::CacheFile;
 
 	typedef DList::ForwardIterator<LineItem> iter;
 
@@ -206,6 +285,13 @@ class CAT_EXPORT File
 	int _key_depth;
 	u32 WriteNewKey(const char *case_key, const char *key, int key_len, LineItem *front, LineItem *end);
 
+	// Path of the mapped original file, for patching it in place
+	std::string _file_path;
+
+	// Overwrite modified values in the original file when each new value is
+	// exactly as long as the old one; returns false to rewrite the file instead
+	bool Patch(const char *file_path);
+
 public:
 	File();
 	~File();
@@ -214,6 +300,34 @@ public:
 	bool Read(const char *file_path);
 	bool Override(const char *file_path);
 
+	// Read from a binary cache image if it is current for the file, or
+	// otherwise parse the file and then write a new cache image
+	bool Read(const char *file_path, const char *cache_path);
+
+	// Apply an override file that was parsed separately.  Keys whose value
+	// is unchanged are skipped, and the rest are counted in changes if set
+	bool Merge(Layer &layer, int *changes = 0);
+
+	// Read the first file and override it with the rest in order, parsing
+	// the override files on worker threads while the first is read.
+	// Returns false if the first file could not be read
+	bool ReadLayers(const char *const *file_paths, int count, const char *cache_path = 0);
+
+	// Called with the hash of each key that differs between two copies
+	typedef Delegate1<void, u32> KeyChanged;
+
+	// Take over the keys that were added to an older copy of this file at
+	// runtime and are still missing here, so they are written back later.
+	// Keys that only an override file named are dropped with the file.
+	// Each key whose final value differs between the copies is passed to
+	// changed, including keys that were removed.  Returns the number of
+	// changed keys, or -1 on out of memory
+	int Adopt(File &old_file, const KeyChanged &changed);
+
+	// Read-only lookups that return false instead of adding a missing key
+	bool Find(const StaticKey &key, std::string &out_value);
+	bool FindInt(const StaticKey &key, int &out_value);
+
 	// Accessors
 	void Set(const char *key, const char *value);
 	const char *Get(const char *key, const char *defaultValue = "");
@@ -228,12 +342,92 @@ public:
 	void SetInt(const char *key, int value, RWLock *lock);
 	int GetInt(const char *key, int defaultValue, RWLock *lock);
 
-	// NOTE: Currently calling Write will close the memory-mapped original file, meaning after
+	// Accessors for keys that are sanitized and hashed ahead of time:
+	void Set(const StaticKey &key, const char *value);
+	const char *Get(const StaticKey &key, const char *defaultValue = "");
+
+	void SetInt(const StaticKey &key, int value);
+	int GetInt(const StaticKey &key, int defaultValue = 0);
+
+	void Set(const StaticKey &key, const char *value, RWLock *lock);
+	void Get(const StaticKey &key, const char *defaultValue, std::string &out_value, RWLock *lock);
+
+	void SetInt(const StaticKey &key, int value, RWLock *lock);
+	int GetInt(const StaticKey &key, int defaultValue, RWLock *lock);
+
+	// Copy every key and value into a flat table, for example to publish
+	// an immutable snapshot of the settings.  Returns false on out of memory
+	bool Flatten(FlatHashTable &table);
+
+	// If only values of keys in the original file changed, and each new value
+	// is as long as the old one, the changed bytes are patched in place and
+	// the file stays open.  Otherwise the whole file is rewritten.
+	// NOTE: Rewriting the file will close the memory-mapped original file, meaning after
 	//		 the write operation, the file cannot be written again without re-reading the file.
 	bool Write(const char *file_path, bool force = false);
 };
 
 
+//// ragdoll::LazyFile
+
+/*
+	Read-only Ragdoll file for large data tables.
+
+	File copies every key and value into a fixed-size LineItem, which is
+	more than half a kilobyte per key, and refuses files over MAX_FILE_SIZE.
+	LazyFile instead keeps the memory-mapped file open for its lifetime and
+	stores each value as a reference into the mapping.  Keys are built from
+	the nested key path, so they are sanitized and packed into a
+	FlatHashTable with no fixed-size padding.
+
+	Values are copied out of the mapping and nul-terminated the first time
+	Get() or GetInt() is called for them.  GetRange() never copies.
+
+	Files up to 4 GB are supported, since the whole file is mapped in one view.
+	Values are limited to FlatHashTable::MAX_VALUE_CHARS.
+
+	Not thread-safe, since Get() may materialize values.
+*/
+
+class CAT_EXPORT LazyFile
+{
+	friend class ragdoll::Parser;
+
+	MappedFile _file;	// Memory-mapped data file
+	MappedView _view;	// View of memory-mapped data file
+
+	FlatHashTable _table;	// Keys with values referencing the view
+
+public:
+	LazyFile();
+	~LazyFile();
+
+	// Read settings from a file, replacing any previously read
+	bool Read(const char *file_path);
+
+	// Release the table and the mapping
+	void Close();
+
+	CAT_INLINE u32 Count() { return _table.Count(); }
+
+	// Returns false if not found; value is not nul-terminated
+	bool GetRange(const StaticKey &key, const char *&value, int &len);
+
+	const char *Get(const StaticKey &key, const char *defaultValue = "");
+	int GetInt(const StaticKey &key, int defaultValue = 0);
+
+	CAT_INLINE const char *Get(const char *key, const char *defaultValue = "")
+	{
+		return Get(StaticKey(key), defaultValue);
+	}
+
+	CAT_INLINE int GetInt(const char *key, int defaultValue = 0)
+	{
+		return GetInt(StaticKey(key), defaultValue);
+	}
+};
+
+
 } // namespace ragdoll
 
 } // namespace cat
@@ -31,7 +31,26 @@
 using namespace cat;
 
 static RefObjects *m_refobjects = 0;
-static Mutex m_refobjects_lock;
+
+// Marks a dead list that no longer accepts objects
+static RefObject * const DEAD_LIST_CLOSED = reinterpret_cast<RefObject*>( 1 );
+
+// Shard for this thread plus one, or 0 if not assigned yet
+static CAT_TLS u32 m_shard = 0;
+static volatile u32 m_next_shard = 0;
+
+static CAT_INLINE u32 GetShardIndex(u32 shard_count)
+{
+	u32 shard = m_shard;
+
+	if (!shard)
+	{
+		shard = Atomic::Add(&m_next_shard, 1) % shard_count + 1;
+		m_shard = shard;
+	}
+
+	return shard - 1;
+}
 
 
 //// RefObject
@@ -41,6 +60,10 @@ RefObject::RefObject()
 	// Initialize to one reference
 	_ref_count = 1;
 	_shutdown = 0;
+
+	_dead_next = 0;
+	_shard = 0;
+	_active = false;
 }
 
 void RefObject::Destroy(const char *file_line)
@@ -95,6 +118,12 @@ bool RefObjects::OnInitialize()
 
 	_shutdown = false;
 
+	for (u32 ii = 0; ii < SHARD_COUNT; ++ii)
+	{
+		_shards[ii].active_list.Clear();
+		_shards[ii].dead_head = 0;
+	}
+
 	if (!Thread::StartThread())
 	{
 		CAT_FATAL("RefObjects") << "Unable to start reaper thread";
@@ -119,7 +148,10 @@ bool RefObjects::Watch(const char *file_line, RefObject *obj)
 		return false;
 	}
 
-	AutoMutex lock(m_refobjects_lock);
+	u32 shard_index = GetShardIndex(SHARD_COUNT);
+	Shard *shard = &_shards[shard_index];
+
+	AutoAdaptiveMutex lock(shard->lock);
 
 	// If RefObjects is shut down,
 	if (_shutdown)
@@ -146,12 +178,9 @@ bool RefObjects::Watch(const char *file_line, RefObject *obj)
 		// Set init success flag to false just in case it is used in their OnDestroy() or OnFinalize() members
 		obj->_init_success = false;
 
-		// So destroy the object
+		// So destroy the object, which puts it on a dead list for finalization
 		obj->Destroy(file_line);
 
-		// And push it on the dead list for finalization
-		_dead_list.PushFront(obj);
-
 		return false;
 	}
 
@@ -160,22 +189,27 @@ bool RefObjects::Watch(const char *file_line, RefObject *obj)
 #endif
 
 	// Add to the active list while lock is held
-	_active_list.PushFront(obj);
+	obj->_shard = shard_index;
+	obj->_active = true;
+	shard->active_list.PushFront(obj);
 
 	return true;
 }
 
 void RefObjects::Kill(RefObject *obj)
 {
-	AutoMutex lock(m_refobjects_lock);
+	Shard *shard = &_shards[GetShardIndex(SHARD_COUNT)];
+	RefObject *head;
 
-	// Skip if shutdown
-	if (!_shutdown)
+	do
 	{
-		_active_list.Erase(obj);
+		head = shard->dead_head;
 
-		_dead_list.PushFront(obj);
-	}
+		// Skip if shutdown: the reaper finds it on the active list
+		if (head == DEAD_LIST_CLOSED) return;
+
+		obj->_dead_next = head;
+	} while (!Atomic::CASPointer((void * volatile *)&shard->dead_head, head, obj));
 }
 
 void RefObjects::OnFinalize()
@@ -187,21 +221,62 @@ void RefObjects::OnFinalize()
 	Thread::WaitForThread(REFOBJECTS_REAPER_WAIT);
 }
 
-void RefObjects::BuryDeadites()
+void RefObjects::BuryDeadites(bool close)
 {
-	if (_dead_list.Empty()) return;
+	// Take every dead list whole
+	RefObject *dead = 0;
+
+	for (u32 ii = 0; ii < SHARD_COUNT; ++ii)
+	{
+		Shard *shard = &_shards[ii];
+
+		if (!close && !shard->dead_head) continue;
+
+		RefObject *obj = (RefObject*)Atomic::SetPointer((void * volatile *)&shard->dead_head, close ? DEAD_LIST_CLOSED : 0);
+
+		while (obj && obj != DEAD_LIST_CLOSED)
+		{
+			RefObject *next = obj->_dead_next;
+			obj->_dead_next = dead;
+			dead = obj;
+			obj = next;
+		}
+	}
 
-	// Copy dead list
-	DListForward dead_list;
+	if (!dead) return;
 
-	m_refobjects_lock.Enter();
-	dead_list.Steal(_dead_list);
-	m_refobjects_lock.Leave();
+	// Remove the batch from the active lists, taking each shard lock once
+	// for each run of objects from the same shard
+	Shard *locked = 0;
 
-	for (iter ii = dead_list; ii; ++ii)
+	for (RefObject *obj = dead; obj; obj = obj->_dead_next)
 	{
-		if (ii->OnFinalize())
-			delete ii;
+		if (!obj->_active) continue;
+
+		Shard *shard = &_shards[obj->_shard];
+
+		if (shard != locked)
+		{
+			if (locked) locked->lock.Leave();
+			shard->lock.Enter();
+			locked = shard;
+		}
+
+		shard->active_list.Erase(obj);
+		obj->_active = false;
+	}
+
+	if (locked) locked->lock.Leave();
+
+	// Finalize without any lock held, since OnFinalize() may create objects
+	while (dead)
+	{
+		RefObject *next = dead->_dead_next;
+
+		if (dead->OnFinalize())
+			delete dead;
+
+		dead = next;
 	}
 }
 
@@ -216,27 +291,39 @@ bool RefObjects::Entrypoint(void *param)
 
 	CAT_INANE("RefObjects") << "Reaper caught shutdown signal, setting asynchronous shutdown flag...";
 
-	m_refobjects_lock.Enter();
-
 	_shutdown = true;
 
+	// Wait for Watch() calls in progress, which check the flag under their shard lock
+	for (u32 ii = 0; ii < SHARD_COUNT; ++ii)
+	{
+		_shards[ii].lock.Enter();
+		_shards[ii].lock.Leave();
+	}
+
+	// Bury what is already dead, and close the dead lists so that objects
+	// released from now on are found on the active list below
+	BuryDeadites(true);
+
 	// Now the shutdown flag is set everywhere synchronously.
 	// The lists may only be modified from this function.
+	DListForward active_list;
 
-	m_refobjects_lock.Leave();
+	for (u32 ii = 0; ii < SHARD_COUNT; ++ii)
+	{
+		for (iter jj = _shards[ii].active_list; jj; ++jj)
+			active_list.PushFront(jj);
+
+		_shards[ii].active_list.Clear();
+	}
 
 	CAT_INANE("RefObjects") << "Reaper destroying remaining active objects...";
 
 	// For each remaining active object,
-	for (iter ii = _active_list; ii; ++ii)
+	for (iter ii = active_list; ii; ++ii)
 	{
 		ii->Destroy(CAT_REFOBJECT_TRACE);
 	}
 
-	CAT_INANE("RefObjects") << "Reaper burying any easy dead...";
-
-	BuryDeadites();
-
 	CAT_INANE("RefObjects") << "Reaper spinning and finalizing the remaining active objects...";
 
 	static const u32 HANG_THRESHOLD = 3000; // ms
@@ -247,7 +334,7 @@ bool RefObjects::Entrypoint(void *param)
 	CAT_FOREVER
 	{
 		// Troll for zero reference counts
-		for (iter ii = _active_list; ii; ++ii)
+		for (iter ii = active_list; ii; ++ii)
 		{
 			// If reference count hits zero,
 			if (ii->_ref_count != 0) continue;
@@ -256,7 +343,7 @@ bool RefObjects::Entrypoint(void *param)
 			CAT_INANE("RefObjects") << ii->GetRefObjectName() << "#" << ii.GetRef() << " finalizing";
 #endif
 
-			_active_list.Erase(ii);
+			active_list.Erase(ii);
 
 			// If object finalizing requests memory freed,
 			if (ii->OnFinalize())
@@ -273,13 +360,13 @@ bool RefObjects::Entrypoint(void *param)
 		}
 
 		// Quit when active list is empty
-		if (_active_list.Empty()) break;
+		if (active_list.Empty()) break;
 
 		// Find smallest ref count object
-		iter smallest_obj = _active_list;
+		iter smallest_obj = active_list;
 		u32 smallest_ref_count = smallest_obj->_ref_count;
 
-		iter ii = _active_list;
+		iter ii = active_list;
 		while (++ii)
 		{
 			if (ii->_ref_count < smallest_ref_count)
@@ -300,7 +387,7 @@ bool RefObjects::Entrypoint(void *param)
 
 		CAT_FATAL("RefObjects") << smallest_obj->GetRefObjectName() << "#" << smallest_obj.GetRef() << " finalization FORCED with " << smallest_ref_count << " dangling references (smallest found)";
 
-		_active_list.Erase(smallest_obj);
+		active_list.Erase(smallest_obj);
 
 		// If object finalizing requests memory freed,
 		if (smallest_obj->OnFinalize())
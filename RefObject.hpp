@@ -32,6 +32,7 @@
 #include <cat/threads/Atomic.hpp>
 #include <cat/threads/WaitableFlag.hpp>
 #include <cat/threads/Mutex.hpp>
+#include <cat/threads/AdaptiveMutex.hpp>
 #include <cat/threads/Thread.hpp>
 #include <cat/lang/LinkedLists.hpp>
 #include <cat/lang/RefSingleton.hpp>
@@ -61,7 +62,16 @@ class RefObject;
 class RefObjects;
 
 
-// Mechanism to wait for reference-counted objects to finish shutting down
+/*
+	Mechanism to wait for reference-counted objects to finish shutting down
+
+	Objects are tracked in SHARD_COUNT shards, and each thread is assigned
+	a shard the first time it creates or kills an object.  A shard keeps the
+	active objects created from its threads behind a short lock, and a list
+	of dead objects that its threads push onto with a single CAS, so there
+	is no global lock for threads to serialize on.  The reaper thread takes
+	each dead list whole and finalizes the batch.
+*/
 class CAT_EXPORT RefObjects : Thread, public RefSingleton<RefObjects>
 {
 	friend class RefObject;
@@ -69,14 +79,30 @@ class CAT_EXPORT RefObjects : Thread, public RefSingleton<RefObjects>
 	bool OnInitialize();
 	void OnFinalize();
 
-	DListForward _active_list, _dead_list;
+	// Threads beyond this many share shards
+	static const u32 SHARD_COUNT = 16;
+
+	struct CAT_ALIGNED(CAT_DEFAULT_CACHE_LINE_SIZE) Shard
+	{
+		// Objects created from this shard's threads
+		AdaptiveMutex lock;
+		DListForward active_list;
+
+		// Objects whose last reference was released on this shard's threads,
+		// linked through _dead_next
+		RefObject * volatile dead_head;
+	};
+
+	Shard _shards[SHARD_COUNT];
 	typedef DListForward::Iterator<RefObject> iter;
 
-	bool _shutdown;
+	volatile bool _shutdown;
 	WaitableFlag _shutdown_flag;
 
 	void Kill(RefObject *obj);
-	void BuryDeadites();
+
+	// With close = true the dead lists stop accepting objects, as for shutdown
+	void BuryDeadites(bool close = false);
 	bool Entrypoint(void *param);
 
 	// NOTE: Will delete and nullify object if it fails to initialize
@@ -124,6 +150,11 @@ class CAT_EXPORT RefObject : DListItem
 	volatile u32 _ref_count, _shutdown;
 	bool _init_success;
 
+	// Used by RefObjects:
+	RefObject *_dead_next;
+	u32 _shard;		// Shard whose active list holds the object
+	bool _active;	// Is on the active list
+
 	void OnZeroReferences(const char *file_line);
 
 public:
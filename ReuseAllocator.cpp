@@ -28,6 +28,11 @@
 
 #include "ReuseAllocator.hpp"
 #include "Enforcer.hpp"
+
+#ifdef CAT_NUMA_ALLOCATOR
+#include "SystemInfo.hpp"
+#endif
+
 using namespace cat;
 
 
@@ -36,8 +41,16 @@ using namespace cat;
 ReuseAllocator::ReuseAllocator()
 {
 	_buffer_bytes = 0;
-	_acquire_head = 0;
-	_release_head = 0;
+
+#ifdef CAT_NUMA_ALLOCATOR
+	_node_count = 1;
+#endif
+
+	for (u32 ii = 0; ii < sizeof(_nodes) / sizeof(_nodes[0]); ++ii)
+	{
+		_nodes[ii].acquire_head = 0;
+		_nodes[ii].release_head = 0;
+	}
 }
 
 void ReuseAllocator::Initialize(u32 buffer_bytes)
@@ -45,31 +58,71 @@ void ReuseAllocator::Initialize(u32 buffer_bytes)
 	Cleanup();
 
 	_buffer_bytes = buffer_bytes;
+
+#ifdef CAT_NUMA_ALLOCATOR
+	_node_count = SystemInfo::ref()->GetNodeCount();
+#endif
+}
+
+u32 ReuseAllocator::GetCurrentNode()
+{
+#ifdef CAT_NUMA_ALLOCATOR
+	if (_node_count > 1)
+		return SystemInfo::ref()->GetCurrentNode();
+#endif
+
+	return 0;
+}
+
+BatchHead *ReuseAllocator::AllocateBuffer(u32 node)
+{
+	u8 *pkt = new (std::nothrow) u8[NODE_HEADER_BYTES + _buffer_bytes];
+	if (!pkt) return 0;
+
+	CAT_ALLOC_STAT(_stats, HEAP_ALLOCS, 1);
+	CAT_ALLOC_STAT(_stats, HEAP_BYTES, NODE_HEADER_BYTES + _buffer_bytes);
+
+#ifdef CAT_NUMA_ALLOCATOR
+	// Tag with home node
+	*reinterpret_cast<u32*>( pkt ) = node;
+#endif
+
+	return reinterpret_cast<BatchHead*>( pkt + NODE_HEADER_BYTES );
+}
+
+void ReuseAllocator::FreeBuffer(BatchHead *buffer)
+{
+	u8 *pkt = reinterpret_cast<u8*>( buffer ) - NODE_HEADER_BYTES;
+	delete []pkt;
 }
 
 void ReuseAllocator::Cleanup() {
-	// For each ready buffer,
-	for (BatchHead *next, *buffer = _acquire_head; buffer; buffer = next)
+	// For each node,
+	for (u32 ii = 0; ii < sizeof(_nodes) / sizeof(_nodes[0]); ++ii)
 	{
-		next = buffer->batch_next;
+		NodeLists *lists = &_nodes[ii];
 
-		// Deallocate
-		u8 *pkt = reinterpret_cast<u8*>( buffer );
-		delete []pkt;
-	}
+		// For each ready buffer,
+		for (BatchHead *next, *buffer = lists->acquire_head; buffer; buffer = next)
+		{
+			next = buffer->batch_next;
 
-	// For each free buffer,
-	for (BatchHead *next, *buffer = _release_head; buffer; buffer = next)
-	{
-		next = buffer->batch_next;
+			// Deallocate
+			FreeBuffer(buffer);
+		}
 
-		// Deallocate
-		u8 *pkt = reinterpret_cast<u8*>( buffer );
-		delete []pkt;
-	}
+		// For each free buffer,
+		for (BatchHead *next, *buffer = lists->release_head; buffer; buffer = next)
+		{
+			next = buffer->batch_next;
 
-	_acquire_head = 0;
-	_release_head = 0;
+			// Deallocate
+			FreeBuffer(buffer);
+		}
+
+		lists->acquire_head = 0;
+		lists->release_head = 0;
+	}
 }
 
 ReuseAllocator::~ReuseAllocator()
@@ -79,32 +132,37 @@ ReuseAllocator::~ReuseAllocator()
 
 void *ReuseAllocator::Acquire(u32 /*bytes*/)
 {
+	const u32 node = GetCurrentNode();
+	NodeLists *lists = &_nodes[node];
+
 #ifdef CAT_THREADED_ALLOCATOR
 	bool acquire_lock_held = false;
 #endif
 
 	// If it looks like the acquire list has more,
-	if (_acquire_head)
+	if (lists->acquire_head)
 	{
 #ifdef CAT_THREADED_ALLOCATOR
 		acquire_lock_held = true;
 
-		_acquire_lock.Enter();
+		CAT_ALLOC_LOCK(_stats, lists->acquire_lock, lists->acquire_start);
 #endif
 
-		BatchHead *last = _acquire_head;
+		BatchHead *last = lists->acquire_head;
 
 		// If found,
 		if (last)
 		{
 			// Update list
 			BatchHead *next = last->batch_next;
-			_acquire_head = next;
+			lists->acquire_head = next;
 
 #ifdef CAT_THREADED_ALLOCATOR
-			_acquire_lock.Leave();
+			CAT_ALLOC_UNLOCK(_stats, lists->acquire_lock, lists->acquire_start);
 #endif
 
+			CAT_ALLOC_STAT(_stats, ACQUIRES, 1);
+
 			//CAT_WARN("ReuseAllocator") << "Reused an acquire-list buffer of size " << _buffer_bytes;
 
 			return last;
@@ -114,16 +172,16 @@ void *ReuseAllocator::Acquire(u32 /*bytes*/)
 	// End up here if the acquire list was empty
 
 	// If it looks like the release list has more,
-	if (_release_head)
+	if (lists->release_head)
 	{
 		// Escalate lock and steal from release list
 #ifdef CAT_THREADED_ALLOCATOR
-		_release_lock.Enter();
+		CAT_ALLOC_LOCK(_stats, lists->release_lock, lists->release_start);
 #endif
-		BatchHead *last = _release_head;
-		_release_head = 0;
+		BatchHead *last = lists->release_head;
+		lists->release_head = 0;
 #ifdef CAT_THREADED_ALLOCATOR
-		_release_lock.Leave();
+		CAT_ALLOC_UNLOCK(_stats, lists->release_lock, lists->release_start);
 #endif
 
 		// If found,
@@ -131,16 +189,18 @@ void *ReuseAllocator::Acquire(u32 /*bytes*/)
 		{
 #ifdef CAT_THREADED_ALLOCATOR
 			if (!acquire_lock_held)
-				_acquire_lock.Enter();
+				CAT_ALLOC_LOCK(_stats, lists->acquire_lock, lists->acquire_start);
 #endif
 
 			BatchHead *next = last->batch_next;
-			_acquire_head = next;
+			lists->acquire_head = next;
 
 #ifdef CAT_THREADED_ALLOCATOR
-			_acquire_lock.Leave();
+			CAT_ALLOC_UNLOCK(_stats, lists->acquire_lock, lists->acquire_start);
 #endif
 
+			CAT_ALLOC_STAT(_stats, ACQUIRES, 1);
+
 			//CAT_WARN("ReuseAllocator") << "Reused a release-list buffer of size " << _buffer_bytes;
 
 			return last;
@@ -150,17 +210,33 @@ void *ReuseAllocator::Acquire(u32 /*bytes*/)
 #ifdef CAT_THREADED_ALLOCATOR
 	// If need to release lock,
 	if (acquire_lock_held)
-		_acquire_lock.Leave();
+		CAT_ALLOC_UNLOCK(_stats, lists->acquire_lock, lists->acquire_start);
 #endif
 
 	// Allocate without lock held
-	BatchHead *buffer = reinterpret_cast<BatchHead*>( new u8[_buffer_bytes] );
+	BatchHead *buffer = AllocateBuffer(node);
+
+	CAT_ALLOC_STAT(_stats, ACQUIRES, buffer ? 1 : 0);
 
 	//CAT_WARN("ReuseAllocator") << "Had to allocate a new buffer of size " << _buffer_bytes;
 
 	return buffer;
 }
 
+void ReuseAllocator::ReleaseNode(u32 node, BatchHead *head, BatchHead *tail)
+{
+	NodeLists *lists = &_nodes[node];
+
+#ifdef CAT_THREADED_ALLOCATOR
+	CAT_ALLOC_LOCK(_stats, lists->release_lock, lists->release_start);
+#endif
+	tail->batch_next = lists->release_head;
+	lists->release_head = head;
+#ifdef CAT_THREADED_ALLOCATOR
+	CAT_ALLOC_UNLOCK(_stats, lists->release_lock, lists->release_start);
+#endif
+}
+
 void ReuseAllocator::ReleaseBatch(const BatchSet &set)
 {
 	if (!set.head) return;
@@ -172,12 +248,284 @@ void ReuseAllocator::ReleaseBatch(const BatchSet &set)
 	CAT_DEBUG_ENFORCE(node == set.tail);
 #endif // CAT_DEBUG
 
+#ifdef CAT_ALLOCATOR_STATS
+	u32 count = 1;
+	for (BatchHead *counted = set.head; counted != set.tail; counted = counted->batch_next)
+		++count;
+
+	_stats.Add(AllocatorStats::BATCH_RELEASES);
+	_stats.Add(AllocatorStats::BATCH_RELEASED, count);
+#endif // CAT_ALLOCATOR_STATS
+
+#ifdef CAT_NUMA_ALLOCATOR
+	// If buffers may belong to different nodes,
+	if (_node_count > 1)
+	{
+		BatchHead *buffer = set.head;
+
+		// For each run of buffers from the same home node,
+		while (buffer)
+		{
+			u32 home = GetBufferNode(buffer);
+			BatchHead *head = buffer, *tail = buffer;
+			BatchHead *next = buffer->batch_next;
+
+			// Extend the run while the next buffer has the same home
+			while (next && GetBufferNode(next) == home)
+			{
+				tail = next;
+				next = next->batch_next;
+			}
+
+			ReleaseNode(home, head, tail);
+
+			buffer = next;
+		}
+
+		return;
+	}
+#endif // CAT_NUMA_ALLOCATOR
+
+	ReleaseNode(0, set.head, set.tail);
+}
+
+u32 ReuseAllocator::AcquireBatch(BatchSet &set, u32 count, u32 /*bytes*/)
+{
+	set.Clear();
+
+	if (count <= 0) return 0;
+
+	const u32 node = GetCurrentNode();
+	NodeLists *lists = &_nodes[node];
+
+	u32 acquired = 0;
+
+#ifdef CAT_THREADED_ALLOCATOR
+	CAT_ALLOC_LOCK(_stats, lists->acquire_lock, lists->acquire_start);
+#endif
+
+	// If the acquire list is empty but the release list looks like it has more,
+	if (!lists->acquire_head && lists->release_head)
+	{
+		// Steal the whole release list
+#ifdef CAT_THREADED_ALLOCATOR
+		CAT_ALLOC_LOCK(_stats, lists->release_lock, lists->release_start);
+#endif
+		lists->acquire_head = lists->release_head;
+		lists->release_head = 0;
 #ifdef CAT_THREADED_ALLOCATOR
-	_release_lock.Enter();
+		CAT_ALLOC_UNLOCK(_stats, lists->release_lock, lists->release_start);
 #endif
-	set.tail->batch_next = _release_head;
-	_release_head = set.head;
+	}
+
+	BatchHead *head = lists->acquire_head;
+
+	// If found,
+	if (head)
+	{
+		// Walk up to count buffers off the front of the list
+		BatchHead *tail = head;
+		for (acquired = 1; acquired < count && tail->batch_next; ++acquired)
+			tail = tail->batch_next;
+
+		// Update list
+		lists->acquire_head = tail->batch_next;
+		tail->batch_next = 0;
+
+		set.head = head;
+		set.tail = tail;
+	}
+
 #ifdef CAT_THREADED_ALLOCATOR
-	_release_lock.Leave();
+	CAT_ALLOC_UNLOCK(_stats, lists->acquire_lock, lists->acquire_start);
+#endif
+
+	// Allocate the remainder without lock held
+	for (; acquired < count; ++acquired)
+	{
+		BatchHead *buffer = AllocateBuffer(node);
+		if (!buffer) break;
+
+		set.PushBack(buffer);
+	}
+
+	CAT_ALLOC_STAT(_stats, BATCH_ACQUIRES, 1);
+	CAT_ALLOC_STAT(_stats, BATCH_ACQUIRED, acquired);
+
+	return acquired;
+}
+
+
+//// ReuseMagazine
+
+ReuseMagazine::ReuseMagazine()
+{
+	_allocator = 0;
+	_batch_count = DEFAULT_BATCH_COUNT;
+	_head = 0;
+	_count = 0;
+
+#ifdef CAT_NUMA_ALLOCATOR
+	_remote.Clear();
+	_remote_count = 0;
 #endif
 }
+
+ReuseMagazine::~ReuseMagazine()
+{
+	Flush();
+}
+
+void ReuseMagazine::Initialize(ReuseAllocator *allocator, u32 batch_count)
+{
+	Flush();
+
+	if (batch_count < 1)
+		batch_count = 1;
+
+	_allocator = allocator;
+	_batch_count = batch_count;
+}
+
+void ReuseMagazine::Spill()
+{
+	BatchHead *head = _head;
+	BatchHead *tail = head;
+
+	// Walk one batch off the front of the magazine
+	for (u32 ii = 1; ii < _batch_count; ++ii)
+		tail = tail->batch_next;
+
+	_head = tail->batch_next;
+	_count -= _batch_count;
+
+	tail->batch_next = 0;
+	_allocator->ReleaseBatch(BatchSet(head, tail));
+}
+
+void ReuseMagazine::Flush()
+{
+#ifdef CAT_NUMA_ALLOCATOR
+	// Send remote buffers home
+	if (_remote.head)
+	{
+		_allocator->ReleaseBatch(_remote);
+
+		_remote.Clear();
+		_remote_count = 0;
+	}
+#endif
+
+	if (!_head) return;
+
+	BatchHead *tail = _head;
+	while (tail->batch_next)
+		tail = tail->batch_next;
+
+	_allocator->ReleaseBatch(BatchSet(_head, tail));
+
+	_head = 0;
+	_count = 0;
+}
+
+void *ReuseMagazine::Acquire(u32 /*bytes*/)
+{
+	BatchHead *buffer = _head;
+
+	// If magazine has a buffer ready,
+	if (CAT_LIKELY(buffer != 0))
+	{
+		_head = buffer->batch_next;
+		--_count;
+
+		return buffer;
+	}
+
+	// Refill a whole batch from the shared allocator
+	BatchSet set;
+	u32 acquired = _allocator->AcquireBatch(set, _batch_count);
+
+	// If no buffers could be acquired,
+	if (acquired <= 0) return 0;
+
+	// Hand out the first one and keep the rest
+	buffer = set.head;
+	_head = buffer->batch_next;
+	_count = acquired - 1;
+
+	return buffer;
+}
+
+void ReuseMagazine::Release(void *buffer)
+{
+	if (!buffer) return;
+
+	BatchHead *node = reinterpret_cast<BatchHead*>( buffer );
+
+#ifdef CAT_NUMA_ALLOCATOR
+	// If buffer belongs to another node,
+	if (_allocator->GetBufferNode(node) != _allocator->GetCurrentNode())
+	{
+		_remote.PushBack(node);
+
+		// If enough have collected, send them home in bulk
+		if (++_remote_count >= _batch_count)
+		{
+			_allocator->ReleaseBatch(_remote);
+
+			_remote.Clear();
+			_remote_count = 0;
+		}
+
+		return;
+	}
+#endif
+
+	node->batch_next = _head;
+	_head = node;
+
+	// If magazine is holding more than two batches,
+	if (CAT_UNLIKELY(++_count > _batch_count * 2))
+		Spill();
+}
+
+u32 ReuseMagazine::AcquireBatch(BatchSet &set, u32 count, u32 /*bytes*/)
+{
+	set.Clear();
+
+	u32 acquired = 0;
+
+	// Take as many as possible from the magazine
+	while (acquired < count && _head)
+	{
+		BatchHead *node = _head;
+		_head = node->batch_next;
+		--_count;
+
+		set.PushBack(node);
+		++acquired;
+	}
+
+	// If more are needed,
+	if (acquired < count)
+	{
+		// Acquire the remainder in bulk
+		BatchSet extra;
+		acquired += _allocator->AcquireBatch(extra, count - acquired);
+
+		set.PushBack(extra);
+	}
+
+	return acquired;
+}
+
+void ReuseMagazine::ReleaseBatch(const BatchSet &set)
+{
+	// For each buffer in the set,
+	for (BatchHead *next, *node = set.head; node; node = next)
+	{
+		next = node->batch_next;
+
+		Release(node);
+	}
+}
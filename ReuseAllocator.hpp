@@ -30,6 +30,7 @@
 #define CAT_REUSE_ALLOCATOR_HPP
 
 #include "IAllocator.hpp"
+#include "AllocatorStats.hpp"
 
 // If multi-threaded allocator is used,
 #ifdef CAT_THREADED_ALLOCATOR
@@ -52,26 +53,65 @@ namespace cat {
 	since it uses two locks and only causes contention if the allocator
 	runs out of space and needs to lazily move all the freed buffers
 	into the acquire list.  In any case, the lock time is minimized. 
+
+	For many worker threads hitting the same allocator, put a ReuseMagazine
+	(below) in front of it in each thread to avoid the locks entirely.
+
+	When CAT_NUMA_ALLOCATOR is defined, each NUMA node gets its own pair of
+	lists.  Buffers are tagged with the node of the thread that allocated
+	them (and so first touched them), and are always returned to that home
+	node's lists no matter which thread releases them.  Acquires are served
+	from the lists of the node the calling thread is running on.
 */
 
 class CAT_EXPORT ReuseAllocator : public IAllocator
 {
 	u32 _buffer_bytes;
 
+	struct NodeLists
+	{
 #ifdef CAT_THREADED_ALLOCATOR
-	Mutex _acquire_lock;
+		Mutex acquire_lock;
 #endif
-	BatchHead * volatile _acquire_head;
+		BatchHead * volatile acquire_head;
 
 #ifdef CAT_THREADED_ALLOCATOR
-	Mutex _release_lock;
+		Mutex release_lock;
+#endif
+		BatchHead * volatile release_head;
+
+#ifdef CAT_ALLOCATOR_STATS
+		// Cycle counts when each lock was taken, only touched with the lock held
+		u32 acquire_start, release_start;
+#endif
+	};
+
+#ifdef CAT_NUMA_ALLOCATOR
+	// Home node is stored in front of each buffer, keeping it 16-byte aligned
+	static const u32 NODE_HEADER_BYTES = 16;
+
+	u32 _node_count;
+	NodeLists _nodes[CAT_MAX_NUMA_NODES];
+#else
+	static const u32 NODE_HEADER_BYTES = 0;
+
+	NodeLists _nodes[1];
+#endif
+
+#ifdef CAT_ALLOCATOR_STATS
+	AllocatorStats _stats;
 #endif
-	BatchHead * volatile _release_head;
 
 	// This interface really doesn't make sense for this allocator
 	CAT_INLINE void *Resize(void *ptr, u32 bytes) { return 0; }
 	CAT_INLINE void Release(void *buffer) {}
-	CAT_INLINE u32 AcquireBatch(BatchSet &set, u32 count, u32 bytes = 0) { return 0; }
+
+	// Allocate a new buffer tagged with the given home node
+	BatchHead *AllocateBuffer(u32 node);
+	void FreeBuffer(BatchHead *buffer);
+
+	// Release a list of buffers that all belong to the same home node
+	void ReleaseNode(u32 node, BatchHead *head, BatchHead *tail);
 
 	void Cleanup();
 
@@ -90,14 +130,109 @@ public:
 		return _buffer_bytes != 0;
 	}
 
+#ifdef CAT_ALLOCATOR_STATS
+	CAT_INLINE void GetStats(AllocatorSnapshot &snapshot) {
+		_stats.Snapshot(snapshot);
+	}
+#endif
+
+	// Returns the node whose lists serve the calling thread
+	u32 GetCurrentNode();
+
+	// Returns the home node of a buffer from this allocator
+	CAT_INLINE u32 GetBufferNode(void *buffer) {
+#ifdef CAT_NUMA_ALLOCATOR
+		return *reinterpret_cast<u32*>( reinterpret_cast<u8*>( buffer ) - NODE_HEADER_BYTES );
+#else
+		return 0;
+#endif
+	}
+
 	// NOTE: Bytes parameter is ignored
 	void *Acquire(u32 bytes = 0);
 
+	// Acquire a number of buffers simultaneously, taking each lock at most once
+	// NOTE: Bytes parameter is ignored
+	// Returns the number of buffers it was able to acquire
+	u32 AcquireBatch(BatchSet &set, u32 count, u32 bytes = 0);
+
 	// Release a number of buffers simultaneously
 	void ReleaseBatch(const BatchSet &set);
 };
 
 
+/*
+	Per-thread magazine in front of a ReuseAllocator.
+
+	Each worker thread owns one of these (as a member of its Thread object
+	or on the stack of its Entrypoint) and allocates through it instead of
+	the shared allocator.  Buffers are handed out from and returned to a
+	private list without any locking.  The shared allocator is only touched
+	in bulk: when the magazine runs dry it refills a whole batch at once,
+	and when it holds more than two batches it spills one batch back.
+
+	Buffers may be released to a different magazine (or directly to the
+	shared allocator) than the one they were acquired from.  With
+	CAT_NUMA_ALLOCATOR, buffers from another node are not cached but are
+	collected separately and sent home in bulk.
+
+	A magazine must only be used by one thread at a time.
+*/
+
+class CAT_EXPORT ReuseMagazine : public IAllocator
+{
+	ReuseAllocator *_allocator;
+	u32 _batch_count;
+
+	BatchHead *_head;
+	u32 _count;
+
+#ifdef CAT_NUMA_ALLOCATOR
+	// Buffers waiting to be sent back to another node
+	BatchSet _remote;
+	u32 _remote_count;
+#endif
+
+	// This interface really doesn't make sense for this allocator
+	CAT_INLINE void *Resize(void *ptr, u32 bytes) { return 0; }
+
+	// Return one batch of buffers to the shared allocator
+	void Spill();
+
+public:
+	static const u32 DEFAULT_BATCH_COUNT = 32;
+
+	ReuseMagazine();
+	virtual ~ReuseMagazine();
+
+	// Magazine will refill and spill batch_count buffers at a time
+	void Initialize(ReuseAllocator *allocator, u32 batch_count = DEFAULT_BATCH_COUNT);
+
+	CAT_INLINE bool Valid() {
+		// Invalid until Initialize()
+		return _allocator != 0 && _allocator->Valid();
+	}
+
+	CAT_INLINE u32 GetCount() {
+		return _count;
+	}
+
+	// NOTE: Bytes parameter is ignored
+	void *Acquire(u32 bytes = 0);
+
+	// Release a single buffer into the magazine
+	void Release(void *buffer);
+
+	// NOTE: Bytes parameter is ignored
+	u32 AcquireBatch(BatchSet &set, u32 count, u32 bytes = 0);
+
+	void ReleaseBatch(const BatchSet &set);
+
+	// Return all cached buffers to the shared allocator
+	void Flush();
+};
+
+
 } // namespace cat
 
 #endif // CAT_BUFFER_ALLOCATOR_HPP
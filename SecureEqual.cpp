@@ -27,6 +27,152 @@
 */
 
 #include "SecureEqual.hpp"
+#include "CPUFeatures.hpp"
+using namespace cat;
+
+// SSE2 is always there on x86-64, and the AVX2 kernel is picked at run time
+// from the CPU features.  The choice never depends on the data
+#if defined(CAT_X86_DISPATCH)
+# define CAT_SECURE_EQUAL_X86_DISPATCH
+# include <immintrin.h>
+#elif defined(CAT_HAS_NEON)
+# define CAT_SECURE_EQUAL_NEON
+# include <arm_neon.h>
+#endif
+
+
+//// Vector kernels
+
+// Each kernel ORs together the XOR of every whole vector of A and B with no
+// early exit, sets done to the bytes covered and returns the differences
+// folded into 64 bits
+typedef u64 (*DiffFunc)(const u8 *A, const u8 *B, int bytes, int &done);
+
+#if defined(CAT_SECURE_EQUAL_X86_DISPATCH)
+
+CAT_TARGET_AVX2 static u64 DiffAVX2(const u8 *A, const u8 *B, int bytes, int &done)
+{
+	__m256i x0 = _mm256_setzero_si256(), x1 = x0;
+	int ii = 0;
+
+	for (; ii + 64 <= bytes; ii += 64)
+	{
+		x0 = _mm256_or_si256(x0, _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(A + ii)),
+												  _mm256_loadu_si256((const __m256i *)(B + ii))));
+		x1 = _mm256_or_si256(x1, _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(A + ii + 32)),
+												  _mm256_loadu_si256((const __m256i *)(B + ii + 32))));
+	}
+
+	if (ii + 32 <= bytes)
+	{
+		x0 = _mm256_or_si256(x0, _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(A + ii)),
+												  _mm256_loadu_si256((const __m256i *)(B + ii))));
+		ii += 32;
+	}
+
+	x0 = _mm256_or_si256(x0, x1);
+	__m128i x = _mm_or_si128(_mm256_castsi256_si128(x0), _mm256_extracti128_si256(x0, 1));
+	x = _mm_or_si128(x, _mm_srli_si128(x, 8));
+
+	u64 fail;
+	_mm_storel_epi64((__m128i *)&fail, x);
+
+	done = ii;
+	return fail;
+}
+
+#if defined(CAT_HAS_SSE2)
+
+static u64 DiffSSE2(const u8 *A, const u8 *B, int bytes, int &done)
+{
+	__m128i x0 = _mm_setzero_si128(), x1 = x0;
+	int ii = 0;
+
+	for (; ii + 32 <= bytes; ii += 32)
+	{
+		x0 = _mm_or_si128(x0, _mm_xor_si128(_mm_loadu_si128((const __m128i *)(A + ii)),
+											_mm_loadu_si128((const __m128i *)(B + ii))));
+		x1 = _mm_or_si128(x1, _mm_xor_si128(_mm_loadu_si128((const __m128i *)(A + ii + 16)),
+											_mm_loadu_si128((const __m128i *)(B + ii + 16))));
+	}
+
+	if (ii + 16 <= bytes)
+	{
+		x0 = _mm_or_si128(x0, _mm_xor_si128(_mm_loadu_si128((const __m128i *)(A + ii)),
+											_mm_loadu_si128((const __m128i *)(B + ii))));
+		ii += 16;
+	}
+
+	x0 = _mm_or_si128(x0, x1);
+	x0 = _mm_or_si128(x0, _mm_srli_si128(x0, 8));
+
+	u64 fail;
+	_mm_storel_epi64((__m128i *)&fail, x0);
+
+	done = ii;
+	return fail;
+}
+
+#endif // CAT_HAS_SSE2
+
+static DiffFunc DetectKernel()
+{
+	if (HasCPUFeatures(CPU_AVX2)) return DiffAVX2;
+#if defined(CAT_HAS_SSE2)
+	return DiffSSE2;
+#else
+	return 0;
+#endif
+}
+
+static DiffFunc m_diff = 0;
+
+static CAT_INLINE DiffFunc GetKernel()
+{
+	return BindKernel(m_diff, DetectKernel);
+}
+
+#elif defined(CAT_SECURE_EQUAL_NEON)
+
+static u64 DiffNEON(const u8 *A, const u8 *B, int bytes, int &done)
+{
+	uint8x16_t x0 = vdupq_n_u8(0), x1 = x0;
+	int ii = 0;
+
+	for (; ii + 32 <= bytes; ii += 32)
+	{
+		x0 = vorrq_u8(x0, veorq_u8(vld1q_u8(A + ii), vld1q_u8(B + ii)));
+		x1 = vorrq_u8(x1, veorq_u8(vld1q_u8(A + ii + 16), vld1q_u8(B + ii + 16)));
+	}
+
+	if (ii + 16 <= bytes)
+	{
+		x0 = vorrq_u8(x0, veorq_u8(vld1q_u8(A + ii), vld1q_u8(B + ii)));
+		ii += 16;
+	}
+
+	uint64x2_t x = vreinterpretq_u64_u8(vorrq_u8(x0, x1));
+
+	done = ii;
+	return vgetq_lane_u64(x, 0) | vgetq_lane_u64(x, 1);
+}
+
+static CAT_INLINE DiffFunc GetKernel()
+{
+	return DiffNEON;
+}
+
+#else
+
+static CAT_INLINE DiffFunc GetKernel()
+{
+	return 0;
+}
+
+#endif
+
+
+//// SecureEqual
 
 bool cat::SecureEqual(const void *vA, const void *vB, int bytes)
 {
@@ -34,6 +180,18 @@ bool cat::SecureEqual(const void *vA, const void *vB, int bytes)
 	const u8 *B = (const u8*)vB;
     u64 fail = 0;
 
+	// Accumulate failures a vector at a time
+	DiffFunc diff = GetKernel();
+	if (diff && bytes > 0)
+	{
+		int done;
+		fail = diff(A, B, bytes, done);
+
+		A += done;
+		B += done;
+		bytes -= done;
+	}
+
     // Accumulate failures, 8 bytes at a time
     int qwords = bytes >> 3;
 
@@ -29,6 +29,13 @@
 #include "SecureErase.hpp"
 using namespace cat;
 
+#if defined(CAT_OS_WINDOWS)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#elif defined(CAT_COMPILER_GCC)
+# include <string.h> // memset
+#endif
+
 #ifdef CAT_HAS_VECTOR_EXTENSIONS
 typedef u64 vec_block CAT_VECTOR_SIZE(u64, 4);
 #endif
@@ -38,6 +45,25 @@ extern "C" {
 #endif
 
 void cat_secure_erase(volatile void *data, int len) {
+	if (len <= 0) {
+		return;
+	}
+
+#if defined(CAT_OS_WINDOWS)
+
+	// Guaranteed by the platform not to be optimized away
+	SecureZeroMemory((PVOID)data, len);
+
+#elif defined(CAT_COMPILER_GCC)
+
+	// The C library memset is already vectorized.  The barrier claims to
+	// read the buffer afterwards, so the compiler cannot drop the stores
+	// even if it inlines this function
+	memset((void *)data, 0, len);
+	CAT_ASM_BEGIN_VOLATILE "" : : "r"(data) : "memory" CAT_ASM_END
+
+#else
+
 	// Calculate number of 64-bit words to erase, usually a multiple of 32 bytes
 	int words = len >> 3;
 
@@ -56,6 +82,7 @@ void cat_secure_erase(volatile void *data, int len) {
 			word[1] = 0;
 			word[2] = 0;
 			word[3] = 0;
+			word += 4;
 			words -= 4;
 		}
 #ifdef CAT_HAS_VECTOR_EXTENSIONS
@@ -110,6 +137,8 @@ void cat_secure_erase(volatile void *data, int len) {
 	default:
 		break;
 	}
+
+#endif
 }
 
 #ifdef __cplusplus
@@ -36,6 +36,10 @@
  * be external and the compiler will not optimize it away.  Most data to securely
  * erase is a multiple of 8 bytes and about 32 or 64 bytes for keys or hashes,
  * which makes vector operations interesting.
+ *
+ * On Windows it uses SecureZeroMemory(), and with GCC-compatible compilers a
+ * plain memset() followed by a compiler barrier, so large buffers are wiped
+ * at memset speed.  Other builds fall back to volatile stores.
  */
 
 #ifdef __cplusplus
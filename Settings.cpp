@@ -28,10 +28,216 @@
 
 #include <cat/io/Settings.hpp>
 #include <cat/io/Log.hpp>
+#include <cat/io/RagdollCache.hpp>
+#include <cat/threads/Thread.hpp>
+#include <cat/time/Clock.hpp>
+
+#if defined(CAT_OS_LINUX)
+# include <sys/inotify.h>
+# include <poll.h>
+# include <unistd.h>
+# include <cstring>
+#elif defined(CAT_OS_WINDOWS)
+# include <cat/port/WindowsInclude.hpp>
+#endif
+
 using namespace cat;
 
 static Log *m_logging = 0;
 
+static const StaticKey KEY_LOG_THRESHOLD("IO.Log.Threshold");
+static const StaticKey KEY_UNLINK_OVERRIDE("IO.Settings.UnlinkOverride");
+static const StaticKey KEY_HOT_RELOAD("IO.Settings.HotReload");
+
+static const char *const SETTINGS_FILE_PATHS[2] = {
+	CAT_SETTINGS_FILE, CAT_SETTINGS_OVERRIDE_FILE
+};
+static const int SETTINGS_FILE_COUNT = 2;
+
+
+//// SettingsWatcher
+
+class cat::SettingsWatcher : public Thread
+{
+	// Give editors time to finish writing before the file is parsed
+	static const u32 SETTLE_MSEC = 50;
+
+	Settings *_settings;
+	volatile bool _stop;
+
+	// Last seen size and modification time of each file
+	u64 _bytes[SETTINGS_FILE_COUNT], _time[SETTINGS_FILE_COUNT];
+
+#if defined(CAT_OS_LINUX)
+	int _fd;
+#elif defined(CAT_OS_WINDOWS)
+	HANDLE _changes[SETTINGS_FILE_COUNT];
+	int _change_count;
+#endif
+
+	// Returns true if any file changed since the last call
+	bool UpdateStamps()
+	{
+		bool changed = false;
+
+		for (int ii = 0; ii < SETTINGS_FILE_COUNT; ++ii)
+		{
+			u64 bytes = 0, time = 0;
+
+			// A missing file has a zero stamp
+			ragdoll::CacheFile::GetSourceStamp(SETTINGS_FILE_PATHS[ii], bytes, time);
+
+			if (bytes != _bytes[ii] || time != _time[ii])
+			{
+				_bytes[ii] = bytes;
+				_time[ii] = time;
+				changed = true;
+			}
+		}
+
+		return changed;
+	}
+
+	// Copy the directory part of a path, or "." if there is none
+	static void GetDirectory(const char *file_path, std::string &dir)
+	{
+		const char *slash = 0;
+
+		for (const char *ch = file_path; *ch; ++ch)
+			if (*ch == '/' || *ch == '\\')
+				slash = ch;
+
+		if (slash)
+			dir.assign(file_path, slash - file_path + 1);
+		else
+			dir = ".";
+	}
+
+	// Block until the OS reports activity in a watched directory or the interval passes
+	void WaitForChange()
+	{
+#if defined(CAT_OS_LINUX)
+
+		if (_fd < 0)
+		{
+			Clock::sleep(CAT_SETTINGS_WATCH_INTERVAL);
+			return;
+		}
+
+		struct pollfd pfd;
+		pfd.fd = _fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+
+		// If events are waiting, drain them; the stamps tell what changed
+		if (poll(&pfd, 1, CAT_SETTINGS_WATCH_INTERVAL) > 0)
+		{
+			char buffer[4096];
+			while (read(_fd, buffer, sizeof(buffer)) > 0);
+		}
+
+#elif defined(CAT_OS_WINDOWS)
+
+		if (_change_count <= 0)
+		{
+			Clock::sleep(CAT_SETTINGS_WATCH_INTERVAL);
+			return;
+		}
+
+		DWORD result = WaitForMultipleObjects(_change_count, _changes, FALSE, CAT_SETTINGS_WATCH_INTERVAL);
+
+		// If a directory changed, re-arm its notification
+		if (result >= WAIT_OBJECT_0 && result < WAIT_OBJECT_0 + (DWORD)_change_count)
+			FindNextChangeNotification(_changes[result - WAIT_OBJECT_0]);
+
+#else
+
+		Clock::sleep(CAT_SETTINGS_WATCH_INTERVAL);
+
+#endif
+	}
+
+	bool Entrypoint(void *param)
+	{
+		while (!_stop)
+		{
+			WaitForChange();
+
+			// If neither file changed, it was some other file in the directory
+			if (_stop || !UpdateStamps())
+				continue;
+
+			// Wait for the file to settle so a partial write is not parsed
+			do Clock::sleep(SETTLE_MSEC);
+			while (!_stop && UpdateStamps());
+
+			if (!_stop)
+				_settings->Reload();
+		}
+
+		return true;
+	}
+
+public:
+	SettingsWatcher(Settings *settings)
+	{
+		_settings = settings;
+		_stop = false;
+
+		UpdateStamps();
+
+#if defined(CAT_OS_LINUX)
+
+		_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+		for (int ii = 0; _fd >= 0 && ii < SETTINGS_FILE_COUNT; ++ii)
+		{
+			std::string dir;
+			GetDirectory(SETTINGS_FILE_PATHS[ii], dir);
+
+			// Watching a directory twice returns the same watch
+			inotify_add_watch(_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE);
+		}
+
+#elif defined(CAT_OS_WINDOWS)
+
+		_change_count = 0;
+
+		for (int ii = 0; ii < SETTINGS_FILE_COUNT; ++ii)
+		{
+			std::string dir;
+			GetDirectory(SETTINGS_FILE_PATHS[ii], dir);
+
+			HANDLE change = FindFirstChangeNotificationA(dir.c_str(), FALSE,
+				FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE);
+
+			if (change != INVALID_HANDLE_VALUE)
+				_changes[_change_count++] = change;
+		}
+
+#endif
+	}
+
+	~SettingsWatcher()
+	{
+		Stop();
+
+#if defined(CAT_OS_LINUX)
+		if (_fd >= 0) close(_fd);
+#elif defined(CAT_OS_WINDOWS)
+		for (int ii = 0; ii < _change_count; ++ii)
+			FindCloseChangeNotification(_changes[ii]);
+#endif
+	}
+
+	void Stop()
+	{
+		_stop = true;
+
+		WaitForThread();
+	}
+};
+
 
 //// Settings
 
@@ -39,26 +245,41 @@ CAT_REF_SINGLETON(Settings);
 
 bool Settings::OnInitialize()
 {
-	AutoWriteLock lock(_lock);
+	_version = 1;
+	for (u32 ii = 0; ii < KEY_VERSION_SLOTS; ++ii)
+		_key_versions[ii] = 1;
+	_snapshot = 0;
+	_snapshot_epoch = 0;
+	_snapshot_readers[0] = 0;
+	_snapshot_readers[1] = 0;
+	_watcher = 0;
 
-	_file = new ragdoll::File;
-	if (!_file) return false;
+	ragdoll::File *file = new ragdoll::File;
+	if (!file) return false;
 
-	_file->Read(CAT_SETTINGS_FILE);
-	_file->Override(CAT_SETTINGS_OVERRIDE_FILE);
+	// Parse the override file while the settings file is read
+	file->ReadLayers(SETTINGS_FILE_PATHS, SETTINGS_FILE_COUNT, CAT_SETTINGS_CACHE_FILE);
 
+	AutoWriteLock lock(_lock);
+	_file = file;
 	lock.Release();
 
 	// Initialize logging threshold
-	EventSeverity threshold = (EventSeverity)getInt("IO.Log.Threshold", DEFAULT_LOG_LEVEL);
+	EventSeverity threshold = (EventSeverity)getInt(KEY_LOG_THRESHOLD, DEFAULT_LOG_LEVEL);
 	Use(m_logging)->SetThreshold(threshold);
 
+	if (getInt(KEY_HOT_RELOAD) == 1)
+		EnableHotReload();
+
 	return true;
 }
 
 void Settings::OnFinalize()
 {
-	if (getInt("IO.Settings.UnlinkOverride") == 1)
+	// Stop watching before the settings file is written back
+	DisableHotReload();
+
+	if (getInt(KEY_UNLINK_OVERRIDE) == 1)
 	{
 		std::remove(CAT_SETTINGS_OVERRIDE_FILE);
 	}
@@ -69,26 +290,338 @@ void Settings::OnFinalize()
 
 	delete _file;
 	_file = 0;
+
+	// No readers may remain at this point
+	delete _snapshot;
+	_snapshot = 0;
+}
+
+u32 Settings::PinSnapshot()
+{
+	for (;;)
+	{
+		u32 epoch = _snapshot_epoch;
+
+		Atomic::Add(&_snapshot_readers[epoch & 1], 1);
+
+		// If the epoch did not advance before the pin was visible,
+		if (epoch == _snapshot_epoch)
+			return epoch;
+
+		// Otherwise the writer may have missed this reader, so retry
+		Atomic::Add(&_snapshot_readers[epoch & 1], -1);
+	}
+}
+
+void Settings::UnpinSnapshot(u32 epoch)
+{
+	Atomic::Add(&_snapshot_readers[epoch & 1], -1);
+}
+
+bool Settings::PublishSnapshot()
+{
+	SettingsSnapshot *snapshot = new (std::nothrow) SettingsSnapshot;
+	if (!snapshot) return false;
+
+	if (!_file->Flatten(snapshot->_table))
+	{
+		delete snapshot;
+		return false;
+	}
+
+	SettingsSnapshot *old_snapshot = _snapshot;
+
+	// Make the table visible before the pointer to it
+	Atomic::StoreMemoryBarrier();
+	_snapshot = snapshot;
+
+	if (old_snapshot)
+	{
+		// Advance the epoch so new readers pin the other counter
+		u32 epoch = _snapshot_epoch;
+		Atomic::Add(&_snapshot_epoch, 1);
+
+		// Wait for readers that may still hold the old snapshot
+		while (_snapshot_readers[epoch & 1] != 0)
+			Clock::sleep(0);
+
+		delete old_snapshot;
+	}
+
+	return true;
+}
+
+bool Settings::Override(const char *const *file_paths, int count)
+{
+	if (count <= 0) return true;
+
+	ragdoll::Layer *layers = new (std::nothrow) ragdoll::Layer[count];
+	if (!layers) return false;
+
+	// Parse without holding the lock
+	ragdoll::Layer::ReadAll(layers, file_paths, count);
+
+	AutoWriteLock lock(_lock);
+
+	bool success = true;
+	for (int ii = 0; ii < count; ++ii)
+	{
+		if (!_file->Merge(layers[ii]))
+			success = false;
+	}
+
+	if (_snapshot) PublishSnapshot();
+
+	// Invalidate setting handles after the new values are readable,
+	// and since the override files may name any key invalidate them all
+	for (u32 ii = 0; ii < KEY_VERSION_SLOTS; ++ii)
+		Atomic::Add(&_key_versions[ii], 1);
+	Atomic::Add(&_version, 1);
+
+	lock.Release();
+
+	delete []layers;
+
+	return success;
+}
+
+void Settings::OnKeyChanged(u32 hash)
+{
+	u32 slot = hash & (KEY_VERSION_SLOTS - 1);
+
+	_changed_slots[slot / 32] |= (u32)1 << (slot % 32);
+}
+
+bool Settings::Reload()
+{
+	ragdoll::File *file = new (std::nothrow) ragdoll::File;
+	if (!file) return false;
+
+	// Parse a fresh copy without holding the lock.  The settings file is
+	// mapped again so that writing it back later starts from the edited text
+	if (!file->ReadLayers(SETTINGS_FILE_PATHS, SETTINGS_FILE_COUNT, CAT_SETTINGS_CACHE_FILE))
+	{
+		delete file;
+		return false;
+	}
+
+	AutoWriteLock lock(_lock);
+
+	for (u32 ii = 0; ii < KEY_VERSION_SLOTS / 32; ++ii)
+		_changed_slots[ii] = 0;
+
+	// Compare final merged values against the live copy
+	int changes = file->Adopt(*_file, ragdoll::File::KeyChanged::FromMember<Settings, &Settings::OnKeyChanged>(this));
+	if (changes < 0)
+	{
+		lock.Release();
+		delete file;
+		return false;
+	}
+
+	ragdoll::File *old_file = _file;
+	_file = file;
+
+	// If any key changed,
+	if (changes > 0)
+	{
+		if (_snapshot) PublishSnapshot();
+
+		// Invalidate handles for the changed keys after the new values are readable
+		for (u32 ii = 0; ii < KEY_VERSION_SLOTS; ++ii)
+		{
+			if (_changed_slots[ii / 32] & ((u32)1 << (ii % 32)))
+				BumpKeyVersion(ii);
+		}
+		Atomic::Add(&_version, 1);
+	}
+
+	lock.Release();
+
+	delete old_file;
+
+	return true;
+}
+
+bool Settings::EnableHotReload()
+{
+	if (_watcher) return true;
+
+	SettingsWatcher *watcher = new (std::nothrow) SettingsWatcher(this);
+	if (!watcher) return false;
+
+	if (!watcher->StartThread())
+	{
+		delete watcher;
+		return false;
+	}
+
+	_watcher = watcher;
+	return true;
+}
+
+void Settings::DisableHotReload()
+{
+	if (!_watcher) return;
+
+	delete _watcher;
+	_watcher = 0;
+}
+
+bool Settings::EnableSnapshots()
+{
+	AutoWriteLock lock(_lock);
+
+	if (_snapshot) return true;
+
+	return PublishSnapshot();
+}
+
+bool Settings::ReadSnapshot(const KeyAdapter &key, int &value)
+{
+	u32 epoch = PinSnapshot();
+
+	SettingsSnapshot *snapshot = _snapshot;
+	Atomic::LoadMemoryBarrier();
+
+	FlatHashEntry *entry = snapshot ? snapshot->_table.Lookup(key) : 0;
+	if (entry) value = entry->GetValueInt();
+
+	UnpinSnapshot(epoch);
+
+	return entry != 0;
+}
+
+bool Settings::ReadSnapshot(const KeyAdapter &key, std::string &value)
+{
+	u32 epoch = PinSnapshot();
+
+	SettingsSnapshot *snapshot = _snapshot;
+	Atomic::LoadMemoryBarrier();
+
+	FlatHashEntry *entry = snapshot ? snapshot->_table.Lookup(key) : 0;
+	if (entry) value.assign(entry->GetValueStr(), entry->GetValueLength());
+
+	UnpinSnapshot(epoch);
+
+	return entry != 0;
+}
+
+int Settings::MissInt(const StaticKey &key, int default_value)
+{
+	AutoWriteLock lock(_lock);
+
+	int value = _file->GetInt(key, default_value);
+
+	PublishSnapshot();
+
+	return value;
+}
+
+std::string Settings::MissStr(const StaticKey &key, const char *default_value)
+{
+	AutoWriteLock lock(_lock);
+
+	std::string value = _file->Get(key, default_value);
+
+	PublishSnapshot();
+
+	return value;
 }
 
 int Settings::getInt(const char *name, int default_value)
 {
-	return _file->GetInt(name, default_value, &_lock);
+	return getInt(StaticKey(name), default_value);
 }
 
 std::string Settings::getStr(const char *name, const char *default_value)
 {
-	std::string value;
-	_file->Get(name, default_value, value, &_lock);
-	return value;
+	return getStr(StaticKey(name), default_value);
 }
 
 void Settings::setInt(const char *name, int value)
 {
-	_file->SetInt(name, value, &_lock);
+	setInt(StaticKey(name), value);
 }
 
 void Settings::setStr(const char *name, const char *value)
 {
-	_file->Set(name, value, &_lock);
+	setStr(StaticKey(name), value);
+}
+
+int Settings::getInt(const StaticKey &key, int default_value)
+{
+	// If snapshot reads are enabled,
+	if (_snapshot)
+	{
+		int value;
+		if (ReadSnapshot(key, value)) return value;
+
+		return MissInt(key, default_value);
+	}
+
+	// Reload() may replace the file, so it is only touched with the lock held
+	AutoReadLock read_lock(_lock);
+
+	int value;
+	if (_file->FindInt(key, value)) return value;
+
+	read_lock.Release();
+
+	// Add the default value to the file
+	AutoWriteLock lock(_lock);
+
+	return _file->GetInt(key, default_value);
+}
+
+std::string Settings::getStr(const StaticKey &key, const char *default_value)
+{
+	std::string value;
+
+	// If snapshot reads are enabled,
+	if (_snapshot)
+	{
+		if (ReadSnapshot(key, value)) return value;
+
+		return MissStr(key, default_value);
+	}
+
+	// Reload() may replace the file, so it is only touched with the lock held
+	AutoReadLock read_lock(_lock);
+
+	if (_file->Find(key, value)) return value;
+
+	read_lock.Release();
+
+	// Add the default value to the file
+	AutoWriteLock lock(_lock);
+
+	value = _file->Get(key, default_value);
+	return value;
+}
+
+void Settings::setInt(const StaticKey &key, int value)
+{
+	AutoWriteLock lock(_lock);
+
+	_file->SetInt(key, value);
+
+	if (_snapshot) PublishSnapshot();
+
+	// Invalidate setting handles after the new value is readable
+	BumpKeyVersion(key.Hash());
+	Atomic::Add(&_version, 1);
+}
+
+void Settings::setStr(const StaticKey &key, const char *value)
+{
+	AutoWriteLock lock(_lock);
+
+	_file->Set(key, value);
+
+	if (_snapshot) PublishSnapshot();
+
+	// Invalidate setting handles after the new value is readable
+	BumpKeyVersion(key.Hash());
+	Atomic::Add(&_version, 1);
 }
@@ -30,6 +30,7 @@
 #define CAT_SETTINGS_HPP
 
 #include <cat/threads/RWLock.hpp>
+#include <cat/threads/Atomic.hpp>
 #include <cat/io/RagdollFile.hpp>
 #include <cat/lang/RefSingleton.hpp>
 
@@ -38,6 +39,54 @@
 namespace cat {
 
 
+/*
+	Snapshot mode
+
+	By default every read takes the settings read lock and copies the value
+	out of the Ragdoll file.  After EnableSnapshots() is called, each write
+	instead publishes an immutable flattened copy of all the settings, and
+	readers only pin the current copy, probe it and unpin it.
+
+	Readers pin a copy by incrementing the reader count for the current
+	epoch.  A writer swaps in the new copy, advances the epoch and waits for
+	the readers of the old epoch to drain before freeing the old copy, so a
+	reader never needs the lock.  Writes become more expensive since they
+	copy the whole table, which suits tunables that are read far more often
+	than they are written.
+
+	Keys that are missing from the snapshot fall back to the locked path so
+	the default value is still added to the file, and then get republished.
+*/
+
+/*
+	Hot reload
+
+	After EnableHotReload() is called, a background thread watches the
+	settings and override files (inotify on Linux, change notifications on
+	Windows, and periodic checks elsewhere).  When either file is edited it
+	calls Reload(), which parses a fresh copy of both files without the lock
+	and then swaps it in for the live copy.  Only keys whose final merged
+	value differs between the two copies count as changed, and only their
+	versions are bumped.
+
+	The files become the source of truth for the keys they name, so a value
+	written with setInt() is replaced on reload if the files disagree with it.
+	Keys that were removed from the files fall back to their defaults, while
+	keys that were only added at runtime are carried over to the new copy.
+*/
+
+//// SettingsSnapshot
+
+class CAT_EXPORT SettingsSnapshot
+{
+	friend class Settings;
+
+	FlatHashTable _table;
+};
+
+class SettingsWatcher;
+
+
 //// Settings
 
 class CAT_EXPORT Settings : public RefSingleton<Settings>
@@ -49,7 +98,74 @@ class CAT_EXPORT Settings : public RefSingleton<Settings>
 
 	ragdoll::File *_file;
 
+	// Incremented whenever a setting is written
+	volatile u32 _version;
+
+	// Per-key versions, shared by keys whose hashes match in the low bits
+	static const u32 KEY_VERSION_SLOTS = 256;
+	volatile u32 _key_versions[KEY_VERSION_SLOTS];
+
+	// Slots of keys found changed by Reload(), bumped once the values are readable
+	u32 _changed_slots[KEY_VERSION_SLOTS / 32];
+
+	void OnKeyChanged(u32 hash);
+
+	CAT_INLINE void BumpKeyVersion(u32 hash)
+	{
+		Atomic::Add(&_key_versions[hash & (KEY_VERSION_SLOTS - 1)], 1);
+	}
+
+	// Snapshot mode
+	SettingsSnapshot * volatile _snapshot;
+	volatile u32 _snapshot_epoch;
+	volatile u32 _snapshot_readers[2];
+
+	// Pin the current snapshot and return the epoch to unpin with
+	u32 PinSnapshot();
+	void UnpinSnapshot(u32 epoch);
+
+	// Publish a fresh snapshot; called with the write lock held
+	bool PublishSnapshot();
+
+	// Look up a key in the snapshot, or return false to take the locked path
+	bool ReadSnapshot(const KeyAdapter &key, int &value);
+	bool ReadSnapshot(const KeyAdapter &key, std::string &value);
+
+	// Locked reads that publish a new snapshot when a key is missing
+	int MissInt(const StaticKey &key, int default_value);
+	std::string MissStr(const StaticKey &key, const char *default_value);
+
+	// Hot reload
+	SettingsWatcher *_watcher;
+
 public:
+	// Apply override files in order, parsing them in parallel before taking the lock
+	bool Override(const char *const *file_paths, int count);
+
+	// Re-read the settings and override files and apply the keys that changed.
+	// Returns false and keeps the live values if the settings file cannot be read
+	bool Reload();
+
+	// Reload() automatically when the files change; returns false if no thread could be started
+	bool EnableHotReload();
+	void DisableHotReload();
+
+	CAT_INLINE bool HotReloadEnabled() { return _watcher != 0; }
+
+	// Switch reads over to lock-free snapshots; returns false on out of memory
+	bool EnableSnapshots();
+
+	CAT_INLINE bool SnapshotsEnabled() { return _snapshot != 0; }
+
+	// Changes whenever any setting is written
+	CAT_INLINE u32 GetVersion() { return _version; }
+
+	// Changes whenever the given key is written or reloaded, for use by SettingHandle
+	CAT_INLINE u32 GetKeyVersion(const SanitizedKey &key)
+	{
+		return _key_versions[key.Hash() & (KEY_VERSION_SLOTS - 1)];
+	}
+
 	int getInt(const char *name, int default_value = 0);
 	std::string getStr(const char *name, const char *default_value = "");
 
@@ -61,6 +177,91 @@ public:
 
 	void setInt(const char *name, int value);
 	void setStr(const char *name, const char *value);
+
+	// Overloads for keys that are sanitized and hashed ahead of time
+	int getInt(const StaticKey &key, int default_value = 0);
+	std::string getStr(const StaticKey &key, const char *default_value = "");
+
+	CAT_INLINE int getInt(const StaticKey &key, int default_value, int min_value, int max_value)
+	{
+		return Bound(min_value, max_value, getInt(key, default_value));
+	}
+
+	void setInt(const StaticKey &key, int value);
+	void setStr(const StaticKey &key, const char *value);
+};
+
+
+//// SettingHandle
+
+/*
+	Resolves an integer setting once and caches the parsed value:
+
+		static SettingHandle<int> buffer_count("IOThreads.BufferCount", 1000);
+
+		for (...)
+			if (count < buffer_count.Get()) ...
+
+	Get() only loads the version of its key and compares it to the version
+	the value was cached at.  The key is looked up and parsed again only
+	after that key has been written or reloaded, so live changes are still
+	picked up.  Keys share version slots by hash, so a write to another key
+	may occasionally cause a harmless extra refresh.
+
+	T may be any type that converts to and from int, such as bool or an enum.
+
+	A handle may be shared between threads.  A thread that races a refresh
+	may see the value from just before the latest write for that one call.
+*/
+
+template<class T>
+class SettingHandle
+{
+	StaticKey _key;
+	int _default_value;
+	T _value;
+	volatile u32 _version; // 0 = not resolved yet
+
+	void Refresh(Settings *settings, u32 version)
+	{
+		// Version was read first, so a racing write will cause another refresh
+		_value = (T)settings->getInt(_key, _default_value);
+
+		// Make the value visible before the version that validates it
+		Atomic::StoreMemoryBarrier();
+		_version = version;
+	}
+
+public:
+	CAT_INLINE SettingHandle(const char *name, T default_value = T()) : _key(name)
+	{
+		_default_value = (int)default_value;
+		_value = default_value;
+		_version = 0;
+	}
+
+	CAT_INLINE const char *Name() const { return _key.Name(); }
+
+	CAT_INLINE T Get()
+	{
+		Settings *settings = Settings::ref();
+
+		u32 version = settings->GetKeyVersion(_key);
+		if (version != _version) Refresh(settings, version);
+
+		// Read the value only after the version that validates it
+		Atomic::LoadMemoryBarrier();
+
+		return _value;
+	}
+
+	CAT_INLINE operator T() { return Get(); }
+
+	// Write a new value, which invalidates cached handles
+	CAT_INLINE void Set(T value)
+	{
+		Settings::ref()->setInt(_key, (int)value);
+	}
 };
 
 
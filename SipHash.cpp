@@ -28,8 +28,21 @@
 
 #include "SipHash.hpp"
 #include "EndianNeutral.hpp"
+#include "CPUFeatures.hpp"
 using namespace cat;
 
+#include <string.h> // memcpy
+
+// Build the AVX2 and AVX-512 batch kernels where the compiler can target
+// them per function, and pick one at run time from the CPU features
+#if defined(CAT_X86_DISPATCH)
+# define CAT_SIPHASH_X86_DISPATCH
+# include <immintrin.h>
+#elif defined(CAT_HAS_NEON) && defined(__aarch64__)
+# define CAT_SIPHASH_NEON
+# include <arm_neon.h>
+#endif
+
 #define SIP_HALF_ROUND(a, b, c, d, s, t) \
 	a += b; \
 	c += d; \
@@ -43,6 +56,53 @@ using namespace cat;
 	SIP_HALF_ROUND(v0, v1, v2, v3, 13, 16); \
 	SIP_HALF_ROUND(v2, v1, v0, v3, 17, 21);
 
+// Mix the last 1..7 bytes at m with the length
+static CAT_INLINE u64 SipLastWord(const u8 *m, const u64 len)
+{
+	u64 last7 = len << 56;
+	switch (len & 7) {
+		case 7: last7 |= (u64)m[6] << 48;
+		case 6: last7 |= (u64)m[5] << 40;
+		case 5: last7 |= (u64)m[4] << 32;
+		case 4: last7 |= getLE(*(const u32 *)m); // low -> low
+				break;
+		case 3: last7 |= (u64)m[2] << 16;
+		case 2: last7 |= (u64)m[1] << 8;
+		case 1: last7 |= (u64)m[0];
+				break;
+	};
+	return last7;
+}
+
+// Absorb a whole input 8 bytes at a time, then mix in its length and finalize
+static CAT_INLINE void SipHashInput(u64 &v0, u64 &v1, u64 &v2, u64 &v3,
+									const void *data, const u64 len)
+{
+	// Perform SIP rounds on 8 bytes of input at a time
+	const u64 *m64 = (const u64 *)data;
+	u64 words = len >> 3;
+	while (words > 0) {
+		u64 mi = getLE(*m64++);
+
+		v3 ^= mi;
+		SIP_DOUBLE_ROUND(v0, v1, v2, v3);
+		v0 ^= mi;
+
+		--words;
+	}
+
+	// Mix the last 1..7 bytes with the length
+	u64 last7 = SipLastWord(reinterpret_cast<const u8 *>( m64 ), len);
+
+	// Final mix
+	v3 ^= last7;
+	SIP_DOUBLE_ROUND(v0, v1, v2, v3);
+	v0 ^= last7;
+	v2 ^= 0xff;
+	SIP_DOUBLE_ROUND(v0, v1, v2, v3);
+	SIP_DOUBLE_ROUND(v0, v1, v2, v3);
+}
+
 u64 cat::siphash24(const char key[16], const void *msg, const u64 msg_len,
 			  	   const u64 nonce, const void *ad, const u64 ad_len)
 {
@@ -64,83 +124,490 @@ u64 cat::siphash24(const char key[16], const void *msg, const u64 msg_len,
 	}
 
 	// Hash the message
-	{
-		// Perform SIP rounds on 8 bytes of input at a time
-		const u64 *m64 = (const u64 *)msg;
-		u64 words = msg_len >> 3;
-		while (words > 0) {
-			u64 mi = getLE(*m64++);
+	SipHashInput(v0, v1, v2, v3, msg, msg_len);
+
+	// Hash the AD, if needed
+	if (ad && ad_len > 0) {
+		SipHashInput(v0, v1, v2, v3, ad, ad_len);
+	}
+
+	return (v0 ^ v1) ^ (v2 ^ v3);
+}
+
 
-			v3 ^= mi;
-			SIP_DOUBLE_ROUND(v0, v1, v2, v3);
-			v0 ^= mi;
+//// Streaming
 
-			--words;
+void SipHasher::Init(const char key[16], const u64 nonce)
+{
+	// Convert key into two 64-bit integers
+	u64 k0 = getLE(*(const u64 *)key);
+	u64 k1 = getLE(*(const u64 *)(key + 8));
+
+	// Mix the key across initial state
+	u64 v0 = k0 ^ 0x736f6d6570736575ULL;
+	u64 v1 = k1 ^ 0x646f72616e646f6dULL;
+	u64 v2 = k0 ^ 0x6c7967656e657261ULL;
+	u64 v3 = k1 ^ 0x7465646279746573ULL;
+
+	// Mix in the nonce
+	v3 ^= nonce;
+	SIP_DOUBLE_ROUND(v0, v1, v2, v3);
+	v0 ^= nonce;
+
+	_v0 = v0;
+	_v1 = v1;
+	_v2 = v2;
+	_v3 = v3;
+	_length = 0;
+}
+
+void SipHasher::Update(const void *data, const u64 bytes)
+{
+	const u8 *m = reinterpret_cast<const u8 *>( data );
+	u64 remaining = bytes;
+	u32 buffered = (u32)_length & 7;
+
+	_length += bytes;
+
+	u64 v0 = _v0, v1 = _v1, v2 = _v2, v3 = _v3;
+
+	// If a word was left partly filled by the last fragment,
+	if (buffered > 0) {
+		u32 copy = 8 - buffered;
+
+		// If this fragment does not complete it either,
+		if (remaining < copy) {
+			memcpy(_buffer + buffered, m, (size_t)remaining);
+			return;
 		}
 
-		// Mix the last 1..7 bytes with the length
-		const u8 *m = reinterpret_cast<const u8 *>( m64 );
-		u64 last7 = msg_len << 56;
-		switch (msg_len & 7) {
-			case 7: last7 |= (u64)m[6] << 48;
-			case 6: last7 |= (u64)m[5] << 40;
-			case 5: last7 |= (u64)m[4] << 32;
-			case 4: last7 |= getLE(*(const u32 *)m); // low -> low
-					break;
-			case 3: last7 |= (u64)m[2] << 16;
-			case 2: last7 |= (u64)m[1] << 8;
-			case 1: last7 |= (u64)m[0];
-					break;
-		};
-
-		// Final mix
-		v3 ^= last7;
-		SIP_DOUBLE_ROUND(v0, v1, v2, v3);
-		v0 ^= last7;
-		v2 ^= 0xff;
+		memcpy(_buffer + buffered, m, copy);
+		m += copy;
+		remaining -= copy;
+
+		u64 mi = getLE(*(const u64 *)_buffer);
+
+		v3 ^= mi;
 		SIP_DOUBLE_ROUND(v0, v1, v2, v3);
+		v0 ^= mi;
+	}
+
+	// Perform SIP rounds on 8 bytes of input at a time
+	const u64 *m64 = (const u64 *)m;
+	u64 words = remaining >> 3;
+	while (words > 0) {
+		u64 mi = getLE(*m64++);
+
+		v3 ^= mi;
 		SIP_DOUBLE_ROUND(v0, v1, v2, v3);
+		v0 ^= mi;
+
+		--words;
 	}
 
+	// Hold the last 1..7 bytes until more arrive
+	memcpy(_buffer, m64, (size_t)(remaining & 7));
+
+	_v0 = v0;
+	_v1 = v1;
+	_v2 = v2;
+	_v3 = v3;
+}
+
+u64 SipHasher::Final(const void *ad, const u64 ad_len)
+{
+	u64 v0 = _v0, v1 = _v1, v2 = _v2, v3 = _v3;
+
+	// Mix the held bytes with the total length
+	u64 last7 = SipLastWord(_buffer, _length);
+
+	// Final mix
+	v3 ^= last7;
+	SIP_DOUBLE_ROUND(v0, v1, v2, v3);
+	v0 ^= last7;
+	v2 ^= 0xff;
+	SIP_DOUBLE_ROUND(v0, v1, v2, v3);
+	SIP_DOUBLE_ROUND(v0, v1, v2, v3);
+
 	// Hash the AD, if needed
 	if (ad && ad_len > 0) {
-		// Perform SIP rounds on 8 bytes of input at a time
-		const u64 *m64 = (const u64 *)ad;
-		u64 words = ad_len >> 3;
-		while (words > 0) {
-			u64 mi = getLE(*m64++);
+		SipHashInput(v0, v1, v2, v3, ad, ad_len);
+	}
+
+	return (v0 ^ v1) ^ (v2 ^ v3);
+}
+
+
+//// Batch
+
+/*
+	Every step of the hash has the form "v3 ^= a; v2 ^= b; two rounds; v0 ^= a":
+	the nonce and each message word are steps with b = 0, and finalization
+	is a step on the last word followed by (0, 0xff) and (0, 0).  Laying the
+	words of several inputs out side by side lets SIMD lanes run them in
+	lockstep, each lane taking its hash once its own steps are done.
+	Since b is only 0xff at the finalization steps, the kernels compare the
+	step number against those instead of loading it.
+*/
+
+// Lanes filled before running a kernel
+static const int SIP_BATCH_LANES = 8;
+
+// Steps a lane can hold, enough for 128 bytes of message and AD together
+static const int SIP_BATCH_MAX_STEPS = 1 + 16 + 3 + 3;
+
+// Never matches a step number
+static const u64 SIP_NO_STEP = ~(u64)0;
+
+struct SipSchedule
+{
+	u64 a[SIP_BATCH_MAX_STEPS][SIP_BATCH_LANES];
+	u64 final0[SIP_BATCH_LANES]; // Step that finalizes the message
+	u64 final1[SIP_BATCH_LANES]; // Step that finalizes the AD, or SIP_NO_STEP
+	u64 steps[SIP_BATCH_LANES]; // Steps taken by each lane
+	int max_steps;
+};
+
+// Returns the steps needed to hash the input, or 0 if it cannot be batched
+static CAT_INLINE int SipStepCount(const u64 msg_len, const void *ad, const u64 ad_len)
+{
+	if (msg_len > 8 * SIP_BATCH_MAX_STEPS || ad_len > 8 * SIP_BATCH_MAX_STEPS)
+		return 0;
+
+	int steps = 1 + (int)(msg_len >> 3) + 3;
+	if (ad && ad_len > 0)
+		steps += (int)(ad_len >> 3) + 3;
+
+	return steps <= SIP_BATCH_MAX_STEPS ? steps : 0;
+}
+
+// Lay out the words that absorb one input, returning the step after its
+// finalization.  The step that injects 0xff is stored in final_step
+static int SipScheduleInput(SipSchedule &sched, int lane, int step, const void *data, const u64 len,
+							u64 &final_step)
+{
+	const u64 *m64 = (const u64 *)data;
+	for (u64 words = len >> 3; words > 0; --words)
+		sched.a[step++][lane] = getLE(*m64++);
+
+	sched.a[step][lane] = SipLastWord(reinterpret_cast<const u8 *>( m64 ), len);
+	sched.a[step + 1][lane] = 0;
+	sched.a[step + 2][lane] = 0;
+	final_step = step + 1;
+
+	return step + 3;
+}
+
+static void SipScheduleLane(SipSchedule &sched, int lane, const void *msg, const u64 msg_len,
+							const u64 nonce, const void *ad, const u64 ad_len)
+{
+	sched.a[0][lane] = nonce;
+
+	int step = SipScheduleInput(sched, lane, 1, msg, msg_len, sched.final0[lane]);
+
+	if (ad && ad_len > 0)
+		step = SipScheduleInput(sched, lane, step, ad, ad_len, sched.final1[lane]);
+	else
+		sched.final1[lane] = SIP_NO_STEP;
+
+	sched.steps[lane] = step;
+	if (sched.max_steps < step)
+		sched.max_steps = step;
+}
+
+// Runs all SIP_BATCH_LANES lanes of the schedule from initial state v[]
+typedef void (*SipBatchFunc)(const u64 v[4], const SipSchedule &sched, u64 hashes[SIP_BATCH_LANES]);
+
+
+//// x86
 
-			v3 ^= mi;
-			SIP_DOUBLE_ROUND(v0, v1, v2, v3);
-			v0 ^= mi;
+#if defined(CAT_SIPHASH_X86_DISPATCH)
 
-			--words;
+#define SIP_AVX2_ROL(x, r) _mm256_or_si256(_mm256_slli_epi64(x, r), _mm256_srli_epi64(x, 64 - (r)))
+
+#define SIP_AVX2_HALF_ROUND(a, b, c, d, s, t) \
+	a = _mm256_add_epi64(a, b); \
+	c = _mm256_add_epi64(c, d); \
+	b = _mm256_xor_si256(SIP_AVX2_ROL(b, s), a); \
+	d = _mm256_xor_si256(SIP_AVX2_ROL(d, t), c); \
+	a = _mm256_shuffle_epi32(a, _MM_SHUFFLE(2, 3, 0, 1));
+
+#define SIP_AVX2_DOUBLE_ROUND(v0, v1, v2, v3) \
+	SIP_AVX2_HALF_ROUND(v0, v1, v2, v3, 13, 16); \
+	SIP_AVX2_HALF_ROUND(v2, v1, v0, v3, 17, 21); \
+	SIP_AVX2_HALF_ROUND(v0, v1, v2, v3, 13, 16); \
+	SIP_AVX2_HALF_ROUND(v2, v1, v0, v3, 17, 21);
+
+// One step for the four lanes from lane i, taking the hash of those that finish
+#define SIP_AVX2_STEP(v0, v1, v2, v3, h, i) { \
+	const __m256i a = _mm256_loadu_si256((const __m256i *)&sched.a[step][i]); \
+	const __m256i b = _mm256_and_si256(ff, _mm256_or_si256( \
+		_mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)&sched.final0[i]), n), \
+		_mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)&sched.final1[i]), n))); \
+	v3 = _mm256_xor_si256(v3, a); \
+	v2 = _mm256_xor_si256(v2, b); \
+	SIP_AVX2_DOUBLE_ROUND(v0, v1, v2, v3); \
+	v0 = _mm256_xor_si256(v0, a); \
+	const __m256i done = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *)&sched.steps[i]), n1); \
+	h = _mm256_blendv_epi8(h, _mm256_xor_si256(_mm256_xor_si256(v0, v1), _mm256_xor_si256(v2, v3)), done); }
+
+// Four lanes at a time, twice
+CAT_TARGET_AVX2 static void SipBatchAVX2(const u64 v[4], const SipSchedule &sched, u64 hashes[SIP_BATCH_LANES])
+{
+	const __m256i ff = _mm256_set1_epi64x(0xff);
+
+	for (int base = 0; base < SIP_BATCH_LANES; base += 4) {
+		__m256i v0 = _mm256_set1_epi64x(v[0]);
+		__m256i v1 = _mm256_set1_epi64x(v[1]);
+		__m256i v2 = _mm256_set1_epi64x(v[2]);
+		__m256i v3 = _mm256_set1_epi64x(v[3]);
+		__m256i h = _mm256_setzero_si256();
+
+		for (int step = 0; step < sched.max_steps; ++step) {
+			const __m256i n = _mm256_set1_epi64x(step);
+			const __m256i n1 = _mm256_set1_epi64x(step + 1);
+
+			SIP_AVX2_STEP(v0, v1, v2, v3, h, base);
 		}
 
-		// Mix the last 1..7 bytes with the length
-		const u8 *m = reinterpret_cast<const u8 *>( m64 );
-		u64 last7 = ad_len << 56;
-		switch (ad_len & 7) {
-			case 7: last7 |= (u64)m[6] << 48;
-			case 6: last7 |= (u64)m[5] << 40;
-			case 5: last7 |= (u64)m[4] << 32;
-			case 4: last7 |= getLE(*(const u32 *)m); // low -> low
-					break;
-			case 3: last7 |= (u64)m[2] << 16;
-			case 2: last7 |= (u64)m[1] << 8;
-			case 1: last7 |= (u64)m[0];
-					break;
-		};
-
-		// Final mix
-		v3 ^= last7;
-		SIP_DOUBLE_ROUND(v0, v1, v2, v3);
-		v0 ^= last7;
-		v2 ^= 0xff;
-		SIP_DOUBLE_ROUND(v0, v1, v2, v3);
-		SIP_DOUBLE_ROUND(v0, v1, v2, v3);
+		_mm256_storeu_si256((__m256i *)&hashes[base], h);
 	}
+}
 
-	return (v0 ^ v1) ^ (v2 ^ v3);
+#undef SIP_AVX2_STEP
+#undef SIP_AVX2_DOUBLE_ROUND
+#undef SIP_AVX2_HALF_ROUND
+#undef SIP_AVX2_ROL
+
+#define SIP_AVX512_HALF_ROUND(a, b, c, d, s, t) \
+	a = _mm512_add_epi64(a, b); \
+	c = _mm512_add_epi64(c, d); \
+	b = _mm512_xor_si512(_mm512_rol_epi64(b, s), a); \
+	d = _mm512_xor_si512(_mm512_rol_epi64(d, t), c); \
+	a = _mm512_rol_epi64(a, 32);
+
+#define SIP_AVX512_DOUBLE_ROUND(v0, v1, v2, v3) \
+	SIP_AVX512_HALF_ROUND(v0, v1, v2, v3, 13, 16); \
+	SIP_AVX512_HALF_ROUND(v2, v1, v0, v3, 17, 21); \
+	SIP_AVX512_HALF_ROUND(v0, v1, v2, v3, 13, 16); \
+	SIP_AVX512_HALF_ROUND(v2, v1, v0, v3, 17, 21);
+
+// One step for the eight lanes from lane i, taking the hash of those that finish
+#define SIP_AVX512_STEP(v0, v1, v2, v3, h, i) { \
+	const __m512i a = _mm512_loadu_si512(&sched.a[step][i]); \
+	const __mmask8 fin = _mm512_cmpeq_epi64_mask(_mm512_loadu_si512(&sched.final0[i]), n) | \
+						 _mm512_cmpeq_epi64_mask(_mm512_loadu_si512(&sched.final1[i]), n); \
+	v3 = _mm512_xor_si512(v3, a); \
+	v2 = _mm512_mask_xor_epi64(v2, fin, v2, ff); \
+	SIP_AVX512_DOUBLE_ROUND(v0, v1, v2, v3); \
+	v0 = _mm512_xor_si512(v0, a); \
+	const __mmask8 done = _mm512_cmpeq_epi64_mask(_mm512_loadu_si512(&sched.steps[i]), n1); \
+	h = _mm512_mask_mov_epi64(h, done, _mm512_ternarylogic_epi64(_mm512_xor_si512(v0, v1), v2, v3, 0x96)); }
+
+// All eight lanes in one register each
+CAT_TARGET_AVX512F static void SipBatchAVX512(const u64 v[4], const SipSchedule &sched, u64 hashes[SIP_BATCH_LANES])
+{
+	const __m512i ff = _mm512_set1_epi64(0xff);
+
+	__m512i v0 = _mm512_set1_epi64(v[0]);
+	__m512i v1 = _mm512_set1_epi64(v[1]);
+	__m512i v2 = _mm512_set1_epi64(v[2]);
+	__m512i v3 = _mm512_set1_epi64(v[3]);
+	__m512i h = _mm512_setzero_si512();
+
+	for (int step = 0; step < sched.max_steps; ++step) {
+		const __m512i n = _mm512_set1_epi64(step);
+		const __m512i n1 = _mm512_set1_epi64(step + 1);
+
+		SIP_AVX512_STEP(v0, v1, v2, v3, h, 0);
+	}
+
+	_mm512_storeu_si512(hashes, h);
 }
 
+#undef SIP_AVX512_STEP
+#undef SIP_AVX512_DOUBLE_ROUND
+#undef SIP_AVX512_HALF_ROUND
+
+static SipBatchFunc DetectKernel()
+{
+	if (HasCPUFeatures(CPU_AVX512F))
+		return SipBatchAVX512;
+	if (HasCPUFeatures(CPU_AVX2))
+		return SipBatchAVX2;
+	return 0;
+}
+
+#endif // CAT_SIPHASH_X86_DISPATCH
+
+
+//// NEON
+
+#if defined(CAT_SIPHASH_NEON)
+
+#define SIP_NEON_ROL(x, r) vsriq_n_u64(vshlq_n_u64(x, r), x, 64 - (r))
+
+#define SIP_NEON_HALF_ROUND(a, b, c, d, s, t) \
+	a = vaddq_u64(a, b); \
+	c = vaddq_u64(c, d); \
+	b = veorq_u64(SIP_NEON_ROL(b, s), a); \
+	d = veorq_u64(SIP_NEON_ROL(d, t), c); \
+	a = vreinterpretq_u64_u32(vrev64q_u32(vreinterpretq_u32_u64(a)));
+
+#define SIP_NEON_DOUBLE_ROUND(v0, v1, v2, v3) \
+	SIP_NEON_HALF_ROUND(v0, v1, v2, v3, 13, 16); \
+	SIP_NEON_HALF_ROUND(v2, v1, v0, v3, 17, 21); \
+	SIP_NEON_HALF_ROUND(v0, v1, v2, v3, 13, 16); \
+	SIP_NEON_HALF_ROUND(v2, v1, v0, v3, 17, 21);
+
+// One step for the two lanes from lane i, taking the hash of those that finish
+#define SIP_NEON_STEP(v0, v1, v2, v3, h, i) { \
+	const uint64x2_t a = vld1q_u64(&sched.a[step][i]); \
+	const uint64x2_t b = vandq_u64(ff, vorrq_u64(vceqq_u64(vld1q_u64(&sched.final0[i]), n), \
+												 vceqq_u64(vld1q_u64(&sched.final1[i]), n))); \
+	v3 = veorq_u64(v3, a); \
+	v2 = veorq_u64(v2, b); \
+	SIP_NEON_DOUBLE_ROUND(v0, v1, v2, v3); \
+	v0 = veorq_u64(v0, a); \
+	const uint64x2_t done = vceqq_u64(vld1q_u64(&sched.steps[i]), n1); \
+	h = vbslq_u64(done, veorq_u64(veorq_u64(v0, v1), veorq_u64(v2, v3)), h); }
+
+// Two lanes at a time
+static void SipBatchNEON(const u64 v[4], const SipSchedule &sched, u64 hashes[SIP_BATCH_LANES])
+{
+	const uint64x2_t ff = vdupq_n_u64(0xff);
+
+	for (int base = 0; base < SIP_BATCH_LANES; base += 2) {
+		uint64x2_t v0 = vdupq_n_u64(v[0]);
+		uint64x2_t v1 = vdupq_n_u64(v[1]);
+		uint64x2_t v2 = vdupq_n_u64(v[2]);
+		uint64x2_t v3 = vdupq_n_u64(v[3]);
+		uint64x2_t h = vdupq_n_u64(0);
+
+		for (int step = 0; step < sched.max_steps; ++step) {
+			const uint64x2_t n = vdupq_n_u64(step);
+			const uint64x2_t n1 = vdupq_n_u64(step + 1);
+
+			SIP_NEON_STEP(v0, v1, v2, v3, h, base);
+		}
+
+		vst1q_u64(&hashes[base], h);
+	}
+}
+
+#undef SIP_NEON_STEP
+#undef SIP_NEON_DOUBLE_ROUND
+#undef SIP_NEON_HALF_ROUND
+#undef SIP_NEON_ROL
+
+#endif // CAT_SIPHASH_NEON
+
+
+//// Dispatch
+
+#if defined(CAT_SIPHASH_X86_DISPATCH)
+
+static SipBatchFunc m_batch = 0;
+
+static CAT_INLINE SipBatchFunc GetBatchKernel()
+{
+	return BindKernel(m_batch, DetectKernel);
+}
+
+#elif defined(CAT_SIPHASH_NEON)
+
+static CAT_INLINE SipBatchFunc GetBatchKernel()
+{
+	return SipBatchNEON;
+}
+
+#else
+
+static CAT_INLINE SipBatchFunc GetBatchKernel()
+{
+	return 0;
+}
+
+#endif
+
+// Runs the scheduled lanes and stores each hash where it belongs
+static void SipRunBatch(SipBatchFunc kernel, const u64 v[4], SipSchedule &sched,
+						int lanes, const int *lane_index, u64 *hashes)
+{
+	// Unused lanes finish immediately
+	for (int lane = lanes; lane < SIP_BATCH_LANES; ++lane) {
+		sched.steps[lane] = 0;
+		sched.final0[lane] = SIP_NO_STEP;
+		sched.final1[lane] = SIP_NO_STEP;
+	}
+
+	// Lanes that finish early keep running on zeros
+	for (int lane = 0; lane < SIP_BATCH_LANES; ++lane) {
+		for (int step = (int)sched.steps[lane]; step < sched.max_steps; ++step)
+			sched.a[step][lane] = 0;
+	}
+
+	u64 results[SIP_BATCH_LANES];
+	kernel(v, sched, results);
+
+	for (int lane = 0; lane < lanes; ++lane)
+		hashes[lane_index[lane]] = results[lane];
+
+	sched.max_steps = 0;
+}
+
+void cat::siphash24_batch(const char key[16], int count, const void * const *msgs,
+						  const u64 *msg_lens, const u64 *nonces, u64 *hashes,
+						  const void * const *ads, const u64 *ad_lens)
+{
+	SipBatchFunc kernel = GetBatchKernel();
+
+	// If there is no vector kernel,
+	if (!kernel) {
+		for (int ii = 0; ii < count; ++ii) {
+			hashes[ii] = siphash24(key, msgs[ii], msg_lens[ii], nonces[ii],
+								   ads ? ads[ii] : 0, ad_lens ? ad_lens[ii] : 0);
+		}
+		return;
+	}
+
+	// Initial state shared by every lane
+	u64 k0 = getLE(*(const u64 *)key);
+	u64 k1 = getLE(*(const u64 *)(key + 8));
+	u64 v[4] = {
+		k0 ^ 0x736f6d6570736575ULL,
+		k1 ^ 0x646f72616e646f6dULL,
+		k0 ^ 0x6c7967656e657261ULL,
+		k1 ^ 0x7465646279746573ULL
+	};
+
+	SipSchedule sched;
+	int lane_index[SIP_BATCH_LANES];
+	int lanes = 0;
+
+	sched.max_steps = 0;
+
+	for (int ii = 0; ii < count; ++ii) {
+		const void *ad = ads ? ads[ii] : 0;
+		const u64 ad_len = ad_lens ? ad_lens[ii] : 0;
+
+		// If the input is too long for the lanes,
+		if (!SipStepCount(msg_lens[ii], ad, ad_len)) {
+			hashes[ii] = siphash24(key, msgs[ii], msg_lens[ii], nonces[ii], ad, ad_len);
+			continue;
+		}
+
+		SipScheduleLane(sched, lanes, msgs[ii], msg_lens[ii], nonces[ii], ad, ad_len);
+		lane_index[lanes++] = ii;
+
+		// If all lanes are full,
+		if (lanes == SIP_BATCH_LANES) {
+			SipRunBatch(kernel, v, sched, lanes, lane_index, hashes);
+			lanes = 0;
+		}
+	}
+
+	// Inputs left over after the last full batch
+	if (lanes > 0)
+		SipRunBatch(kernel, v, sched, lanes, lane_index, hashes);
+}
@@ -51,6 +51,32 @@ namespace cat {
 u64 siphash24(const char key[16], const void *msg, const u64 msg_len,
 			  const u64 nonce, const void *ad = 0, const u64 ad_len = 0);
 
+// Incremental form of siphash24() for messages split across buffers:
+// Init(), then Update() with each fragment in order, then Final().
+// The result matches siphash24() over the fragments joined together
+class CAT_EXPORT SipHasher
+{
+	u64 _v0, _v1, _v2, _v3;
+	u64 _length;	// Message bytes so far
+	u8 _buffer[8];	// Bytes of the word not yet complete
+
+public:
+	void Init(const char key[16], const u64 nonce);
+
+	void Update(const void *data, const u64 bytes);
+
+	// AD: Additional Data, can be null if not needed
+	u64 Final(const void *ad = 0, const u64 ad_len = 0);
+};
+
+// Hashes count independent messages under one key, writing the same values
+// siphash24() would into hashes[].  Short inputs run side by side in SIMD
+// lanes (AVX-512, AVX2 or NEON); longer ones use the scalar function.
+// ads and ad_lens can be null if not needed
+void siphash24_batch(const char key[16], int count, const void * const *msgs,
+					 const u64 *msg_lens, const u64 *nonces, u64 *hashes,
+					 const void * const *ads = 0, const u64 *ad_lens = 0);
+
 
 } // namespace cat
 
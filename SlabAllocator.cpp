@@ -0,0 +1,438 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "SlabAllocator.hpp"
+#include "SystemInfo.hpp"
+#include "Enforcer.hpp"
+using namespace cat;
+
+#if defined(CAT_OS_WINDOWS)
+# include <malloc.h>
+#else
+# include <stdlib.h>
+#endif
+
+
+//// Aligned heap memory
+
+static void *AllocateAligned(u32 alignment, u32 bytes)
+{
+#if defined(CAT_OS_WINDOWS)
+	return _aligned_malloc(bytes, alignment);
+#else
+	void *ptr;
+	if (posix_memalign(&ptr, alignment, bytes))
+		return 0;
+	return ptr;
+#endif
+}
+
+static void FreeAligned(void *ptr)
+{
+#if defined(CAT_OS_WINDOWS)
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+
+//// SlabAllocator
+
+SlabAllocator::SlabAllocator()
+{
+	_slab_bytes = 0;
+	_class_count = 0;
+
+	for (u32 ii = 0; ii < MAX_CLASSES; ++ii)
+	{
+		_classes[ii].free_head = 0;
+		_classes[ii].slabs = 0;
+	}
+}
+
+SlabAllocator::~SlabAllocator()
+{
+	Cleanup();
+}
+
+bool SlabAllocator::Initialize(u32 slab_bytes)
+{
+	Cleanup();
+
+	// If slab size is unspecified,
+	if (!slab_bytes)
+	{
+		u32 page_bytes = SystemInfo::ref()->GetPageSize();
+
+		// Use a multiple of the page size
+		slab_bytes = page_bytes;
+		while (slab_bytes < MIN_SLAB_BYTES)
+			slab_bytes <<= 1;
+	}
+
+	// Slabs must be a power of two so that buffers can find their slab by masking
+	if (!CAT_IS_POWER_OF_2(slab_bytes) || slab_bytes < 256)
+		return false;
+
+	// Largest class is 1/8th of a slab
+	u32 class_count = BSR32(slab_bytes) - 3 - MIN_CLASS_SHIFT + 1;
+	if (class_count > MAX_CLASSES)
+		class_count = MAX_CLASSES;
+
+	_slab_bytes = slab_bytes;
+	_class_count = class_count;
+
+	return true;
+}
+
+void SlabAllocator::Cleanup()
+{
+	// For each size class,
+	for (u32 ii = 0; ii < MAX_CLASSES; ++ii)
+	{
+		SizeClass *sc = &_classes[ii];
+
+		// For each slab,
+		for (SlabHead *next, *slab = sc->slabs; slab; slab = next)
+		{
+			next = slab->next;
+
+			FreeAligned(slab);
+		}
+
+		sc->free_head = 0;
+		sc->slabs = 0;
+	}
+
+	_slab_bytes = 0;
+	_class_count = 0;
+}
+
+u32 SlabAllocator::CarveSlab(u32 size_class, BatchSet &set)
+{
+	SlabHead *slab = reinterpret_cast<SlabHead*>( AllocateAligned(_slab_bytes, _slab_bytes) );
+	if (!slab) return 0;
+
+	CAT_ALLOC_STAT(_stats, HEAP_ALLOCS, 1);
+	CAT_ALLOC_STAT(_stats, HEAP_BYTES, _slab_bytes);
+
+	slab->size_class = size_class;
+	slab->bytes = 0;
+
+	// Small buffers are naturally aligned, larger ones are packed in behind the header
+	const u32 class_bytes = GetClassBytes(size_class);
+	u32 offset = class_bytes <= 256 ? class_bytes : HEADER_BYTES;
+
+	u8 *base = reinterpret_cast<u8*>( slab );
+	u32 count = 0;
+
+	set.Clear();
+
+	// For each buffer that fits in the slab,
+	for (; offset + class_bytes <= _slab_bytes; offset += class_bytes, ++count)
+		set.PushBack(reinterpret_cast<BatchHead*>( base + offset ));
+
+	// Link slab into class list
+	SizeClass *sc = &_classes[size_class];
+
+#ifdef CAT_THREADED_ALLOCATOR
+	CAT_ALLOC_LOCK(_stats, sc->lock, sc->lock_start);
+#endif
+	slab->next = sc->slabs;
+	sc->slabs = slab;
+#ifdef CAT_THREADED_ALLOCATOR
+	CAT_ALLOC_UNLOCK(_stats, sc->lock, sc->lock_start);
+#endif
+
+	return count;
+}
+
+void *SlabAllocator::AcquireLarge(u32 bytes)
+{
+	// Round up to the next page so that Resize() can make use of the slack
+	u32 page_bytes = SystemInfo::ref()->GetPageSize();
+	u32 total = CAT_CEIL(bytes + HEADER_BYTES, page_bytes);
+
+	// Guard against overflow
+	if (total < bytes) return 0;
+
+	// Align to the slab size so that the header can be found by masking
+	SlabHead *slab = reinterpret_cast<SlabHead*>( AllocateAligned(_slab_bytes, total) );
+	if (!slab) return 0;
+
+	CAT_ALLOC_STAT(_stats, ACQUIRES, 1);
+	CAT_ALLOC_STAT(_stats, HEAP_ALLOCS, 1);
+	CAT_ALLOC_STAT(_stats, HEAP_BYTES, total);
+
+	slab->next = 0;
+	slab->size_class = LARGE_CLASS;
+	slab->bytes = total - HEADER_BYTES;
+
+	return reinterpret_cast<u8*>( slab ) + HEADER_BYTES;
+}
+
+u32 SlabAllocator::GetBufferBytes(void *buffer)
+{
+	SlabHead *slab = GetSlab(buffer);
+
+	if (slab->size_class == LARGE_CLASS)
+		return slab->bytes;
+
+	return GetClassBytes(slab->size_class);
+}
+
+void *SlabAllocator::Acquire(u32 bytes)
+{
+	u32 size_class = GetClass(bytes);
+
+	// If too large for a size class,
+	if (size_class == LARGE_CLASS)
+		return AcquireLarge(bytes);
+
+	SizeClass *sc = &_classes[size_class];
+
+	// If it looks like the free list has more,
+	if (sc->free_head)
+	{
+#ifdef CAT_THREADED_ALLOCATOR
+		CAT_ALLOC_LOCK(_stats, sc->lock, sc->lock_start);
+#endif
+
+		BatchHead *buffer = sc->free_head;
+
+		// If found,
+		if (buffer)
+		{
+			sc->free_head = buffer->batch_next;
+
+#ifdef CAT_THREADED_ALLOCATOR
+			CAT_ALLOC_UNLOCK(_stats, sc->lock, sc->lock_start);
+#endif
+
+			CAT_ALLOC_STAT(_stats, ACQUIRES, 1);
+
+			return buffer;
+		}
+
+#ifdef CAT_THREADED_ALLOCATOR
+		CAT_ALLOC_UNLOCK(_stats, sc->lock, sc->lock_start);
+#endif
+	}
+
+	// Carve a new slab without lock held
+	BatchSet set;
+	if (!CarveSlab(size_class, set))
+		return 0;
+
+	// Keep all but the first buffer
+	BatchHead *buffer = set.head;
+	if (buffer != set.tail)
+		ReleaseClass(size_class, buffer->batch_next, set.tail);
+
+	CAT_ALLOC_STAT(_stats, ACQUIRES, 1);
+
+	return buffer;
+}
+
+void *SlabAllocator::Resize(void *ptr, u32 bytes)
+{
+	// If no buffer was given, acquire a new one
+	if (!ptr) return Acquire(bytes);
+
+	u32 old_bytes = GetBufferBytes(ptr);
+
+	// If it already fits,
+	if (bytes <= old_bytes)
+		return ptr;
+
+	void *buffer = Acquire(bytes);
+	if (!buffer) return 0;
+
+	memcpy(buffer, ptr, old_bytes);
+
+	Release(ptr);
+
+	return buffer;
+}
+
+void SlabAllocator::ReleaseClass(u32 size_class, BatchHead *head, BatchHead *tail)
+{
+	SizeClass *sc = &_classes[size_class];
+
+#ifdef CAT_THREADED_ALLOCATOR
+	CAT_ALLOC_LOCK(_stats, sc->lock, sc->lock_start);
+#endif
+	tail->batch_next = sc->free_head;
+	sc->free_head = head;
+#ifdef CAT_THREADED_ALLOCATOR
+	CAT_ALLOC_UNLOCK(_stats, sc->lock, sc->lock_start);
+#endif
+}
+
+void SlabAllocator::Release(void *ptr)
+{
+	if (!ptr) return;
+
+	CAT_ALLOC_STAT(_stats, RELEASES, 1);
+
+	SlabHead *slab = GetSlab(ptr);
+
+	// If it was a large allocation,
+	if (slab->size_class == LARGE_CLASS)
+	{
+		FreeAligned(slab);
+		return;
+	}
+
+	BatchHead *buffer = reinterpret_cast<BatchHead*>( ptr );
+
+	ReleaseClass(slab->size_class, buffer, buffer);
+}
+
+u32 SlabAllocator::AcquireBatch(BatchSet &set, u32 count, u32 bytes)
+{
+	set.Clear();
+
+	if (count <= 0) return 0;
+
+	if (bytes < sizeof(BatchHead))
+		bytes = sizeof(BatchHead);
+
+	u32 size_class = GetClass(bytes);
+
+	// Batches of large allocations are not supported
+	if (size_class == LARGE_CLASS)
+		return 0;
+
+	SizeClass *sc = &_classes[size_class];
+	u32 acquired = 0;
+
+#ifdef CAT_THREADED_ALLOCATOR
+	CAT_ALLOC_LOCK(_stats, sc->lock, sc->lock_start);
+#endif
+
+	BatchHead *head = sc->free_head;
+
+	// If found,
+	if (head)
+	{
+		// Walk up to count buffers off the front of the list
+		BatchHead *tail = head;
+		for (acquired = 1; acquired < count && tail->batch_next; ++acquired)
+			tail = tail->batch_next;
+
+		// Update list
+		sc->free_head = tail->batch_next;
+		tail->batch_next = 0;
+
+		set.head = head;
+		set.tail = tail;
+	}
+
+#ifdef CAT_THREADED_ALLOCATOR
+	CAT_ALLOC_UNLOCK(_stats, sc->lock, sc->lock_start);
+#endif
+
+	// While more buffers are needed,
+	while (acquired < count)
+	{
+		// Carve a new slab without lock held
+		BatchSet slab_set;
+		u32 carved = CarveSlab(size_class, slab_set);
+		if (!carved) break;
+
+		u32 needed = count - acquired;
+
+		// If the whole slab is needed,
+		if (carved <= needed)
+		{
+			set.PushBack(slab_set);
+			acquired += carved;
+			continue;
+		}
+
+		// Split the slab and keep the rest on the free list
+		BatchHead *tail = slab_set.head;
+		for (u32 ii = 1; ii < needed; ++ii)
+			tail = tail->batch_next;
+
+		BatchHead *rest = tail->batch_next;
+		tail->batch_next = 0;
+
+		set.PushBack(BatchSet(slab_set.head, tail));
+		acquired += needed;
+
+		ReleaseClass(size_class, rest, slab_set.tail);
+	}
+
+	CAT_ALLOC_STAT(_stats, BATCH_ACQUIRES, 1);
+	CAT_ALLOC_STAT(_stats, BATCH_ACQUIRED, acquired);
+
+	return acquired;
+}
+
+void SlabAllocator::ReleaseBatch(const BatchSet &set)
+{
+	BatchHead *node = set.head;
+
+	CAT_ALLOC_STAT(_stats, BATCH_RELEASES, 1);
+
+	// For each run of buffers from the same size class,
+	while (node)
+	{
+		CAT_ALLOC_STAT(_stats, BATCH_RELEASED, 1);
+
+		SlabHead *slab = GetSlab(node);
+		BatchHead *next = node->batch_next;
+
+		// If it was a large allocation,
+		if (slab->size_class == LARGE_CLASS)
+		{
+			FreeAligned(slab);
+			node = next;
+			continue;
+		}
+
+		u32 size_class = slab->size_class;
+		BatchHead *head = node, *tail = node;
+
+		// Extend the run while the next buffer is in the same class
+		while (next && GetSlab(next)->size_class == size_class)
+		{
+			CAT_ALLOC_STAT(_stats, BATCH_RELEASED, 1);
+
+			tail = next;
+			next = next->batch_next;
+		}
+
+		ReleaseClass(size_class, head, tail);
+
+		node = next;
+	}
+}
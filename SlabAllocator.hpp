@@ -0,0 +1,185 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_SLAB_ALLOCATOR_HPP
+#define CAT_SLAB_ALLOCATOR_HPP
+
+#include "IAllocator.hpp"
+#include "BitMath.hpp"
+#include "AllocatorStats.hpp"
+
+// If multi-threaded allocator is used,
+#ifdef CAT_THREADED_ALLOCATOR
+#include "Mutex.hpp"
+#endif
+
+namespace cat {
+
+
+/*
+	The slab allocator serves variable-sized requests out of power-of-two
+	size classes, from 16 bytes up to 1/8th of a slab.
+
+	Slabs are page-aligned runs of memory sized from SystemInfo::GetPageSize()
+	and each one holds buffers of a single size class.  The slab header at the
+	front of each slab records its class, so Release() finds the class of any
+	buffer by masking off the low bits of its address.
+
+	Requests larger than the biggest class get their own page-aligned run
+	with the same header, and are returned to the heap on Release().
+
+	Freed buffers are kept on a per-class free list for later re-use.  Slabs
+	are not returned to the heap until the allocator is destroyed.
+
+	Buffers are aligned to 16 bytes.
+
+	Allocation and deallocation are thread-safe when CAT_THREADED_ALLOCATOR
+	is defined, with one lock per size class.
+*/
+
+class CAT_EXPORT SlabAllocator : public IAllocator
+{
+	CAT_NO_COPY(SlabAllocator);
+
+	// Header at the front of each slab
+	struct SlabHead
+	{
+		SlabHead *next;
+		u32 size_class;		// LARGE_CLASS for large allocations
+		u32 bytes;			// Usable bytes for large allocations
+	};
+
+	static const u32 HEADER_BYTES = 16;
+	static const u32 MIN_CLASS_SHIFT = 4;
+	static const u32 MAX_CLASSES = 16;
+	static const u32 LARGE_CLASS = 0xffffffff;
+
+	// Slabs are at least this large, rounded up to a multiple of the page size
+	static const u32 MIN_SLAB_BYTES = 65536;
+
+	struct SizeClass
+	{
+#ifdef CAT_THREADED_ALLOCATOR
+		Mutex lock;
+#endif
+		BatchHead *free_head;
+		SlabHead *slabs;
+
+#ifdef CAT_ALLOCATOR_STATS
+		// Cycle count when the lock was taken, only touched with the lock held
+		u32 lock_start;
+#endif
+	};
+
+	u32 _slab_bytes, _class_count;
+	SizeClass _classes[MAX_CLASSES];
+
+#ifdef CAT_ALLOCATOR_STATS
+	AllocatorStats _stats;
+#endif
+
+	// Returns the size class for the given number of bytes, or LARGE_CLASS
+	CAT_INLINE u32 GetClass(u32 bytes)
+	{
+		if (bytes <= (1 << MIN_CLASS_SHIFT))
+			return 0;
+
+		u32 size_class = BSR32(bytes - 1) + 1 - MIN_CLASS_SHIFT;
+
+		return size_class < _class_count ? size_class : LARGE_CLASS;
+	}
+
+	CAT_INLINE u32 GetClassBytes(u32 size_class)
+	{
+		return (u32)1 << (size_class + MIN_CLASS_SHIFT);
+	}
+
+	CAT_INLINE SlabHead *GetSlab(void *buffer)
+	{
+		return reinterpret_cast<SlabHead*>( (uintptr_t)buffer & ~(uintptr_t)(_slab_bytes - 1) );
+	}
+
+	// Allocate and carve a new slab into a list of buffers
+	// Returns the number of buffers in the list, or 0 on failure
+	u32 CarveSlab(u32 size_class, BatchSet &set);
+
+	void *AcquireLarge(u32 bytes);
+
+	// Release a list of buffers that all belong to the same size class
+	void ReleaseClass(u32 size_class, BatchHead *head, BatchHead *tail);
+
+	void Cleanup();
+
+public:
+	SlabAllocator();
+	virtual ~SlabAllocator();
+
+	// Slab size defaults to a multiple of the page size
+	// Returns false on failure
+	bool Initialize(u32 slab_bytes = 0);
+
+	CAT_INLINE bool Valid() {
+		// Invalid until Initialize()
+		return _slab_bytes != 0;
+	}
+
+	CAT_INLINE u32 GetSlabBytes() {
+		return _slab_bytes;
+	}
+
+	// Largest request served from a size class rather than a private run
+	CAT_INLINE u32 GetMaxClassBytes() {
+		return GetClassBytes(_class_count - 1);
+	}
+
+#ifdef CAT_ALLOCATOR_STATS
+	CAT_INLINE void GetStats(AllocatorSnapshot &snapshot) {
+		_stats.Snapshot(snapshot);
+	}
+#endif
+
+	// Returns the number of usable bytes in a buffer
+	u32 GetBufferBytes(void *buffer);
+
+	void *Acquire(u32 bytes);
+	void *Resize(void *ptr, u32 bytes);
+	void Release(void *ptr);
+
+	// Acquire a number of buffers of the same size class, taking its lock once
+	// Bytes must be at least sizeof(BatchHead) and no larger than GetMaxClassBytes()
+	// Returns the number of buffers it was able to acquire
+	u32 AcquireBatch(BatchSet &set, u32 count, u32 bytes = 0);
+
+	// Release a number of buffers simultaneously, which may be of mixed size classes
+	void ReleaseBatch(const BatchSet &set);
+};
+
+
+} // namespace cat
+
+#endif // CAT_SLAB_ALLOCATOR_HPP
@@ -31,103 +31,115 @@
 
 #include "Platform.hpp"
 #include "Enforcer.hpp"
+#include "IAllocator.hpp"
 #include <stdlib.h>
+#include <string.h>
 
 namespace cat {
 
 
 //// SmartArray
 
-template<class T> class SmartArray {
-	static const int ALIGN = 8; // byte alignment
+/*
+	Growable array of plain data whose storage is aligned to ALIGN bytes,
+	so SIMD kernels can use aligned loads on it.  ALIGN must be a power of
+	two up to 128; 64 covers AVX-512 registers and most cache lines.
+
+	Storage comes from malloc unless an IAllocator is provided.  Growing
+	doubles the capacity and copies only the live elements, so appending
+	one element at a time is amortized O(1).  Elements are moved as bytes
+	and never constructed, so T must be plain old data.
 
+	Use swap() to hand a buffer to another array without copying it.
+*/
+template<class T, int ALIGN = 64> class SmartArray {
+	IAllocator *_allocator;
 	T *_data;
 	int _size, _alloc;
 
-	static T *aligned_malloc(int size) {
-		// Allocate memory
-		u8 *data = (u8 *)malloc(8 + sizeof(T) * size);
+	// Not copyable; use swap() to move the buffer instead
+	SmartArray(const SmartArray &);
+	SmartArray &operator=(const SmartArray &);
 
-		// Get pointer offset residual
-#ifdef CAT_WORD_64
-		int offset = (u32)(u64)data & 7;
-#else
-		int offset = (u32)data & 7;
-#endif
-
-		// Bump data pointer up to the next multiple of 8 bytes
-		data += 8 - offset;
-
-		// Record the offset right before start of data
-		data[-1] = offset;
-
-		return (T *)data;
-	}
-
-	// This version uses calloc to initialize the data
-	static T *aligned_malloc_zero(int size) {
-		// Allocate memory
-		u8 *data = (u8 *)calloc(8 + sizeof(T) * size, 1);
+	T *aligned_malloc(int size) {
+		// Allocate memory with room to bump the pointer up to ALIGN
+		u32 bytes = ALIGN + sizeof(T) * size;
+		u8 *data = _allocator ? (u8 *)_allocator->Acquire(bytes) : (u8 *)malloc(bytes);
+		if (!data) {
+			return 0;
+		}
 
 		// Get pointer offset residual
 #ifdef CAT_WORD_64
-		int offset = (u32)(u64)data & 7;
+		int offset = (u32)(u64)data & (ALIGN - 1);
 #else
-		int offset = (u32)data & 7;
+		int offset = (u32)data & (ALIGN - 1);
 #endif
 
-		// Bump data pointer up to the next multiple of 8 bytes
-		data += 8 - offset;
+		// Bump data pointer up to the next multiple of ALIGN bytes
+		offset = ALIGN - offset;
+		data += offset;
 
 		// Record the offset right before start of data
-		data[-1] = offset;
+		data[-1] = (u8)(offset - 1);
 
 		return (T *)data;
 	}
 
-	static void aligned_free(void *data) {
+	void aligned_free(void *data) {
 		u8 *orig = (u8 *)data;
 
-		CAT_DEBUG_ENFORCE(orig[-1] < 8);
+		CAT_DEBUG_ENFORCE(orig[-1] < ALIGN);
 
-		orig -= 8 - orig[-1];
+		orig -= orig[-1] + 1;
 
-		free(orig);
+		if (_allocator) {
+			_allocator->Release(orig);
+		} else {
+			free(orig);
+		}
 	}
 
 protected:
-	void alloc(int size) {
-		_data = aligned_malloc(size);
-		_alloc = size;
-	}
-
-	void grow(int size) {
-		if (_data) {
-			aligned_free(_data);
+	// Replace the buffer with one holding at least size elements,
+	// keeping the first keep elements
+	bool realloc(int size, int keep) {
+		// Grow geometrically so repeated appends do not copy every time
+		int count = _alloc * 2;
+		if (count < size) {
+			count = size;
 		}
 
-		alloc(size);
-	}
-
-	// Versions that call aligned_malloc_zero instead:
-
-	void allocZero(int size) {
-		_data = aligned_malloc_zero(size);
-		_alloc = size;
-	}
+		T *data = aligned_malloc(count);
+		if (!data) {
+			// Try again without the headroom
+			if (count == size || !(data = aligned_malloc(size))) {
+				return false;
+			}
+			count = size;
+		}
 
-	void growZero(int size) {
 		if (_data) {
+			if (keep > 0) {
+				memcpy(data, _data, keep * sizeof(T));
+			}
+
 			aligned_free(_data);
 		}
 
-		allocZero(size);
+		_data = data;
+		_alloc = count;
+		return true;
 	}
 
 public:
-	CAT_INLINE SmartArray() {
+	CAT_INLINE SmartArray(IAllocator *allocator = 0) {
+		CAT_DEBUG_ENFORCE(ALIGN > 0 && ALIGN <= 128 && (ALIGN & (ALIGN - 1)) == 0);
+
+		_allocator = allocator;
 		_data = 0;
 		_size = 0;
+		_alloc = 0;
 	}
 	CAT_INLINE virtual ~SmartArray() {
 		if (_data) {
@@ -136,28 +148,78 @@ public:
 		}
 	}
 
-	CAT_INLINE void resize(int size) {
-		if (!_data) {
-			alloc(size);
-		} else if (size > _alloc) {
-			grow(size);
+	// Must be called before the first allocation
+	CAT_INLINE void setAllocator(IAllocator *allocator) {
+		CAT_DEBUG_ENFORCE(!_data);
+
+		_allocator = allocator;
+	}
+
+	// Make room for size elements without changing the element count
+	CAT_INLINE bool reserve(int size) {
+		if (size <= _alloc) {
+			return true;
+		}
+
+		return realloc(size, _size);
+	}
+
+	// Change the element count, keeping existing elements
+	// Returns false if out of memory, leaving the array unchanged
+	CAT_INLINE bool resize(int size) {
+		if (size > _alloc && !realloc(size, _size)) {
+			return false;
 		}
 
 		_size = size;
+		return true;
 	}
 
 	// Resize and ensure it is zero (can be faster than just resizing)
-	CAT_INLINE void resizeZero(int size) {
-		if (!_data) {
-			allocZero(size);
-		} else if (size > _alloc) {
-			growZero(size);
-		} else {
-			void * CAT_RESTRICT data = _data;
+	CAT_INLINE bool resizeZero(int size) {
+		if (size > _alloc && !realloc(size, 0)) {
+			return false;
+		}
+
+		void * CAT_RESTRICT data = _data;
+		if (data) {
 			memset(data, 0x00, size * sizeof(T));
 		}
 
 		_size = size;
+		return true;
+	}
+
+	// Add one element to the end
+	CAT_INLINE bool append(const T &item) {
+		if (_size >= _alloc && !realloc(_size + 1, _size)) {
+			return false;
+		}
+
+		_data[_size++] = item;
+		return true;
+	}
+
+	// Keep the buffer for reuse
+	CAT_INLINE void clear() {
+		_size = 0;
+	}
+
+	// Exchange buffers and allocators with another array
+	CAT_INLINE void swap(SmartArray &other) {
+		IAllocator *allocator = _allocator;
+		T *data = _data;
+		int size = _size, alloc = _alloc;
+
+		_allocator = other._allocator;
+		_data = other._data;
+		_size = other._size;
+		_alloc = other._alloc;
+
+		other._allocator = allocator;
+		other._data = data;
+		other._size = size;
+		other._alloc = alloc;
 	}
 
 	CAT_INLINE void fill_00() {
@@ -178,6 +240,10 @@ public:
 		return _size;
 	}
 
+	CAT_INLINE int capacity() {
+		return _alloc;
+	}
+
 	CAT_INLINE T *get() {
 		CAT_DEBUG_ENFORCE(_data != 0);
 
@@ -0,0 +1,1147 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "SocketEngine.hpp"
+#include "SystemInfo.hpp"
+#include "Atomic.hpp"
+
+#if !defined(CAT_OS_WINDOWS)
+# include <sys/epoll.h>
+# include <sys/eventfd.h>
+# include <sys/socket.h>
+# include <fcntl.h>
+# include <errno.h>
+# include <pthread.h>
+# include <unistd.h>
+#endif
+
+#if defined(CAT_OS_LINUX)
+# include "IORing.hpp"
+#endif
+
+using namespace cat;
+
+enum OpTypes {
+	OP_RECV,
+	OP_SEND,
+	OP_RECVFROM,
+	OP_SENDTO,
+	OP_RECV_MULTISHOT,
+	OP_FILE_READ
+};
+
+#if defined(CAT_OS_LINUX)
+
+// Submission queue entries in each worker ring
+static const u32 RING_ENTRIES = 1024;
+
+// Completion tags that are not operations
+static const u64 WAKE_TAG = 0;
+static const u64 CANCEL_TAG = 1;
+static const u64 TIMER_TAG = 2; // Alternates with TIMER_TAG + 1 when a timeout is replaced
+
+#endif
+
+static CAT_INLINE bool IsReadOp(u32 type) {
+	return type == OP_RECV || type == OP_RECVFROM || type == OP_RECV_MULTISHOT;
+}
+
+
+//// SocketWorker
+
+class cat::SocketWorker : public Thread {
+	bool Entrypoint(void *param) {
+		_engine->WorkerLoop(this);
+		return true;
+	}
+
+public:
+	SocketEngine *_engine;
+
+	// Epoch observed before the last wait that has finished processing
+	volatile u32 _seen_epoch;
+
+#if defined(CAT_OS_LINUX)
+	// io_uring backend
+	IORing _ring;
+	Mutex _ring_lock; // Guards the submission queue and buffer ring
+	pthread_t _self;
+
+	// Timeout that wakes the worker for the timer wheel
+	__kernel_timespec _timeout;
+	bool _timeout_armed;
+	u64 _timeout_tag;
+#endif
+};
+
+
+//// SocketEngine
+
+SocketEngine::SocketEngine() {
+	_worker_count = 0;
+	_workers = 0;
+	_shutdown = false;
+	_timers = 0;
+
+#if defined(CAT_OS_WINDOWS)
+	_port = 0;
+#else
+	_epoll_fd = -1;
+	_wake_fd = -1;
+	_epoch = 0;
+	_retired = 0;
+#endif
+
+#if defined(CAT_OS_LINUX)
+	_use_ring = false;
+	_next_worker = 0;
+#endif
+}
+
+SocketEngine::~SocketEngine() {
+	SetTimers(0);
+	Shutdown();
+}
+
+bool SocketEngine::Initialize(u32 worker_count, bool use_io_uring) {
+	Shutdown();
+
+	u32 processor_count = SystemInfo::ref()->GetProcessorCount();
+
+	if (worker_count == 0) {
+		worker_count = processor_count;
+	}
+
+#if defined(CAT_OS_WINDOWS)
+	_port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, 0, 0, worker_count);
+	if (!_port) {
+		return false;
+	}
+#else
+	_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (_epoll_fd < 0) {
+		return false;
+	}
+
+	// Edge-triggered so that each write wakes a worker once
+	_wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (_wake_fd < 0) {
+		Shutdown();
+		return false;
+	}
+
+	epoll_event ev;
+	ev.events = EPOLLIN | EPOLLET;
+	ev.data.ptr = 0;
+	if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _wake_fd, &ev) < 0) {
+		Shutdown();
+		return false;
+	}
+#endif
+
+	_workers = new (std::nothrow) SocketWorker[worker_count];
+	if (!_workers) {
+		Shutdown();
+		return false;
+	}
+
+	_shutdown = false;
+
+#if defined(CAT_OS_LINUX)
+	// If each worker can get its own ring,
+	_use_ring = use_io_uring;
+	for (u32 ii = 0; _use_ring && ii < worker_count; ++ii) {
+		if (!_workers[ii]._ring.Initialize(RING_ENTRIES)) {
+			_use_ring = false;
+		}
+	}
+
+	// Fall back to epoll
+	if (!_use_ring) {
+		for (u32 ii = 0; ii < worker_count; ++ii) {
+			_workers[ii]._ring.Finalize();
+		}
+	}
+#endif
+
+	for (u32 ii = 0; ii < worker_count; ++ii) {
+		SocketWorker *worker = &_workers[ii];
+
+		worker->_engine = this;
+		worker->_seen_epoch = 0;
+#if defined(CAT_OS_LINUX)
+		CAT_OBJCLR(worker->_self);
+		worker->_timeout_armed = false;
+		worker->_timeout_tag = TIMER_TAG;
+#endif
+
+		if (!worker->StartThread()) {
+			_worker_count = ii;
+			Shutdown();
+			return false;
+		}
+
+		// Pinned on Linux, so wrap around when there are more workers than processors
+		worker->SetIdealCore(ii % processor_count);
+	}
+
+	_worker_count = worker_count;
+	return true;
+}
+
+void SocketEngine::Shutdown() {
+	_shutdown = true;
+
+#if defined(CAT_OS_WINDOWS)
+	// Wake each worker with an empty packet
+	for (u32 ii = 0; ii < _worker_count; ++ii) {
+		PostQueuedCompletionStatus(_port, 0, 0, 0);
+	}
+#endif
+
+#if defined(CAT_OS_LINUX)
+	// Wake each worker with an empty operation
+	for (u32 ii = 0; _use_ring && ii < _worker_count; ++ii) {
+		SocketWorker *worker = &_workers[ii];
+		AutoMutex lock(worker->_ring_lock);
+
+		io_uring_sqe *sqe = worker->_ring.GetSQE();
+		if (sqe) {
+			sqe->opcode = IORING_OP_NOP;
+			sqe->user_data = WAKE_TAG;
+		}
+
+		worker->_ring.Submit();
+	}
+#endif
+
+	for (u32 ii = 0; ii < _worker_count; ++ii) {
+		_workers[ii].WaitForThread();
+	}
+
+	delete []_workers;
+	_workers = 0;
+	_worker_count = 0;
+
+#if defined(CAT_OS_LINUX)
+	_use_ring = false;
+#endif
+
+#if defined(CAT_OS_WINDOWS)
+	if (_port) {
+		CloseHandle(_port);
+		_port = 0;
+	}
+#else
+	if (_epoll_fd >= 0) {
+		close(_epoll_fd);
+		_epoll_fd = -1;
+	}
+
+	if (_wake_fd >= 0) {
+		close(_wake_fd);
+		_wake_fd = -1;
+	}
+
+	// No worker remains to hold a pointer
+	Reclaim();
+#endif
+}
+
+void SocketEngine::SetTimers(TimerWheel *timers) {
+	TimerWheel *old_timers = _timers;
+
+	if (old_timers && old_timers != timers) {
+		TimerDelegate none;
+		none.Invalidate();
+		old_timers->SetWakeCallback(none);
+	}
+
+	_timers = timers;
+
+	if (timers) {
+		timers->SetWakeCallback(TimerDelegate::FromMember<SocketEngine, &SocketEngine::WakeForTimers>(this));
+
+		// Workers may be in a wait that did not account for the wheel
+		WakeForTimers();
+	}
+}
+
+void SocketEngine::WakeForTimers() {
+	if (_worker_count == 0) {
+		return;
+	}
+
+#if defined(CAT_OS_WINDOWS)
+	PostQueuedCompletionStatus(_port, 0, 0, 0);
+#else
+#if defined(CAT_OS_LINUX)
+	// Any worker can run the wheel, so wake the first ring
+	if (_use_ring) {
+		SocketWorker *worker = &_workers[0];
+		AutoMutex lock(worker->_ring_lock);
+
+		io_uring_sqe *sqe = worker->_ring.GetSQE();
+		if (sqe) {
+			sqe->opcode = IORING_OP_NOP;
+			sqe->user_data = WAKE_TAG;
+		}
+
+		worker->_ring.Submit();
+		return;
+	}
+#endif
+
+	// Fails only when the counter is saturated, so a wake is pending anyway
+	u64 count = 1;
+	ssize_t result = write(_wake_fd, &count, sizeof(count));
+	(void) result;
+#endif
+}
+
+bool SocketEngine::PostRecv(EngineSocket *socket, SocketOp *op) {
+	return Post(socket, op, OP_RECV);
+}
+
+bool SocketEngine::PostSend(EngineSocket *socket, SocketOp *op) {
+	return Post(socket, op, OP_SEND);
+}
+
+bool SocketEngine::PostRecvFrom(EngineSocket *socket, SocketOp *op) {
+	return Post(socket, op, OP_RECVFROM);
+}
+
+bool SocketEngine::PostSendTo(EngineSocket *socket, SocketOp *op) {
+	if (!op->addr.Unwrap(op->sa, op->sa_len, socket->_ipv6)) {
+		return false;
+	}
+
+	return Post(socket, op, OP_SENDTO);
+}
+
+
+#if defined(CAT_OS_WINDOWS)
+
+//// SocketEngine: I/O completion port
+
+EngineSocket *SocketEngine::Associate(Socket *socket) {
+	EngineSocket *engine_socket = new (std::nothrow) EngineSocket;
+	if (!engine_socket) {
+		return 0;
+	}
+
+	engine_socket->_s = socket->GetSocket();
+	engine_socket->_ipv6 = socket->SupportsIPv6();
+
+	if (!CreateIoCompletionPort((HANDLE)engine_socket->_s, _port, 0, 0)) {
+		delete engine_socket;
+		return 0;
+	}
+
+	return engine_socket;
+}
+
+void SocketEngine::Dissociate(EngineSocket *socket) {
+	// Pending operations complete with ERROR_OPERATION_ABORTED
+	CancelIoEx((HANDLE)socket->_s, 0);
+
+	delete socket;
+}
+
+bool SocketEngine::Post(EngineSocket *socket, SocketOp *op, u32 type) {
+	op->socket = socket;
+	op->type = type;
+	op->done = 0;
+
+	CAT_OBJCLR(op->ov);
+
+	WSABUF buf;
+	buf.buf = (char *)op->data;
+	buf.len = op->bytes;
+
+	DWORD flags = 0;
+	int result;
+
+	switch (type) {
+	case OP_RECV:
+		result = WSARecv(socket->_s, &buf, 1, 0, &flags, &op->ov, 0);
+		break;
+	case OP_SEND:
+		result = WSASend(socket->_s, &buf, 1, 0, 0, &op->ov, 0);
+		break;
+	case OP_RECVFROM:
+		op->sa_len = sizeof(op->sa);
+		result = WSARecvFrom(socket->_s, &buf, 1, 0, &flags, reinterpret_cast<sockaddr*>( &op->sa ),
+							 &op->sa_len, &op->ov, 0);
+		break;
+	default:
+		result = WSASendTo(socket->_s, &buf, 1, 0, 0, reinterpret_cast<sockaddr*>( &op->sa ),
+						   op->sa_len, &op->ov, 0);
+		break;
+	}
+
+	// If it did not complete or start in the background,
+	if (result == SOCKET_ERROR && WSAGetLastError() != WSA_IO_PENDING) {
+		return false;
+	}
+
+	return true;
+}
+
+void SocketEngine::WorkerLoop(SocketWorker *worker) {
+	for (;;) {
+		DWORD bytes = 0;
+		ULONG_PTR key;
+		OVERLAPPED *ov = 0;
+
+		TimerWheel *timers = _timers;
+		DWORD wait = timers ? timers->GetWaitMsec(INFINITE) : INFINITE;
+
+		BOOL success = GetQueuedCompletionStatus(_port, &bytes, &key, &ov, wait);
+
+		// If woken up without an operation,
+		if (!ov) {
+			if (_shutdown || (!success && GetLastError() != WAIT_TIMEOUT)) {
+				break;
+			}
+		} else {
+			SocketOp *op = reinterpret_cast<SocketOp*>( ov );
+			op->bytes = bytes;
+
+			if (success && op->type == OP_RECVFROM) {
+				op->addr.Wrap(reinterpret_cast<sockaddr*>( &op->sa ));
+			}
+
+			op->callback(op, success != FALSE);
+		}
+
+		if (timers && timers->IsDue()) {
+			timers->Tick();
+		}
+	}
+}
+
+#else // CAT_OS_WINDOWS
+
+
+//// SocketEngine: epoll
+
+// Perform an operation; returns 1 when done, 0 if it would block, -1 on error
+static int Perform(SocketHandle s, SocketOp *op) {
+	for (;;) {
+		ssize_t result;
+
+		switch (op->type) {
+		case OP_RECV:
+			result = recv(s, op->data, op->bytes, 0);
+			break;
+		case OP_SEND:
+			result = send(s, op->data + op->done, op->bytes - op->done, MSG_NOSIGNAL);
+			break;
+		case OP_RECVFROM:
+			op->sa_len = sizeof(op->sa);
+			result = recvfrom(s, op->data, op->bytes, 0, reinterpret_cast<sockaddr*>( &op->sa ), &op->sa_len);
+			break;
+		default:
+			result = sendto(s, op->data, op->bytes, MSG_NOSIGNAL, reinterpret_cast<sockaddr*>( &op->sa ), op->sa_len);
+			break;
+		}
+
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+		}
+
+		switch (op->type) {
+		case OP_SEND:
+			op->done += (u32)result;
+
+			// If only part of the stream was accepted, wait to send the rest
+			if (op->done < op->bytes) {
+				continue;
+			}
+			break;
+		case OP_RECVFROM:
+			op->addr.Wrap(reinterpret_cast<sockaddr*>( &op->sa ));
+			// Fall-thru
+		case OP_RECV:
+			op->bytes = (u32)result;
+			break;
+		}
+
+		return 1;
+	}
+}
+
+// Invoke callbacks for a list of finished operations
+static void CompleteList(SocketOp *head, bool success) {
+	while (head) {
+		SocketOp *next = head->next;
+		head->callback(head, success);
+		head = next;
+	}
+}
+
+EngineSocket *SocketEngine::Associate(Socket *socket) {
+	EngineSocket *engine_socket = new (std::nothrow) EngineSocket;
+	if (!engine_socket) {
+		return 0;
+	}
+
+	SocketHandle s = socket->GetSocket();
+
+	engine_socket->_s = s;
+	engine_socket->_ipv6 = socket->SupportsIPv6();
+	engine_socket->_armed = 0;
+	engine_socket->_closed = false;
+	engine_socket->_read_head = engine_socket->_read_tail = 0;
+	engine_socket->_write_head = engine_socket->_write_tail = 0;
+
+#if defined(CAT_OS_LINUX)
+	// If submitting through io_uring, spread the sockets over the rings
+	if (_use_ring) {
+		engine_socket->_worker = &_workers[Atomic::Add(&_next_worker, 1) % _worker_count];
+		engine_socket->_refs = 1;
+		return engine_socket;
+	}
+#endif
+
+	// Operations are performed by whichever worker sees the socket become ready
+	int flags = fcntl(s, F_GETFL, 0);
+
+	epoll_event ev;
+	ev.events = EPOLLONESHOT;
+	ev.data.ptr = engine_socket;
+
+	// Registered disarmed until an operation is posted
+	if (flags < 0 || fcntl(s, F_SETFL, flags | O_NONBLOCK) < 0 ||
+		epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, s, &ev) < 0) {
+		delete engine_socket;
+		return 0;
+	}
+
+	return engine_socket;
+}
+
+void SocketEngine::Dissociate(EngineSocket *socket) {
+#if defined(CAT_OS_LINUX)
+	if (_use_ring) {
+		SocketWorker *worker = socket->_worker;
+		AutoMutex lock(worker->_ring_lock);
+
+		socket->_closed = true;
+
+		// Operations in flight complete with -ECANCELED
+		io_uring_sqe *sqe = worker->_ring.GetSQE();
+		if (!sqe && worker->_ring.Submit()) {
+			sqe = worker->_ring.GetSQE();
+		}
+		if (sqe) {
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->fd = socket->_s;
+			sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+			sqe->user_data = CANCEL_TAG;
+		}
+
+		worker->_ring.Submit();
+		lock.Release();
+
+		// Freed after the last operation completes
+		ReleaseRef(socket);
+		return;
+	}
+#endif
+
+	AutoMutex lock(socket->_lock);
+
+	socket->_closed = true;
+	epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, socket->_s, 0);
+
+	SocketOp *reads = socket->_read_head;
+	SocketOp *writes = socket->_write_head;
+	socket->_read_head = socket->_read_tail = 0;
+	socket->_write_head = socket->_write_tail = 0;
+
+	lock.Release();
+
+	CompleteList(reads, false);
+	CompleteList(writes, false);
+
+	// Workers that start waiting after this epoch cannot see the socket
+	socket->_retire_epoch = Atomic::Add(&_epoch, 1) + 1;
+
+	AutoMutex retired_lock(_retired_lock);
+	socket->_retired_next = _retired;
+	_retired = socket;
+}
+
+bool SocketEngine::Arm(EngineSocket *socket) {
+	epoll_event ev;
+	ev.events = EPOLLONESHOT;
+
+	// A half-close only completes reads.  Waiting on it with just writes
+	// queued would wake at once, forever, without draining anything
+	if (socket->_read_head) ev.events |= EPOLLIN | EPOLLRDHUP;
+	if (socket->_write_head) ev.events |= EPOLLOUT;
+	ev.data.ptr = socket;
+
+	// If it is already waiting for these events,
+	if (socket->_armed == ev.events) {
+		return true;
+	}
+
+	if (epoll_ctl(_epoll_fd, EPOLL_CTL_MOD, socket->_s, &ev) != 0) {
+		return false;
+	}
+
+	socket->_armed = ev.events;
+	return true;
+}
+
+bool SocketEngine::Post(EngineSocket *socket, SocketOp *op, u32 type) {
+	op->socket = socket;
+	op->type = type;
+	op->done = 0;
+	op->next = 0;
+
+#if defined(CAT_OS_LINUX)
+	if (_use_ring) {
+		return SubmitToRing(socket->_worker, op);
+	}
+#endif
+
+	AutoMutex lock(socket->_lock);
+
+	if (socket->_closed) {
+		return false;
+	}
+
+	// Queue behind other operations in the same direction
+	if (IsReadOp(type)) {
+		if (socket->_read_tail) socket->_read_tail->next = op;
+		else socket->_read_head = op;
+		socket->_read_tail = op;
+	} else {
+		if (socket->_write_tail) socket->_write_tail->next = op;
+		else socket->_write_head = op;
+		socket->_write_tail = op;
+	}
+
+	// Re-arm covering the new direction; a ready socket fires at once
+	if (!Arm(socket)) {
+		// Take the operation back off the queue
+		SocketOp **head = IsReadOp(type) ? &socket->_read_head : &socket->_write_head;
+		SocketOp **tail = IsReadOp(type) ? &socket->_read_tail : &socket->_write_tail;
+
+		SocketOp *prev = 0;
+		for (SocketOp *ii = *head; ii != op; ii = ii->next) {
+			prev = ii;
+		}
+
+		if (prev) prev->next = 0;
+		else *head = 0;
+		*tail = prev;
+
+		return false;
+	}
+
+	return true;
+}
+
+// Perform queued operations until one would block; returns the finished ones
+static SocketOp *Drain(SocketHandle s, SocketOp *&head, SocketOp *&tail, bool disconnected, SocketOp *&failed) {
+	SocketOp *finished = 0, *finished_tail = 0;
+
+	while (head) {
+		SocketOp *op = head;
+
+		int result = disconnected ? -1 : Perform(s, op);
+		if (result == 0) {
+			break;
+		}
+
+		head = op->next;
+		if (!head) tail = 0;
+		op->next = 0;
+
+		// On error fail the rest too, since the socket is unusable
+		if (result < 0) {
+			op->next = head;
+			failed = op;
+			head = tail = 0;
+			break;
+		}
+
+		if (finished_tail) finished_tail->next = op;
+		else finished = op;
+		finished_tail = op;
+	}
+
+	return finished;
+}
+
+void SocketEngine::OnReady(EngineSocket *socket, u32 events) {
+	AutoMutex lock(socket->_lock);
+
+	// One-shot event was consumed
+	socket->_armed = 0;
+
+	if (socket->_closed) {
+		return;
+	}
+
+	bool error = (events & EPOLLERR) != 0;
+
+	SocketOp *read_failed = 0, *write_failed = 0;
+	SocketOp *reads = 0, *writes = 0;
+
+	// Hang-up still lets queued data be read, and reads of 0 bytes report it
+	if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+		reads = Drain(socket->_s, socket->_read_head, socket->_read_tail, false, read_failed);
+	}
+	if (events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+		writes = Drain(socket->_s, socket->_write_head, socket->_write_tail, error && !(events & EPOLLOUT), write_failed);
+	}
+
+	// If operations are still waiting, wait for the socket again
+	if (socket->_read_head || socket->_write_head) {
+		Arm(socket);
+	}
+
+	lock.Release();
+
+	CompleteList(reads, true);
+	CompleteList(writes, true);
+	CompleteList(read_failed, false);
+	CompleteList(write_failed, false);
+}
+
+void SocketEngine::Reclaim() {
+	u32 safe_epoch = _epoch;
+
+	// Find the oldest epoch any worker may still be processing
+	for (u32 ii = 0; ii < _worker_count; ++ii) {
+		u32 seen = _workers[ii]._seen_epoch;
+
+		if ((s32)(seen - safe_epoch) < 0) {
+			safe_epoch = seen;
+		}
+	}
+
+	AutoMutex lock(_retired_lock);
+
+	EngineSocket **prev = &_retired;
+	for (EngineSocket *socket = _retired, *next; socket; socket = next) {
+		next = socket->_retired_next;
+
+		// If every worker has started a wait since it was retired,
+		if ((s32)(safe_epoch - socket->_retire_epoch) >= 0) {
+			*prev = next;
+			delete socket;
+		} else {
+			prev = &socket->_retired_next;
+		}
+	}
+}
+
+void SocketEngine::WorkerLoop(SocketWorker *worker) {
+#if defined(CAT_OS_LINUX)
+	if (_use_ring) {
+		RingLoop(worker);
+		return;
+	}
+#endif
+
+	static const int MAX_EVENTS = 64;
+	epoll_event events[MAX_EVENTS];
+
+	while (!_shutdown) {
+		u32 epoch = _epoch;
+		Atomic::LoadMemoryBarrier();
+
+		TimerWheel *timers = _timers;
+		int wait = timers ? (int)timers->GetWaitMsec(WAIT_MSEC) : WAIT_MSEC;
+
+		int count = epoll_wait(_epoll_fd, events, MAX_EVENTS, wait);
+
+		for (int ii = 0; ii < count; ++ii) {
+			EngineSocket *socket = static_cast<EngineSocket*>( events[ii].data.ptr );
+
+			// If woken for the timer wheel, reset the eventfd
+			if (!socket) {
+				u64 wakes;
+				ssize_t result = read(_wake_fd, &wakes, sizeof(wakes));
+				(void) result;
+				continue;
+			}
+
+			OnReady(socket, events[ii].events);
+		}
+
+		if (timers && timers->IsDue()) {
+			timers->Tick();
+		}
+
+		// Done with every socket pointer from before this epoch
+		Atomic::StoreMemoryBarrier();
+		worker->_seen_epoch = epoch;
+
+		if (_retired) {
+			Reclaim();
+		}
+	}
+}
+
+#endif // CAT_OS_WINDOWS
+
+
+#if defined(CAT_OS_LINUX)
+
+//// SocketEngine: io_uring
+
+bool SocketEngine::SetupRecvBuffers(ReuseAllocator *allocator, u32 count) {
+	if (!_use_ring) {
+		return false;
+	}
+
+	for (u32 ii = 0; ii < _worker_count; ++ii) {
+		SocketWorker *worker = &_workers[ii];
+		AutoMutex lock(worker->_ring_lock);
+
+		if (!worker->_ring.SetupBufferRing(allocator, count)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool SocketEngine::PostRecvMultishot(EngineSocket *socket, SocketOp *op) {
+	// If no buffers were set up for the kernel to pick from,
+	if (!_use_ring || socket->_worker->_ring.GetRingBufferBytes() == 0) {
+		return false;
+	}
+
+	return Post(socket, op, OP_RECV_MULTISHOT);
+}
+
+void SocketEngine::ReleaseRecvBuffer(SocketOp *op) {
+	ReleaseRecvBuffer(op, op->buffer_id);
+
+	op->buffer_id = SocketOp::NO_BUFFER;
+}
+
+void SocketEngine::ReleaseRecvBuffer(SocketOp *op, u16 buffer_id) {
+	if (buffer_id == SocketOp::NO_BUFFER) {
+		return;
+	}
+
+	SocketWorker *worker = op->worker;
+	AutoMutex lock(worker->_ring_lock);
+
+	worker->_ring.RecycleRingBuffer(buffer_id);
+}
+
+bool SocketEngine::PostFileRead(int fd, u64 offset, SocketOp *op) {
+	if (!_use_ring) {
+		return false;
+	}
+
+	op->socket = 0;
+	op->type = OP_FILE_READ;
+	op->done = 0;
+	op->file_fd = fd;
+	op->offset = offset;
+
+	return SubmitToRing(&_workers[Atomic::Add(&_next_worker, 1) % _worker_count], op);
+}
+
+void SocketEngine::ReleaseRef(EngineSocket *socket) {
+	// If that was the last reference,
+	if (Atomic::Add(&socket->_refs, -1) == 1) {
+		delete socket;
+	}
+}
+
+bool SocketEngine::SubmitToRing(SocketWorker *worker, SocketOp *op) {
+	EngineSocket *socket = op->socket;
+
+	AutoMutex lock(worker->_ring_lock);
+
+	if (socket && socket->_closed) {
+		return false;
+	}
+
+	IORing *ring = &worker->_ring;
+
+	// If the queue is full, flush it and try again
+	io_uring_sqe *sqe = ring->GetSQE();
+	if (!sqe && ring->Submit()) {
+		sqe = ring->GetSQE();
+	}
+	if (!sqe) {
+		return false;
+	}
+
+	op->worker = worker;
+	op->buffer_id = SocketOp::NO_BUFFER;
+
+	switch (op->type) {
+	case OP_RECV:
+		sqe->opcode = IORING_OP_RECV;
+		sqe->addr = (u64)(uintptr_t)op->data;
+		sqe->len = op->bytes;
+		break;
+	case OP_SEND:
+		sqe->opcode = IORING_OP_SEND;
+		sqe->addr = (u64)(uintptr_t)(op->data + op->done);
+		sqe->len = op->bytes - op->done;
+		sqe->msg_flags = MSG_NOSIGNAL;
+		break;
+	case OP_RECVFROM:
+	case OP_SENDTO:
+		op->iov.iov_base = op->data;
+		op->iov.iov_len = op->bytes;
+
+		CAT_OBJCLR(op->msg);
+		op->msg.msg_name = &op->sa;
+		op->msg.msg_namelen = (op->type == OP_RECVFROM) ? sizeof(op->sa) : op->sa_len;
+		op->msg.msg_iov = &op->iov;
+		op->msg.msg_iovlen = 1;
+
+		sqe->opcode = (op->type == OP_RECVFROM) ? IORING_OP_RECVMSG : IORING_OP_SENDMSG;
+		sqe->addr = (u64)(uintptr_t)&op->msg;
+		sqe->len = 1;
+		sqe->msg_flags = (op->type == OP_SENDTO) ? MSG_NOSIGNAL : 0;
+		break;
+	case OP_RECV_MULTISHOT:
+		sqe->opcode = IORING_OP_RECV;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = IORing::BUFFER_GROUP;
+		break;
+	default:
+		sqe->opcode = IORING_OP_READ;
+		sqe->addr = (u64)(uintptr_t)op->data;
+		sqe->len = op->bytes;
+		sqe->off = op->offset;
+		break;
+	}
+
+	sqe->fd = socket ? socket->_s : op->file_fd;
+	sqe->user_data = (u64)(uintptr_t)op;
+
+	if (socket) {
+		Atomic::Add(&socket->_refs, 1);
+	}
+
+	// Posts from the worker's own callbacks go out with its next wait
+	if (!pthread_equal(pthread_self(), worker->_self)) {
+		ring->Submit();
+	}
+
+	return true;
+}
+
+void SocketEngine::OnRingCompletion(SocketWorker *worker, SocketOp *op, int result, u32 flags) {
+	EngineSocket *socket = op->socket;
+	bool success = result >= 0;
+
+	switch (op->type) {
+	case OP_SEND:
+		if (success) {
+			op->done += (u32)result;
+
+			// If the stream took only part of it, send the rest
+			if (op->done < op->bytes) {
+				if (result > 0 && SubmitToRing(worker, op)) {
+					ReleaseRef(socket);
+					return;
+				}
+
+				success = false;
+			}
+		}
+		break;
+
+	case OP_RECVFROM:
+		if (success) {
+			op->bytes = (u32)result;
+			op->addr.Wrap(reinterpret_cast<sockaddr*>( &op->sa ));
+		}
+		break;
+
+	case OP_RECV_MULTISHOT:
+		// If the kernel filled one of the ring buffers,
+		if (flags & IORING_CQE_F_BUFFER) {
+			op->buffer_id = (u16)(flags >> IORING_CQE_BUFFER_SHIFT);
+			op->data = worker->_ring.GetRingBuffer(op->buffer_id);
+			op->bytes = (u32)result;
+			op->callback(op, true);
+		}
+
+		// If the receive is still armed, it keeps its reference
+		if (flags & IORING_CQE_F_MORE) {
+			return;
+		}
+
+		// If it stopped after delivering data, re-arm it
+		if (result > 0 && SubmitToRing(worker, op)) {
+			ReleaseRef(socket);
+			return;
+		}
+
+		// End of stream or an error
+		op->buffer_id = SocketOp::NO_BUFFER;
+		op->data = 0;
+		op->bytes = 0;
+		success = (result == 0);
+		break;
+
+	default:
+		if (success) {
+			op->bytes = (u32)result;
+		}
+		break;
+	}
+
+	op->callback(op, success);
+
+	if (socket) {
+		ReleaseRef(socket);
+	}
+}
+
+void SocketEngine::RingLoop(SocketWorker *worker) {
+	IORing *ring = &worker->_ring;
+
+	worker->_self = pthread_self();
+
+	bool rearm = false;
+
+	for (;;) {
+		TimerWheel *timers = _timers;
+
+		// Hand over operations posted by the last round of callbacks
+		worker->_ring_lock.Enter();
+
+		// If woken because a timer is due sooner, replace the armed timeout
+		if (rearm && timers && worker->_timeout_armed) {
+			io_uring_sqe *sqe = ring->GetSQE();
+			if (sqe) {
+				sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+				sqe->fd = -1;
+				sqe->addr = worker->_timeout_tag;
+				sqe->user_data = CANCEL_TAG;
+
+				worker->_timeout_tag ^= 1;
+				worker->_timeout_armed = false;
+			}
+		}
+		rearm = false;
+
+		// If the wait should end in time for the timer wheel's next tick,
+		if (timers && !worker->_timeout_armed) {
+			io_uring_sqe *sqe = ring->GetSQE();
+			if (sqe) {
+				u32 wait = timers->GetWaitMsec(WAIT_MSEC);
+
+				worker->_timeout.tv_sec = wait / 1000;
+				worker->_timeout.tv_nsec = (wait % 1000) * 1000000;
+
+				sqe->opcode = IORING_OP_TIMEOUT;
+				sqe->fd = -1;
+				sqe->addr = (u64)&worker->_timeout;
+				sqe->len = 1;
+				sqe->user_data = worker->_timeout_tag;
+
+				worker->_timeout_armed = true;
+			}
+		}
+
+		ring->Submit();
+		worker->_ring_lock.Leave();
+
+		ring->Wait(1);
+
+		bool stop = false;
+
+		for (io_uring_cqe *cqe; (cqe = ring->PeekCQE()) != 0;) {
+			u64 user_data = cqe->user_data;
+			int result = cqe->res;
+			u32 flags = cqe->flags;
+
+			ring->SeenCQE();
+
+			if (user_data == WAKE_TAG) {
+				stop = _shutdown;
+				rearm = true;
+			} else if ((user_data & ~(u64)1) == TIMER_TAG) {
+				// A replaced timeout completes with the other tag
+				if (user_data == worker->_timeout_tag) {
+					worker->_timeout_armed = false;
+				}
+			} else if (user_data != CANCEL_TAG) {
+				OnRingCompletion(worker, reinterpret_cast<SocketOp*>( user_data ), result, flags);
+			}
+		}
+
+		if (timers && timers->IsDue()) {
+			timers->Tick();
+		}
+
+		if (stop) {
+			break;
+		}
+	}
+}
+
+#else // CAT_OS_LINUX
+
+bool SocketEngine::SetupRecvBuffers(ReuseAllocator *allocator, u32 count) {
+	return false;
+}
+
+bool SocketEngine::PostRecvMultishot(EngineSocket *socket, SocketOp *op) {
+	return false;
+}
+
+void SocketEngine::ReleaseRecvBuffer(SocketOp *op) {
+}
+
+void SocketEngine::ReleaseRecvBuffer(SocketOp *op, u16 buffer_id) {
+}
+
+bool SocketEngine::PostFileRead(int fd, u64 offset, SocketOp *op) {
+	return false;
+}
+
+#endif // CAT_OS_LINUX
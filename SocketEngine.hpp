@@ -0,0 +1,286 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_SOCKET_ENGINE_HPP
+#define CAT_SOCKET_ENGINE_HPP
+
+#include "Sockets.hpp"
+#include "Delegates.hpp"
+#include "Thread.hpp"
+#include "Mutex.hpp"
+#include "TimerWheel.hpp"
+
+#if defined(CAT_OS_LINUX)
+# include <sys/socket.h>
+# include <sys/uio.h>
+#endif
+
+/*
+	Completion engine for sockets
+
+	Sockets are associated with the engine, and then reads and writes are
+	posted to them.  When an operation finishes, its callback is invoked on
+	one of the engine worker threads.  Idle sockets cost no thread time, so
+	tens of thousands of mostly idle connections are fine.
+
+	On Windows this is a thin layer over an I/O completion port, driving the
+	overlapped sockets that Sockets::Create() makes.
+
+	On Linux each socket is armed one-shot on a shared epoll set for the
+	directions that have operations waiting.  The worker that receives the
+	event performs the queued operations until the socket would block, so
+	both platforms look like completions to the caller.
+
+	Operations in each direction complete in the order they were posted.
+	A callback may post the next operation on the same socket.
+
+	io_uring backend (Linux)
+
+	Initialize() can be asked to submit through io_uring instead, with one
+	ring per worker.  Each socket is bound to one worker's ring.  Operations
+	posted from that worker's callbacks are batched and handed to the kernel
+	in the same system call that waits for the next completions.
+
+	Multishot receive keeps one receive armed that completes repeatedly into
+	buffers the kernel picks from a ring registered from a ReuseAllocator
+	with SetupRecvBuffers().  File reads can also be posted in this mode.
+
+	The kernel may reorder two stream sends that are in flight at once, so
+	with io_uring post the next TCP send from the previous one's callback.
+
+	Timers
+
+	A TimerWheel handed to SetTimers() is driven by the workers: each one
+	limits its wait to the wheel's next tick and runs the timer callbacks
+	that are due alongside socket completions.  Setting a timer that is due
+	before the workers would wake up interrupts a wait with an empty packet
+	on Windows, an eventfd with epoll and a NOP with io_uring.
+*/
+
+namespace cat {
+
+
+class SocketEngine;
+class SocketWorker;
+class EngineSocket;
+struct SocketOp;
+
+// Called with the finished operation and whether it succeeded
+typedef Delegate2<void, SocketOp *, bool> SocketOpCallback;
+
+
+//// SocketOp
+
+// A pending read or write, owned by the caller until its callback runs
+struct CAT_EXPORT SocketOp {
+#if defined(CAT_OS_WINDOWS)
+	OVERLAPPED ov; // Must be first
+#endif
+
+	// Filled in by the caller:
+	u8 *data;		// Buffer to read into or write from
+	u32 bytes;		// Buffer size when posted, bytes transferred on completion
+	UNetAddr addr;	// Destination for SendTo, source after RecvFrom
+	SocketOpCallback callback;
+
+	// Used by the engine:
+	SocketOp *next;
+	EngineSocket *socket;
+	u32 type, done;
+	UNetAddr::SockAddr sa;
+	socklen_t sa_len;
+
+#if defined(CAT_OS_LINUX)
+	// io_uring:
+	msghdr msg;
+	iovec iov;
+	SocketWorker *worker;	// Ring the operation was submitted to
+	u16 buffer_id;			// Ring buffer holding a multishot receive, or NO_BUFFER
+	int file_fd;			// File and position for PostFileRead
+	u64 offset;
+
+	static const u16 NO_BUFFER = 0xffff;
+#endif
+};
+
+
+//// EngineSocket
+
+// Returned by SocketEngine::Associate() to post operations on
+class CAT_EXPORT EngineSocket {
+	friend class SocketEngine;
+
+	SocketHandle _s;
+	bool _ipv6;
+
+#if !defined(CAT_OS_WINDOWS)
+	Mutex _lock;
+	u32 _armed; // Events the socket is armed for, or 0
+	bool _closed;
+
+	// Operations waiting for the socket to become ready
+	SocketOp *_read_head, *_read_tail;
+	SocketOp *_write_head, *_write_tail;
+
+	// Freed once no worker can still hold a pointer from epoll
+	EngineSocket *_retired_next;
+	u32 _retire_epoch;
+
+	// With io_uring: ring that the operations are submitted to, and one
+	// reference held by Associate() plus one for each operation in flight
+	SocketWorker *_worker;
+	volatile u32 _refs;
+#endif
+
+public:
+	CAT_INLINE SocketHandle GetSocket() {
+		return _s;
+	}
+};
+
+
+//// SocketEngine
+
+class CAT_EXPORT SocketEngine {
+	friend class SocketWorker;
+
+	u32 _worker_count;
+	SocketWorker *_workers;
+	volatile bool _shutdown;
+	TimerWheel * volatile _timers;
+
+#if defined(CAT_OS_WINDOWS)
+	HANDLE _port;
+#else
+	// Longest time a worker waits before checking for shutdown and reclaiming
+	static const int WAIT_MSEC = 100;
+
+	int _epoll_fd;
+	int _wake_fd; // eventfd in the epoll set that interrupts waits for timers
+
+	// Advanced each time a socket is retired
+	volatile u32 _epoch;
+
+	Mutex _retired_lock;
+	EngineSocket *_retired;
+
+	bool Arm(EngineSocket *socket);
+	void OnReady(EngineSocket *socket, u32 events);
+	void Reclaim();
+#endif
+
+#if defined(CAT_OS_LINUX)
+	bool _use_ring;
+	volatile u32 _next_worker;
+
+	bool SubmitToRing(SocketWorker *worker, SocketOp *op);
+	void OnRingCompletion(SocketWorker *worker, SocketOp *op, int result, u32 flags);
+	void ReleaseRef(EngineSocket *socket);
+	void RingLoop(SocketWorker *worker);
+#endif
+
+	bool Post(EngineSocket *socket, SocketOp *op, u32 type);
+	void WorkerLoop(SocketWorker *worker);
+
+	// Wake a worker so that it shortens its wait for the timer wheel
+	void WakeForTimers();
+
+public:
+	SocketEngine();
+	virtual ~SocketEngine();
+
+	// Start worker_count threads, or one per processor if 0, each given the
+	// processor with the same index (modulo the processor count) as its
+	// ideal core, which pins it on Linux.  With use_io_uring
+	// the engine submits through io_uring if the kernel supports it, and
+	// otherwise falls back to epoll
+	bool Initialize(u32 worker_count = 0, bool use_io_uring = false);
+
+	CAT_INLINE bool UsingIORing() {
+#if defined(CAT_OS_LINUX)
+		return _use_ring;
+#else
+		return false;
+#endif
+	}
+
+	// Wait for the worker threads to exit
+	void Shutdown();
+
+	CAT_INLINE u32 GetWorkerCount() {
+		return _worker_count;
+	}
+
+	// Have the workers run the wheel's timers, or stop with 0.  The wheel
+	// must outlive the engine or be removed first
+	void SetTimers(TimerWheel *timers);
+
+	// Returns 0 on failure.  On Linux the socket is made non-blocking
+	EngineSocket *Associate(Socket *socket);
+
+	// Stop driving a socket before closing it.  On Linux pending operations
+	// complete with failure right away; on Windows they are cancelled and
+	// complete with failure on a worker thread
+	void Dissociate(EngineSocket *socket);
+
+	// Return false if the operation could not be started, in which case the
+	// callback will not be invoked
+
+	// TCP
+	bool PostRecv(EngineSocket *socket, SocketOp *op);
+	bool PostSend(EngineSocket *socket, SocketOp *op);
+
+	// UDP
+	bool PostRecvFrom(EngineSocket *socket, SocketOp *op);
+	bool PostSendTo(EngineSocket *socket, SocketOp *op);
+
+	// io_uring only:
+
+	// Register count buffers (power of two) per worker for multishot receive
+	bool SetupRecvBuffers(ReuseAllocator *allocator, u32 count);
+
+	// Completes once per received datagram or stream chunk, with data and
+	// bytes set to a ring buffer that must be handed back with
+	// ReleaseRecvBuffer().  Datagram sources are not reported.  Completes a
+	// last time with 0 bytes when the stream ends, or with failure on error
+	// or when every ring buffer is still held, after which it may be posted
+	// again.  The next completion overwrites data and buffer_id, so the
+	// callback must either release the buffer before returning or save
+	// buffer_id and pass it to the second form of ReleaseRecvBuffer() later
+	bool PostRecvMultishot(EngineSocket *socket, SocketOp *op);
+	void ReleaseRecvBuffer(SocketOp *op);
+	void ReleaseRecvBuffer(SocketOp *op, u16 buffer_id);
+
+	// Read from a file at an offset, such as one opened by MappedFile
+	bool PostFileRead(int fd, u64 offset, SocketOp *op);
+};
+
+
+} // namespace cat
+
+#endif // CAT_SOCKET_ENGINE_HPP
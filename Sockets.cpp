@@ -27,6 +27,9 @@
 */
 
 #include "Sockets.hpp"
+#include "ReuseAllocator.hpp"
+#include "SystemInfo.hpp"
+#include "SipHash.hpp"
 using namespace cat;
 
 #if defined(CAT_COMPILER_MSVC)
@@ -36,6 +39,14 @@ using namespace cat;
 #if !defined(CAT_OS_WINDOWS)
 #include <arpa/inet.h>
 #include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#endif
+
+#if defined(CAT_OS_LINUX)
+#include <linux/errqueue.h>
+#include <linux/filter.h>
+#include <netinet/in.h>
 #endif
 
 // Fix missing definitions (mainly for MinGW):
@@ -48,6 +59,39 @@ using namespace cat;
 # define SIO_UDP_CONNRESET _WSAIOW(IOC_VENDOR,12)
 #endif
 
+#if defined(CAT_OS_LINUX)
+# if !defined(SOL_UDP)
+#  define SOL_UDP 17
+# endif
+# if !defined(UDP_SEGMENT)
+#  define UDP_SEGMENT 103
+# endif
+# if !defined(UDP_GRO)
+#  define UDP_GRO 104
+# endif
+# if !defined(SO_REUSEPORT)
+#  define SO_REUSEPORT 15
+# endif
+# if !defined(SO_INCOMING_CPU)
+#  define SO_INCOMING_CPU 49
+# endif
+# if !defined(SO_ATTACH_REUSEPORT_CBPF)
+#  define SO_ATTACH_REUSEPORT_CBPF 51
+# endif
+# if !defined(SO_ZEROCOPY)
+#  define SO_ZEROCOPY 60
+# endif
+# if !defined(MSG_ZEROCOPY)
+#  define MSG_ZEROCOPY 0x4000000
+# endif
+# if !defined(SO_EE_ORIGIN_ZEROCOPY)
+#  define SO_EE_ORIGIN_ZEROCOPY 5
+# endif
+# if !defined(SO_EE_CODE_ZEROCOPY_COPIED)
+#  define SO_EE_CODE_ZEROCOPY_COPIED 1
+# endif
+#endif
+
 
 //// Socket
 
@@ -103,6 +147,21 @@ bool Socket::SetRecvBufferSize(int bytes) {
 	return true;
 }
 
+bool Socket::SetReusePort(bool enable) {
+#if defined(SO_REUSEPORT)
+	int on = enable ? 1 : 0;
+
+	if (setsockopt(_s, SOL_SOCKET, SO_REUSEPORT, (const char *)&on, sizeof(on))) {
+		return !enable;
+	}
+
+	return true;
+#else
+	// Windows SO_REUSEADDR allows port hijacking rather than load sharing
+	return !enable;
+#endif
+}
+
 bool Socket::Bind(Port port) {
 	// Bind the socket to a given port
 	if (!Sockets::NetBind(_s, port, _support6)) {
@@ -114,9 +173,49 @@ bool Socket::Bind(Port port) {
 	return true;
 }
 
+bool Socket::SetIncomingCPU(int cpu) {
+#if defined(CAT_OS_LINUX)
+	if (setsockopt(_s, SOL_SOCKET, SO_INCOMING_CPU, (const char *)&cpu, sizeof(cpu))) {
+		return false;
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool Socket::SteerByCPU(u32 group_size) {
+#if defined(CAT_OS_LINUX)
+	if (group_size == 0) {
+		return false;
+	}
+
+	// Classic BPF program returning the socket index: cpu % group_size
+	sock_filter code[] = {
+		{ BPF_LD | BPF_W | BPF_ABS, 0, 0, (u32)(SKF_AD_OFF + SKF_AD_CPU) },
+		{ BPF_ALU | BPF_MOD | BPF_K, 0, 0, group_size },
+		{ BPF_RET | BPF_A, 0, 0, 0 }
+	};
+
+	sock_fprog prog;
+	prog.len = sizeof(code) / sizeof(code[0]);
+	prog.filter = code;
+
+	if (setsockopt(_s, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, (const char *)&prog, sizeof(prog))) {
+		return false;
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
 void Socket::Close() {
 	if (_s != INVALID_SOCKET) {
 		CloseSocketHandle(_s);
+		_s = INVALID_SOCKET;
 	}
 }
 
@@ -154,6 +253,688 @@ bool UDPSocket::DontFragment(bool df)
 	return true;
 }
 
+bool UDPSocket::EnableGSO(bool enable) {
+#if defined(CAT_OS_LINUX)
+	if (enable) {
+		// Segment size is given with each send, so only probe for support here
+		int segment = 0;
+
+		if (setsockopt(GetSocket(), SOL_UDP, UDP_SEGMENT, (const char *)&segment, sizeof(segment))) {
+			_gso = false;
+			return false;
+		}
+	}
+
+	_gso = enable;
+	return true;
+#else
+	_gso = false;
+	return !enable;
+#endif
+}
+
+bool UDPSocket::EnableGRO(bool enable) {
+#if defined(CAT_OS_LINUX)
+	int on = enable ? 1 : 0;
+
+	if (setsockopt(GetSocket(), SOL_UDP, UDP_GRO, (const char *)&on, sizeof(on))) {
+		_gro = false;
+		return !enable;
+	}
+
+	_gro = enable;
+	return true;
+#else
+	_gro = false;
+	return !enable;
+#endif
+}
+
+// Returns true if the last socket error means no datagram was waiting
+static bool LastErrorWouldBlock() {
+#if defined(CAT_OS_WINDOWS)
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+#if !defined(CAT_OS_LINUX)
+
+// Returns true if another datagram can be read without blocking
+static bool DatagramWaiting(SocketHandle s) {
+#if defined(CAT_OS_WINDOWS)
+	u_long waiting = 0;
+
+	if (ioctlsocket(s, FIONREAD, &waiting) == SOCKET_ERROR) {
+		return false;
+	}
+#else
+	int waiting = 0;
+
+	if (ioctl(s, FIONREAD, &waiting) < 0) {
+		return false;
+	}
+#endif
+
+	return waiting > 0;
+}
+
+#endif // CAT_OS_LINUX
+
+int UDPSocket::RecvBatch(ReuseAllocator *allocator, BatchSet &set, u32 max_count) {
+	set.Clear();
+
+	const u32 buffer_bytes = allocator->GetBufferBytes();
+	if (buffer_bytes <= sizeof(UDPBuffer)) {
+		return -1;
+	}
+	const u32 data_bytes = buffer_bytes - sizeof(UDPBuffer);
+
+	if (max_count > MAX_BATCH) {
+		max_count = MAX_BATCH;
+	}
+
+	BatchSet buffers;
+	u32 count = allocator->AcquireBatch(buffers, max_count);
+	if (count == 0) {
+		return -1;
+	}
+
+	UDPBuffer *list[MAX_BATCH];
+	UNetAddr::SockAddr addrs[MAX_BATCH];
+
+	BatchHead *node = buffers.head;
+	for (u32 ii = 0; ii < count; ++ii, node = node->batch_next) {
+		list[ii] = static_cast<UDPBuffer*>( node );
+	}
+
+	int received = 0;
+
+#if defined(CAT_OS_LINUX)
+
+	mmsghdr msgs[MAX_BATCH];
+	iovec iovs[MAX_BATCH];
+
+	// Room for the coalesced segment size reported with GRO
+	static const int CONTROL_BYTES = CMSG_SPACE(sizeof(int));
+	u64 controls[MAX_BATCH][(CONTROL_BYTES + 7) / 8];
+
+	for (u32 ii = 0; ii < count; ++ii) {
+		iovs[ii].iov_base = list[ii]->GetData();
+		iovs[ii].iov_len = data_bytes;
+
+		CAT_OBJCLR(msgs[ii].msg_hdr);
+		msgs[ii].msg_hdr.msg_name = &addrs[ii];
+		msgs[ii].msg_hdr.msg_namelen = sizeof(addrs[ii]);
+		msgs[ii].msg_hdr.msg_iov = &iovs[ii];
+		msgs[ii].msg_hdr.msg_iovlen = 1;
+
+		if (_gro) {
+			msgs[ii].msg_hdr.msg_control = controls[ii];
+			msgs[ii].msg_hdr.msg_controllen = CONTROL_BYTES;
+		}
+	}
+
+	// Wait for the first datagram only, then take whatever else is queued
+	received = recvmmsg(GetSocket(), msgs, count, MSG_WAITFORONE, 0);
+
+	for (int ii = 0; ii < received; ++ii) {
+		list[ii]->bytes = msgs[ii].msg_len;
+		list[ii]->segment_bytes = 0;
+
+		// If GRO coalesced several datagrams into this buffer,
+		if (_gro) {
+			msghdr *msg = &msgs[ii].msg_hdr;
+
+			for (cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+				if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+					int segment;
+					memcpy(&segment, CMSG_DATA(cmsg), sizeof(segment));
+					list[ii]->segment_bytes = segment;
+				}
+			}
+		}
+	}
+
+#else
+
+	// Read one datagram at a time, only blocking on the first one
+	while (received < (int)count) {
+		if (received > 0 && !DatagramWaiting(GetSocket())) {
+			break;
+		}
+
+		socklen_t addr_len = sizeof(addrs[received]);
+
+		int bytes = recvfrom(GetSocket(), (char *)list[received]->GetData(), data_bytes, 0,
+							 reinterpret_cast<sockaddr*>( &addrs[received] ), &addr_len);
+
+		if (bytes < 0) {
+			break;
+		}
+
+		list[received]->segment_bytes = 0;
+		list[received++]->bytes = bytes;
+	}
+
+	if (received == 0) {
+		received = -1;
+	}
+
+#endif
+
+	int result = received;
+
+	if (received < 0) {
+		result = LastErrorWouldBlock() ? 0 : -1;
+		received = 0;
+	}
+
+	// Fill in source addresses and collect the filled buffers
+	for (int ii = 0; ii < received; ++ii) {
+		list[ii]->addr.Wrap(reinterpret_cast<sockaddr*>( &addrs[ii] ));
+		set.PushBack(list[ii]);
+	}
+
+	// If some buffers were not used, return them to the allocator
+	if (received < (int)count) {
+		allocator->ReleaseBatch(BatchSet(list[received], buffers.tail));
+	}
+
+	return result;
+}
+
+int UDPSocket::SendBatch(const BatchSet &set) {
+	int sent = 0;
+
+	BatchHead *node = set.head;
+	while (node) {
+		UDPBuffer *list[MAX_BATCH];
+		UNetAddr::SockAddr addrs[MAX_BATCH];
+		socklen_t addr_lens[MAX_BATCH];
+		u32 count = 0;
+
+		// Collect the next group of datagrams
+		while (node && count < MAX_BATCH) {
+			UDPBuffer *buffer = static_cast<UDPBuffer*>( node );
+
+			// If the kernel would refuse to make that many segments,
+			if (_gso && buffer->segment_bytes > 0 && buffer->bytes > 0 &&
+				(buffer->bytes - 1) / buffer->segment_bytes >= MAX_SEGMENTS) {
+				// Send the group before it first, then split this one alone
+				if (count > 0) {
+					break;
+				}
+
+				if (!SendSegmented(buffer->addr, buffer->GetData(), buffer->bytes, buffer->segment_bytes)) {
+					return sent > 0 ? sent : -1;
+				}
+
+				++sent;
+				node = node->batch_next;
+				continue;
+			}
+
+			if (!buffer->addr.Unwrap(addrs[count], addr_lens[count], SupportsIPv6())) {
+				return sent > 0 ? sent : -1;
+			}
+
+			list[count++] = buffer;
+			node = node->batch_next;
+		}
+
+		// If only a buffer that was split on its own was in the way,
+		if (count == 0) {
+			continue;
+		}
+
+#if defined(CAT_OS_LINUX)
+
+		mmsghdr msgs[MAX_BATCH];
+		iovec iovs[MAX_BATCH];
+
+		// Room for the segment size passed with GSO
+		static const int CONTROL_BYTES = CMSG_SPACE(sizeof(u16));
+		u64 controls[MAX_BATCH][(CONTROL_BYTES + 7) / 8];
+
+		for (u32 ii = 0; ii < count; ++ii) {
+			UDPBuffer *buffer = list[ii];
+
+			iovs[ii].iov_base = buffer->GetData();
+			iovs[ii].iov_len = buffer->bytes;
+
+			CAT_OBJCLR(msgs[ii].msg_hdr);
+			msgs[ii].msg_hdr.msg_name = &addrs[ii];
+			msgs[ii].msg_hdr.msg_namelen = addr_lens[ii];
+			msgs[ii].msg_hdr.msg_iov = &iovs[ii];
+			msgs[ii].msg_hdr.msg_iovlen = 1;
+
+			// If the kernel should split this buffer into datagrams,
+			if (_gso && buffer->segment_bytes > 0 && buffer->bytes > buffer->segment_bytes) {
+				msghdr *msg = &msgs[ii].msg_hdr;
+				msg->msg_control = controls[ii];
+				msg->msg_controllen = CONTROL_BYTES;
+
+				cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
+				cmsg->cmsg_level = SOL_UDP;
+				cmsg->cmsg_type = UDP_SEGMENT;
+				cmsg->cmsg_len = CMSG_LEN(sizeof(u16));
+
+				u16 segment = (u16)buffer->segment_bytes;
+				memcpy(CMSG_DATA(cmsg), &segment, sizeof(segment));
+			}
+		}
+
+		int group_sent = sendmmsg(GetSocket(), msgs, count, 0);
+
+#else
+
+		int group_sent = 0;
+
+		while (group_sent < (int)count) {
+			UDPBuffer *buffer = list[group_sent];
+
+			if (sendto(GetSocket(), (const char *)buffer->GetData(), buffer->bytes, 0,
+					   reinterpret_cast<sockaddr*>( &addrs[group_sent] ), addr_lens[group_sent]) < 0) {
+				break;
+			}
+
+			++group_sent;
+		}
+
+		if (group_sent == 0) {
+			group_sent = -1;
+		}
+
+#endif
+
+		// If nothing in this group could be sent,
+		if (group_sent <= 0) {
+			return sent > 0 ? sent : -1;
+		}
+
+		sent += group_sent;
+
+		// If the send buffer filled up part way through,
+		if (group_sent < (int)count) {
+			break;
+		}
+	}
+
+	return sent;
+}
+
+bool UDPSocket::SendSegmented(const UNetAddr &addr, const u8 *data, u32 bytes, u32 segment_bytes) {
+	if (segment_bytes == 0 || bytes > MAX_SEGMENTED_BYTES) {
+		return false;
+	}
+
+	UNetAddr::SockAddr addr_out;
+	socklen_t addr_len;
+
+	if (!addr.Unwrap(addr_out, addr_len, SupportsIPv6())) {
+		return false;
+	}
+
+#if defined(CAT_OS_LINUX)
+
+	// If the kernel can split it,
+	if (_gso && bytes > segment_bytes) {
+		// It makes at most MAX_SEGMENTS datagrams per call
+		u32 run_bytes = segment_bytes * MAX_SEGMENTS;
+
+		for (u32 offset = 0; offset < bytes; offset += run_bytes) {
+			u32 len = bytes - offset;
+			if (len > run_bytes) {
+				len = run_bytes;
+			}
+
+			iovec iov;
+			iov.iov_base = const_cast<u8*>( data ) + offset;
+			iov.iov_len = len;
+
+			u64 control[(CMSG_SPACE(sizeof(u16)) + 7) / 8];
+
+			msghdr msg;
+			CAT_OBJCLR(msg);
+			msg.msg_name = &addr_out;
+			msg.msg_namelen = addr_len;
+			msg.msg_iov = &iov;
+			msg.msg_iovlen = 1;
+			msg.msg_control = control;
+			msg.msg_controllen = CMSG_SPACE(sizeof(u16));
+
+			cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+			cmsg->cmsg_level = SOL_UDP;
+			cmsg->cmsg_type = UDP_SEGMENT;
+			cmsg->cmsg_len = CMSG_LEN(sizeof(u16));
+
+			u16 segment = (u16)segment_bytes;
+			memcpy(CMSG_DATA(cmsg), &segment, sizeof(segment));
+
+			if (sendmsg(GetSocket(), &msg, 0) != (ssize_t)len) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+#endif
+
+	// Send one datagram at a time
+	for (u32 offset = 0; offset < bytes; offset += segment_bytes) {
+		u32 len = bytes - offset;
+		if (len > segment_bytes) {
+			len = segment_bytes;
+		}
+
+		if (sendto(GetSocket(), (const char *)data + offset, len, 0,
+				   reinterpret_cast<sockaddr*>( &addr_out ), addr_len) != (int)len) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+//// UDP Socket Group
+
+UDPSocketGroup::UDPSocketGroup() {
+	_sockets = 0;
+	_count = 0;
+	_steered = false;
+}
+
+UDPSocketGroup::~UDPSocketGroup() {
+	Close();
+}
+
+bool UDPSocketGroup::Create(Port port, u32 count, bool steer_by_cpu, bool RequestIPv6, bool RequireIPv4) {
+	Close();
+
+	if (count == 0) {
+		count = SystemInfo::ref()->GetProcessorCount();
+		if (count == 0) {
+			count = 1;
+		}
+	}
+
+	_sockets = new (std::nothrow) UDPSocket[count];
+	if (!_sockets) {
+		return false;
+	}
+
+	for (u32 ii = 0; ii < count; ++ii) {
+		UDPSocket *socket = &_sockets[ii];
+
+		// Later sockets must match the address family of the first
+		if (ii > 0) {
+			RequestIPv6 = _sockets[0].SupportsIPv6();
+		}
+
+		if (!socket->Create(RequestIPv6, RequireIPv4)) {
+			break;
+		}
+
+		// If port sharing is unavailable, settle for one socket
+		if (!socket->SetReusePort()) {
+			if (ii > 0) {
+				break;
+			}
+			count = 1;
+		}
+
+		if (!socket->Bind(port)) {
+			break;
+		}
+
+		// Share the port the first socket was given
+		if (ii == 0) {
+			port = socket->GetPort();
+		}
+
+		++_count;
+	}
+
+	if (_count != count) {
+		Close();
+		return false;
+	}
+
+	if (steer_by_cpu && _count > 1) {
+		_steered = _sockets[0].SteerByCPU(_count);
+
+		// Without BPF, hint the preferred socket for each CPU instead
+		if (!_steered) {
+			for (u32 ii = 0; ii < _count; ++ii) {
+				_sockets[ii].SetIncomingCPU((int)ii);
+			}
+		}
+	}
+
+	return true;
+}
+
+Port UDPSocketGroup::GetPort() {
+	return _count > 0 ? _sockets[0].GetPort() : 0;
+}
+
+void UDPSocketGroup::Close() {
+	if (_sockets) {
+		delete []_sockets;
+		_sockets = 0;
+	}
+
+	_count = 0;
+	_steered = false;
+}
+
+
+//// TCP Socket
+
+struct TCPSocket::ZeroCopySend {
+	ZeroCopySend *next;
+	void *context;
+	u32 id;
+	bool done, copied;
+};
+
+TCPSocket::TCPSocket() {
+	_zerocopy = false;
+	_zerocopy_next_id = 0;
+	_zerocopy_pending = 0;
+	_zerocopy_head = _zerocopy_tail = 0;
+}
+
+TCPSocket::~TCPSocket() {
+	Close();
+}
+
+bool TCPSocket::EnableZeroCopy(const ZeroCopyCallback &callback, bool enable) {
+	_zerocopy_callback = callback;
+
+#if defined(CAT_OS_LINUX)
+	int on = enable ? 1 : 0;
+
+	if (setsockopt(GetSocket(), SOL_SOCKET, SO_ZEROCOPY, (const char *)&on, sizeof(on))) {
+		_zerocopy = false;
+		return !enable;
+	}
+
+	_zerocopy = enable;
+	return true;
+#else
+	_zerocopy = false;
+	return !enable;
+#endif
+}
+
+void TCPSocket::QueueZeroCopy(ZeroCopySend *entry) {
+	entry->next = 0;
+
+	if (_zerocopy_tail) {
+		_zerocopy_tail->next = entry;
+	} else {
+		_zerocopy_head = entry;
+	}
+	_zerocopy_tail = entry;
+
+	// Copied sends only hold their place in the callback order
+	if (!entry->done) {
+		++_zerocopy_pending;
+	}
+}
+
+int TCPSocket::ReleaseZeroCopy(bool all) {
+	int count = 0;
+
+	// Deliver in send order, stopping at the first send still in flight
+	while (_zerocopy_head && (all || _zerocopy_head->done)) {
+		ZeroCopySend *entry = _zerocopy_head;
+
+		_zerocopy_head = entry->next;
+		if (!_zerocopy_head) {
+			_zerocopy_tail = 0;
+		}
+		if (!entry->done) {
+			--_zerocopy_pending;
+		}
+
+		if (entry->context) {
+			_zerocopy_callback(entry->context, entry->copied);
+			++count;
+		}
+
+		delete entry;
+	}
+
+	return count;
+}
+
+int TCPSocket::SendZeroCopy(const u8 *data, u32 bytes, void *context) {
+	bool zerocopy = _zerocopy && bytes >= ZEROCOPY_MIN_BYTES;
+
+	// Allocate tracking up front so a send is never left untracked
+	ZeroCopySend *entry = 0;
+	if (zerocopy || (context && _zerocopy_head)) {
+		entry = new (std::nothrow) ZeroCopySend;
+		if (!entry) {
+			return -1;
+		}
+	}
+
+	int flags = 0;
+#if defined(CAT_OS_LINUX)
+	flags = MSG_NOSIGNAL;
+	if (zerocopy) {
+		flags |= MSG_ZEROCOPY;
+	}
+#endif
+
+	int sent = send(GetSocket(), (const char *)data, bytes, flags);
+
+#if defined(CAT_OS_LINUX)
+	// If the kernel is out of memory for notifications, copy this one
+	if (sent < 0 && zerocopy && errno == ENOBUFS) {
+		zerocopy = false;
+		sent = send(GetSocket(), (const char *)data, bytes, MSG_NOSIGNAL);
+	}
+#endif
+
+	if (sent <= 0) {
+		delete entry;
+
+		if (sent == 0) {
+			return 0;
+		}
+
+#if defined(CAT_OS_WINDOWS)
+		return WSAGetLastError() == WSAEWOULDBLOCK ? 0 : -1;
+#else
+		return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+#endif
+	}
+
+	if (zerocopy) {
+		// The kernel numbers each zero-copy send in order
+		entry->context = context;
+		entry->id = _zerocopy_next_id++;
+		entry->done = false;
+		entry->copied = false;
+		QueueZeroCopy(entry);
+	} else if (entry) {
+		// Copied, but wait behind earlier sends to keep callbacks in order
+		entry->context = context;
+		entry->id = 0;
+		entry->done = true;
+		entry->copied = true;
+		QueueZeroCopy(entry);
+	} else if (context) {
+		_zerocopy_callback(context, true);
+	}
+
+	return sent;
+}
+
+int TCPSocket::ProcessZeroCopyCompletions() {
+#if defined(CAT_OS_LINUX)
+	if (!_zerocopy_head) {
+		return 0;
+	}
+
+	for (;;) {
+		u64 control[(CMSG_SPACE(sizeof(sock_extended_err)) + 64 + 7) / 8];
+
+		msghdr msg;
+		CAT_OBJCLR(msg);
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		if (recvmsg(GetSocket(), &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+			break;
+		}
+
+		for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (!(cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) &&
+				!(cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+				continue;
+			}
+
+			const sock_extended_err *err = reinterpret_cast<const sock_extended_err*>( CMSG_DATA(cmsg) );
+			if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+				continue;
+			}
+
+			// Each notification covers the inclusive id range [ee_info, ee_data]
+			u32 lo = err->ee_info, span = err->ee_data - lo;
+			bool copied = (err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) != 0;
+
+			for (ZeroCopySend *entry = _zerocopy_head; entry; entry = entry->next) {
+				if (!entry->done && (u32)(entry->id - lo) <= span) {
+					entry->done = true;
+					entry->copied = copied;
+					--_zerocopy_pending;
+				}
+			}
+		}
+	}
+#endif
+
+	return ReleaseZeroCopy(false);
+}
+
+void TCPSocket::Close() {
+	Socket::Close();
+
+	ReleaseZeroCopy(true);
+
+	_zerocopy = false;
+	_zerocopy_next_id = 0;
+}
+
 
 //// Sockets
 
@@ -408,6 +1189,21 @@ bool UNetAddr::EqualsIPOnly(const UNetAddr &addr) const {
 	}
 }
 
+u64 UNetAddr::Hash(const u64 key[2]) const {
+	// Only the first word of an IPv4 address is meaningful
+	u64 words[3];
+	if (_family == AF_INET) {
+		words[0] = _ip.v4;
+		words[1] = 0;
+	} else {
+		words[0] = _ip.v6[0];
+		words[1] = _ip.v6[1];
+	}
+	words[2] = _valid;
+
+	return siphash24(reinterpret_cast<const char*>( key ), words, sizeof(words), 0);
+}
+
 bool UNetAddr::IsInternetRoutable() {
 	if (_family == AF_INET) {
 		u32 ipv4 = ntohl(_ip.v4);
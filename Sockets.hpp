@@ -30,6 +30,8 @@
 #define CAT_SOCKETS_HPP
 
 #include "Platform.hpp"
+#include "IAllocator.hpp"
+#include "Delegates.hpp"
 
 #if defined(CAT_OS_WINDOWS)
 # include <WS2tcpip.h>
@@ -52,7 +54,10 @@
  * Provides extra features for UDP sockets: Setting DF bit in header and ICMP
  * ignore unreachable.
  *
- * It does not provide DNS name resolution nor read/write functionality.
+ * Provides batched datagram send/receive for UDP sockets, using
+ * recvmmsg/sendmmsg on Linux to move many datagrams per system call.
+ *
+ * It does not provide DNS name resolution nor TCP read/write functionality.
  */
 
 namespace cat {
@@ -180,6 +185,11 @@ struct CAT_EXPORT UNetAddr {
 		return !(*this == addr);
 	}
 
+	// Keyed hash of the address and port for hash tables, consistent with
+	// operator==.  Uses SipHash-2-4 so remote hosts that do not know the
+	// key cannot pick addresses that collide
+	u64 Hash(const u64 key[2]) const;
+
 	// To validate external input; don't want clients connecting
 	// to their local network instead of the actual game server.
 	bool IsInternetRoutable();
@@ -241,6 +251,48 @@ struct CAT_EXPORT NetAddr : UNetAddr {
 #pragma pack(pop)
 
 
+//// UDP Buffer
+
+class ReuseAllocator;
+
+// Header at the front of each buffer used for batched UDP send/receive.
+// The datagram data immediately follows the header.
+struct CAT_EXPORT UDPBuffer : BatchHead {
+	UNetAddr addr;	// Source on receive, destination on send
+	u32 bytes;		// Datagram length not including this header
+
+	// Size of each datagram packed into the buffer, or 0 for a single datagram.
+	// Set on receive when GRO coalesced datagrams, and read on send with GSO
+	u32 segment_bytes;
+
+	CAT_INLINE u8 *GetData() {
+		return reinterpret_cast<u8*>( this + 1 );
+	}
+
+	CAT_INLINE u32 GetSegmentCount() {
+		if (segment_bytes == 0 || bytes <= segment_bytes) {
+			return 1;
+		}
+
+		return (bytes + segment_bytes - 1) / segment_bytes;
+	}
+
+	// Returns a view of one of the packed datagrams; the last one may be shorter
+	CAT_INLINE u8 *GetSegment(u32 index, u32 &len) {
+		if (segment_bytes == 0) {
+			len = bytes;
+			return GetData();
+		}
+
+		u32 offset = index * segment_bytes;
+		u32 remaining = bytes - offset;
+
+		len = remaining < segment_bytes ? remaining : segment_bytes;
+		return GetData() + offset;
+	}
+};
+
+
 //// Socket
 
 class CAT_EXPORT Socket {
@@ -261,6 +313,11 @@ public:
 	bool SetSendBufferSize(int bytes);
 	bool SetRecvBufferSize(int bytes);
 
+	// Disabled by default; lets several sockets bind the same port so the
+	// kernel spreads incoming traffic across them (SO_REUSEPORT).
+	// Returns false if the platform does not support it
+	bool SetReusePort(bool enable = true);
+
 	bool Bind(Port port);
 
 	// Call these after binding:
@@ -280,6 +337,15 @@ public:
 
 	Port GetPort();
 
+	// Linux only: prefer this socket for traffic received on the given CPU
+	// among sockets sharing its port (SO_INCOMING_CPU)
+	bool SetIncomingCPU(int cpu);
+
+	// Linux only: steer traffic received on CPU c to the socket with index
+	// c % group_size within its SO_REUSEPORT group, where indices follow the
+	// bind order.  Call on any one socket of the group
+	bool SteerByCPU(u32 group_size);
+
 	void Close();
 };
 
@@ -288,7 +354,12 @@ public:
 
 // Adds functions only used for UDP sockets
 class CAT_EXPORT UDPSocket : public Socket {
+	bool _gso, _gro;
+
 public:
+	CAT_INLINE UDPSocket() {
+		_gso = _gro = false;
+	}
 	CAT_INLINE virtual ~UDPSocket() {
 	}
 
@@ -305,20 +376,160 @@ public:
 
 	// Disabled by default; useful for MTU discovery
 	bool DontFragment(bool df = true);
+
+	// Largest payload the kernel will segment or coalesce in one buffer
+	static const u32 MAX_SEGMENTED_BYTES = 65507;
+
+	// Most datagrams the kernel will build from one buffer with GSO (UDP_MAX_SEGMENTS)
+	static const u32 MAX_SEGMENTS = 64;
+
+	// Disabled by default; UDP generic segmentation offload on send (Linux 4.18+).
+	// Returns false if the kernel does not support it
+	bool EnableGSO(bool enable = true);
+
+	// Disabled by default; UDP generic receive offload (Linux 5.0+).
+	// Received buffers should be large enough for MAX_SEGMENTED_BYTES, and
+	// GetSegmentCount()/GetSegment() split them back into datagrams.
+	// Returns false if the kernel does not support it
+	bool EnableGRO(bool enable = true);
+
+	CAT_INLINE bool GSOEnabled() {
+		return _gso;
+	}
+	CAT_INLINE bool GROEnabled() {
+		return _gro;
+	}
+
+	// Most datagrams moved by one call to RecvBatch() or SendBatch()
+	static const u32 MAX_BATCH = 64;
+
+	// Blocks until at least one datagram arrives, then receives up to max_count
+	// datagrams into buffers from the allocator.  Each buffer must have room
+	// for a UDPBuffer header in front of the largest expected datagram.
+	// Filled buffers are returned in the set, and unused ones are released.
+	// Returns the number of datagrams received, 0 if the socket would block,
+	// or -1 on error
+	int RecvBatch(ReuseAllocator *allocator, BatchSet &set, u32 max_count = MAX_BATCH);
+
+	// Sends each buffer in the set to the address in its header, in order.
+	// With GSO enabled, a buffer whose segment_bytes is set is sent as a run
+	// of datagrams of that size; otherwise segment_bytes must be 0.  A buffer
+	// that would make more than MAX_SEGMENTS datagrams is sent on its own
+	// with SendSegmented().
+	// Buffers are not released.
+	// Returns the number of buffers sent from the front of the set, or -1 on error
+	int SendBatch(const BatchSet &set);
+
+	// Sends data as datagrams of segment_bytes each to one address, using one
+	// system call per MAX_SEGMENTS datagrams when GSO is enabled.
+	// Returns false on error
+	bool SendSegmented(const UNetAddr &addr, const u8 *data, u32 bytes, u32 segment_bytes);
+};
+
+
+//// UDP Socket Group
+
+/*
+	Several UDP sockets bound to the same port with SO_REUSEPORT, so each
+	worker thread drains its own receive queue instead of all of them
+	contending for the lock of a single socket.
+
+	With CPU steering, a datagram is queued on the socket whose index is the
+	CPU that received it, so worker i should run on core i to keep the data
+	in its cache (see Thread::SetIdealCore).
+*/
+class CAT_EXPORT UDPSocketGroup {
+	UDPSocket *_sockets;
+	u32 _count;
+	bool _steered;
+
+public:
+	UDPSocketGroup();
+	~UDPSocketGroup();
+
+	// Binds count sockets to the port, or one per processor if count is 0.
+	// Port 0 picks a free port shared by the group.
+	// Creates a single socket where SO_REUSEPORT is not supported.
+	// Returns false on error
+	bool Create(Port port, u32 count = 0, bool steer_by_cpu = true, bool RequestIPv6 = true, bool RequireIPv4 = true);
+
+	CAT_INLINE u32 GetCount() {
+		return _count;
+	}
+	CAT_INLINE UDPSocket *GetSocket(u32 index) {
+		return &_sockets[index];
+	}
+	// True if traffic is steered by receiving CPU
+	CAT_INLINE bool Steered() {
+		return _steered;
+	}
+
+	Port GetPort();
+
+	void Close();
 };
 
 
 //// TCP Socket
 
+// Called when the kernel no longer needs a buffer passed to SendZeroCopy(),
+// with copied set if it fell back to copying the data
+typedef Delegate2<void, void *, bool> ZeroCopyCallback;
+
 // Adds functions only used for TCP sockets
 class CAT_EXPORT TCPSocket : public Socket {
+	struct ZeroCopySend;
+
+	bool _zerocopy;
+	ZeroCopyCallback _zerocopy_callback;
+	u32 _zerocopy_next_id, _zerocopy_pending;
+	ZeroCopySend *_zerocopy_head, *_zerocopy_tail;
+
+	void QueueZeroCopy(ZeroCopySend *entry);
+	int ReleaseZeroCopy(bool all);
+
 public:
-	CAT_INLINE virtual ~TCPSocket() {
-	}
+	TCPSocket();
+	virtual ~TCPSocket();
 
 	CAT_INLINE bool Create(bool RequestIPv6 = true, bool RequireIPv4 = true) {
+		Close();
 		return Socket::Create(SOCK_STREAM, IPPROTO_TCP, RequestIPv6, RequireIPv4);
 	}
+
+	// Sends smaller than this are copied, since pinning pages costs more
+	static const u32 ZEROCOPY_MIN_BYTES = 16384;
+
+	// Disabled by default; send large buffers without copying them into the
+	// kernel (MSG_ZEROCOPY, Linux 4.14+).  Elsewhere SendZeroCopy() copies
+	// and completes immediately.  Returns false if the kernel does not support it
+	bool EnableZeroCopy(const ZeroCopyCallback &callback, bool enable = true);
+
+	CAT_INLINE bool ZeroCopyEnabled() {
+		return _zerocopy;
+	}
+
+	// Sends data that must stay untouched until the callback runs with the
+	// given context.  If fewer bytes are sent, call again for the rest; the
+	// callback runs once per call that sent data and has a context, in send
+	// order, so pass the context with the piece that should release the buffer.
+	// Returns the number of bytes sent, 0 if the socket would block, or -1 on error
+	int SendZeroCopy(const u8 *data, u32 bytes, void *context);
+
+	// Delivers callbacks for sends the kernel has finished with.  Call when
+	// the socket reports an error event (POLLERR) or periodically.
+	// Returns the number of callbacks made
+	int ProcessZeroCopyCompletions();
+
+	// Number of sends the kernel may still be reading from
+	CAT_INLINE u32 GetZeroCopyPending() {
+		return _zerocopy_pending;
+	}
+
+	// Closes the socket, then delivers callbacks for all buffers still pending.
+	// The kernel may still be sending queued data after close, so wait for
+	// GetZeroCopyPending() to reach 0 first if the buffers will be reused
+	void Close();
 };
 
 
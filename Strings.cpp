@@ -28,15 +28,333 @@
 
 #include <cat/lang/Strings.hpp>
 #include <cat/io/Log.hpp>
-#include <cctype> // tolower
+#include <cstring> // memcpy
 using namespace cat;
 
+#if defined(CAT_HAS_SSE2)
+# define CAT_STRINGS_SSE2
+# include <emmintrin.h>
+#elif defined(CAT_HAS_NEON) && defined(__aarch64__)
+# define CAT_STRINGS_NEON
+# include <arm_neon.h>
+#endif
+
+
+//// Block kernels
+
+/*
+	The string routines below copy 16 characters at a time while a block
+	is simple, and fall back to one character at a time around anything
+	else, like the nul terminator.
+
+	Nul-terminated input is only read a block at a time when the block
+	does not cross a page boundary, so the read past the terminator cannot
+	fault.
+*/
+
+#if defined(CAT_STRINGS_SSE2) || defined(CAT_STRINGS_NEON)
+
+# define CAT_STRINGS_BLOCKS
+
+static const int BLOCK_CHARS = 16;
+
+static CAT_INLINE bool CanLoadBlock(const char *str)
+{
+	return ((size_t)str & 4095) <= 4096 - BLOCK_CHARS;
+}
+
+#endif
+
+#if defined(CAT_STRINGS_SSE2)
+
+// If the block has no nul, stores it with letters first..last flipped in case
+static CAT_INLINE bool FoldBlock(const char *from, char *to, char first, char last)
+{
+	__m128i x = _mm_loadu_si128((const __m128i *)from);
+
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128())))
+		return false;
+
+	// Signed compares leave bytes >= 0x80 alone
+	__m128i in_range = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8(first - 1)),
+									 _mm_cmplt_epi8(x, _mm_set1_epi8(last + 1)));
+
+	_mm_storeu_si128((__m128i *)to, _mm_xor_si128(x, _mm_and_si128(in_range, _mm_set1_epi8(0x20))));
+	return true;
+}
+
+// If the block is only letters, digits and single dots between them, stores it
+static CAT_INLINE bool SanitizeBlock(const char *from, char *to, bool lowercase)
+{
+	__m128i x = _mm_loadu_si128((const __m128i *)from);
+	__m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+
+	__m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+								  _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+	__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('0' - 1)),
+								  _mm_cmplt_epi8(x, _mm_set1_epi8('9' + 1)));
+	__m128i dot = _mm_cmpeq_epi8(x, _mm_set1_epi8('.'));
+
+	if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), dot)) != 0xffff)
+		return false;
+
+	// Dots on the block edges or next to each other need the scalar rules
+	int dots = _mm_movemask_epi8(dot);
+	if ((dots & 0x8001) || (dots & (dots >> 1)))
+		return false;
+
+	if (lowercase)
+		x = _mm_or_si128(x, _mm_and_si128(alpha, _mm_set1_epi8(0x20)));
+
+	_mm_storeu_si128((__m128i *)to, x);
+	return true;
+}
+
+#elif defined(CAT_STRINGS_NEON)
+
+// If the block has no nul, stores it with letters first..last flipped in case
+static CAT_INLINE bool FoldBlock(const char *from, char *to, char first, char last)
+{
+	int8x16_t x = vld1q_s8((const int8_t *)from);
+
+	if (vminvq_u8(vreinterpretq_u8_s8(x)) == 0)
+		return false;
+
+	// Signed compares leave bytes >= 0x80 alone
+	uint8x16_t in_range = vandq_u8(vcgtq_s8(x, vdupq_n_s8(first - 1)),
+								   vcltq_s8(x, vdupq_n_s8(last + 1)));
+
+	uint8x16_t y = veorq_u8(vreinterpretq_u8_s8(x), vandq_u8(in_range, vdupq_n_u8(0x20)));
+	vst1q_u8((uint8_t *)to, y);
+	return true;
+}
+
+// If the block is only letters, digits and single dots between them, stores it
+static CAT_INLINE bool SanitizeBlock(const char *from, char *to, bool lowercase)
+{
+	uint8x16_t x = vld1q_u8((const uint8_t *)from);
+	uint8x16_t lower = vorrq_u8(x, vdupq_n_u8(0x20));
+
+	uint8x16_t alpha = vandq_u8(vcgeq_u8(lower, vdupq_n_u8('a')), vcleq_u8(lower, vdupq_n_u8('z')));
+	uint8x16_t digit = vandq_u8(vcgeq_u8(x, vdupq_n_u8('0')), vcleq_u8(x, vdupq_n_u8('9')));
+	uint8x16_t dot = vceqq_u8(x, vdupq_n_u8('.'));
+
+	if (vminvq_u8(vorrq_u8(vorrq_u8(alpha, digit), dot)) != 0xff)
+		return false;
+
+	// Dots on the block edges or next to each other need the scalar rules
+	if (vgetq_lane_u8(dot, 0) || vgetq_lane_u8(dot, 15) ||
+		vmaxvq_u8(vandq_u8(dot, vextq_u8(dot, dot, 1))))
+		return false;
+
+	if (lowercase)
+		x = vorrq_u8(x, vandq_u8(alpha, vdupq_n_u8(0x20)));
+
+	vst1q_u8((uint8_t *)to, x);
+	return true;
+}
+
+#endif
+
+
+//// Decimal conversion
+
+// Two-digit strings for 00 through 99, so formatting needs one divide per pair
+static const char DIGIT_PAIRS[201] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+template<typename T>
+static CAT_INLINE int CountDigits(T x)
+{
+	int digits = 1;
+
+	// Take four digits at a time while the number is large
+	for (; x >= 10000; x /= 10000)
+		digits += 4;
+
+	if (x >= 1000) return digits + 3;
+	if (x >= 100) return digits + 2;
+	if (x >= 10) return digits + 1;
+	return digits;
+}
+
+// Writes the digits of x backwards from the end
+template<typename T>
+static CAT_INLINE int WriteDecimal(T x, char *outs)
+{
+	int digits = CountDigits(x);
+	char *ptr = outs + digits;
+
+	*ptr = '\0';
+
+	while (x >= 100)
+	{
+		const char *pair = DIGIT_PAIRS + (u32)(x % 100) * 2;
+		x /= 100;
+
+		ptr -= 2;
+		ptr[0] = pair[0];
+		ptr[1] = pair[1];
+	}
+
+	if (x >= 10)
+	{
+		const char *pair = DIGIT_PAIRS + (u32)x * 2;
+		ptr[-2] = pair[0];
+		ptr[-1] = pair[1];
+	}
+	else
+	{
+		ptr[-1] = (char)('0' + (u32)x);
+	}
+
+	return digits;
+}
+
+int cat::FormatDecimal(u32 x, char *outs)
+{
+	return WriteDecimal(x, outs);
+}
+
+int cat::FormatDecimal(s32 x, char *outs)
+{
+	if (x >= 0) return WriteDecimal((u32)x, outs);
+
+	*outs = '-';
+	return 1 + WriteDecimal(0 - (u32)x, outs + 1);
+}
+
+int cat::FormatDecimal(u64 x, char *outs)
+{
+	// Stay with 32-bit divides when possible
+	if ((u32)(x >> 32) == 0) return WriteDecimal((u32)x, outs);
+
+	return WriteDecimal(x, outs);
+}
+
+int cat::FormatDecimal(s64 x, char *outs)
+{
+	if (x >= 0) return FormatDecimal((u64)x, outs);
+
+	*outs = '-';
+	return 1 + FormatDecimal(0 - (u64)x, outs + 1);
+}
+
+// Parses the digits of a decimal integer with magnitude up to limit
+// Returns false on no digits or on overflow, which saturates to limit
+static bool ParseMagnitude(const char *str, int len, u64 limit, u64 &x, bool &negative)
+{
+	const char *end = len >= 0 ? str + len : 0;
+
+	// Skip white space like atoi()
+	while ((!end || str < end) && (*str == ' ' || (u32)(*str - '\t') <= '\r' - '\t'))
+		++str;
+
+	negative = false;
+
+	if ((!end || str < end) && (*str == '-' || *str == '+'))
+	{
+		negative = (*str == '-');
+		++str;
+	}
+
+	// Digits are checked with one compare each; nul is not a digit
+	const u64 limit_div = limit / 10;
+	const u32 limit_mod = (u32)(limit % 10);
+	u64 value = 0;
+	const char *first = str;
+
+	for (; !end || str < end; ++str)
+	{
+		u32 digit = (u32)(*str - '0');
+		if (digit > 9) break;
+
+		// If the next digit would pass the limit,
+		if (value >= limit_div && (value > limit_div || digit > limit_mod))
+		{
+			x = limit;
+			return false;
+		}
+
+		value = value * 10 + digit;
+	}
+
+	x = value;
+	return str != first;
+}
+
+bool cat::ParseDecimal(const char *str, int len, s32 &x)
+{
+	bool negative = false;
+	u64 value;
+
+	// Parse up to the magnitude of INT_MIN, then clip positive values one lower
+	bool success = ParseMagnitude(str, len, 0x80000000, value, negative);
+
+	if (!negative && value == 0x80000000)
+	{
+		value = 0x7fffffff;
+		success = false;
+	}
+
+	x = negative ? (s32)(0 - (u32)value) : (s32)value;
+
+	return success;
+}
+
+bool cat::ParseDecimal(const char *str, int len, s64 &x)
+{
+	bool negative = false;
+	u64 value;
+
+	// Parse up to the magnitude of INT64_MIN, then clip positive values one lower
+	bool success = ParseMagnitude(str, len, (u64)1 << 63, value, negative);
+
+	if (!negative && value == (u64)1 << 63)
+	{
+		value = ((u64)1 << 63) - 1;
+		success = false;
+	}
+
+	x = negative ? (s64)(0 - value) : (s64)value;
+
+	return success;
+}
+
+
+//// Integer conversion
 
 bool cat::IntegerToArray(s32 x, char *outs, int outs_buf_size, int radix)
 {
 	CAT_DEBUG_ENFORCE(outs_buf_size >= 1);
 	CAT_DEBUG_ENFORCE(radix >= 2 && radix <= 36);
 
+	// If decimal, use the table-driven path
+	if (radix == 10)
+	{
+		if (outs_buf_size >= MAX_DECIMAL32_CHARS)
+		{
+			FormatDecimal(x, outs);
+			return true;
+		}
+
+		char digits[MAX_DECIMAL32_CHARS];
+		int len = FormatDecimal(x, digits);
+		if (len >= outs_buf_size) return false;
+
+		memcpy(outs, digits, len + 1);
+		return true;
+	}
+
 	char *ptr = outs;
 
 	int prev;
@@ -147,66 +465,33 @@ bool cat::IsZeroFixedBuffer(const void *vbuffer, u32 bytes)
 }
 
 
+// Lowercase letters are first made uppercase, then each of these groups
+// maps to its first character:
+//	I L 1 |    O 0    T +    ` ' "    B 8    . ,    G 6
+//	Z 2    ~ -    / \    ; :    N M
+static const u8 DESIMILAR_TABLE[256] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+	0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+	0x20, 0x21, 0x60, 0x23, 0x24, 0x25, 0x26, 0x60, 0x28, 0x29, 0x2a, 0x54, 0x2e, 0x7e, 0x2e, 0x2f,
+	0x4f, 0x49, 0x5a, 0x33, 0x34, 0x35, 0x47, 0x37, 0x42, 0x39, 0x3b, 0x3b, 0x3c, 0x3d, 0x3e, 0x3f,
+	0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x4b, 0x49, 0x4e, 0x4e, 0x4f,
+	0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x5b, 0x2f, 0x5d, 0x5e, 0x5f,
+	0x60, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x4b, 0x49, 0x4e, 0x4e, 0x4f,
+	0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x7b, 0x49, 0x7d, 0x7e, 0x7f,
+	0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8e, 0x8f,
+	0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0x9b, 0x9c, 0x9d, 0x9e, 0x9f,
+	0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xab, 0xac, 0xad, 0xae, 0xaf,
+	0xb0, 0xb1, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xbb, 0xbc, 0xbd, 0xbe, 0xbf,
+	0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xcb, 0xcc, 0xcd, 0xce, 0xcf,
+	0xd0, 0xd1, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xdb, 0xdc, 0xdd, 0xde, 0xdf,
+	0xe0, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xeb, 0xec, 0xed, 0xee, 0xef,
+	0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff,
+};
+
 // Replaces all similar-looking glyphs with a common character
 char cat::DesimilarizeCharacter(char ch)
 {
-	ch = (char)std::toupper(ch);
-
-	switch (ch)
-	{
-	case 'I':
-	case 'L':
-	case '1':
-	case '|':
-		return 'I';
-
-	case 'O':
-	case '0':
-		return 'O';
-
-	case 'T':
-	case '+':
-		return 'T';
-
-	case '`':
-	case '\'':
-	case '"':
-		return '`';
-
-	case '8':
-	case 'B':
-		return 'B';
-
-	case '.':
-	case ',':
-		return '.';
-
-	case '6':
-	case 'G':
-		return 'G';
-
-	case '2':
-	case 'Z':
-		return 'Z';
-
-	case '~':
-	case '-':
-		return '~';
-
-	case '\\':
-	case '/':
-		return '/';
-
-	case ':':
-	case ';':
-		return ';';
-
-	case 'N':
-	case 'M':
-		return 'N';
-	}
-
-	return ch;
+	return (char)DESIMILAR_TABLE[(u8)ch];
 }
 
 // Replaces all similar-looking glyphs with common characters while copying a string
@@ -214,7 +499,7 @@ void cat::CopyDesimilarizeString(const char *from, char *to)
 {
 	char ch;
 
-	while ((ch = *from++)) *to++ = DesimilarizeCharacter(ch);
+	while ((ch = *from++)) *to++ = (char)DESIMILAR_TABLE[(u8)ch];
 
 	*to = '\0';
 }
@@ -227,7 +512,7 @@ u32 cat::DesimilarizeFixedString(char *str, u32 max_len)
 		if (str[ii] == '\0')
 			return ii;
 
-		str[ii] = DesimilarizeCharacter(str[ii]);
+		str[ii] = (char)DESIMILAR_TABLE[(u8)str[ii]];
 	}
 
 	return max_len;
@@ -238,6 +523,15 @@ void cat::CopyToUppercaseString(const char *from, char *to)
 {
 	char ch;
 
+#if defined(CAT_STRINGS_BLOCKS)
+	// Copy whole blocks until one holds the nul or would cross a page
+	while (CanLoadBlock(from) && FoldBlock(from, to, 'a', 'z'))
+	{
+		from += BLOCK_CHARS;
+		to += BLOCK_CHARS;
+	}
+#endif
+
 	while ((ch = *from++))
 	{
 		if (ch >= 'a' && ch <= 'z')
@@ -254,6 +548,15 @@ void cat::CopyToLowercaseString(const char *from, char *to)
 {
 	char ch;
 
+#if defined(CAT_STRINGS_BLOCKS)
+	// Copy whole blocks until one holds the nul or would cross a page
+	while (CanLoadBlock(from) && FoldBlock(from, to, 'A', 'Z'))
+	{
+		from += BLOCK_CHARS;
+		to += BLOCK_CHARS;
+	}
+#endif
+
 	while ((ch = *from++))
 	{
 		if (ch >= 'A' && ch <= 'Z')
@@ -265,6 +568,75 @@ void cat::CopyToLowercaseString(const char *from, char *to)
 	*to = '\0';
 }
 
+// Copies runs of letters and digits from a key, joined by single dots
+int cat::CopySanitizedString(const char *key, int len, char *out, bool lowercase)
+{
+	const char *end = len >= 0 ? key + len : 0;
+	char ch, *outs = out;
+	bool seen_punct = false;
+
+	CAT_FOREVER
+	{
+#if defined(CAT_STRINGS_BLOCKS)
+		// If a whole block can be read,
+		if (end ? (end - key >= BLOCK_CHARS) : CanLoadBlock(key))
+		{
+			char *block_out = outs + (seen_punct ? 1 : 0);
+
+			// If the block can be copied directly,
+			if (SanitizeBlock(key, block_out, lowercase))
+			{
+				if (seen_punct)
+				{
+					*outs = '.';
+					seen_punct = false;
+				}
+
+				outs = block_out + BLOCK_CHARS;
+				key += BLOCK_CHARS;
+				continue;
+			}
+		}
+#endif
+
+		if (end)
+		{
+			if (key >= end) break;
+			ch = *key++;
+		}
+		else if (!(ch = *key++)) break;
+
+		if (ch >= 'A' && ch <= 'Z')
+		{
+			if (seen_punct)
+			{
+				*outs++ = '.';
+				seen_punct = false;
+			}
+			*outs++ = lowercase ? ch + 'a' - 'A' : ch;
+		}
+		else if ((ch >= 'a' && ch <= 'z') ||
+			(ch >= '0' && ch <= '9'))
+		{
+			if (seen_punct)
+			{
+				*outs++ = '.';
+				seen_punct = false;
+			}
+			*outs++ = ch;
+		}
+		else
+		{
+			if (outs != out)
+				seen_punct = true;
+		}
+	}
+
+	*outs = '\0';
+
+	return (int)(outs - out);
+}
+
 // Copies the contents of a line from a text file into a nul-terminated output buffer
 int cat::ReadLineFromTextFileBuffer(u8 *data, u32 remaining, char *outs, int len)
 {
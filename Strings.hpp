@@ -47,6 +47,29 @@ namespace cat {
 // Returns false if output is clipped (13 character buffer is good enough for 32-bit decimal)
 bool CAT_EXPORT IntegerToArray(s32 x, char *outs, int outs_buf_size, int radix = 10);
 
+// Writes x in decimal followed by a nul, returning the number of digits and sign written
+// Needs a buffer of MAX_DECIMAL32_CHARS or MAX_DECIMAL64_CHARS, which includes the nul
+static const int MAX_DECIMAL32_CHARS = 12;
+static const int MAX_DECIMAL64_CHARS = 21;
+int CAT_EXPORT FormatDecimal(u32 x, char *outs);
+int CAT_EXPORT FormatDecimal(s32 x, char *outs);
+int CAT_EXPORT FormatDecimal(u64 x, char *outs);
+int CAT_EXPORT FormatDecimal(s64 x, char *outs);
+
+// Parses a decimal integer from at most len characters of str (or up to the nul if len < 0)
+// Like atoi(), skips leading white space, takes one sign and stops at the first non-digit
+// Returns false if there are no digits (x = 0) or the value does not fit (x saturates)
+bool CAT_EXPORT ParseDecimal(const char *str, int len, s32 &x);
+bool CAT_EXPORT ParseDecimal(const char *str, int len, s64 &x);
+
+// Drop-in for atoi() that saturates instead of overflowing
+CAT_INLINE int ParseInt(const char *str)
+{
+	s32 x;
+	ParseDecimal(str, -1, x);
+	return x;
+}
+
 // Returns true if character is alphabetic
 CAT_INLINE bool IsAlpha(char ch)
 {
@@ -112,6 +135,11 @@ void CAT_EXPORT CopyToUppercaseString(const char *from, char *to);
 // Copies the input string to an output string replacing uppercase letters with their lowercase equivalents
 void CAT_EXPORT CopyToLowercaseString(const char *from, char *to);
 
+// Copies the runs of letters and digits in a key, joined by single dots, optionally lowercasing
+// A negative len means the key is nul-terminated.  Output is nul-terminated and no longer
+// than the key.  Returns the output length
+int CAT_EXPORT CopySanitizedString(const char *key, int len, char *out, bool lowercase);
+
 // Copies the contents of a line from a text file into a nul-terminated output buffer
 int CAT_EXPORT ReadLineFromTextFileBuffer(u8 *data, u32 remaining, char *outs, int len);
 
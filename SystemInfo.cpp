@@ -36,7 +36,10 @@ using namespace cat;
 # include <cat/math/BitMath.hpp>
 # include <WinIoCtl.h>
 	typedef BOOL (WINAPI* PGetLogicalProcessorInformation)(PSYSTEM_LOGICAL_PROCESSOR_INFORMATION, PDWORD);
-#elif defined(CAT_OS_LINUX) || defined(CAT_OS_AIX) || defined(CAT_OS_SOLARIS) || defined(CAT_OS_IRIX)
+#elif defined(CAT_OS_LINUX)
+# include <unistd.h>
+# include <sched.h>
+#elif defined(CAT_OS_AIX) || defined(CAT_OS_SOLARIS) || defined(CAT_OS_IRIX)
 # include <unistd.h>
 #elif defined(CAT_OS_OSX) || defined(CAT_OS_BSD)
 # include <sys/sysctl.h>
@@ -53,6 +56,129 @@ using namespace cat;
 # define aligned_free _aligned_free
 #endif
 
+#if defined(CAT_OS_WINDOWS)
+
+// Returns an array of count entries to free(), or 0 if unavailable
+static SYSTEM_LOGICAL_PROCESSOR_INFORMATION *GetProcessorInformation(u32 &count)
+{
+	PGetLogicalProcessorInformation pGetLogicalProcessorInformation;
+
+	pGetLogicalProcessorInformation = (PGetLogicalProcessorInformation)GetProcAddress(GetModuleHandleA("kernel32.dll"), "GetLogicalProcessorInformation");
+	if (!pGetLogicalProcessorInformation) return 0;
+
+	DWORD buffer_size = 0;
+	pGetLogicalProcessorInformation(0, &buffer_size);
+	if (buffer_size == 0) return 0;
+
+	SYSTEM_LOGICAL_PROCESSOR_INFORMATION *buffer = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION *)malloc(buffer_size);
+	if (!buffer) return 0;
+
+	if (!pGetLogicalProcessorInformation(buffer, &buffer_size))
+	{
+		free(buffer);
+		return 0;
+	}
+
+	count = (u32)(buffer_size / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+	return buffer;
+}
+
+#elif defined(CAT_OS_LINUX)
+
+// Reads the first number in a sysfs file, scaled by a K or M suffix
+static bool ReadSysValue(const char *path, u32 &value)
+{
+	FILE *file = fopen(path, "r");
+	if (!file) return false;
+
+	bool success = (1 == fscanf(file, "%u", &value));
+
+	if (success)
+	{
+		int ch = fgetc(file);
+		if (ch == 'K') value <<= 10;
+		else if (ch == 'M') value <<= 20;
+	}
+
+	fclose(file);
+	return success;
+}
+
+// Calls back for each processor range in a sysfs list like "0-7,16-23"
+// Returns false if the file could not be opened
+template<class Visitor>
+static bool ReadProcessorList(const char *path, Visitor &visitor)
+{
+	FILE *file = fopen(path, "r");
+	if (!file) return false;
+
+	u32 first, last;
+	while (1 == fscanf(file, "%u", &first))
+	{
+		last = first;
+
+		int ch = fgetc(file);
+		if (ch == '-')
+		{
+			if (1 != fscanf(file, "%u", &last))
+				break;
+			ch = fgetc(file);
+		}
+
+		visitor(first, last);
+
+		if (ch != ',')
+			break;
+	}
+
+	fclose(file);
+	return true;
+}
+
+struct ProcessorCounter
+{
+	u32 count;
+
+	CAT_INLINE ProcessorCounter() { count = 0; }
+	CAT_INLINE void operator()(u32 first, u32 last) { count += last - first + 1; }
+};
+
+struct ProcessorNodeSetter
+{
+	u8 *processor_node;
+	u8 node;
+
+	CAT_INLINE void operator()(u32 first, u32 last)
+	{
+		for (u32 ii = first; ii <= last && ii < CAT_MAX_NUMA_PROCESSORS; ++ii)
+			processor_node[ii] = node;
+	}
+};
+
+struct NodeListReader
+{
+	u8 *processor_node;
+	u32 node_count;
+
+	void operator()(u32 first, u32 last)
+	{
+		for (u32 node = first; node <= last && node < CAT_MAX_NUMA_NODES; ++node)
+		{
+			char path[64];
+			sprintf(path, "/sys/devices/system/node/node%u/cpulist", node);
+
+			ProcessorNodeSetter setter;
+			setter.processor_node = processor_node;
+			setter.node = (u8)node;
+
+			if (ReadProcessorList(path, setter) && node >= node_count)
+				node_count = node + 1;
+		}
+	}
+};
+
+#endif
+
 static u32 GetCacheLineBytes()
 {
 	// Based on work by Nick Strupat (http://strupat.ca/)
@@ -71,33 +197,22 @@ static u32 GetCacheLineBytes()
 
 #elif defined(CAT_OS_WINDOWS)
 
-	DWORD buffer_size = 0;
-	SYSTEM_LOGICAL_PROCESSOR_INFORMATION *buffer = 0;
-	PGetLogicalProcessorInformation pGetLogicalProcessorInformation;
-
-	pGetLogicalProcessorInformation = (PGetLogicalProcessorInformation)GetProcAddress(GetModuleHandleA("kernel32.dll"), "pGetLogicalProcessorInformation");
+	u32 count;
+	SYSTEM_LOGICAL_PROCESSOR_INFORMATION *info = GetProcessorInformation(count);
 
-	if (pGetLogicalProcessorInformation)
+	if (info)
 	{
-		pGetLogicalProcessorInformation(0, &buffer_size);
-
-		if (buffer_size > 0)
+		for (u32 ii = 0; ii < count; ++ii)
 		{
-			buffer = (SYSTEM_LOGICAL_PROCESSOR_INFORMATION *)malloc(buffer_size);
-			pGetLogicalProcessorInformation(&buffer[0], &buffer_size);
-
-			for (int i = 0; i < (int)(buffer_size / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION)); ++i)
+			if (info[ii].Relationship == RelationCache &&
+				info[ii].Cache.Level == 1)
 			{
-				if (buffer[i].Relationship == RelationCache &&
-					buffer[i].Cache.Level == 1)
-				{
-					discovered_cache_line_size = (u32)buffer[i].Cache.LineSize;
-					break;
-				}
+				discovered_cache_line_size = (u32)info[ii].Cache.LineSize;
+				break;
 			}
-
-			free(buffer);
 		}
+
+		free(info);
 	}
 
 #elif defined(CAT_OS_LINUX)
@@ -318,6 +433,207 @@ static u32 GetMaxSectorSize()
 	return sector_size > 0 ? sector_size : CAT_DEFAULT_SECTOR_SIZE;
 }
 
+static u32 GetNodeTopology(u8 *processor_node)
+{
+	u32 node_count = 0;
+
+	memset(processor_node, 0, CAT_MAX_NUMA_PROCESSORS);
+
+#if defined(CAT_OS_WINDOWS)
+
+	ULONG highest_node;
+	if (GetNumaHighestNodeNumber(&highest_node))
+	{
+		node_count = (u32)highest_node + 1;
+
+		// For each processor that can be described with a UCHAR,
+		for (u32 ii = 0; ii < CAT_MAX_NUMA_PROCESSORS && ii < 256; ++ii)
+		{
+			UCHAR node;
+			if (GetNumaProcessorNode((UCHAR)ii, &node) && node < CAT_MAX_NUMA_NODES)
+				processor_node[ii] = node;
+		}
+	}
+
+#elif defined(CAT_OS_LINUX)
+
+	// Node numbers may have gaps, so walk the online list rather than
+	// stopping at the first missing node
+	NodeListReader reader;
+	reader.processor_node = processor_node;
+	reader.node_count = 0;
+
+	if (ReadProcessorList("/sys/devices/system/node/online", reader))
+		node_count = reader.node_count;
+
+#endif
+
+	return node_count > 1 ? node_count : 1;
+}
+
+
+static u32 GetCoreTopology(u8 *processor_core, u32 processor_count)
+{
+	u32 core_count = 0;
+
+	if (processor_count > CAT_MAX_NUMA_PROCESSORS)
+		processor_count = CAT_MAX_NUMA_PROCESSORS;
+
+#if defined(CAT_OS_WINDOWS)
+
+	u32 count;
+	SYSTEM_LOGICAL_PROCESSOR_INFORMATION *info = GetProcessorInformation(count);
+
+	if (info)
+	{
+		// For each core, mark each of its processors
+		for (u32 ii = 0; ii < count; ++ii)
+		{
+			if (info[ii].Relationship != RelationProcessorCore)
+				continue;
+
+			ULONG_PTR mask = info[ii].ProcessorMask;
+			for (u32 jj = 0; mask && jj < CAT_MAX_NUMA_PROCESSORS; ++jj, mask >>= 1)
+				if (mask & 1) processor_core[jj] = (u8)core_count;
+
+			++core_count;
+		}
+
+		free(info);
+	}
+
+#elif defined(CAT_OS_LINUX)
+
+	// First sibling of each processor's core -> dense core index
+	u16 leader_core[CAT_MAX_NUMA_PROCESSORS];
+	for (u32 ii = 0; ii < CAT_MAX_NUMA_PROCESSORS; ++ii)
+		leader_core[ii] = 0xffff;
+
+	for (u32 ii = 0; ii < processor_count; ++ii)
+	{
+		char path[80];
+		sprintf(path, "/sys/devices/system/cpu/cpu%u/topology/thread_siblings_list", ii);
+
+		u32 leader;
+		if (!ReadSysValue(path, leader) || leader >= CAT_MAX_NUMA_PROCESSORS)
+			leader = ii;
+
+		if (leader_core[leader] == 0xffff)
+			leader_core[leader] = (u16)core_count++;
+
+		processor_core[ii] = (u8)leader_core[leader];
+	}
+
+#elif defined(CAT_OS_OSX)
+
+	u32 physical = 0;
+	size_t size = sizeof(physical);
+
+	if (0 == sysctlbyname("hw.physicalcpu", &physical, &size, 0, 0) &&
+		physical > 0 && physical <= processor_count)
+	{
+		// Siblings are numbered next to each other
+		u32 threads = processor_count / physical;
+
+		for (u32 ii = 0; ii < processor_count; ++ii)
+			processor_core[ii] = (u8)(ii / threads);
+
+		core_count = physical;
+	}
+
+#endif
+
+	// If discovery failed, treat each processor as a core
+	if (core_count < 1 || core_count > processor_count)
+	{
+		for (u32 ii = 0; ii < CAT_MAX_NUMA_PROCESSORS; ++ii)
+			processor_core[ii] = (u8)ii;
+
+		core_count = processor_count;
+	}
+
+	return core_count;
+}
+
+static void GetCacheTopology(SystemInfo::CacheLevel *caches)
+{
+	memset(caches, 0, sizeof(SystemInfo::CacheLevel) * CAT_MAX_CACHE_LEVELS);
+
+#if defined(CAT_OS_WINDOWS)
+
+	u32 count;
+	SYSTEM_LOGICAL_PROCESSOR_INFORMATION *info = GetProcessorInformation(count);
+
+	if (info)
+	{
+		for (u32 ii = 0; ii < count; ++ii)
+		{
+			if (info[ii].Relationship != RelationCache ||
+				info[ii].Cache.Type == CacheInstruction)
+				continue;
+
+			u32 level = info[ii].Cache.Level;
+			if (level < 1 || level > CAT_MAX_CACHE_LEVELS || caches[level - 1].bytes)
+				continue;
+
+			caches[level - 1].bytes = (u32)info[ii].Cache.Size;
+			caches[level - 1].sharing = (u32)BitCount(info[ii].ProcessorMask);
+		}
+
+		free(info);
+	}
+
+#elif defined(CAT_OS_LINUX)
+
+	// For each cache of the first processor,
+	for (u32 index = 0; index < 16; ++index)
+	{
+		char path[80];
+		sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%u/type", index);
+
+		FILE *file = fopen(path, "r");
+		if (!file) break;
+
+		char type[16] = {0};
+		bool instruction = (1 == fscanf(file, "%15s", type) && type[0] == 'I');
+		fclose(file);
+
+		if (instruction) continue;
+
+		u32 level, bytes;
+		sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%u/level", index);
+		if (!ReadSysValue(path, level) || level < 1 || level > CAT_MAX_CACHE_LEVELS)
+			continue;
+
+		sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%u/size", index);
+		if (!ReadSysValue(path, bytes))
+			continue;
+
+		ProcessorCounter counter;
+		sprintf(path, "/sys/devices/system/cpu/cpu0/cache/index%u/shared_cpu_list", index);
+		ReadProcessorList(path, counter);
+
+		caches[level - 1].bytes = bytes;
+		caches[level - 1].sharing = counter.count;
+	}
+
+#elif defined(CAT_OS_OSX) || defined(CAT_OS_BSD)
+
+	static const char *NAMES[CAT_MAX_CACHE_LEVELS] = {
+		"hw.l1dcachesize", "hw.l2cachesize", "hw.l3cachesize"
+	};
+
+	for (u32 ii = 0; ii < CAT_MAX_CACHE_LEVELS; ++ii)
+	{
+		u64 bytes = 0;
+		size_t size = sizeof(bytes);
+
+		if (0 == sysctlbyname(NAMES[ii], &bytes, &size, 0, 0))
+			caches[ii].bytes = (u32)bytes;
+	}
+
+#endif
+}
 
 //// SystemInfo
 
@@ -330,6 +646,39 @@ bool SystemInfo::OnInitialize()
 	_PageSize = ::GetPageSize();
 	_AllocationGranularity = ::GetAllocationGranularity();
 	_MaxSectorSize = ::GetMaxSectorSize();
+	_NodeCount = ::GetNodeTopology(_ProcessorNode);
+
+	if (_NodeCount > CAT_MAX_NUMA_NODES)
+		_NodeCount = CAT_MAX_NUMA_NODES;
+
+	_CoreCount = ::GetCoreTopology(_ProcessorCore, _ProcessorCount);
+	::GetCacheTopology(_Caches);
+	_CPUFeatures = cat::GetCPUFeatures();
 
 	return true;
 }
+
+u32 SystemInfo::GetCurrentNode()
+{
+	// If there is only one node,
+	if (_NodeCount <= 1)
+		return 0;
+
+#if defined(CAT_OS_WINDOWS)
+
+	return GetProcessorNode(GetCurrentProcessorNumber());
+
+#elif defined(CAT_OS_LINUX)
+
+	// NOTE: sched_getcpu() is serviced by the vDSO and does not enter the kernel
+	int processor = sched_getcpu();
+	if (processor < 0) return 0;
+
+	return GetProcessorNode((u32)processor);
+
+#else
+
+	return 0;
+
+#endif
+}
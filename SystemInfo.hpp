@@ -30,14 +30,28 @@
 #define CAT_SYSTEM_INFO_HPP
 
 #include <cat/lang/Singleton.hpp>
+#include <cat/port/CPUFeatures.hpp>
 
 namespace cat {
 
 
+// Highest cache level described by SystemInfo
+static const u32 CAT_MAX_CACHE_LEVELS = 3;
+
+
 class CAT_EXPORT SystemInfo : public Singleton<SystemInfo>
 {
 	bool OnInitialize();
 
+public:
+	struct CacheLevel
+	{
+		u32 bytes;			// Size of one cache at this level
+		u32 sharing;		// Number of processors sharing one cache
+	};
+
+private:
+
 	// Number of bytes in each CPU cache line
 	u32 _CacheLineBytes;
 
@@ -53,12 +67,60 @@ class CAT_EXPORT SystemInfo : public Singleton<SystemInfo>
 	// Maximum sector size of all fixed disks
 	u32 _MaxSectorSize;
 
+	// Number of NUMA nodes
+	u32 _NodeCount;
+
+	// NUMA node of each processor
+	u8 _ProcessorNode[CAT_MAX_NUMA_PROCESSORS];
+
+	// Number of physical cores
+	u32 _CoreCount;
+
+	// Physical core of each processor, shared by its SMT siblings
+	u8 _ProcessorCore[CAT_MAX_NUMA_PROCESSORS];
+
+	// Data or unified cache at each level, starting with L1
+	CacheLevel _Caches[CAT_MAX_CACHE_LEVELS];
+
+	// Bitfield of CPUFeatures
+	u32 _CPUFeatures;
+
 public:
 	CAT_INLINE u32 GetCacheLineBytes() { return _CacheLineBytes; }
 	CAT_INLINE u32 GetProcessorCount() { return _ProcessorCount; }
+	CAT_INLINE u32 GetNodeCount() { return _NodeCount; }
+	CAT_INLINE u32 GetProcessorNode(u32 processor) {
+		return processor < CAT_MAX_NUMA_PROCESSORS ? _ProcessorNode[processor] : 0;
+	}
 	CAT_INLINE u32 GetPageSize() { return _PageSize; }
 	CAT_INLINE u32 GetAllocationGranularity() { return _AllocationGranularity; }
 	CAT_INLINE u32 GetMaxSectorSize() { return _MaxSectorSize; }
+
+	// Physical cores, so GetProcessorCount() / GetCoreCount() is the SMT width
+	CAT_INLINE u32 GetCoreCount() { return _CoreCount; }
+	CAT_INLINE u32 GetProcessorCore(u32 processor) {
+		return processor < CAT_MAX_NUMA_PROCESSORS ? _ProcessorCore[processor] : 0;
+	}
+	CAT_INLINE u32 GetThreadsPerCore() {
+		return _ProcessorCount > _CoreCount ? _ProcessorCount / _CoreCount : 1;
+	}
+
+	// Level 1 is the L1 data cache.  Returns 0 for levels that are unknown or absent
+	CAT_INLINE u32 GetCacheBytes(u32 level) {
+		return level >= 1 && level <= CAT_MAX_CACHE_LEVELS ? _Caches[level - 1].bytes : 0;
+	}
+	CAT_INLINE u32 GetCacheSharing(u32 level) {
+		return level >= 1 && level <= CAT_MAX_CACHE_LEVELS ? _Caches[level - 1].sharing : 0;
+	}
+
+	// Bitfield of CPUFeatures supported by both the processor and the OS
+	CAT_INLINE u32 GetCPUFeatures() { return _CPUFeatures; }
+
+	// Returns true if all of the CPUFeatures flags given are supported
+	CAT_INLINE bool HasCPUFeatures(u32 features) { return (_CPUFeatures & features) == features; }
+
+	// Returns the NUMA node of the processor the calling thread is running on
+	u32 GetCurrentNode();
 };
 
 
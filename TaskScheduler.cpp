@@ -0,0 +1,502 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "TaskScheduler.hpp"
+#include "WaitableFlag.hpp"
+#include "SystemInfo.hpp"
+#include "Thread.hpp"
+#include "Atomic.hpp"
+#include <new>
+using namespace cat;
+
+// x86 does not reorder stores with stores or loads with loads, so the
+// deque only needs the compiler to keep them in order
+#if defined(CAT_ISA_X86)
+# define CAT_TASK_STORE_BARRIER() CAT_FENCE_COMPILER
+# define CAT_TASK_LOAD_BARRIER() CAT_FENCE_COMPILER
+#else
+# define CAT_TASK_STORE_BARRIER() Atomic::StoreMemoryBarrier()
+# define CAT_TASK_LOAD_BARRIER() Atomic::DataMemoryBarrier()
+#endif
+
+
+//// TaskWorker
+
+class cat::TaskWorker : public Thread
+{
+	friend class TaskScheduler;
+
+	// Tasks queued on each worker before overflowing to the shared queue
+	static const u32 DEQUE_SIZE = 4096;
+	static const u32 DEQUE_MASK = DEQUE_SIZE - 1;
+
+	// Sleeping workers also look for work this often, in case of a missed wake
+	static const int IDLE_WAIT_MSEC = 100;
+
+	TaskScheduler *_scheduler;
+	u32 _index;
+	u32 _victim_seed;
+
+	WaitableFlag _wake;
+	volatile u32 _asleep;
+
+	EpochParticipant *_epoch;
+
+	// Thieves take from the top and the owner works at the bottom,
+	// so keep them on separate cache lines
+	volatile u32 _top;
+	u8 _padding[CAT_DEFAULT_CACHE_LINE_SIZE];
+	volatile u32 _bottom;
+
+	TaskDelegate _tasks[DEQUE_SIZE];
+
+	bool Entrypoint(void *param);
+
+	// Run a task inside an epoch read section if there is a reclaimer
+	void Run(const TaskDelegate &task);
+
+public:
+	TaskWorker(TaskScheduler *scheduler, u32 index)
+	{
+		_scheduler = scheduler;
+		_index = index;
+		_victim_seed = index * 0x9E3779B9 + 1;
+		_asleep = 0;
+		_epoch = 0;
+		_top = 0;
+		_bottom = 0;
+	}
+
+	// Owner only: returns false if the deque is full
+	bool Push(const TaskDelegate &task);
+
+	// Owner only: take the most recently pushed task
+	bool Pop(TaskDelegate &task);
+
+	// Any thread: take the oldest task
+	bool Steal(TaskDelegate &task);
+
+	// Pick a random worker index to start stealing from
+	CAT_INLINE u32 NextVictim(u32 count)
+	{
+		u32 x = _victim_seed;
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		_victim_seed = x;
+		return x % count;
+	}
+};
+
+// Worker running on this thread, if any
+static CAT_TLS TaskWorker *m_current_worker = 0;
+
+bool TaskWorker::Push(const TaskDelegate &task)
+{
+	u32 b = _bottom;
+	u32 t = _top;
+
+	// A stale top only makes the deque look fuller than it is
+	if (b - t >= DEQUE_SIZE) return false;
+
+	_tasks[b & DEQUE_MASK] = task;
+
+	// Publish the task before the new bottom
+	CAT_TASK_STORE_BARRIER();
+
+	_bottom = b + 1;
+
+	return true;
+}
+
+bool TaskWorker::Pop(TaskDelegate &task)
+{
+	u32 b = _bottom - 1;
+
+	// Claim the bottom task before reading top, with a full barrier
+	Atomic::Set(&_bottom, b);
+
+	u32 t = _top;
+
+	// If it was empty,
+	if ((s32)(b - t) < 0)
+	{
+		_bottom = t;
+		return false;
+	}
+
+	task = _tasks[b & DEQUE_MASK];
+
+	// If there is more than one task, no thief can reach this one
+	if (b != t) return true;
+
+	// Otherwise race thieves for the last task
+	bool won = Atomic::CAS(&_top, t, t + 1);
+
+	_bottom = t + 1;
+
+	return won;
+}
+
+bool TaskWorker::Steal(TaskDelegate &task)
+{
+	for (;;)
+	{
+		u32 t = _top;
+
+		CAT_TASK_LOAD_BARRIER();
+
+		u32 b = _bottom;
+
+		// If it is empty,
+		if ((s32)(b - t) <= 0) return false;
+
+		// The copy may be torn if another thief wins, but then the CAS fails
+		TaskDelegate stolen = _tasks[t & DEQUE_MASK];
+
+		if (Atomic::CAS(&_top, t, t + 1))
+		{
+			task = stolen;
+			return true;
+		}
+	}
+}
+
+void TaskWorker::Run(const TaskDelegate &task)
+{
+	if (_epoch)
+	{
+		_epoch->Enter();
+		task();
+		_epoch->Leave();
+	}
+	else
+	{
+		task();
+	}
+}
+
+bool TaskWorker::Entrypoint(void *param)
+{
+	m_current_worker = this;
+
+	EpochReclaimer *reclaimer = _scheduler->_reclaimer;
+	if (reclaimer) _epoch = reclaimer->Register();
+
+	TaskDelegate task;
+
+	for (;;)
+	{
+		if (_scheduler->FindTask(this, task))
+		{
+			Run(task);
+			continue;
+		}
+
+		// Stop once there is nothing left to do
+		if (_scheduler->_stop) break;
+
+		// Use the idle time to release retired memory
+		if (_epoch && _epoch->GetPendingCount())
+			_epoch->Collect();
+
+		// Announce sleep, then look once more so a task that was queued
+		// in between is not left waiting for the timeout
+		Atomic::Set(&_asleep, 1);
+
+		if (_scheduler->FindTask(this, task))
+		{
+			_asleep = 0;
+			Run(task);
+			continue;
+		}
+
+		if (_scheduler->_stop) break;
+
+		_wake.Wait(IDLE_WAIT_MSEC);
+
+		_asleep = 0;
+	}
+
+	if (_epoch)
+	{
+		reclaimer->Unregister(_epoch);
+		_epoch = 0;
+	}
+
+	m_current_worker = 0;
+
+	return true;
+}
+
+
+//// TaskScheduler
+
+TaskScheduler::TaskScheduler()
+{
+	_workers = 0;
+	_worker_count = 0;
+	_reclaimer = 0;
+	_wake_index = 0;
+	_stop = true;
+
+	_shared = 0;
+	_shared_size = 0;
+	_shared_head = 0;
+	_shared_count = 0;
+	_shared_pending = 0;
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	Shutdown();
+
+	delete []_shared;
+}
+
+bool TaskScheduler::Initialize(u32 worker_count, EpochReclaimer *reclaimer)
+{
+	if (_workers) return false;
+
+	_reclaimer = reclaimer;
+
+	u32 processors = SystemInfo::ref()->GetProcessorCount();
+	if (processors < 1) processors = 1;
+
+	if (worker_count == 0) worker_count = processors;
+
+	_workers = new (std::nothrow) TaskWorker*[worker_count];
+	if (!_workers) return false;
+
+	_stop = false;
+
+	// Workers look at each other as soon as they start, so create them all first
+	for (u32 ii = 0; ii < worker_count; ++ii)
+	{
+		_workers[ii] = new (std::nothrow) TaskWorker(this, ii);
+
+		if (!_workers[ii] || !_workers[ii]->_wake.Valid())
+		{
+			delete _workers[ii];
+			_worker_count = ii;
+			Shutdown();
+			return false;
+		}
+	}
+
+	_worker_count = worker_count;
+
+	for (u32 ii = 0; ii < worker_count; ++ii)
+	{
+		if (!_workers[ii]->StartThread())
+		{
+			// Stop the ones that did start, then free them all
+			_stop = true;
+
+			for (u32 jj = 0; jj < ii; ++jj)
+			{
+				_workers[jj]->_wake.Set();
+				_workers[jj]->WaitForThread();
+			}
+
+			for (u32 jj = 0; jj < worker_count; ++jj)
+				delete _workers[jj];
+
+			delete []_workers;
+			_workers = 0;
+			_worker_count = 0;
+
+			return false;
+		}
+
+		_workers[ii]->SetIdealCore(ii % processors);
+	}
+
+	return true;
+}
+
+void TaskScheduler::Shutdown()
+{
+	if (!_workers) return;
+
+	// Workers drain every queue before they see the stop flag
+	_stop = true;
+
+	for (u32 ii = 0; ii < _worker_count; ++ii)
+		_workers[ii]->_wake.Set();
+
+	for (u32 ii = 0; ii < _worker_count; ++ii)
+		_workers[ii]->WaitForThread();
+
+	// Tasks queued after the workers stopped looking are run here
+	TaskDelegate task;
+	while (PopShared(task))
+		task();
+
+	for (u32 ii = 0; ii < _worker_count; ++ii)
+		delete _workers[ii];
+
+	delete []_workers;
+	_workers = 0;
+	_worker_count = 0;
+}
+
+bool TaskScheduler::PushShared(const TaskDelegate &task)
+{
+	AutoMutex lock(_shared_lock);
+
+	// If the ring is full, double it
+	if (_shared_count >= _shared_size)
+	{
+		u32 size = _shared_size ? _shared_size * 2 : 256;
+
+		TaskDelegate *ring = new (std::nothrow) TaskDelegate[size];
+		if (!ring) return false;
+
+		for (u32 ii = 0; ii < _shared_count; ++ii)
+			ring[ii] = _shared[(_shared_head + ii) & (_shared_size - 1)];
+
+		delete []_shared;
+		_shared = ring;
+		_shared_size = size;
+		_shared_head = 0;
+	}
+
+	_shared[(_shared_head + _shared_count) & (_shared_size - 1)] = task;
+	++_shared_count;
+
+	_shared_pending = _shared_count;
+
+	return true;
+}
+
+bool TaskScheduler::PopShared(TaskDelegate &task)
+{
+	// Skip the lock when the queue is empty
+	if (!_shared_pending) return false;
+
+	AutoMutex lock(_shared_lock);
+
+	if (!_shared_count) return false;
+
+	task = _shared[_shared_head];
+	_shared_head = (_shared_head + 1) & (_shared_size - 1);
+	--_shared_count;
+
+	_shared_pending = _shared_count;
+
+	return true;
+}
+
+bool TaskScheduler::FindTask(TaskWorker *worker, TaskDelegate &task)
+{
+	// Own deque first: newest task, whose data is likely still in cache
+	if (worker && worker->Pop(task))
+		return true;
+
+	if (PopShared(task))
+		return true;
+
+	u32 count = _worker_count;
+	if (count == 0) return false;
+
+	u32 start = worker ? worker->NextVictim(count) : Atomic::Add(&_wake_index, 1) % count;
+
+	for (u32 ii = 0; ii < count; ++ii)
+	{
+		TaskWorker *victim = _workers[(start + ii) % count];
+
+		if (victim != worker && victim->Steal(task))
+			return true;
+	}
+
+	return false;
+}
+
+void TaskScheduler::WakeOne()
+{
+	u32 count = _worker_count;
+	u32 start = Atomic::Add(&_wake_index, 1);
+
+	for (u32 ii = 0; ii < count; ++ii)
+	{
+		TaskWorker *worker = _workers[(start + ii) % count];
+
+		// If this worker was asleep and nobody else woke it,
+		if (worker->_asleep && Atomic::Set(&worker->_asleep, 0) == 1)
+		{
+			worker->_wake.Set();
+			return;
+		}
+	}
+}
+
+bool TaskScheduler::Submit(const TaskDelegate &task)
+{
+	// Tasks may still queue more work while Shutdown() drains
+	if (!_workers) return false;
+
+	TaskWorker *worker = m_current_worker;
+
+	// If not called from one of our workers, or its deque is full,
+	if (!worker || worker->_scheduler != this || !worker->Push(task))
+	{
+		if (!PushShared(task))
+			return false;
+	}
+
+	WakeOne();
+
+	return true;
+}
+
+bool TaskScheduler::RunOne()
+{
+	if (!_workers) return false;
+
+	TaskWorker *worker = m_current_worker;
+	if (worker && worker->_scheduler != this) worker = 0;
+
+	TaskDelegate task;
+	if (!FindTask(worker, task))
+		return false;
+
+	if (worker) worker->Run(task);
+	else task();
+
+	return true;
+}
+
+EpochParticipant *TaskScheduler::GetWorkerEpoch()
+{
+	TaskWorker *worker = m_current_worker;
+
+	if (!worker || worker->_scheduler != this) return 0;
+
+	return worker->_epoch;
+}
@@ -0,0 +1,120 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_TASK_SCHEDULER_HPP
+#define CAT_TASK_SCHEDULER_HPP
+
+#include "Delegates.hpp"
+#include "Mutex.hpp"
+#include "EpochReclaimer.hpp"
+
+namespace cat {
+
+
+/*
+	Work-stealing task scheduler
+
+	One worker thread runs on each core, pinned with Thread::SetIdealCore.
+	Each worker owns a Chase-Lev deque: it pushes and pops tasks at the
+	bottom without locking, and idle workers steal from the top of other
+	workers' deques.  Tasks submitted from outside the pool go on a shared
+	queue that workers check before stealing.
+
+	Idle workers sleep on a WaitableFlag and are woken one at a time as
+	tasks arrive.
+
+	Tasks are Delegate0<void> objects, so no memory is allocated per task.
+	To wait for a batch of tasks, count them down with Atomic::Add and
+	call RunOne() while waiting so the waiting thread helps out.
+
+	Given an EpochReclaimer, each worker registers a participant and runs
+	every task inside a read section, so tasks can read lock-free
+	structures and retire memory through GetWorkerEpoch() without any
+	setup of their own.  Idle workers collect retired memory.
+*/
+
+typedef Delegate0<void> TaskDelegate;
+
+class TaskWorker;
+
+class CAT_EXPORT TaskScheduler
+{
+	friend class TaskWorker;
+
+	TaskWorker **_workers;
+	u32 _worker_count;
+	EpochReclaimer *_reclaimer;
+	volatile u32 _wake_index;	// Rotates which sleeping worker is woken first
+	volatile bool _stop;
+
+	// Shared ring of tasks submitted from outside the pool
+	Mutex _shared_lock;
+	TaskDelegate *_shared;
+	u32 _shared_size, _shared_head, _shared_count;
+	volatile u32 _shared_pending;	// Checked without the lock
+
+	bool PushShared(const TaskDelegate &task);
+	bool PopShared(TaskDelegate &task);
+	bool FindTask(TaskWorker *worker, TaskDelegate &task);
+	void WakeOne();
+
+	CAT_NO_COPY(TaskScheduler);
+
+public:
+	TaskScheduler();
+	~TaskScheduler();
+
+	// Start the workers.  0 = one per processor from SystemInfo.
+	// With a reclaimer, tasks run inside epoch read sections
+	bool Initialize(u32 worker_count = 0, EpochReclaimer *reclaimer = 0);
+
+	// Run every task that is still queued, including tasks they queue,
+	// then stop the workers
+	void Shutdown();
+
+	CAT_INLINE u32 GetWorkerCount() { return _worker_count; }
+
+	// Queue a task to run on some worker.  From one of this scheduler's
+	// workers it goes on the worker's own deque.
+	// Returns false on out of memory or when not initialized
+	bool Submit(const TaskDelegate &task);
+
+	// Run one queued task on the calling thread.
+	// Returns false if there was nothing to run
+	bool RunOne();
+
+	// Epoch participant of the calling worker thread, or 0 if called from
+	// another thread or there is no reclaimer.  Tasks run by RunOne() on
+	// other threads are not inside a read section
+	EpochParticipant *GetWorkerEpoch();
+};
+
+
+} // namespace cat
+
+#endif // CAT_TASK_SCHEDULER_HPP
@@ -53,6 +53,46 @@ bool cat::SetExecPriority(ThreadPrio prio)
 #endif
 }
 
+ThreadPrio cat::GetExecPriority()
+{
+#if defined(CAT_OS_WINDOWS)
+	int level = ::GetThreadPriority(::GetCurrentThread());
+
+	if (level <= THREAD_PRIORITY_IDLE) return P_IDLE;
+	if (level < THREAD_PRIORITY_NORMAL) return P_LOW;
+	if (level == THREAD_PRIORITY_NORMAL) return P_NORMAL;
+	if (level < THREAD_PRIORITY_HIGHEST) return P_HIGH;
+	return P_HIGHEST;
+#else
+	return P_NORMAL;
+#endif
+}
+
+bool cat::SetExecCore(u32 index)
+{
+#if defined(CAT_OS_WINDOWS)
+
+	if (index >= sizeof(DWORD_PTR) * 8) return false;
+
+	return 0 != ::SetThreadAffinityMask(::GetCurrentThread(), (DWORD_PTR)1 << index);
+
+#elif defined(CAT_OS_LINUX) && !defined(CAT_OS_ANDROID)
+
+	if (index >= CPU_SETSIZE) return false;
+
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(index, &cpus);
+
+	return 0 == pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+#else
+
+	return false;
+
+#endif
+}
+
 
 //// GetThreadID
 
@@ -190,6 +230,18 @@ void Thread::SetIdealCore(u32 index)
 	if (_thread)
 		SetThreadIdealProcessor(_thread, index);
 
+#elif defined(CAT_OS_LINUX) && !defined(CAT_OS_ANDROID)
+
+	// There is no soft preference on Linux, so pin the thread instead
+	if (_thread_running && index < CPU_SETSIZE)
+	{
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(index, &cpus);
+
+		pthread_setaffinity_np(_thread, sizeof(cpus), &cpus);
+	}
+
 #endif
 }
 
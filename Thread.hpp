@@ -51,6 +51,13 @@ enum ThreadPrio
 
 bool SetExecPriority(ThreadPrio prio = P_NORMAL);
 
+// Priority of the calling thread, rounded to the nearest level above.
+// P_NORMAL where SetExecPriority() is not supported
+ThreadPrio GetExecPriority();
+
+// Pin the calling thread to one processor core
+bool SetExecCore(u32 index);
+
 u32 GetThreadID();
 
 
@@ -75,6 +82,11 @@ protected:
 
 public:
 	bool StartThread(void *param = 0);
+
+	// Prefer the processor with the given index, counting from 0.  On Windows
+	// this is a hint to the scheduler.  Linux has no soft preference, so the
+	// thread is pinned to that processor there, and an index past the last
+	// processor is ignored.  Wrap the index to the processor count first
 	void SetIdealCore(u32 index);
 	bool WaitForThread(int milliseconds = -1); // < 0 = infinite wait
 	void AbortThread();
@@ -0,0 +1,271 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "TimerWheel.hpp"
+#include "LinkedLists.hpp"
+using namespace cat;
+
+
+//// TimerWheel
+
+TimerWheel::TimerWheel()
+{
+	_clock = 0;
+	_tick_msec = 1;
+	_start_msec = 0;
+	_current = 0;
+	_expired = 0;
+	_count = 0;
+	_next_tick_msec = 0;
+	_wait_until_msec = 0;
+	_wake.Invalidate();
+
+	CAT_OBJCLR(_slots);
+}
+
+void TimerWheel::Initialize(Clock *clock, u32 tick_msec)
+{
+	AutoAdaptiveMutex lock(_lock);
+
+	_clock = clock;
+	_tick_msec = tick_msec ? tick_msec : 1;
+	_start_msec = clock->msec_cached();
+
+	// Workers may be waiting without a timeout, so wake them for the first timer
+	_wait_until_msec = MAX_WAIT_MSEC;
+}
+
+void TimerWheel::SetWakeCallback(const TimerDelegate &wake)
+{
+	AutoAdaptiveMutex lock(_lock);
+
+	_wake = wake;
+}
+
+void TimerWheel::SkipIdle(u64 now_tick)
+{
+	// With no timers in the wheels there is nothing to cascade, so jump
+	// straight to the tick after now instead of visiting every slot
+	if (_count == 0 && _current <= now_tick)
+	{
+		_current = now_tick + 1;
+		_next_tick_msec = (u32)(_current * _tick_msec);
+	}
+}
+
+void TimerWheel::Link(WheelTimer *timer)
+{
+	u64 expire = timer->_expire;
+	if (expire < _current) expire = _current;
+
+	u64 delta = expire - _current;
+
+	// Find the lowest wheel that spans the delay
+	u32 level = 0;
+	while (level < LEVELS - 1 && delta >> ((level + 1) * SLOT_BITS))
+		++level;
+
+	// If it is beyond the top wheel, shorten it
+	if (delta >> (LEVELS * SLOT_BITS))
+		expire = _current + ((u64)1 << (LEVELS * SLOT_BITS)) - 1;
+
+	timer->_expire = expire;
+
+	WheelTimer **head = &_slots[level][(u32)(expire >> (level * SLOT_BITS)) & SLOT_MASK];
+
+	CAT_FDLL_PUSH_FRONT(*head, timer, _next, _prev);
+	timer->_head = head;
+}
+
+void TimerWheel::Unlink(WheelTimer *timer)
+{
+	CAT_FDLL_ERASE(*timer->_head, timer, _next, _prev);
+	timer->_head = 0;
+}
+
+void TimerWheel::Cascade(u32 level, u32 slot)
+{
+	// Detach the list first: a timer may hash back into the same slot
+	WheelTimer *timer = _slots[level][slot];
+	_slots[level][slot] = 0;
+
+	while (timer)
+	{
+		WheelTimer *next = timer->_next;
+
+		Link(timer);
+
+		timer = next;
+	}
+}
+
+void TimerWheel::Advance()
+{
+	u32 index = (u32)_current & SLOT_MASK;
+
+	// When the first wheel starts a lap, bring down the next slot from the
+	// wheel above, and so on up while those wheels start laps too
+	if (index == 0)
+	{
+		for (u32 level = 1; level < LEVELS; ++level)
+		{
+			u32 slot = (u32)(_current >> (level * SLOT_BITS)) & SLOT_MASK;
+
+			Cascade(level, slot);
+
+			if (slot != 0) break;
+		}
+	}
+
+	// Everything left in this slot expires on this tick
+	WheelTimer *timer = _slots[0][index];
+	_slots[0][index] = 0;
+
+	while (timer)
+	{
+		WheelTimer *next = timer->_next;
+
+		CAT_FDLL_PUSH_FRONT(_expired, timer, _next, _prev);
+		timer->_head = &_expired;
+		--_count;
+
+		timer = next;
+	}
+
+	++_current;
+	_next_tick_msec = (u32)(_current * _tick_msec);
+}
+
+void TimerWheel::Set(WheelTimer *timer, u32 delay_msec)
+{
+	u64 now = _clock->msec_cached() - _start_msec;
+
+	AutoAdaptiveMutex lock(_lock);
+
+	// If it is already pending,
+	if (timer->_head)
+	{
+		if (timer->_head != &_expired) --_count;
+		Unlink(timer);
+	}
+
+	SkipIdle(now / _tick_msec);
+
+	// Round up so that it never fires early
+	timer->_expire = (now + delay_msec + _tick_msec - 1) / _tick_msec;
+
+	Link(timer);
+	++_count;
+
+	// If it is due before the waiting workers would wake up,
+	u32 expire_msec = (u32)(timer->_expire * _tick_msec);
+	if (!_wake.IsValid() || (s32)(expire_msec - _wait_until_msec) >= 0)
+		return;
+
+	// Count on the woken worker to be back in time for it
+	_wait_until_msec = expire_msec;
+
+	TimerDelegate wake = _wake;
+
+	lock.Release();
+
+	wake();
+}
+
+bool TimerWheel::Cancel(WheelTimer *timer)
+{
+	AutoAdaptiveMutex lock(_lock);
+
+	if (!timer->_head) return false;
+
+	if (timer->_head != &_expired) --_count;
+	Unlink(timer);
+
+	return true;
+}
+
+u32 TimerWheel::Tick()
+{
+	if (!_clock) return 0;
+
+	u64 now = (_clock->msec_cached() - _start_msec) / _tick_msec;
+
+	_lock.Enter();
+
+	SkipIdle(now);
+
+	while (_current <= now)
+		Advance();
+
+	// Run due callbacks one at a time, so other callers can help and
+	// each callback is free to take the lock
+	u32 fired = 0;
+
+	while (_expired)
+	{
+		WheelTimer *timer = _expired;
+		Unlink(timer);
+
+		TimerDelegate callback = timer->callback;
+
+		_lock.Leave();
+
+		callback();
+		++fired;
+
+		_lock.Enter();
+	}
+
+	_lock.Leave();
+
+	return fired;
+}
+
+u32 TimerWheel::GetWaitMsec(u32 max_msec)
+{
+	if (HasExpired()) return 0;
+	if (!_clock) return max_msec;
+
+	u32 now = Elapsed32();
+	u32 wait = max_msec;
+
+	if (_count)
+	{
+		// Time until the start of the next unprocessed tick
+		s32 next = (s32)(_next_tick_msec - now);
+
+		if (next <= 0) return 0;
+
+		if ((u32)next < wait) wait = (u32)next;
+	}
+
+	// Remember when this worker will be back, keeping it comparable
+	_wait_until_msec = now + (wait < MAX_WAIT_MSEC ? wait : MAX_WAIT_MSEC);
+
+	return wait;
+}
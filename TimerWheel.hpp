@@ -0,0 +1,169 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_TIMER_WHEEL_HPP
+#define CAT_TIMER_WHEEL_HPP
+
+#include "Delegates.hpp"
+#include "AdaptiveMutex.hpp"
+#include "Clock.hpp"
+
+namespace cat {
+
+
+/*
+	Hierarchical timer wheel
+
+	Timers are kept in LEVELS wheels of SLOTS lists each.  The first wheel
+	has one slot per tick, and each wheel above it has slots SLOTS times
+	wider.  A timer is hashed into the lowest wheel that spans its expiry,
+	and is moved down a wheel each time the wheel below completes a lap.
+	Set() and Cancel() are O(1), and each Tick() only touches the slots of
+	the ticks that have passed.
+
+	Delays are rounded up to whole ticks, so a timer never fires early.
+	Delays longer than 2^32 ticks are shortened to that.
+
+	Tick() is meant to be called from worker threads, for example by a
+	SocketEngine that has been handed the wheel with SetTimers().  Several
+	threads may call it at once: one advances the wheel and every caller
+	helps run the callbacks that are due.  Callbacks run without the wheel
+	lock held, so they may set or cancel timers, including their own.
+
+	Workers size their waits with GetWaitMsec(), which remembers when they
+	planned to wake up.  If Set() arms a timer that is due before then, it
+	invokes the wake callback so that a worker can shorten its wait.
+*/
+
+class TimerWheel;
+
+typedef Delegate0<void> TimerDelegate;
+
+
+// Embed in the object that owns the timer
+class CAT_EXPORT WheelTimer
+{
+	friend class TimerWheel;
+
+	WheelTimer *_next, *_prev;
+	WheelTimer **_head;		// List the timer is on, or 0 if it is not pending
+	u64 _expire;			// Tick it fires on
+
+public:
+	CAT_INLINE WheelTimer() { _head = 0; }
+
+	// Invoked on the thread that calls TimerWheel::Tick()
+	TimerDelegate callback;
+};
+
+
+class CAT_EXPORT TimerWheel
+{
+	static const u32 LEVELS = 4;
+	static const u32 SLOT_BITS = 8;
+	static const u32 SLOTS = 1 << SLOT_BITS;
+	static const u32 SLOT_MASK = SLOTS - 1;
+
+	// Longest wait that still compares correctly in 32 bits
+	static const u32 MAX_WAIT_MSEC = 0x7fffffff;
+
+	Clock *_clock;
+	u32 _tick_msec;
+	u64 _start_msec;
+
+	AdaptiveMutex _lock;
+	u64 _current;			// Next tick to process
+	WheelTimer *_slots[LEVELS][SLOTS];
+	WheelTimer *_expired;	// Due timers whose callbacks have not started
+
+	// Read without the lock by IsDue() and GetWaitMsec()
+	volatile u32 _count;			// Timers in the wheels
+	volatile u32 _next_tick_msec;	// Low 32 bits of when tick _current starts
+
+	// Low 32 bits of when the waiting workers planned to wake up at the latest
+	volatile u32 _wait_until_msec;
+	TimerDelegate _wake;
+
+	CAT_INLINE bool HasExpired() { return *(WheelTimer * volatile *)&_expired != 0; }
+
+	// Milliseconds since Initialize(), truncated to 32 bits
+	CAT_INLINE u32 Elapsed32() { return (u32)(_clock->msec_cached() - _start_msec); }
+
+	// Call with the lock held
+	void SkipIdle(u64 now_tick);
+	void Link(WheelTimer *timer);
+	void Unlink(WheelTimer *timer);
+	void Cascade(u32 level, u32 slot);
+	void Advance();
+
+	CAT_NO_COPY(TimerWheel);
+
+public:
+	TimerWheel();
+
+	// Times are read from clock->msec_cached(), so start its ticker
+	// at the tick resolution or finer
+	void Initialize(Clock *clock, u32 tick_msec = 10);
+
+	CAT_INLINE u32 GetTickMsec() { return _tick_msec; }
+
+	// Invoked outside the lock when Set() arms a timer that is due before
+	// the waiting workers would wake up.  Pass an invalid delegate to stop
+	void SetWakeCallback(const TimerDelegate &wake);
+
+	// Fire timer->callback after delay_msec.  A pending timer is moved
+	void Set(WheelTimer *timer, u32 delay_msec);
+
+	// Returns true if the timer was pending, and false if it had already
+	// fired (its callback may be running now) or was never set
+	bool Cancel(WheelTimer *timer);
+
+	// Advance the wheel to the current time and run callbacks that are due.
+	// Returns the number of callbacks run by this caller
+	u32 Tick();
+
+	// Cheap check without the lock for whether Tick() has anything to do
+	CAT_INLINE bool IsDue()
+	{
+		if (HasExpired()) return true;
+		if (!_count || !_clock) return false;
+
+		return (s32)(Elapsed32() - _next_tick_msec) >= 0;
+	}
+
+	// Milliseconds a worker may wait before it should call Tick() again,
+	// at most max_msec: 0 if callbacks are due, the time to the next tick
+	// if any timer is set, and max_msec otherwise.  Does not take the lock.
+	// The result is remembered so that Set() knows when to wake a worker
+	u32 GetWaitMsec(u32 max_msec);
+};
+
+
+} // namespace cat
+
+#endif // CAT_TIMER_WHEEL_HPP
@@ -0,0 +1,146 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "WaitableFlag.hpp"
+using namespace cat;
+
+#if !defined(CAT_OS_WINDOWS)
+# include <sys/time.h>
+# include <errno.h>
+#endif
+
+
+//// WaitableFlag
+
+WaitableFlag::WaitableFlag()
+{
+#if defined(CAT_OS_WINDOWS)
+
+	// Auto-reset and initially clear
+	_event = CreateEvent(0, FALSE, FALSE, 0);
+
+#else
+
+	_flag = false;
+	_valid_cond = pthread_cond_init(&_cond, 0) == 0;
+	_valid_mutex = pthread_mutex_init(&_mutex, 0) == 0;
+
+#endif
+}
+
+WaitableFlag::~WaitableFlag()
+{
+#if defined(CAT_OS_WINDOWS)
+
+	if (_event) CloseHandle(_event);
+
+#else
+
+	if (_valid_cond) pthread_cond_destroy(&_cond);
+	if (_valid_mutex) pthread_mutex_destroy(&_mutex);
+
+#endif
+}
+
+bool WaitableFlag::Valid()
+{
+#if defined(CAT_OS_WINDOWS)
+
+	return _event != 0;
+
+#else
+
+	return _valid_cond && _valid_mutex;
+
+#endif
+}
+
+bool WaitableFlag::Set()
+{
+#if defined(CAT_OS_WINDOWS)
+
+	return _event && SetEvent(_event) != 0;
+
+#else
+
+	if (!Valid()) return false;
+
+	pthread_mutex_lock(&_mutex);
+	_flag = true;
+	pthread_cond_signal(&_cond);
+	pthread_mutex_unlock(&_mutex);
+
+	return true;
+
+#endif
+}
+
+bool WaitableFlag::Wait(int milliseconds)
+{
+#if defined(CAT_OS_WINDOWS)
+
+	if (!_event) return false;
+
+	return WaitForSingleObject(_event, milliseconds >= 0 ? milliseconds : INFINITE) == WAIT_OBJECT_0;
+
+#else
+
+	if (!Valid()) return false;
+
+	struct timespec deadline;
+
+	if (milliseconds >= 0)
+	{
+		struct timeval now;
+		gettimeofday(&now, 0);
+
+		u64 nsec = (u64)now.tv_usec * 1000 + (u64)(milliseconds % 1000) * 1000000;
+		deadline.tv_sec = now.tv_sec + milliseconds / 1000 + (time_t)(nsec / 1000000000);
+		deadline.tv_nsec = (long)(nsec % 1000000000);
+	}
+
+	pthread_mutex_lock(&_mutex);
+
+	// Loop on the flag since condition variables can wake spuriously
+	while (!_flag)
+	{
+		if (milliseconds < 0)
+			pthread_cond_wait(&_cond, &_mutex);
+		else if (pthread_cond_timedwait(&_cond, &_mutex, &deadline) == ETIMEDOUT)
+			break;
+	}
+
+	bool set = _flag;
+	_flag = false;
+
+	pthread_mutex_unlock(&_mutex);
+
+	return set;
+
+#endif
+}
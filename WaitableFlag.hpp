@@ -0,0 +1,79 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_WAITABLE_FLAG_HPP
+#define CAT_WAITABLE_FLAG_HPP
+
+#include "Platform.hpp"
+
+#if defined(CAT_OS_WINDOWS)
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#else
+# include <pthread.h>
+#endif
+
+namespace cat {
+
+
+/*
+	A flag that one thread can block on until another thread sets it.
+
+	The flag resets itself when a waiting thread wakes up, and a Set()
+	made while nobody is waiting is kept for the next Wait().
+*/
+class CAT_EXPORT WaitableFlag
+{
+#if defined(CAT_OS_WINDOWS)
+	HANDLE _event;
+#else
+	bool _valid_cond, _valid_mutex;
+	bool _flag;
+	pthread_cond_t _cond;
+	pthread_mutex_t _mutex;
+#endif
+
+	CAT_NO_COPY(WaitableFlag);
+
+public:
+	WaitableFlag();
+	~WaitableFlag();
+
+	bool Valid();
+
+	// Wake one waiting thread, or the next one to wait
+	bool Set();
+
+	// Returns false on timeout.  Negative milliseconds = wait forever
+	bool Wait(int milliseconds = -1);
+};
+
+
+} // namespace cat
+
+#endif // CAT_WAITABLE_FLAG_HPP
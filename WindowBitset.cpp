@@ -0,0 +1,270 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "WindowBitset.hpp"
+#include "BitMath.hpp"
+#include "CPUFeatures.hpp"
+using namespace cat;
+
+#if defined(CAT_X86_DISPATCH)
+# define CAT_WINDOW_X86_DISPATCH
+# include <immintrin.h>
+#endif
+
+
+//// Word scanning
+
+// Returns the first word at or after ii where (word ^ flip) is non-zero,
+// stepping over whole groups of words that match the flip pattern.
+// May return a word up to end if all of them match
+static u32 SkipWordsGeneric(const u32 *words, u32 ii, u32 end, u32 flip)
+{
+	while (ii + 4 <= end &&
+		   ((words[ii] ^ flip) | (words[ii + 1] ^ flip) |
+			(words[ii + 2] ^ flip) | (words[ii + 3] ^ flip)) == 0)
+	{
+		ii += 4;
+	}
+
+	return ii;
+}
+
+#if defined(CAT_WINDOW_X86_DISPATCH)
+
+CAT_TARGET_AVX2 static u32 SkipWordsAVX2(const u32 *words, u32 ii, u32 end, u32 flip)
+{
+	const __m256i f = _mm256_set1_epi32(flip);
+
+	// Two vectors (512 bits) per test
+	while (ii + 16 <= end)
+	{
+		__m256i a = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(words + ii)), f);
+		__m256i b = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(words + ii + 8)), f);
+		__m256i x = _mm256_or_si256(a, b);
+
+		if (!_mm256_testz_si256(x, x))
+			break;
+
+		ii += 16;
+	}
+
+	return SkipWordsGeneric(words, ii, end, flip);
+}
+
+#endif // CAT_WINDOW_X86_DISPATCH
+
+// Returns the first bit in [begin, end) where (word ^ flip) is set, or end
+static u32 ScanWords(const u32 *words, u32 begin, u32 end, u32 flip)
+{
+	u32 ii = begin >> 5;
+	const u32 end_word = (end + 31) >> 5;
+
+	// Mask off bits before the start in the first word
+	u32 w = (words[ii] ^ flip) & ((u32)~(u32)0 << (begin & 31));
+
+	while (!w)
+	{
+		if (++ii >= end_word)
+			return end;
+
+#if defined(CAT_WINDOW_X86_DISPATCH)
+		if (HasCPUFeatures(CPU_AVX2))
+			ii = SkipWordsAVX2(words, ii, end_word, flip);
+		else
+#endif
+			ii = SkipWordsGeneric(words, ii, end_word, flip);
+
+		if (ii >= end_word)
+			return end;
+
+		w = words[ii] ^ flip;
+	}
+
+	u32 bit = (ii << 5) + BSF32(w);
+	return bit < end ? bit : end;
+}
+
+// Clear bits [begin, end) of the word array
+static void ClearWords(u32 *words, u32 begin, u32 end, bool atomic)
+{
+	while (begin < end)
+	{
+		u32 ii = begin >> 5;
+		u32 first = begin & 31;
+		u32 count = end - begin;
+		if (count > 32 - first)
+			count = 32 - first;
+
+		if (count == 32)
+			words[ii] = 0;
+		else
+		{
+			u32 mask = (((u32)1 << count) - 1) << first;
+
+			// Other bits of this word are still live, and may be changing
+			if (atomic)
+			{
+				volatile u32 *word = (volatile u32 *)&words[ii];
+				u32 old;
+				do old = *word;
+				while (!Atomic::CAS(word, old, old & ~mask));
+			}
+			else
+				words[ii] &= ~mask;
+		}
+
+		begin += count;
+	}
+}
+
+
+//// WindowBitset
+
+WindowBitset::WindowBitset()
+{
+	_words = 0;
+	_base = 0;
+	_bits = 0;
+}
+
+bool WindowBitset::Initialize(u32 size, u32 base)
+{
+	if (size < 32)
+		size = 32;
+	else if (size & (size - 1))
+		size = NextHighestPow2(size);
+
+	if (!_storage.resizeZero(size >> 5))
+		return false;
+
+	_words = _storage.get();
+	_bits = size;
+	_base = base;
+	return true;
+}
+
+u32 WindowBitset::Scan(u32 from, u32 flip)
+{
+	const u32 base = _base;
+	const u32 end = base + _bits;
+
+	// Start at the base if from is before the window
+	u32 offset = from - base;
+	if (offset >= _bits)
+	{
+		if ((s32)offset >= 0)
+			return end;
+
+		from = base;
+		offset = 0;
+	}
+
+	// The window is one or two runs of the ring
+	while (offset < _bits)
+	{
+		u32 begin = (base + offset) & (_bits - 1);
+		u32 run = _bits - begin;
+		if (run > _bits - offset)
+			run = _bits - offset;
+
+		u32 found = ScanWords(_words, begin, begin + run, flip);
+		if (found < begin + run)
+			return base + offset + (found - begin);
+
+		offset += run;
+	}
+
+	return end;
+}
+
+void WindowBitset::ClearBefore(u32 new_base, bool atomic)
+{
+	u32 distance = new_base - _base;
+
+	// If the whole window is dropped,
+	if (distance >= _bits)
+	{
+		ClearWords(_words, 0, _bits, atomic);
+		return;
+	}
+
+	u32 begin = _base & (_bits - 1);
+	u32 end = begin + distance;
+
+	if (end <= _bits)
+		ClearWords(_words, begin, end, atomic);
+	else
+	{
+		ClearWords(_words, begin, _bits, atomic);
+		ClearWords(_words, 0, end - _bits, atomic);
+	}
+}
+
+void WindowBitset::Advance(u32 new_base)
+{
+	// If new_base is behind the window or is the same,
+	if ((s32)(new_base - _base) <= 0)
+		return;
+
+	ClearBefore(new_base, false);
+
+	_base = new_base;
+}
+
+void WindowBitset::Reset(u32 base)
+{
+	ClearWords(_words, 0, _bits, false);
+
+	_base = base;
+}
+
+u32 WindowBitset::Count()
+{
+	u32 count = 0;
+
+	for (u32 ii = 0, words = _bits >> 5; ii < words; ++ii)
+		count += BitCount(_words[ii]);
+
+	return count;
+}
+
+
+//// ConcurrentWindowBitset
+
+void ConcurrentWindowBitset::Advance(u32 new_base)
+{
+	// If new_base is behind the window or is the same,
+	if ((s32)(new_base - _base) <= 0)
+		return;
+
+	ClearBefore(new_base, true);
+
+	// Publish the new base only after the dropped bits are clear
+	Atomic::StoreMemoryBarrier();
+	_base = new_base;
+}
@@ -0,0 +1,197 @@
+/*
+	Copyright (c) 2014 Christopher A. Taylor.  All rights reserved.
+
+	Redistribution and use in source and binary forms, with or without
+	modification, are permitted provided that the following conditions are met:
+
+	* Redistributions of source code must retain the above copyright notice,
+	  this list of conditions and the following disclaimer.
+	* Redistributions in binary form must reproduce the above copyright notice,
+	  this list of conditions and the following disclaimer in the documentation
+	  and/or other materials provided with the distribution.
+	* Neither the name of LibCat nor the names of its contributors may be used
+	  to endorse or promote products derived from this software without
+	  specific prior written permission.
+
+	THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+	AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+	IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+	ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+	LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+	CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+	SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+	INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+	CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+	ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+	POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CAT_WINDOW_BITSET_HPP
+#define CAT_WINDOW_BITSET_HPP
+
+#include "SmartArray.hpp"
+#include "Atomic.hpp"
+
+namespace cat {
+
+
+/*
+	Sliding-window bitset
+
+	Tracks which sequence numbers in [base, base + size) have been seen,
+	such as packets in a reliable receive window.  The window is a ring of
+	32-bit words, so sliding it forward only clears the words that leave.
+	Sequence numbers are u32 and may roll over.
+
+	FindFirstClear() finds the next hole for loss detection and
+	GetRunLength() measures received runs for ACK ranges.  These scan many
+	words at a time (16 with AVX2) instead of testing each bit, so a
+	scan over a 64k-packet window is a few hundred vector tests at most.
+
+	ConcurrentWindowBitset below lets several receive threads mark packets
+	at once.
+*/
+
+class CAT_EXPORT WindowBitset
+{
+	CAT_NO_COPY(WindowBitset);
+
+protected:
+	SmartArray<u32> _storage;
+	u32 *_words;
+	volatile u32 _base;
+	u32 _bits;
+
+	// Returns the first sequence number at or after from whose bit differs
+	// from the flip pattern, or GetEnd() if there is none
+	u32 Scan(u32 from, u32 flip);
+
+	// Clear the bits of sequence numbers before new_base
+	void ClearBefore(u32 new_base, bool atomic);
+
+public:
+	WindowBitset();
+
+	// Size is rounded up to a power of two, at least 32
+	// Returns false if out of memory
+	bool Initialize(u32 size, u32 base = 0);
+
+	CAT_INLINE u32 GetBase() { return _base; }
+	CAT_INLINE u32 GetSize() { return _bits; }
+	CAT_INLINE u32 GetEnd() { return _base + _bits; }
+
+	CAT_INLINE bool InWindow(u32 seq) { return (u32)(seq - _base) < _bits; }
+
+	// Returns true if the sequence number is in the window and was not set
+	CAT_INLINE bool Set(u32 seq)
+	{
+		if (!InWindow(seq)) return false;
+
+		u32 bit = seq & (_bits - 1);
+		u32 mask = (u32)1 << (bit & 31);
+		u32 &word = _words[bit >> 5];
+
+		if (word & mask) return false;
+		word |= mask;
+		return true;
+	}
+
+	// Returns true if the sequence number is in the window and was set
+	CAT_INLINE bool Clear(u32 seq)
+	{
+		if (!InWindow(seq)) return false;
+
+		u32 bit = seq & (_bits - 1);
+		u32 mask = (u32)1 << (bit & 31);
+		u32 &word = _words[bit >> 5];
+
+		if (!(word & mask)) return false;
+		word &= ~mask;
+		return true;
+	}
+
+	// Returns false for sequence numbers outside the window
+	CAT_INLINE bool Test(u32 seq)
+	{
+		if (!InWindow(seq)) return false;
+
+		u32 bit = seq & (_bits - 1);
+		return (_words[bit >> 5] >> (bit & 31)) & 1;
+	}
+
+	// Slide the window forward so it starts at new_base, clearing the bits
+	// that wrap around.  Ignored if new_base is behind the current base
+	void Advance(u32 new_base);
+
+	// Clear every bit
+	void Reset(u32 base);
+
+	// Returns the first unset sequence number at or after from, or GetEnd()
+	CAT_INLINE u32 FindFirstClear(u32 from) { return Scan(from, ~(u32)0); }
+
+	// Returns the first set sequence number at or after from, or GetEnd()
+	CAT_INLINE u32 FindFirstSet(u32 from) { return Scan(from, 0); }
+
+	// Returns the number of consecutive set bits starting at from
+	CAT_INLINE u32 GetRunLength(u32 from) { return FindFirstClear(from) - from; }
+
+	// Returns the number of consecutive unset bits starting at from
+	CAT_INLINE u32 GetHoleLength(u32 from) { return FindFirstSet(from) - from; }
+
+	// Returns the number of set bits in the window
+	u32 Count();
+};
+
+
+/*
+	Concurrent sliding-window bitset
+
+	Set(), Clear() and Test() may be called from any thread, and use atomic
+	bit operations so marks on the same word are not lost.  Advance(),
+	Reset() and the scans must come from one thread at a time.  Scans see
+	a snapshot that may miss marks made while they run.
+
+	Advance() clears the bits it drops before it publishes the new base, so
+	a sequence number is never accepted into a word that is still being
+	cleared.  It must not move past sequence numbers that other threads may
+	still be setting.
+*/
+
+class CAT_EXPORT ConcurrentWindowBitset : public WindowBitset
+{
+public:
+	// Returns true if the sequence number is in the window and was not set
+	CAT_INLINE bool Set(u32 seq)
+	{
+		if (!InWindow(seq)) return false;
+
+		u32 bit = seq & (_bits - 1);
+		return !Atomic::BTS((volatile u32 *)&_words[bit >> 5], bit & 31);
+	}
+
+	// Returns true if the sequence number is in the window and was set
+	CAT_INLINE bool Clear(u32 seq)
+	{
+		if (!InWindow(seq)) return false;
+
+		u32 bit = seq & (_bits - 1);
+		return Atomic::BTR((volatile u32 *)&_words[bit >> 5], bit & 31);
+	}
+
+	// Returns false for sequence numbers outside the window
+	CAT_INLINE bool Test(u32 seq)
+	{
+		if (!InWindow(seq)) return false;
+
+		u32 bit = seq & (_bits - 1);
+		return (((volatile u32 *)_words)[bit >> 5] >> (bit & 31)) & 1;
+	}
+
+	// Slide the window forward, see WindowBitset::Advance()
+	void Advance(u32 new_base);
+};
+
+
+} // namespace cat
+
+#endif // CAT_WINDOW_BITSET_HPP